@@ -31,7 +31,9 @@ function getFiles(compsBase32) {
 			} else {
 				console.log('   ' + i);
 			}
-		} else {
+		} else if (!deps[i].deferred) {
+			// Deferred components are built into a separate file that
+			// the page loads asynchronously after the first tiles.
 			addFiles(deps[i].src);
 		}
 	}
@@ -59,6 +61,40 @@ function getAdminFiles() {
 	return files;
 }
 
+/// The sources of the deferred components, minus anything (e.g.
+/// Control.js) that the main build carries already.
+function getDeferredFiles() {
+	var core = {},
+	    memo = {},
+	    i, j;
+
+	for (i in deps) {
+		if (!deps[i].deferred) {
+			for (j = 0; j < deps[i].src.length; j++) {
+				core[deps[i].src[j]] = true;
+			}
+		}
+	}
+
+	for (i in deps) {
+		if (deps[i].deferred) {
+			for (j = 0; j < deps[i].src.length; j++) {
+				if (!core[deps[i].src[j]]) {
+					memo[deps[i].src[j]] = true;
+				}
+			}
+		}
+	}
+
+	var files = [];
+
+	for (var src in memo) {
+		files.push('src/' + src);
+	}
+
+	return files;
+}
+
 exports.getFiles = getFiles;
 
 function getSizeDelta(newContent, oldContent, fixCRLF) {
@@ -150,6 +186,40 @@ exports.build = function (callback, version, compsBase32, buildName) {
 		console.log('\tSaved to ' + srcPath);
 	}
 
+	// The deferred components go into their own file, loaded by the
+	// page asynchronously once the first tiles are on screen, so
+	// their parse cost stays off the time-to-first-tile path. They
+	// run against the already-exposed window.L.
+	var deferredFiles = getDeferredFiles(),
+	    deferredIntro = '(function (window, document, undefined) {\nvar L = window.L;\n',
+	    newDeferredSrc = copy + deferredIntro + combineFiles(deferredFiles) + outro,
+	    deferredSrcPath = 'dist/leaflet-deferred-src.js',
+	    oldDeferredSrc = loadSilently(deferredSrcPath);
+
+	console.log('Concatenating and compressing ' + deferredFiles.length + ' deferred files...');
+	console.log('\tUncompressed: ' + bytesToKB(newDeferredSrc.length) +
+	            getSizeDelta(newDeferredSrc, oldDeferredSrc, true));
+
+	if (newDeferredSrc !== oldDeferredSrc) {
+		fs.writeFileSync(deferredSrcPath, newDeferredSrc);
+		console.log('\tSaved to ' + deferredSrcPath);
+	}
+
+	var deferredPath = 'dist/leaflet-deferred.js',
+	    oldDeferred = loadSilently(deferredPath),
+	    newDeferred = copy + UglifyJS.minify(newDeferredSrc, {
+	        warnings: true,
+	        fromString: true
+	    }).code;
+
+	console.log('\tCompressed: ' + bytesToKB(newDeferred.length) +
+	            getSizeDelta(newDeferred, oldDeferred));
+
+	if (newDeferred !== oldDeferred) {
+		fs.writeFileSync(deferredPath, newDeferred);
+		console.log('\tSaved to ' + deferredPath);
+	}
+
 	// Also combine and copy the admin JS files
 	// TODO: Also minify if admin complexity increases in future
 	var adminNewSrc = combineFiles(getAdminFiles()),
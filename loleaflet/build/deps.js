@@ -290,6 +290,7 @@ var deps = {
 	},
 
 	ControlDocumentRepair: {
+		deferred: true,
 		src: ['control/Control.js',
 		      'control/Control.DocumentRepair.js'],
 		heading: 'Controls',
@@ -297,6 +298,7 @@ var deps = {
 	},
 
 	ControlContextmenu: {
+		deferred: true,
 		src: ['control/Control.js',
 		      'control/Control.ContextMenu.js'],
 		heading: 'Controls',
@@ -304,6 +306,7 @@ var deps = {
 	},
 
 	ControlMenubar: {
+		deferred: true,
 		src: ['control/Control.js',
 		      'control/Control.Menubar.js'],
 		heading: 'Controls',
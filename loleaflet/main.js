@@ -107,7 +107,40 @@ map.addControl(L.control.partsPreview());
 map.addControl(L.control.tabs());
 map.addControl(L.control.columnHeader());
 map.addControl(L.control.rowHeader());
-map.addControl(L.control.contextMenu());
-map.addControl(L.control.menubar());
+
+// The menubar and the context menu are not needed to paint the document;
+// they are built into leaflet-deferred.js and loaded asynchronously once
+// the first tiles are on screen, keeping their parse and setup cost off
+// the time-to-first-tile path.
+var deferredControlsLoaded = false;
+function loadDeferredControls() {
+    if (deferredControlsLoaded) {
+        return;
+    }
+    deferredControlsLoaded = true;
+
+    var bundleScript = document.querySelector('script[src*="bundle.js"]');
+    var script = document.createElement('script');
+    script.src = bundleScript.src.replace(/bundle\.js.*$/, 'leaflet-deferred.js');
+    script.onload = function () {
+        map.addControl(L.control.contextMenu());
+        var menubar = L.control.menubar();
+        map.addControl(menubar);
+        if (map._docLayer) {
+            // doclayerinit fired before the menubar existed.
+            menubar._onDocLayerInit();
+        }
+    };
+    document.head.appendChild(script);
+}
+
+map.on('statusindicator', function (e) {
+    if (e.statusType === 'alltilesloaded') {
+        loadDeferredControls();
+    }
+});
+
+// Don't wait forever if the tiles stall (e.g. a load error).
+setTimeout(loadDeferredControls, 4000);
 
 //require('./dist/toolbar/toolbar');
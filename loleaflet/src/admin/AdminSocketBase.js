@@ -19,7 +19,7 @@ var AdminSocketBase = Base.extend({
 			this.socket = new WebSocket(host);
 			this.socket.onopen = this.onSocketOpen.bind(this);
 			this.socket.onclose = this.onSocketClose.bind(this);
-			this.socket.onmessage = this.onSocketMessage.bind(this);
+			this.socket.onmessage = this._onSocketMessage.bind(this);
 			this.socket.onerror = this.onSocketError.bind(this);
 			this.socket.binaryType = 'arraybuffer';
 		}
@@ -30,6 +30,20 @@ var AdminSocketBase = Base.extend({
 		this.socket.send('auth ' + Util.getCookie('jwt'));
 	},
 
+	_onSocketMessage: function(e) {
+		// The server batches model updates into one frame per tick;
+		// unwrap the batch so child classes keep seeing one message
+		// per update.
+		if (typeof e.data === 'string' && e.data.indexOf('batch\n') === 0) {
+			var messages = e.data.substring('batch\n'.length).split('\n');
+			for (var i = 0; i < messages.length; i++) {
+				this.onSocketMessage({data: messages[i]});
+			}
+			return;
+		}
+		this.onSocketMessage(e);
+	},
+
 	onSocketMessage: function() {
 		/* Implemented by child */
 	},
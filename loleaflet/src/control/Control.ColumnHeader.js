@@ -85,12 +85,6 @@ L.Control.ColumnHeader = L.Control.Header.extend({
 		this._map.sendUnoCommand('.uno:DeleteColumns');
 	},
 
-	clearColumns : function () {
-		while (this._columns.firstChild) {
-			this._columns.removeChild(this._columns.firstChild);
-		}
-	},
-
 	setViewPort: function(e) {
 		this._viewPort = e.columns.viewPort;
 		this._totalWidth = e.columns.totalWidth;
@@ -99,7 +93,7 @@ L.Control.ColumnHeader = L.Control.Header.extend({
 	setScrollPosition: function (e) {
 		var position = -e.x;
 		this._position = Math.min(0, position);
-		L.DomUtil.setStyle(this._columns, 'left', this._position + 'px');
+		L.DomUtil.setPosition(this._columns, new L.Point(this._position, 0));
 	},
 
 	offsetScrollPosition: function (e) {
@@ -107,7 +101,7 @@ L.Control.ColumnHeader = L.Control.Header.extend({
 		this._position = Math.min(0,
 					  Math.max(this._position - offset,
 						   -(this._totalWidth - this._viewPort)));
-		L.DomUtil.setStyle(this._columns, 'left', this._position + 'px');
+		L.DomUtil.setPosition(this._columns, new L.Point(this._position, 0));
 	},
 
 	viewRowColumnHeaders: function (e) {
@@ -117,34 +111,59 @@ L.Control.ColumnHeader = L.Control.Header.extend({
 	fillColumns: function (columns, converter, context) {
 		var iterator, twip, width, column, text, resize;
 
-		this.clearColumns();
+		// The header elements are pooled and recycled: the pool only
+		// grows to the largest viewport seen, and a scroll update is
+		// style and text changes on existing elements, not a DOM
+		// teardown and rebuild over the whole sheet.
+		while (this._columns.childNodes.length < columns.length) {
+			column = L.DomUtil.create('div', 'spreadsheet-header-column', this._columns);
+			L.DomUtil.create('div', 'spreadsheet-header-column-text', column);
+			L.DomUtil.create('div', 'spreadsheet-header-column-resize', column);
+		}
+
+		for (iterator = columns.length; iterator < this._columns.childNodes.length; iterator++) {
+			L.DomUtil.setStyle(this._columns.childNodes[iterator], 'display', 'none');
+		}
+
 		for (iterator = 0; iterator < columns.length; iterator++) {
 			width = columns[iterator].size - (iterator > 0 ? columns[iterator - 1].size : 0);
 			twip = new L.Point(width, width);
-			column = L.DomUtil.create('div', 'spreadsheet-header-column', this._columns);
-			text = L.DomUtil.create('div', 'spreadsheet-header-column-text', column);
-			resize = L.DomUtil.create('div', 'spreadsheet-header-column-resize', column);
+			column = this._columns.childNodes[iterator];
+			text = column.firstChild;
+			resize = column.lastChild;
 			var content = columns[iterator].text;
 			text.setAttribute('rel', 'spreadsheet-column-' + content); // for easy addressing
 			text.innerHTML = content;
 			width = Math.round(converter.call(context, twip).x) - 1;
 			if (width <= 0) {
 				L.DomUtil.setStyle(column, 'display', 'none');
-			} else if (width < 10) {
+				continue;
+			}
+
+			L.DomUtil.setStyle(column, 'display', '');
+			L.DomUtil.setStyle(column, 'width', width + 'px');
+			if (width < 10) {
 				text.column = iterator + 1;
 				text.width = width;
-				L.DomUtil.setStyle(column, 'width', width + 'px');
 				L.DomUtil.setStyle(column, 'cursor', 'col-resize');
+				L.DomUtil.setStyle(text, 'width', '');
 				L.DomUtil.setStyle(text, 'cursor', 'col-resize');
 				L.DomUtil.setStyle(resize, 'display', 'none');
+				// Adding the same listener again is a no-op, so a
+				// recycled element ends up with exactly one handler
+				// on whichever of text/resize is the drag handle.
 				this.mouseInit(text);
+				L.DomEvent.off(resize, 'mousedown', this._onMouseDown, this);
 			} else {
 				resize.column = iterator + 1;
 				resize.width = width;
-				L.DomUtil.setStyle(column, 'width', width + 'px');
+				L.DomUtil.setStyle(column, 'cursor', '');
 				L.DomUtil.setStyle(text, 'width', width - 3 + 'px');
+				L.DomUtil.setStyle(text, 'cursor', '');
+				L.DomUtil.setStyle(resize, 'display', '');
 				L.DomUtil.setStyle(resize, 'width', '3px');
 				this.mouseInit(resize);
+				L.DomEvent.off(text, 'mousedown', this._onMouseDown, this);
 			}
 			L.DomEvent.addListener(text, 'click', this._onColumnHeaderClick, this);
 		}
@@ -38,12 +38,15 @@ L.Control.PartsPreview = L.Control.extend({
 				setTimeout(L.bind(function () {
 					this._map.invalidateSize();
 					$('.scroll-container').mCustomScrollbar('update');
+					// The sidebar has its size now; load what it shows.
+					this._fetchVisiblePreviews();
 				}, this), 500);
 				for (var i = 0; i < parts; i++) {
-					this._previewTiles.push(this._createPreview(i, e.partNames[i]));
+					this._previewTiles.push(this._createPreview(i, e.partNames[i], /*lazy=*/true));
 				}
 				L.DomUtil.addClass(this._previewTiles[selectedPart], 'preview-img-selected');
 				this._previewInitialized = true;
+				this._fetchVisiblePreviews();
 			}
 			else
 			{
@@ -60,23 +63,58 @@ L.Control.PartsPreview = L.Control.extend({
 		}
 	},
 
-	_createPreview: function (i, hashCode) {
+	_createPreview: function (i, hashCode, lazy) {
 		var frame = L.DomUtil.create('div', 'preview-frame', this._partsPreviewCont);
 		L.DomUtil.create('span', 'preview-helper', frame);
 		var imgClassName = 'preview-img';
 		var img = L.DomUtil.create('img', imgClassName, frame);
 		img.hash = hashCode;
 		img.src = L.Icon.Default.imagePath + '/preview_placeholder.png';
+		img.fetched = false;
 		L.DomEvent
 			.on(img, 'click', L.DomEvent.stopPropagation)
 			.on(img, 'click', L.DomEvent.stop)
 			.on(img, 'click', this._setPart, this)
 			.on(img, 'click', this._refocusOnMap, this);
-		this._map.getPreview(i, i, 180, 180, {autoUpdate: this.options.autoUpdate});
+		if (!lazy) {
+			this._fetchPreview(i, img);
+		}
 
 		return img;
 	},
 
+	_fetchPreview: function (i, img) {
+		img.fetched = true;
+		this._map.getPreview(i, i, 180, 180, {autoUpdate: this.options.autoUpdate});
+	},
+
+	_fetchVisiblePreviews: function () {
+		// Request only the thumbnails in, or within one sidebar height
+		// of, the visible part of the sidebar. The rest are requested
+		// as they scroll in, so opening a large presentation does not
+		// flood the render queue with preview requests.
+		var contRect = this._partsPreviewCont.getBoundingClientRect();
+		for (var i = 0; i < this._previewTiles.length; i++) {
+			var img = this._previewTiles[i];
+			if (img.fetched) {
+				continue;
+			}
+			if (contRect.height === 0) {
+				// Not laid out yet; load a screenful's worth and let
+				// the layout settle before deciding on the rest.
+				if (i < 10) {
+					this._fetchPreview(i, img);
+				}
+				continue;
+			}
+			var rect = img.parentNode.getBoundingClientRect();
+			if (rect.bottom >= contRect.top - contRect.height &&
+			    rect.top <= contRect.bottom + contRect.height) {
+				this._fetchPreview(i, img);
+			}
+		}
+	},
+
 	_setPart: function (e) {
 		if (map._permission !== 'edit') {
 			return;
@@ -89,6 +127,9 @@ L.Control.PartsPreview = L.Control.extend({
 
 	_updatePart: function (e) {
 		if (e.docType === 'presentation') {
+			if (this._previewTiles[e.part]) {
+				this._previewTiles[e.part].fetched = true;
+			}
 			this._map.getPreview(e.part, e.part, 180, 180, {autoUpdate: this.options.autoUpdate});
 		}
 	},
@@ -134,8 +175,10 @@ L.Control.PartsPreview = L.Control.extend({
 				for (it = 0; it < e.partNames.length; it++) {
 					this._previewTiles[it].hash = e.partNames[it];
 					this._previewTiles[it].src = L.Icon.Default.imagePath + '/preview_placeholder.png';
-					this._map.getPreview(it, it, 180, 180, {autoUpdate: this.options.autoUpdate});
+					this._previewTiles[it].fetched = false;
 				}
+
+				this._fetchVisiblePreviews();
 			}
 		}
 		else {
@@ -152,13 +195,16 @@ L.Control.PartsPreview = L.Control.extend({
 		if (this._map.getDocType() === 'presentation') {
 			// the scrollbar has to be re-initialized here else it doesn't work
 			// probably a bug from the scrollbar
-			this._previewTiles[e.id].onload = function () {
+			this._previewTiles[e.id].onload = L.bind(function () {
 				$('.parts-preview').mCustomScrollbar({
 					axis: 'y',
 					theme: 'dark-thick',
 					scrollInertia: 0,
-					alwaysShowScrollbar: 1});
-			};
+					alwaysShowScrollbar: 1,
+					callbacks: {
+						whileScrolling: L.bind(this._fetchVisiblePreviews, this)
+					}});
+			}, this);
 
 			this._previewTiles[e.id].src = e.tile;
 		}
@@ -81,12 +81,6 @@ L.Control.RowHeader = L.Control.Header.extend({
 		this._map.sendUnoCommand('.uno:DeleteRows');
 	},
 
-	clearRows: function () {
-		while (this._rows.firstChild) {
-			this._rows.removeChild(this._rows.firstChild);
-		}
-	},
-
 	setViewPort: function(e) {
 		this._viewPort = e.rows.viewPort;
 		this._totalHeight = e.rows.totalHeight;
@@ -95,7 +89,7 @@ L.Control.RowHeader = L.Control.Header.extend({
 	setScrollPosition: function (e) {
 		var position = -e.y;
 		this._position = Math.min(0, position);
-		L.DomUtil.setStyle(this._rows, 'top', this._position + 'px');
+		L.DomUtil.setPosition(this._rows, new L.Point(0, this._position));
 	},
 
 	offsetScrollPosition: function (e) {
@@ -103,7 +97,7 @@ L.Control.RowHeader = L.Control.Header.extend({
 		this._position = Math.min(0,
 		Math.max(this._position - offset,
 			-(this._totalHeight - this._viewPort)));
-		L.DomUtil.setStyle(this._rows, 'top', this._position + 'px');
+		L.DomUtil.setPosition(this._rows, new L.Point(0, this._position));
 	},
 
 	viewRowColumnHeaders: function (e) {
@@ -113,36 +107,61 @@ L.Control.RowHeader = L.Control.Header.extend({
 	fillRows: function (rows, converter, context) {
 		var iterator, twip, height, row, text, resize;
 
-		this.clearRows();
+		// The header elements are pooled and recycled: the pool only
+		// grows to the largest viewport seen, and a scroll update is
+		// style and text changes on existing elements, not a DOM
+		// teardown and rebuild over the whole sheet.
+		while (this._rows.childNodes.length < rows.length) {
+			row = L.DomUtil.create('div', 'spreadsheet-header-row', this._rows);
+			L.DomUtil.create('div', 'spreadsheet-header-row-text', row);
+			L.DomUtil.create('div', 'spreadsheet-header-row-resize', row);
+		}
+
+		for (iterator = rows.length; iterator < this._rows.childNodes.length; iterator++) {
+			L.DomUtil.setStyle(this._rows.childNodes[iterator], 'display', 'none');
+		}
+
 		for (iterator = 0; iterator < rows.length; iterator++) {
 			height = rows[iterator].size - (iterator > 0 ? rows[iterator - 1].size : 0);
 			twip = new L.Point(height, height);
-			row = L.DomUtil.create('div', 'spreadsheet-header-row', this._rows);
-			text = L.DomUtil.create('div', 'spreadsheet-header-row-text', row);
-			resize = L.DomUtil.create('div', 'spreadsheet-header-row-resize', row);
+			row = this._rows.childNodes[iterator];
+			text = row.firstChild;
+			resize = row.lastChild;
 			var content = rows[iterator].text;
 			text.setAttribute('rel', 'spreadsheet-row-' + content); // for easy addressing
 			text.innerHTML = content;
 			height = Math.round(converter.call(context, twip).y) - 1;
 			if (height <= 0) {
 				L.DomUtil.setStyle(row, 'display', 'none');
-			} else if (height < 10) {
+				continue;
+			}
+
+			L.DomUtil.setStyle(row, 'display', '');
+			L.DomUtil.setStyle(row, 'height', height + 'px');
+			if (height < 10) {
 				text.row = iterator + 1;
 				text.height = height;
-				L.DomUtil.setStyle(row, 'height', height + 'px');
 				L.DomUtil.setStyle(row, 'cursor', 'row-resize');
 				L.DomUtil.setStyle(text, 'line-height', height + 'px');
+				L.DomUtil.setStyle(text, 'height', '');
 				L.DomUtil.setStyle(text, 'cursor', 'row-resize');
 				L.DomUtil.setStyle(resize, 'display', 'none');
+				// Adding the same listener again is a no-op, so a
+				// recycled element ends up with exactly one handler
+				// on whichever of text/resize is the drag handle.
 				this.mouseInit(text);
+				L.DomEvent.off(resize, 'mousedown', this._onMouseDown, this);
 			} else {
 				resize.row = iterator + 1;
 				resize.height = height;
-				L.DomUtil.setStyle(row, 'height', height + 'px');
+				L.DomUtil.setStyle(row, 'cursor', '');
 				L.DomUtil.setStyle(text, 'line-height', height - 3 + 'px');
 				L.DomUtil.setStyle(text, 'height', height - 3 + 'px');
+				L.DomUtil.setStyle(text, 'cursor', '');
+				L.DomUtil.setStyle(resize, 'display', '');
 				L.DomUtil.setStyle(resize, 'height', '3px');
 				this.mouseInit(resize);
+				L.DomEvent.off(text, 'mousedown', this._onMouseDown, this);
 			}
 			L.DomEvent.addListener(text, 'click', this._onRowHeaderClick, this);
 		}
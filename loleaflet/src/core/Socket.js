@@ -12,7 +12,14 @@ L.Socket = L.Class.extend({
 			if (map.options.permission) {
 				map.options.docParams['permission'] = map.options.permission;
 			}
-			this.socket = new WebSocket(map.options.server + '/lool/' + encodeURIComponent(map.options.doc + '?' + $.param(map.options.docParams)) + '/ws');
+			var docParams = map.options.docParams;
+			if (this._reconnectToken && map._docLayer) {
+				// Resuming after a dropped connection: present the
+				// token so the server restores the previous view
+				// without a fresh storage round-trip.
+				docParams = L.extend({reconnect_token: this._reconnectToken}, docParams);
+			}
+			this.socket = new WebSocket(map.options.server + '/lool/' + encodeURIComponent(map.options.doc + '?' + $.param(docParams)) + '/ws');
 			this.socket.onerror = L.bind(this._onSocketError, this);
 			this.socket.onclose = L.bind(this._onSocketClose, this);
 			this.socket.onopen = L.bind(this._onSocketOpen, this);
@@ -23,6 +30,11 @@ L.Socket = L.Class.extend({
 			return null;
 		}
 		this._msgQueue = [];
+		if (!this._inMsgQueue) {
+			this._inMsgQueue = [];
+			this._inMsgFlusher = null;
+			this._inMsgFlushTimeout = null;
+		}
 	},
 
 	close: function () {
@@ -117,6 +129,67 @@ L.Socket = L.Class.extend({
 	},
 
 	_onMessage: function (e) {
+		// Batch the messages of one animation frame and process them
+		// together: an invalidation storm then costs one relayout
+		// instead of one per message, and state messages overwritten
+		// within the batch are dropped before they touch the DOM.
+		this._inMsgQueue.push(e);
+		if (!this._inMsgFlusher) {
+			this._inMsgFlusher = L.Util.requestAnimFrame(this._flushMessages, this);
+			// requestAnimationFrame stalls in hidden tabs; make sure
+			// the queue still drains there.
+			this._inMsgFlushTimeout = setTimeout(L.bind(this._flushMessages, this), 100);
+		}
+	},
+
+	_flushMessages: function () {
+		L.Util.cancelAnimFrame(this._inMsgFlusher);
+		clearTimeout(this._inMsgFlushTimeout);
+		this._inMsgFlusher = null;
+		this._inMsgFlushTimeout = null;
+
+		var queue = this._inMsgQueue;
+		this._inMsgQueue = [];
+
+		// Walk backwards so of each collapsible kind only the last
+		// writer in the batch survives.
+		var process = [];
+		var seen = {};
+		for (var i = queue.length - 1; i >= 0; i--) {
+			var key = (typeof queue[i].data === 'string') ? this._collapseKey(queue[i].data) : null;
+			if (key) {
+				if (seen[key]) {
+					continue;
+				}
+				seen[key] = true;
+			}
+			process.push(queue[i]);
+		}
+
+		for (i = process.length - 1; i >= 0; i--) {
+			this._processMessage(process[i]);
+		}
+	},
+
+	// The key under which a message overwrites earlier ones of its
+	// kind within a batch, or null when every instance matters.
+	_collapseKey: function (textMsg) {
+		if (textMsg.startsWith('statechanged:')) {
+			// Keyed by the command, e.g. 'statechanged: .uno:Bold=true'.
+			var index = textMsg.indexOf('=');
+			return (index > 0 ? textMsg.substring(0, index) : textMsg);
+		}
+		var collapsible = ['invalidatecursor:', 'cursorvisible:', 'cellcursor:',
+			'textselection:', 'mousepointer:', 'setpart:', 'statusindicatorsetvalue:'];
+		for (var i = 0; i < collapsible.length; i++) {
+			if (textMsg.startsWith(collapsible[i])) {
+				return collapsible[i];
+			}
+		}
+		return null;
+	},
+
+	_processMessage: function (e) {
 		var imgBytes, index, textMsg;
 
 		if (typeof (e.data) === 'string') {
@@ -167,6 +240,29 @@ L.Socket = L.Class.extend({
 
 			return;
 		}
+		else if (textMsg.startsWith('reconnect:')) {
+			// Token with which this view can be resumed after a
+			// dropped connection. tilesvalid means nothing was
+			// invalidated while we were away, so the cached tiles
+			// can be kept on resume.
+			var reconnectToken = textMsg.match(/token=(\S+)/);
+			this._reconnectToken = reconnectToken ? reconnectToken[1] : null;
+			this._resumeTilesValid = / tilesvalid=1/.test(textMsg);
+			return;
+		}
+		else if (textMsg.startsWith('migrate:')) {
+			// The document is being handed over to another server.
+			// Reconnect there; the load on reconnect restores the view
+			// without a visible reload.
+			var migrateServer = textMsg.match(/server=(\S+)/);
+			if (migrateServer) {
+				this._map.options.server =
+					this._map.options.server.replace(/^(wss?:\/\/)[^/]+/, '$1' + migrateServer[1]);
+			}
+			this.close();
+			this.initialize(this._map);
+			return;
+		}
 		else if (textMsg.startsWith('error:') && command.errorCmd === 'internal') {
 			this._map._fatal = true;
 			if (command.errorKind === 'diskfull') {
@@ -253,7 +349,8 @@ L.Socket = L.Class.extend({
 			//FIXME: We should get statusindicator when saving too, no?
 			this._map.showBusy(_('Connecting...'), false);
 		}
-		else if (!textMsg.startsWith('tile:') && !textMsg.startsWith('renderfont:')) {
+		else if (!textMsg.startsWith('tile:') && !textMsg.startsWith('tiledelta:') &&
+			 !textMsg.startsWith('renderfont:')) {
 			// log the tile msg separately as we need the tile coordinates
 			L.Log.log(textMsg, L.INCOMING);
 			if (imgBytes !== undefined) {
@@ -330,7 +427,14 @@ L.Socket = L.Class.extend({
 			this._map.fire('doclayerinit');
 		} else if (textMsg.startsWith('status:')) {
 			// we are reconnecting ...
-			this._map._docLayer._onMessage('invalidatetiles: EMPTY', null);
+			if (this._resumeTilesValid) {
+				// The server vouched that nothing was invalidated
+				// while we were away; keep the cached tiles.
+				this._resumeTilesValid = false;
+			}
+			else {
+				this._map._docLayer._onMessage('invalidatetiles: EMPTY', null);
+			}
 			this._map.fire('statusindicator', {statusType: 'reconnected'});
 			this._map.setPermission(this._map.options.permission);
 		}
@@ -413,12 +517,16 @@ L.Socket = L.Class.extend({
 				// remove newline characters
 				command.id = tokens[i].substring(3).replace(/(\r\n|\n|\r)/gm, '');
 			}
+			else if (tokens[i].substring(0, 5) === 'hash=') {
+				// Kept as a string; too wide for a js number.
+				command.hash = tokens[i].substring(5).replace(/(\r\n|\n|\r)/gm, '');
+			}
 			else if (tokens[i].substring(0, 5) === 'type=') {
 				// remove newline characters
 				command.type = tokens[i].substring(5).replace(/(\r\n|\n|\r)/gm, '');
 			}
 			else if (tokens[i].substring(0, 9) === 'prefetch=') {
-				command.preFetch = tokens[i].substring(9);
+				command.preFetch = tokens[i].substring(9).replace(/(\r\n|\n|\r)/gm, '') === '1';
 			}
 			else if (tokens[i].substring(0, 4) === 'cmd=') {
 				command.errorCmd = tokens[i].substring(4);
@@ -456,6 +564,9 @@ L.Socket = L.Class.extend({
 			else if (tokens[i].substring(0, 12) === 'rendercount=') {
 				command.rendercount = parseInt(tokens[i].substring(12));
 			}
+			else if (tokens[i].substring(0, 7) === 'ystart=') {
+				command.ystart = parseInt(tokens[i].substring(7));
+			}
 		}
 		if (command.tileWidth && command.tileHeight && this._map._docLayer) {
 			var defaultZoom = this._map.options.zoom;
@@ -43,6 +43,7 @@ L.CalcTileLayer = L.TileLayer.extend({
 
 		var tilePositionsX = '';
 		var tilePositionsY = '';
+		var oldHashes = '';
 		var needsNewTiles = false;
 
 		for (var key in this._tiles) {
@@ -66,6 +67,12 @@ L.CalcTileLayer = L.TileLayer.extend({
 						tilePositionsY += ',';
 					}
 					tilePositionsY += tileTopLeft.y;
+					if (oldHashes !== '') {
+						oldHashes += ',';
+					}
+					// The server skips the payload when the re-render
+					// matches what we already have.
+					oldHashes += this._tiles[key]._hash || '0';
 					needsNewTiles = true;
 					if (this._debug) {
 						this._debugAddInvalidationData(this._tiles[key]);
@@ -88,7 +95,8 @@ L.CalcTileLayer = L.TileLayer.extend({
 				'tileposx=' + tilePositionsX + ' ' +
 				'tileposy=' + tilePositionsY + ' ' +
 				'tilewidth=' + this._tileWidthTwips + ' ' +
-				'tileheight=' + this._tileHeightTwips;
+				'tileheight=' + this._tileHeightTwips + ' ' +
+				'oldhash=' + oldHashes;
 
 			this._map._socket.sendMessage(message, '');
 			if (this._debug) {
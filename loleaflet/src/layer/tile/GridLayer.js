@@ -17,8 +17,13 @@ L.GridLayer = L.Layer.extend({
 		zIndex: null,
 		bounds: null,
 
-		minZoom: 0
+		minZoom: 0,
 		// maxZoom: <Number>
+
+		// Composite the tiles of a zoom level onto a single canvas
+		// instead of keeping one <img> element per tile in the DOM;
+		// the images stay around off-DOM as decoded-bitmap handles.
+		useCanvas: !!document.createElement('canvas').getContext
 	},
 
 	initialize: function (options) {
@@ -161,7 +166,7 @@ L.GridLayer = L.Layer.extend({
 		var opacity = this.options.opacity;
 
 		// IE doesn't inherit filter opacity properly, so we're forced to set it on tiles
-		if (!L.Browser.ielt9 && !this._map._fadeAnimated) {
+		if (this.options.useCanvas || (!L.Browser.ielt9 && !this._map._fadeAnimated)) {
 			L.DomUtil.setOpacity(this._container, opacity);
 			return;
 		}
@@ -208,7 +213,12 @@ L.GridLayer = L.Layer.extend({
 		    maxZoom = this.options.maxZoom;
 
 		for (var z in this._levels) {
-			if (this._levels[z].el.children.length || z === zoom) {
+			// with a canvas the level container always has one child;
+			// check the tiles we actually hold at that zoom instead
+			var inUse = this.options.useCanvas ?
+				(this._levelHasTiles(+z) || +z === zoom) :
+				(this._levels[z].el.children.length || z === zoom);
+			if (inUse) {
 				this._levels[z].el.style.zIndex = maxZoom - Math.abs(zoom - z);
 			} else {
 				L.DomUtil.remove(this._levels[z].el);
@@ -228,6 +238,10 @@ L.GridLayer = L.Layer.extend({
 			level.origin = map.project(map.unproject(map.getPixelOrigin()), zoom).round();
 			level.zoom = zoom;
 
+			if (this.options.useCanvas) {
+				this._initLevelCanvas(level);
+			}
+
 			this._setZoomTransform(level, map.getCenter(), map.getZoom());
 
 			// force the browser to consider the newly added element for transition
@@ -239,6 +253,76 @@ L.GridLayer = L.Layer.extend({
 		return level;
 	},
 
+	_levelHasTiles: function (zoom) {
+		for (var key in this._tiles) {
+			if (this._tiles[key].coords.z === zoom) {
+				return true;
+			}
+		}
+		return false;
+	},
+
+	_initLevelCanvas: function (level) {
+		// the tile classes keep the tile CSS and the mouse
+		// entering/leaving detection working on the canvas
+		level.canvas = L.DomUtil.create('canvas',
+			'leaflet-tile leaflet-tile-loaded leaflet-tile-canvas', level.el);
+		level.canvasCtx = level.canvas.getContext('2d');
+		level.canvasOrigin = null;
+		level.canvas.width = 0;
+		level.canvas.height = 0;
+	},
+
+	// Position and size the level's canvas to cover the given tile
+	// range; a change repaints it from the tiles we hold.
+	_updateCanvas: function (level, tileRange) {
+		if (!level || !level.canvas) {
+			return;
+		}
+		var tileSize = this._tileSize;
+		var origin = tileRange.min.multiplyBy(tileSize).subtract(level.origin);
+		var width = (tileRange.max.x - tileRange.min.x + 1) * tileSize;
+		var height = (tileRange.max.y - tileRange.min.y + 1) * tileSize;
+		if (level.canvasOrigin && level.canvasOrigin.equals(origin) &&
+				level.canvas.width === width && level.canvas.height === height) {
+			return;
+		}
+		level.canvasOrigin = origin;
+		// setting the size also clears the canvas
+		level.canvas.width = width;
+		level.canvas.height = height;
+		L.DomUtil.setPosition(level.canvas, origin, true);
+		for (var key in this._tiles) {
+			var tile = this._tiles[key];
+			if (tile.loaded && tile.coords.z === level.zoom) {
+				this._drawTile(tile);
+			}
+		}
+	},
+
+	// Blit one loaded tile onto its level's canvas.
+	_drawTile: function (tile) {
+		var level = this._levels[tile.coords.z];
+		if (!level || !level.canvas || !level.canvasOrigin ||
+				tile.coords.part !== this._selectedPart ||
+				!tile.el.complete || !tile.el.src) {
+			return;
+		}
+		var pos = tile.coords.multiplyBy(this._tileSize)
+			.subtract(level.origin).subtract(level.canvasOrigin);
+		level.canvasCtx.drawImage(tile.el, pos.x, pos.y, this._tileSize, this._tileSize);
+	},
+
+	_clearTile: function (tile) {
+		var level = this._levels[tile.coords.z];
+		if (!level || !level.canvas || !level.canvasOrigin) {
+			return;
+		}
+		var pos = tile.coords.multiplyBy(this._tileSize)
+			.subtract(level.origin).subtract(level.canvasOrigin);
+		level.canvasCtx.clearRect(pos.x, pos.y, this._tileSize, this._tileSize);
+	},
+
 	_pruneTiles: function () {
 		var key, tile;
 
@@ -500,6 +584,10 @@ L.GridLayer = L.Layer.extend({
 		    tileRange = this._pxBoundsToTileRange(pixelBounds),
 		    queue = [];
 
+		if (this.options.useCanvas) {
+			this._updateCanvas(this._level, tileRange);
+		}
+
 		for (var key in this._tiles) {
 			if (this._keyToTileCoords(key).z !== zoom ||
 					this._keyToTileCoords(key).part !== this._selectedPart) {
@@ -572,6 +660,10 @@ L.GridLayer = L.Layer.extend({
 		    tileRange = this._pxBoundsToTileRange(pixelBounds),
 		    queue = [];
 
+		if (this.options.useCanvas) {
+			this._updateCanvas(this._level, tileRange);
+		}
+
 		for (key in this._tiles) {
 			if (this._keyToTileCoords(key).z !== zoom ||
 					this._keyToTileCoords(key).part !== this._selectedPart) {
@@ -756,6 +848,9 @@ L.GridLayer = L.Layer.extend({
 		if (!tile.loaded && this._emptyTilesCount > 0) {
 			this._emptyTilesCount -= 1;
 		}
+		if (this.options.useCanvas) {
+			this._clearTile(tile);
+		}
 		L.DomUtil.remove(tile.el);
 		if (this._debug && this._debugInfo && this._tiles[key]._debugPopup) {
 			this._debugInfo.removeLayer(this._tiles[key]._debugPopup);
@@ -821,7 +916,11 @@ L.GridLayer = L.Layer.extend({
 					current: true
 				};
 
-				fragment.appendChild(tile);
+				if (!this.options.useCanvas) {
+					// composited tiles are blitted off the image when
+					// they load; the element never enters the DOM
+					fragment.appendChild(tile);
+				}
 
 				this.fire('tileloadstart', {
 					tile: tile,
@@ -974,7 +1073,12 @@ L.GridLayer = L.Layer.extend({
 		if (!tile) { return; }
 
 		tile.loaded = +new Date();
-		if (this._map._fadeAnimated) {
+		if (this.options.useCanvas) {
+			// composited tiles do not fade; blit and retire the rest
+			tile.active = true;
+			this._drawTile(tile);
+			this._pruneTiles();
+		} else if (this._map._fadeAnimated) {
 			L.DomUtil.setOpacity(tile.el, 0);
 			L.Util.cancelAnimFrame(this._fadeFrame);
 			this._fadeFrame = L.Util.requestAnimFrame(this._updateOpacity, this);
@@ -1096,13 +1200,24 @@ L.GridLayer = L.Layer.extend({
 			maxBorderWidth = 3;
 		}
 
+		var pixelBounds = this._map.getPixelBounds(center, zoom);
+
+		// Remember which way the view has been moving, so the tiles
+		// ahead of the scroll are fetched before the ones behind it.
+		var dx = 0;
+		var dy = 0;
+		if (this._preFetchPosition) {
+			dx = pixelBounds.min.x - this._preFetchPosition.x;
+			dy = pixelBounds.min.y - this._preFetchPosition.y;
+		}
+		this._preFetchPosition = pixelBounds.min;
+
 		if (!this._preFetchBorder) {
 			if (this._selectedPart !== this._preFetchPart) {
 				// all tiles from the new part have to be pre-fetched
 				var tileBorder = this._preFetchBorder = new L.Bounds(new L.Point(0, 0), new L.Point(0, 0));
 			}
 			else {
-				var pixelBounds = this._map.getPixelBounds(center, zoom);
 				tileBorder = this._pxBoundsToTileRange(pixelBounds);
 				this._preFetchBorder = tileBorder;
 			}
@@ -1122,29 +1237,29 @@ L.GridLayer = L.Layer.extend({
 				tilesToFetch > 0 && borderWidth < maxBorderWidth) {
 			// while the bounds do not fully contain the document
 
+			var below = [],
+			    above = [],
+			    rightSide = [],
+			    leftSide = [];
 			for (var i = tileBorder.min.x; i <= tileBorder.max.x; i++) {
-				// tiles below the visible area
-				var coords = new L.Point(i, tileBorder.max.y);
-				queue.push(coords);
-			}
-			for (i = tileBorder.min.x; i <= tileBorder.max.x; i++) {
-				// tiles above the visible area
-				coords = new L.Point(i, tileBorder.min.y);
-				queue.push(coords);
+				below.push(new L.Point(i, tileBorder.max.y));
+				above.push(new L.Point(i, tileBorder.min.y));
 			}
 			for (i = tileBorder.min.y; i <= tileBorder.max.y; i++) {
-				// tiles to the right of the visible area
-				coords = new L.Point(tileBorder.max.x, i);
-				queue.push(coords);
-			}
-			for (i = tileBorder.min.y; i <= tileBorder.max.y; i++) {
-				// tiles to the left of the visible area
-				coords = new L.Point(tileBorder.min.x, i);
-				queue.push(coords);
+				rightSide.push(new L.Point(tileBorder.max.x, i));
+				leftSide.push(new L.Point(tileBorder.min.x, i));
 			}
 
+			// the sides the view is heading towards come first, so the
+			// budget is spent where the view will be next; ties keep the
+			// old below-above-right-left order
+			queue = queue.concat(dy >= 0 ? below : above,
+					dy >= 0 ? above : below,
+					dx >= 0 ? rightSide : leftSide,
+					dx >= 0 ? leftSide : rightSide);
+
 			for (i = 0; i < queue.length && tilesToFetch > 0; i++) {
-				coords = queue[i];
+				var coords = queue[i];
 				coords.z = zoom;
 				coords.part = this._preFetchPart;
 				var key = this._tileCoordsToKey(coords);
@@ -1152,6 +1267,7 @@ L.GridLayer = L.Layer.extend({
 				if (!this._isValidTile(coords) ||
 						this._tiles[key] ||
 						this._tileCache[key] ||
+						this._preFetchRequested[key] ||
 						visitedTiles[key]) {
 					continue;
 				}
@@ -1181,9 +1297,38 @@ L.GridLayer = L.Layer.extend({
 		}
 
 		if (finalQueue.length > 0) {
-			var fragment = document.createDocumentFragment();
-			this._addTiles(finalQueue, fragment);
-			this._level.el.appendChild(fragment);
+			var tilePositionsX = '';
+			var tilePositionsY = '';
+			for (i = 0; i < finalQueue.length; i++) {
+				coords = finalQueue[i];
+				key = this._tileCoordsToKey(coords);
+				this._preFetchRequested[key] = true;
+
+				var twips = this._coordsToTwips(coords);
+				if (tilePositionsX !== '') {
+					tilePositionsX += ',';
+				}
+				tilePositionsX += twips.x;
+				if (tilePositionsY !== '') {
+					tilePositionsY += ',';
+				}
+				tilePositionsY += twips.y;
+			}
+
+			// prefetch=1 makes the server render and send these at
+			// preview priority; the responses land in _tileCache,
+			// ready for when the view reaches them
+			var message = 'tilecombine ' +
+				'part=' + this._preFetchPart + ' ' +
+				'width=' + this._tileSize + ' ' +
+				'height=' + this._tileSize + ' ' +
+				'tileposx=' + tilePositionsX + ' ' +
+				'tileposy=' + tilePositionsY + ' ' +
+				'tilewidth=' + this._tileWidthTwips + ' ' +
+				'tileheight=' + this._tileHeightTwips + ' ' +
+				'prefetch=1';
+
+			this._map._socket.sendMessage(message, '');
 		}
 	},
 
@@ -1196,6 +1341,7 @@ L.GridLayer = L.Layer.extend({
 		if (resetBorder) {
 			this._preFetchBorder = null;
 		}
+		this._preFetchRequested = {};
 		var interval = 750;
 		var idleTime = 5000;
 		this._preFetchPart = this._selectedPart;
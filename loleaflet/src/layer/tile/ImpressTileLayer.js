@@ -27,6 +27,7 @@ L.ImpressTileLayer = L.TileLayer.extend({
 
 		var tilePositionsX = '';
 		var tilePositionsY = '';
+		var oldHashes = '';
 		var needsNewTiles = false;
 
 		for (var key in this._tiles) {
@@ -50,6 +51,12 @@ L.ImpressTileLayer = L.TileLayer.extend({
 						tilePositionsY += ',';
 					}
 					tilePositionsY += tileTopLeft.y;
+					if (oldHashes !== '') {
+						oldHashes += ',';
+					}
+					// The server skips the payload when the re-render
+					// matches what we already have.
+					oldHashes += this._tiles[key]._hash || '0';
 					needsNewTiles = true;
 					if (this._debug) {
 						this._debugAddInvalidationData(this._tiles[key]);
@@ -72,7 +79,8 @@ L.ImpressTileLayer = L.TileLayer.extend({
 				'tileposx=' + tilePositionsX + ' ' +
 				'tileposy=' + tilePositionsY + ' ' +
 				'tilewidth=' + this._tileWidthTwips + ' ' +
-				'tileheight=' + this._tileHeightTwips;
+				'tileheight=' + this._tileHeightTwips + ' ' +
+				'oldhash=' + oldHashes;
 
 			this._map._socket.sendMessage(message, '');
 			if (this._debug) {
@@ -364,6 +364,9 @@ L.TileLayer = L.GridLayer.extend({
 		else if (textMsg.startsWith('tile:')) {
 			this._onTileMsg(textMsg, img);
 		}
+		else if (textMsg.startsWith('tiledelta:')) {
+			this._onTileDeltaMsg(textMsg, img);
+		}
 		else if (textMsg.startsWith('unocommandresult:')) {
 			this._onUnoCommandResultMsg(textMsg);
 		}
@@ -1110,14 +1113,66 @@ L.TileLayer = L.GridLayer.extend({
 					this._map.fire('statusindicator', {statusType: 'alltilesloaded'});
 				}
 			}
+			// Remember the content hash, so re-requests after an
+			// invalidation can tell the server what we have.
+			tile._hash = command.hash;
 			tile.el.src = img;
 		}
-		else if (command.preFetch === 'true') {
+		else if (command.preFetch) {
 			this._tileCache[key] = img;
 		}
 		L.Log.log(textMsg, L.INCOMING, key);
 	},
 
+	_onTileDeltaMsg: function (textMsg, img) {
+		var command = this._map._socket.parseServerCmd(textMsg);
+		var coords = this._twipsToCoords(command);
+		coords.z = command.zoom;
+		coords.part = command.part;
+		var key = this._tileCoordsToKey(coords);
+		var tile = this._tiles[key];
+		if (!tile || !tile.loaded) {
+			// We have nothing to apply the delta onto; request the full
+			// tile, which the server has just cached.
+			var twips = this._coordsToTwips(coords);
+			this._map._socket.sendMessage('tile ' +
+				'part=' + coords.part + ' ' +
+				'width=' + this._tileSize + ' ' +
+				'height=' + this._tileSize + ' ' +
+				'tileposx=' + twips.x + ' '	+
+				'tileposy=' + twips.y + ' ' +
+				'tilewidth=' + this._tileWidthTwips + ' ' +
+				'tileheight=' + this._tileHeightTwips, key);
+			L.Log.log(textMsg, L.INCOMING, key);
+			return;
+		}
+
+		if (tile._invalidCount > 0) {
+			tile._invalidCount -= 1;
+		}
+
+		if (command.hash !== undefined) {
+			tile._hash = command.hash;
+		}
+
+		// An empty delta confirms the tile is unchanged.
+		if (img !== 'data:image/png;base64,') {
+			var ystart = command.ystart || 0;
+			var delta = new Image();
+			delta.onload = function () {
+				var canvas = document.createElement('canvas');
+				canvas.width = command.width;
+				canvas.height = command.height;
+				var context = canvas.getContext('2d');
+				context.drawImage(tile.el, 0, 0);
+				context.drawImage(delta, 0, ystart);
+				tile.el.src = canvas.toDataURL('image/png');
+			};
+			delta.src = img;
+		}
+		L.Log.log(textMsg, L.INCOMING, key);
+	},
+
 	_tileOnLoad: function (done, tile) {
 		done(null, tile);
 	},
@@ -727,6 +727,7 @@ L.Map = L.Evented.extend({
 
 		L.DomEvent[onOff](window, 'blur', this._onLostFocus, this);
 		L.DomEvent[onOff](window, 'focus', this._onGotFocus, this);
+		L.DomEvent[onOff](document, 'visibilitychange', this._onVisibilityChange, this);
 	},
 
 	_onResize: function () {
@@ -849,6 +850,25 @@ L.Map = L.Evented.extend({
 		this._activate();
 	},
 
+	_onVisibilityChange: function () {
+		if (!this._loaded) { return; }
+
+		if (document.hidden) {
+			// A backgrounded tab cannot show updates; tell the server
+			// right away to stop rendering for us, instead of waiting
+			// for the inactivity dim timer. No overlay either - the
+			// tab is not visible, and we reactivate the moment it is.
+			if (this._active && this._socket.connected()) {
+				this._active = false;
+				this._docLayer && this._docLayer._onMessage('textselection:', null);
+				this._socket.sendMessage('userinactive');
+			}
+		}
+		else {
+			this._activate();
+		}
+	},
+
 	_onUpdateProgress: function (e) {
 		if (e.statusType === 'start') {
 			if (this._socket.readyState === 1) {
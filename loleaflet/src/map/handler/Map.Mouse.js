@@ -12,6 +12,8 @@ L.Map.Mouse = L.Handler.extend({
 		this._map = map;
 		this._mouseEventsQueue = [];
 		this._prevMousePos = null;
+		this._pendingDragMove = null;
+		this._dragMoveTimeout = null;
 	},
 
 	addHooks: function () {
@@ -112,6 +114,7 @@ L.Map.Mouse = L.Handler.extend({
 		}
 		else if (e.type === 'mouseup') {
 			this._mouseDown = false;
+			this._flushDragMove();
 			if (this._map.dragging.enabled()) {
 				if (this._mouseEventsQueue.length === 0) {
 					// mouse up after panning
@@ -180,7 +183,13 @@ L.Map.Mouse = L.Handler.extend({
 			}
 			if (!this._map.dragging.enabled()) {
 				mousePos = docLayer._latLngToTwips(e.latlng);
-				docLayer._postMouseEvent('move', mousePos.x, mousePos.y, 1, buttons, modifier);
+				// Coalesce the move events of a selection drag to one
+				// per interval; only the latest position matters, and
+				// mouse-up flushes the pending one first.
+				this._pendingDragMove = {x: mousePos.x, y: mousePos.y, buttons: buttons, modifier: modifier};
+				if (!this._dragMoveTimeout) {
+					this._dragMoveTimeout = setTimeout(L.bind(this._flushDragMove, this), 40);
+				}
 
 				for (key in docLayer._selectionHandles) {
 					handle = docLayer._selectionHandles[key];
@@ -220,6 +229,16 @@ L.Map.Mouse = L.Handler.extend({
 		}
 	},
 
+	_flushDragMove: function () {
+		clearTimeout(this._dragMoveTimeout);
+		this._dragMoveTimeout = null;
+		if (this._pendingDragMove) {
+			var move = this._pendingDragMove;
+			this._pendingDragMove = null;
+			this._map._docLayer._postMouseEvent('move', move.x, move.y, 1, move.buttons, move.modifier);
+		}
+	},
+
 	_executeMouseEvents: function () {
 		this._holdMouseEvent = null;
 		for (var i = 0; i < this._mouseEventsQueue.length; i++) {
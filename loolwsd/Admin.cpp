@@ -9,6 +9,7 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <cassert>
 #include <mutex>
 #include <sys/poll.h>
@@ -92,7 +93,9 @@ bool AdminRequestHandler::adminCommandHandler(const std::vector<char>& payload)
              tokens[0] == "active_users_count" ||
              tokens[0] == "active_docs_count" ||
              tokens[0] == "mem_stats" ||
-             tokens[0] == "cpu_stats" )
+             tokens[0] == "cpu_stats" ||
+             tokens[0] == "histogram" ||
+             tokens[0] == "doc_stats" )
     {
         const std::string result = model.query(tokens[0]);
         if (!result.empty())
@@ -114,11 +117,22 @@ bool AdminRequestHandler::adminCommandHandler(const std::vector<char>& payload)
             model.unsubscribe(_sessionId, tokens[i + 1]);
         }
     }
+    else if (tokens[0] == "reset_histograms")
+    {
+        model.resetHistograms();
+        sendTextFrame("histogram reset");
+    }
     else if (tokens[0] == "total_mem")
     {
         const auto totalMem = _admin->getTotalMemoryUsage(model);
         sendTextFrame("total_mem " + std::to_string(totalMem));
     }
+    else if (tokens[0] == "tilecache_stats")
+    {
+        sendTextFrame("tilecache_stats size=" + std::to_string(TileCache::getTotalCacheSize()) +
+                      " evicted=" + std::to_string(TileCache::getEvictedTileCount()) +
+                      " evicted_bytes=" + std::to_string(TileCache::getEvictedBytes()));
+    }
     else if (tokens[0] == "kill" && tokens.count() == 2)
     {
         try
@@ -135,6 +149,23 @@ bool AdminRequestHandler::adminCommandHandler(const std::vector<char>& payload)
             return false;
         }
     }
+    else if (tokens[0] == "migrate" && tokens.count() == 3)
+    {
+        try
+        {
+            const auto pid = std::stoi(tokens[1]);
+            const auto docKey = model.getDocKeyForPid(pid);
+            if (docKey.empty() || !LOOLWSD::migrateDocument(docKey, tokens[2]))
+            {
+                sendTextFrame("error: cmd=migrate kind=failed");
+            }
+        }
+        catch(std::invalid_argument& exc)
+        {
+            Log::warn() << "Invalid PID to migrate: " << tokens[1] << Log::end;
+            return false;
+        }
+    }
     else if (tokens[0] == "settings")
     {
         // for now, we have only these settings
@@ -259,6 +290,32 @@ void AdminRequestHandler::handleRequest(HTTPServerRequest& request, HTTPServerRe
         {
             handleWSRequests(request, response, sessionId);
         }
+        else if (request.getMethod() == Poco::Net::HTTPRequest::HTTP_GET &&
+                 pathTokens.count() > 0 && pathTokens[pathTokens.count() - 1] == "metrics")
+        {
+            // Pull-based metrics: one snapshot per request, instead
+            // of pushing every tick to every admin websocket.
+            if (!FileServerRequestHandler::isAdminLoggedIn(request, response))
+                throw Poco::Net::NotAuthenticatedException("Invalid admin login");
+
+            std::ostringstream oss;
+            {
+                std::unique_lock<std::mutex> modelLock(_admin->getLock());
+                AdminModel& model = _admin->getModel();
+                oss << "total_mem_kb " << _admin->getTotalMemoryUsage(model) << "\n"
+                    << model.getMetrics();
+            }
+
+            oss << "tilecache_size " << TileCache::getTotalCacheSize() << "\n"
+                << "tilecache_evicted " << TileCache::getEvictedTileCount() << "\n"
+                << "tilecache_evicted_bytes " << TileCache::getEvictedBytes() << "\n";
+
+            const std::string content = oss.str();
+            response.setStatusAndReason(HTTPResponse::HTTP_OK);
+            response.setContentType("text/plain");
+            response.setContentLength(content.size());
+            response.sendBuffer(content.data(), content.size());
+        }
     }
     catch(const Poco::Net::NotAuthenticatedException& exc)
     {
@@ -287,19 +344,19 @@ Admin::Admin() :
 {
     Log::info("Admin ctor.");
 
-    _memStatsTask = new MemoryStats(this);
-    _memStatsTimer.schedule(_memStatsTask, _memStatsTaskInterval, _memStatsTaskInterval);
+    scheduleStatsCollection(std::min(_memStatsTaskInterval, _cpuStatsTaskInterval));
 
-    _cpuStatsTask = new CpuStats(this);
-    _cpuStatsTimer.schedule(_cpuStatsTask, _cpuStatsTaskInterval, _cpuStatsTaskInterval);
+    _notifyTaskInterval = Application::instance().config().getUInt("admin_console.notify_interval_ms", 1000);
+    _notifyFlushTask = new NotifyFlush(this);
+    _notifyTimer.schedule(_notifyFlushTask, _notifyTaskInterval, _notifyTaskInterval);
 }
 
 Admin::~Admin()
 {
     Log::info("~Admin dtor.");
 
-    _memStatsTask->cancel();
-    _cpuStatsTask->cancel();
+    _statsTask->cancel();
+    _notifyFlushTask->cancel();
 }
 
 void Admin::addDoc(const std::string& docKey, Poco::Process::PID pid, const std::string& filename, const std::string& sessionId)
@@ -308,6 +365,14 @@ void Admin::addDoc(const std::string& docKey, Poco::Process::PID pid, const std:
     _model.addDocument(docKey, pid, filename, sessionId);
 }
 
+void Admin::updateDocumentStats(const std::string& docKey, const unsigned tiles,
+                                const unsigned long bytes, const unsigned long renderMs,
+                                const unsigned messages)
+{
+    std::unique_lock<std::mutex> modelLock(_modelMutex);
+    _model.updateDocumentStats(docKey, tiles, bytes, renderMs, messages);
+}
+
 void Admin::rmDoc(const std::string& docKey, const std::string& sessionId)
 {
     std::unique_lock<std::mutex> modelLock(_modelMutex);
@@ -320,51 +385,80 @@ void Admin::rmDoc(const std::string& docKey)
     _model.removeDocument(docKey);
 }
 
-void MemoryStats::run()
+void StatsCollect::run()
 {
-    std::unique_lock<std::mutex> modelLock(_admin->getLock());
-    AdminModel& model = _admin->getModel();
-    const auto totalMem = _admin->getTotalMemoryUsage(model);
+    _admin->collectStats();
+}
 
-    if (totalMem != _lastTotalMemory)
+void Admin::collectStats()
+{
+    unsigned interval;
     {
-        Log::trace("Total memory used: " + std::to_string(totalMem));
+        std::unique_lock<std::mutex> modelLock(_modelMutex);
+        const auto totalMem = getTotalMemoryUsage(_model);
+
+        if (totalMem != _lastTotalMemory)
+        {
+            Log::trace("Total memory used: " + std::to_string(totalMem));
+        }
+
+        _lastTotalMemory = totalMem;
+        _model.addMemStats(totalMem);
+        //TODO: feed _model.addCpuStats() from the same pass.
+        _model.tickMetrics();
+
+        // Sampling every few seconds is only worth the /proc walk
+        // while an admin console is watching, or while memory is close
+        // enough to the limit that we may need to act on the numbers.
+        // Otherwise stretch the interval; a host running hundreds of
+        // idle kits should not pay a constant monitoring tax.
+        const unsigned idleMultiplier = 12;
+        const unsigned maxIntervalMs = 60 * 1000;
+        interval = std::min(_memStatsTaskInterval, _cpuStatsTaskInterval);
+        const auto systemMemKb = Util::getTotalSystemMemoryKb();
+        const bool busy = _model.hasSubscribers() ||
+                          (systemMemKb > 0 && totalMem > (systemMemKb * 8) / 10);
+        if (!busy)
+        {
+            interval = std::min(interval * idleMultiplier, maxIntervalMs);
+        }
     }
 
-    _lastTotalMemory = totalMem;
-    model.addMemStats(totalMem);
+    scheduleStatsCollection(interval);
 }
 
-void CpuStats::run()
+void Admin::scheduleStatsCollection(unsigned intervalMs)
 {
-    //TODO: Implement me
-    //std::unique_lock<std::mutex> modelLock(_admin->getLock());
-    //model.addCpuStats(totalMem);
+    _statsTask = new StatsCollect(this);
+    _statsTimer.schedule(_statsTask, static_cast<long>(intervalMs));
+}
+
+void NotifyFlush::run()
+{
+    std::unique_lock<std::mutex> modelLock(_admin->getLock());
+    _admin->getModel().flushNotifications();
 }
 
 void Admin::rescheduleMemTimer(unsigned interval)
 {
-    _memStatsTask->cancel();
     _memStatsTaskInterval = interval;
-    _memStatsTask = new MemoryStats(this);
-    _memStatsTimer.schedule(_memStatsTask, _memStatsTaskInterval, _memStatsTaskInterval);
+    _statsTask->cancel();
+    scheduleStatsCollection(std::min(_memStatsTaskInterval, _cpuStatsTaskInterval));
     Log::info("Memory stats interval changed - New interval: " + std::to_string(interval));
 }
 
 void Admin::rescheduleCpuTimer(unsigned interval)
 {
-    _cpuStatsTask->cancel();
     _cpuStatsTaskInterval = interval;
-    _cpuStatsTask = new CpuStats(this);
-    _cpuStatsTimer.schedule(_cpuStatsTask, _cpuStatsTaskInterval, _cpuStatsTaskInterval);
+    _statsTask->cancel();
+    scheduleStatsCollection(std::min(_memStatsTaskInterval, _cpuStatsTaskInterval));
     Log::info("CPU stats interval changed - New interval: " + std::to_string(interval));
 }
 
 unsigned Admin::getTotalMemoryUsage(AdminModel& model)
 {
-    unsigned totalMem = Util::getMemoryUsage(_forKitPid);
+    unsigned totalMem = Util::getTotalMemoryUsage({ _forKitPid, Poco::Process::id() });
     totalMem += model.getTotalMemoryUsage();
-    totalMem += Util::getMemoryUsage(Poco::Process::id());
 
     return totalMem;
 }
@@ -74,11 +74,20 @@ public:
     /// Remove the document with all views. Used on termination or catastrophic failure.
     void rmDoc(const std::string& docKey);
 
+    /// Add resource spend to a document's live counters.
+    void updateDocumentStats(const std::string& docKey, unsigned tiles, unsigned long bytes,
+                             unsigned long renderMs, unsigned messages);
+
     void setForKitPid(const int forKitPid) { _forKitPid = forKitPid; }
 
     /// Callers must ensure that modelMutex is acquired
     AdminModel& getModel();
 
+    /// One pass of the statistics collection: samples memory (and,
+    /// eventually, cpu) for all kits and books the next pass at a
+    /// cadence matched to demand.
+    void collectStats();
+
     unsigned getMemStatsInterval();
 
     unsigned getCpuStatsInterval();
@@ -98,60 +107,67 @@ public:
 private:
     Admin();
 
+    /// Book a one-shot collection pass after the given delay.
+    void scheduleStatsCollection(unsigned intervalMs);
+
 private:
     AdminModel _model;
     std::mutex _modelMutex;
     int _forKitPid;
 
-    Poco::Util::Timer _memStatsTimer;
-    Poco::Util::TimerTask::Ptr _memStatsTask;
+    Poco::Util::Timer _statsTimer;
+    Poco::Util::TimerTask::Ptr _statsTask;
     unsigned _memStatsTaskInterval = 5000;
-
-    Poco::Util::Timer _cpuStatsTimer;
-    Poco::Util::TimerTask::Ptr _cpuStatsTask;
     unsigned _cpuStatsTaskInterval = 5000;
+    long _lastTotalMemory = 0;
+
+    Poco::Util::Timer _notifyTimer;
+    Poco::Util::TimerTask::Ptr _notifyFlushTask;
+    unsigned _notifyTaskInterval = 1000;
 };
 
-/// Memory statistics.
-class MemoryStats : public Poco::Util::TimerTask
+/// One statistics collection pass. A TimerTask runs only once when
+/// scheduled without a period, so each pass books its successor with
+/// a freshly computed interval.
+class StatsCollect : public Poco::Util::TimerTask
 {
 public:
-    MemoryStats(Admin* admin)
-        : _admin(admin),
-          _lastTotalMemory(0)
+    StatsCollect(Admin* admin)
+        : _admin(admin)
     {
-        Log::debug("Memory stat ctor");
+        Log::debug("Stats collect ctor");
     }
 
-    ~MemoryStats()
+    ~StatsCollect()
     {
-        Log::debug("Memory stat dtor");
+        Log::debug("Stats collect dtor");
     }
 
     void run() override;
 
 private:
     Admin* _admin;
-    long _lastTotalMemory;
 };
 
-/// CPU statistics.
-class CpuStats : public Poco::Util::TimerTask
+/// Periodic flush of the queued model notifications.
+class NotifyFlush : public Poco::Util::TimerTask
 {
 public:
-    CpuStats(Admin* /*admin*/)
+    NotifyFlush(Admin* admin)
+        : _admin(admin)
     {
-        Log::debug("Cpu stat ctor");
+        Log::debug("Notify flush ctor");
     }
 
-    ~CpuStats()
+    ~NotifyFlush()
     {
-        Log::debug("Cpu stat dtor");
+        Log::debug("Notify flush dtor");
     }
 
     void run() override;
 
 private:
+    Admin* _admin;
 };
 
 #endif
@@ -0,0 +1,164 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef INCLUDED_ADMINMETRICS_HPP
+#define INCLUDED_ADMINMETRICS_HPP
+
+#include <atomic>
+#include <string>
+
+/// A lock-free log-bucketed latency histogram: bucket i counts
+/// samples in [2^i, 2^(i+1)) microseconds. Coarse resolution, but
+/// enough to answer percentile questions without packet captures,
+/// and recording is a single relaxed increment on the hot path.
+class LatencyHistogram
+{
+public:
+    static const size_t BucketCount = 28; // Up to ~134 seconds.
+
+    LatencyHistogram()
+    {
+        reset();
+    }
+
+    void record(const unsigned long usec)
+    {
+        size_t bucket = 0;
+        auto value = usec;
+        while (value > 1 && bucket < BucketCount - 1)
+        {
+            value >>= 1;
+            ++bucket;
+        }
+
+        _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        _count.fetch_add(1, std::memory_order_relaxed);
+        _totalUsec.fetch_add(usec, std::memory_order_relaxed);
+    }
+
+    void reset()
+    {
+        for (auto& bucket : _buckets)
+        {
+            bucket.store(0);
+        }
+
+        _count.store(0);
+        _totalUsec.store(0);
+    }
+
+    unsigned long count() const
+    {
+        return _count.load();
+    }
+
+    /// The bucket upper bound, in usec, below which the given
+    /// fraction of the samples fall.
+    unsigned long percentile(const double fraction) const
+    {
+        const auto total = _count.load();
+        if (total == 0)
+        {
+            return 0;
+        }
+
+        const auto target = static_cast<unsigned long>(total * fraction);
+        unsigned long seen = 0;
+        for (size_t i = 0; i < BucketCount; ++i)
+        {
+            seen += _buckets[i].load();
+            if (seen > target)
+            {
+                return 1ul << (i + 1);
+            }
+        }
+
+        return 1ul << BucketCount;
+    }
+
+    /// A one-line summary for the admin protocol and the logs.
+    std::string summarize() const
+    {
+        const auto total = _count.load();
+        const auto avg = (total > 0 ? _totalUsec.load() / total : 0);
+        return "count=" + std::to_string(total) +
+               " avg_us=" + std::to_string(avg) +
+               " p50_us=" + std::to_string(percentile(0.50)) +
+               " p90_us=" + std::to_string(percentile(0.90)) +
+               " p99_us=" + std::to_string(percentile(0.99));
+    }
+
+private:
+    std::atomic<unsigned long> _buckets[BucketCount];
+    std::atomic<unsigned long> _count;
+    std::atomic<unsigned long> _totalUsec;
+};
+
+/// Global event counters for capacity planning. The hot paths bump
+/// these lock-free; the admin stats tick folds the deltas into the
+/// AdminModel time series. Header-only, so instrumented code doesn't
+/// grow a link dependency on the admin objects.
+struct AdminMetrics
+{
+    /// Tiles rendered by the kits and saved to the cache.
+    std::atomic<unsigned long> TilesRendered;
+
+    /// Payload bytes of those rendered tiles.
+    std::atomic<unsigned long> TileBytesRendered;
+
+    /// Sum of tile render round-trips, in ms; divide by TilesRendered
+    /// for the average.
+    std::atomic<unsigned long> RenderLatencyMs;
+
+    /// Tiles currently out for rendering. A gauge, not a counter.
+    std::atomic<unsigned long> TilesBeingRendered;
+
+    /// Bytes sent over the session websockets.
+    std::atomic<unsigned long> BytesSent;
+
+    /// Bytes queued for sending, across sessions. A gauge, not a counter.
+    std::atomic<unsigned long> SendQueueBytes;
+
+    /// Tile frames dropped for clients that can't keep up.
+    std::atomic<unsigned long> TileFramesDropped;
+
+    /// Tile request-to-cached round-trip. Recorded in wsd.
+    LatencyHistogram TileRoundTripUs;
+
+    /// Wait between tile enqueue and dequeue. Recorded in the kit.
+    LatencyHistogram TileQueueWaitUs;
+
+    /// lok paint duration per (combined) tile. Recorded in the kit.
+    LatencyHistogram TileRenderUs;
+
+    /// Fan-out of a rendered tile to its subscribers. Recorded in wsd.
+    LatencyHistogram TileSendUs;
+
+    static AdminMetrics& get()
+    {
+        static AdminMetrics instance;
+        return instance;
+    }
+
+private:
+    AdminMetrics() :
+        TilesRendered(0),
+        TileBytesRendered(0),
+        RenderLatencyMs(0),
+        TilesBeingRendered(0),
+        BytesSent(0),
+        SendQueueBytes(0),
+        TileFramesDropped(0)
+    {
+    }
+};
+
+#endif
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -14,12 +14,14 @@
 #include <set>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <Poco/Net/WebSocket.h>
 #include <Poco/Process.h>
 #include <Poco/StringTokenizer.h>
 #include <Poco/URI.h>
 
+#include "AdminMetrics.hpp"
 #include "Log.hpp"
 #include "Unit.hpp"
 #include "Util.hpp"
@@ -74,6 +76,48 @@ bool Subscriber::notify(const std::string& message)
     }
 }
 
+bool Subscriber::notifyDigest(const std::vector<std::string>& messages)
+{
+    std::string digest;
+    size_t count = 0;
+    for (const auto& message : messages)
+    {
+        StringTokenizer tokens(message, " ", StringTokenizer::TOK_IGNORE_EMPTY | StringTokenizer::TOK_TRIM);
+        if (_subscriptions.find(tokens[0]) == _subscriptions.end())
+            continue;
+
+        if (++count == 1)
+        {
+            // A single message goes out bare, as before batching.
+            digest = message;
+        }
+        else
+        {
+            if (count == 2)
+            {
+                digest = "batch\n" + digest;
+            }
+
+            digest += '\n' + message;
+        }
+    }
+
+    if (count == 0)
+        return true;
+
+    auto webSocket = _ws.lock();
+    if (webSocket)
+    {
+        UnitWSD::get().onAdminNotifyMessage(digest);
+        webSocket->sendFrame(digest.data(), digest.length());
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
 bool  Subscriber::subscribe(const std::string& command)
 {
     auto ret = _subscriptions.insert(command);
@@ -107,7 +151,7 @@ std::string AdminModel::query(const std::string& command)
     }
     else if (tokens[0] == "mem_stats_size")
     {
-        return std::to_string(_memStatsSize);
+        return std::to_string(_memStats.capacity());
     }
     else if (tokens[0] == "cpu_stats")
     {
@@ -115,7 +159,15 @@ std::string AdminModel::query(const std::string& command)
     }
     else if (tokens[0] == "cpu_stats_size")
     {
-        return std::to_string(_cpuStatsSize);
+        return std::to_string(_cpuStats.capacity());
+    }
+    else if (tokens[0] == "histogram")
+    {
+        return getHistograms();
+    }
+    else if (tokens[0] == "doc_stats")
+    {
+        return getDocStats();
     }
 
     return std::string("");
@@ -124,16 +176,17 @@ std::string AdminModel::query(const std::string& command)
 /// Returns memory consumed by all active loolkit processes
 unsigned AdminModel::getTotalMemoryUsage()
 {
-    unsigned totalMem = 0;
-    for (auto& it: _documents)
+    std::vector<Poco::Process::PID> pids;
+    pids.reserve(_documents.size());
+    for (const auto& it: _documents)
     {
         if (it.second.isExpired())
             continue;
 
-        totalMem += Util::getMemoryUsage(it.second.getPid());
+        pids.push_back(it.second.getPid());
     }
 
-    return totalMem;
+    return Util::getTotalMemoryUsage(pids);
 }
 
 void AdminModel::subscribe(int nSessionId, std::shared_ptr<Poco::Net::WebSocket>& ws)
@@ -165,11 +218,7 @@ void AdminModel::unsubscribe(int nSessionId, const std::string& command)
 
 void AdminModel::addMemStats(unsigned memUsage)
 {
-    _memStats.push_back(memUsage);
-    if (_memStats.size() > _memStatsSize)
-    {
-        _memStats.pop_front();
-    }
+    _memStats.push(memUsage);
 
     std::ostringstream oss;
     oss << "mem_stats "
@@ -179,11 +228,7 @@ void AdminModel::addMemStats(unsigned memUsage)
 
 void AdminModel::addCpuStats(unsigned cpuUsage)
 {
-    _cpuStats.push_back(cpuUsage);
-    if (_cpuStats.size() > _cpuStatsSize)
-    {
-        _cpuStats.pop_front();
-    }
+    _cpuStats.push(cpuUsage);
 
     std::ostringstream oss;
     oss << "cpu_stats "
@@ -193,42 +238,131 @@ void AdminModel::addCpuStats(unsigned cpuUsage)
 
 void AdminModel::setCpuStatsSize(unsigned size)
 {
-    int wasteValuesLen = _cpuStats.size() - size;
-    while (wasteValuesLen-- > 0)
-    {
-        _cpuStats.pop_front();
-    }
-    _cpuStatsSize = size;
+    _cpuStats.resize(size);
 
     std::ostringstream oss;
     oss << "settings "
         << "cpu_stats_size="
-        << std::to_string(_cpuStatsSize);
+        << std::to_string(_cpuStats.capacity());
     notify(oss.str());
 }
 
 void AdminModel::setMemStatsSize(unsigned size)
 {
-    int wasteValuesLen = _memStats.size() - size;
-    while (wasteValuesLen-- > 0)
-    {
-        _memStats.pop_front();
-    }
-    _memStatsSize = size;
+    _memStats.resize(size);
 
     std::ostringstream oss;
     oss << "settings "
         << "mem_stats_size="
-        << std::to_string(_memStatsSize);
+        << std::to_string(_memStats.capacity());
     notify(oss.str());
 }
 
+void AdminModel::tickMetrics()
+{
+    auto& metrics = AdminMetrics::get();
+
+    const auto tilesRendered = metrics.TilesRendered.load();
+    const auto renderLatencyMs = metrics.RenderLatencyMs.load();
+    const auto bytesSent = metrics.BytesSent.load();
+
+    const auto tilesDelta = tilesRendered - _lastTilesRendered;
+    const auto latencyDelta = renderLatencyMs - _lastRenderLatencyMs;
+
+    _tilesRenderedStats.push(tilesDelta);
+    _renderLatencyStats.push(tilesDelta > 0 ? latencyDelta / tilesDelta : 0);
+    _sentBytesStats.push(bytesSent - _lastBytesSent);
+    _renderQueueDepthStats.push(metrics.TilesBeingRendered.load());
+
+    _lastTilesRendered = tilesRendered;
+    _lastRenderLatencyMs = renderLatencyMs;
+    _lastBytesSent = bytesSent;
+}
+
+std::string AdminModel::getMetrics()
+{
+    const auto& metrics = AdminMetrics::get();
+
+    std::ostringstream oss;
+    oss << "active_docs_count " << _documents.size() << "\n"
+        << "active_users_count " << getTotalActiveViews() << "\n"
+        << "kit_mem_kb " << getTotalMemoryUsage() << "\n"
+        << "tiles_rendered_total " << metrics.TilesRendered.load() << "\n"
+        << "tile_bytes_rendered_total " << metrics.TileBytesRendered.load() << "\n"
+        << "render_latency_ms_total " << metrics.RenderLatencyMs.load() << "\n"
+        << "sent_bytes_total " << metrics.BytesSent.load() << "\n"
+        << "send_queue_bytes " << metrics.SendQueueBytes.load() << "\n"
+        << "tile_frames_dropped_total " << metrics.TileFramesDropped.load() << "\n"
+        << "tiles_being_rendered " << metrics.TilesBeingRendered.load() << "\n"
+        << "mem_stats " << _memStats.toString() << "\n"
+        << "cpu_stats " << _cpuStats.toString() << "\n"
+        << "tiles_rendered_stats " << _tilesRenderedStats.toString() << "\n"
+        << "render_latency_ms_stats " << _renderLatencyStats.toString() << "\n"
+        << "sent_bytes_stats " << _sentBytesStats.toString() << "\n"
+        << "render_queue_depth_stats " << _renderQueueDepthStats.toString() << "\n"
+        << "tile_roundtrip_hist " << metrics.TileRoundTripUs.summarize() << "\n"
+        << "tile_send_hist " << metrics.TileSendUs.summarize() << "\n"
+        << getDocStats();
+
+    return oss.str();
+}
+
+std::string AdminModel::getHistograms()
+{
+    // The queue-wait and render histograms fill in the kit
+    // processes; only the wsd-side ones can be reported here.
+    const auto& metrics = AdminMetrics::get();
+
+    std::ostringstream oss;
+    oss << "tile_roundtrip " << metrics.TileRoundTripUs.summarize() << "\n"
+        << "tile_send " << metrics.TileSendUs.summarize();
+
+    return oss.str();
+}
+
+void AdminModel::resetHistograms()
+{
+    auto& metrics = AdminMetrics::get();
+    metrics.TileRoundTripUs.reset();
+    metrics.TileSendUs.reset();
+}
+
 void AdminModel::notify(const std::string& message)
 {
+    StringTokenizer tokens(message, " ", StringTokenizer::TOK_IGNORE_EMPTY | StringTokenizer::TOK_TRIM);
+
+    // Stat updates for the same subject supersede each other; lifecycle
+    // events (adddoc, rmdoc) must all reach the console in order.
+    if (tokens[0] != "adddoc" && tokens[0] != "rmdoc")
+    {
+        std::string key = tokens[0];
+        if (tokens.count() > 1)
+        {
+            key += ' ' + tokens[1];
+        }
+
+        const auto it = _pendingKeys.find(key);
+        if (it != _pendingKeys.end())
+        {
+            _pendingNotifications[it->second] = message;
+            return;
+        }
+
+        _pendingKeys[key] = _pendingNotifications.size();
+    }
+
+    _pendingNotifications.push_back(message);
+}
+
+void AdminModel::flushNotifications()
+{
+    if (_pendingNotifications.empty())
+        return;
+
     auto it = std::begin(_subscribers);
     while (it != std::end(_subscribers))
     {
-        if (!it->second.notify(message))
+        if (!it->second.notifyDigest(_pendingNotifications))
         {
             it = _subscribers.erase(it);
         }
@@ -237,6 +371,9 @@ void AdminModel::notify(const std::string& message)
             it++;
         }
     }
+
+    _pendingNotifications.clear();
+    _pendingKeys.clear();
 }
 
 void AdminModel::addDocument(const std::string& docKey, Poco::Process::PID pid,
@@ -302,26 +439,56 @@ void AdminModel::removeDocument(const std::string& docKey)
     }
 }
 
-std::string AdminModel::getMemStats()
+std::string AdminModel::getDocKeyForPid(const Poco::Process::PID pid)
 {
-    std::string response;
-    for (auto& i: _memStats)
+    for (const auto& it : _documents)
     {
-        response += std::to_string(i) + ",";
+        if (it.second.getPid() == pid && !it.second.isExpired())
+        {
+            return it.first;
+        }
     }
 
-    return response;
+    return std::string();
+}
+
+std::string AdminModel::getMemStats()
+{
+    return _memStats.toString();
 }
 
 std::string AdminModel::getCpuStats()
 {
-    std::string response;
-    for (auto& i: _cpuStats)
+    return _cpuStats.toString();
+}
+
+std::string AdminModel::getDocStats()
+{
+    std::ostringstream oss;
+    for (const auto& it: _documents)
     {
-        response += std::to_string(i) + ",";
+        if (it.second.isExpired())
+            continue;
+
+        oss << "doc " << it.second.getPid()
+            << " tiles=" << it.second.getTilesRendered()
+            << " bytes=" << it.second.getRenderedBytes()
+            << " render_ms=" << it.second.getRenderTimeMs()
+            << " messages=" << it.second.getMessages() << "\n";
     }
 
-    return response;
+    return oss.str();
+}
+
+void AdminModel::updateDocumentStats(const std::string& docKey, const unsigned tiles,
+                                     const unsigned long bytes, const unsigned long renderMs,
+                                     const unsigned messages)
+{
+    auto it = _documents.find(docKey);
+    if (it != _documents.end())
+    {
+        it->second.addRenderStats(tiles, bytes, renderMs, messages);
+    }
 }
 
 unsigned AdminModel::getTotalActiveViews()
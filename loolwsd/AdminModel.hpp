@@ -10,9 +10,11 @@
 #ifndef INCLUDED_ADMINMODEL_HPP
 #define INCLUDED_ADMINMODEL_HPP
 
+#include <algorithm>
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 #include <Poco/Net/WebSocket.h>
 #include <Poco/Process.h>
@@ -20,6 +22,81 @@
 #include "Log.hpp"
 #include "Util.hpp"
 
+/// A fixed-capacity ring of metric samples. Pushing past capacity
+/// overwrites the oldest, so a series costs one bounded allocation
+/// however long the server runs.
+class StatsRing
+{
+public:
+    explicit StatsRing(const size_t capacity) :
+        _samples(capacity),
+        _next(0),
+        _count(0)
+    {
+    }
+
+    size_t capacity() const { return _samples.size(); }
+
+    size_t size() const { return _count; }
+
+    void clear()
+    {
+        _next = 0;
+        _count = 0;
+    }
+
+    void push(const unsigned sample)
+    {
+        if (_samples.empty())
+        {
+            return;
+        }
+
+        _samples[_next] = sample;
+        _next = (_next + 1) % _samples.size();
+        _count = std::min(_count + 1, _samples.size());
+    }
+
+    /// The i-th oldest retained sample.
+    unsigned at(const size_t i) const
+    {
+        return _samples[(_next + _samples.size() - _count + i) % _samples.size()];
+    }
+
+    /// Change the capacity, keeping the newest samples.
+    void resize(const size_t capacity)
+    {
+        std::vector<unsigned> samples(capacity);
+        const auto keep = std::min(_count, capacity);
+        for (size_t i = 0; i < keep; ++i)
+        {
+            samples[i] = at(_count - keep + i);
+        }
+
+        _samples.swap(samples);
+        _next = (capacity == 0 ? 0 : keep % capacity);
+        _count = keep;
+    }
+
+    /// Comma-separated samples, oldest first, with a trailing comma
+    /// as the admin console expects.
+    std::string toString() const
+    {
+        std::string response;
+        for (size_t i = 0; i < _count; ++i)
+        {
+            response += std::to_string(at(i)) + ",";
+        }
+
+        return response;
+    }
+
+private:
+    std::vector<unsigned> _samples;
+    size_t _next;
+    size_t _count;
+};
+
 /// A client view in Admin controller.
 class View
 {
@@ -73,6 +150,21 @@ public:
 
     const std::map<std::string, View>& getViews() const { return _views; }
 
+    /// Resource spend, fed from the document's broker.
+    void addRenderStats(const unsigned tiles, const unsigned long bytes,
+                        const unsigned long renderMs, const unsigned messages)
+    {
+        _tilesRendered += tiles;
+        _renderedBytes += bytes;
+        _renderTimeMs += renderMs;
+        _messages += messages;
+    }
+
+    unsigned long getTilesRendered() const { return _tilesRendered; }
+    unsigned long getRenderedBytes() const { return _renderedBytes; }
+    unsigned long getRenderTimeMs() const { return _renderTimeMs; }
+    unsigned long getMessages() const { return _messages; }
+
 private:
     const std::string _docKey;
     const Poco::Process::PID _pid;
@@ -83,6 +175,12 @@ private:
     /// Hosted filename
     std::string _filename;
 
+    /// Resource accounting, for the fair-share counters.
+    unsigned long _tilesRendered = 0;
+    unsigned long _renderedBytes = 0;
+    unsigned long _renderTimeMs = 0;
+    unsigned long _messages = 0;
+
     std::time_t _start;
     std::time_t _end = 0;
 };
@@ -106,6 +204,10 @@ public:
 
     bool notify(const std::string& message);
 
+    /// Send the subscribed subset of the given messages as one frame,
+    /// wrapped in a batch envelope when there is more than one.
+    bool notifyDigest(const std::vector<std::string>& messages);
+
     bool subscribe(const std::string& command);
 
     void unsubscribe(const std::string& command);
@@ -148,6 +250,9 @@ public:
     void subscribe(int sessionId, std::shared_ptr<Poco::Net::WebSocket>& ws);
     void subscribe(int sessionId, const std::string& command);
 
+    /// True while at least one admin console is connected.
+    bool hasSubscribers() const { return !_subscribers.empty(); }
+
     void unsubscribe(int sessionId, const std::string& command);
 
     void clearMemStats() { _memStats.clear(); }
@@ -162,32 +267,79 @@ public:
 
     void setMemStatsSize(unsigned size);
 
+    /// Fold the AdminMetrics counter deltas into the time series.
+    /// Called from the periodic stats tick, under the model lock.
+    void tickMetrics();
+
+    /// Serialize a snapshot of all series and totals, for the
+    /// pull-based metrics endpoint.
+    std::string getMetrics();
+
+    /// One summary line per wsd-side latency histogram.
+    std::string getHistograms();
+
+    /// Restart the latency histograms from zero.
+    void resetHistograms();
+
+    /// Queue a model update for the subscribers. Updates are coalesced
+    /// and sent as one digest frame per flush tick, not a frame per
+    /// event; flushNotifications() does the sending.
     void notify(const std::string& message);
 
+    /// Send the queued updates, one frame per subscriber.
+    void flushNotifications();
+
     void addDocument(const std::string& docKey, Poco::Process::PID pid, const std::string& filename, const std::string& sessionId);
 
     void removeDocument(const std::string& docKey, const std::string& sessionId);
     void removeDocument(const std::string& docKey);
 
+    /// The docKey of the document hosted by the given kit process,
+    /// or empty when unknown.
+    std::string getDocKeyForPid(Poco::Process::PID pid);
+
+    /// Add resource spend to a document's live counters.
+    void updateDocumentStats(const std::string& docKey, unsigned tiles, unsigned long bytes,
+                             unsigned long renderMs, unsigned messages);
+
 private:
 
     std::string getMemStats();
 
     std::string getCpuStats();
 
+    /// One line of resource counters per active document.
+    std::string getDocStats();
+
     unsigned getTotalActiveViews();
 
     std::string getDocuments();
 
 private:
+    static const size_t DefStatsSize = 100;
+
     std::map<int, Subscriber> _subscribers;
     std::map<std::string, Document> _documents;
 
-    std::list<unsigned> _memStats;
-    unsigned _memStatsSize = 100;
+    /// Updates queued since the last flush, in arrival order.
+    std::vector<std::string> _pendingNotifications;
+
+    /// Coalescing key (the first two tokens) -> index into the above.
+    std::map<std::string, size_t> _pendingKeys;
+
+    StatsRing _memStats{DefStatsSize};
+    StatsRing _cpuStats{DefStatsSize};
+
+    /// Per-tick series folded out of AdminMetrics by tickMetrics().
+    StatsRing _tilesRenderedStats{DefStatsSize};
+    StatsRing _renderLatencyStats{DefStatsSize};
+    StatsRing _sentBytesStats{DefStatsSize};
+    StatsRing _renderQueueDepthStats{DefStatsSize};
 
-    std::list<unsigned> _cpuStats;
-    unsigned _cpuStatsSize = 100;
+    /// Counter values at the last tick, for the deltas.
+    unsigned long _lastTilesRendered = 0;
+    unsigned long _lastRenderLatencyMs = 0;
+    unsigned long _lastBytesSent = 0;
 };
 
 #endif
@@ -11,6 +11,9 @@
 #include "config.h"
 
 #include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 
 #include <Poco/Base64Decoder.h>
@@ -25,6 +28,7 @@
 #include <Poco/Net/HTTPRequest.h>
 #include <Poco/Net/HTTPResponse.h>
 #include <Poco/Net/NetException.h>
+#include <Poco/SHA1Engine.h>
 #include <Poco/StringTokenizer.h>
 #include <Poco/Timestamp.h>
 #include <Poco/URI.h>
@@ -36,6 +40,39 @@ using Poco::Base64Decoder;
 using Poco::Base64Encoder;
 using Poco::OutputLineEndingConverter;
 
+namespace
+{
+
+std::mutex keyCacheMutex;
+std::map<std::string, std::shared_ptr<const Poco::Crypto::RSAKey>> keyCache;
+
+/// Verified token hashes and their expiry times, so a repeat
+/// verification is a map lookup instead of an RSA signature.
+const size_t MaxVerifiedTokens = 1024;
+std::mutex verifiedTokensMutex;
+std::map<std::string, std::time_t> verifiedTokens;
+
+std::string hashToken(const std::string& token)
+{
+    Poco::SHA1Engine engine;
+    engine.update(token);
+    return Poco::DigestEngine::digestToHex(engine.digest());
+}
+
+}
+
+std::shared_ptr<const Poco::Crypto::RSAKey> JWTAuth::getKey(const std::string& keyPath)
+{
+    std::unique_lock<std::mutex> lock(keyCacheMutex);
+    auto& key = keyCache[keyPath];
+    if (!key)
+    {
+        key = std::make_shared<const Poco::Crypto::RSAKey>("", keyPath);
+    }
+
+    return key;
+}
+
 const std::string JWTAuth::getAccessToken()
 {
     std::string encodedHeader = createHeader();
@@ -91,6 +128,21 @@ const std::string JWTAuth::getAccessToken()
 
 bool JWTAuth::verify(const std::string& accessToken)
 {
+    const std::string tokenHash = hashToken(accessToken);
+    {
+        std::unique_lock<std::mutex> lock(verifiedTokensMutex);
+        const auto it = verifiedTokens.find(tokenHash);
+        if (it != verifiedTokens.end())
+        {
+            if (Poco::Timestamp().epochTime() <= it->second)
+            {
+                return true;
+            }
+
+            verifiedTokens.erase(it);
+        }
+    }
+
     Poco::StringTokenizer tokens(accessToken, ".", Poco::StringTokenizer::TOK_IGNORE_EMPTY | Poco::StringTokenizer::TOK_TRIM);
 
     try
@@ -140,6 +192,31 @@ bool JWTAuth::verify(const std::string& accessToken)
             Log::info("JWTAuth:verify: JWT expired; curtime:" + std::to_string(curtime) + ", exp:" + std::to_string(decodedExptime));
             return false;
         }
+
+        std::unique_lock<std::mutex> lock(verifiedTokensMutex);
+        if (verifiedTokens.size() >= MaxVerifiedTokens)
+        {
+            // Sweep the expired entries; should that not be enough,
+            // start over rather than grow without bound.
+            for (auto it = verifiedTokens.begin(); it != verifiedTokens.end();)
+            {
+                if (curtime > it->second)
+                {
+                    it = verifiedTokens.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+
+            if (verifiedTokens.size() >= MaxVerifiedTokens)
+            {
+                verifiedTokens.clear();
+            }
+        }
+
+        verifiedTokens[tokenHash] = decodedExptime;
     }
     catch(Poco::Exception& exc)
     {
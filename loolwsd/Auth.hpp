@@ -11,6 +11,7 @@
 #ifndef INCLUDED_AUTH_HPP
 #define INCLUDED_AUTH_HPP
 
+#include <memory>
 #include <string>
 
 #include <Poco/Crypto/RSADigestEngine.h>
@@ -36,8 +37,8 @@ public:
         : _name(name),
           _sub(sub),
           _aud(aud),
-          _key(Poco::Crypto::RSAKey("", keyPath)),
-          _digestEngine(_key, "SHA256")
+          _key(getKey(keyPath)),
+          _digestEngine(*_key, "SHA256")
     {    }
 
     const std::string getAccessToken() override;
@@ -49,6 +50,11 @@ private:
 
     const std::string createPayload();
 
+    /// The parsed key for the given path, cached for the process
+    /// lifetime; we are constructed on each admin request and
+    /// parsing the PEM every time is needless work.
+    static std::shared_ptr<const Poco::Crypto::RSAKey> getKey(const std::string& keyPath);
+
 private:
     const std::string _alg = "RS256";
     const std::string _typ = "JWT";
@@ -58,7 +64,7 @@ private:
     const std::string _sub;
     const std::string _aud;
 
-    const Poco::Crypto::RSAKey _key;
+    const std::shared_ptr<const Poco::Crypto::RSAKey> _key;
     Poco::Crypto::RSADigestEngine _digestEngine;
 };
 
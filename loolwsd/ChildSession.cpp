@@ -10,7 +10,12 @@
 #include "ChildSession.hpp"
 #include "config.h"
 
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
 #include <sstream>
+#include <unordered_map>
 
 #include <Poco/JSON/Object.h>
 #include <Poco/JSON/Parser.h>
@@ -32,6 +37,75 @@ using Poco::URI;
 
 using namespace LOOLProtocol;
 
+namespace
+{
+
+/// The commands understood by the child session. Routing is a single
+/// hash lookup on the first token instead of a string-compare cascade.
+enum class ChildCommand
+{
+    Unknown,
+    DummyMsg,
+    CommandValues,
+    PartPageRectangles,
+    Load,
+    RenderFont,
+    SetClientPart,
+    SetPage,
+    Status,
+    Tile,
+    TileCombine,
+    ClientZoom,
+    ClientVisibleArea,
+    DownloadAs,
+    GetChildId,
+    GetTextSelection,
+    Paste,
+    InsertFile,
+    Key,
+    Mouse,
+    Uno,
+    SelectText,
+    SelectGraphic,
+    ResetSelection,
+    SaveAs,
+    UserActive,
+    UserInactive
+};
+
+/// Token to command table, built once at startup.
+const std::unordered_map<std::string, ChildCommand> ChildCommands
+{
+    { "dummymsg", ChildCommand::DummyMsg },
+    { "commandvalues", ChildCommand::CommandValues },
+    { "partpagerectangles", ChildCommand::PartPageRectangles },
+    { "load", ChildCommand::Load },
+    { "renderfont", ChildCommand::RenderFont },
+    { "setclientpart", ChildCommand::SetClientPart },
+    { "setpage", ChildCommand::SetPage },
+    { "status", ChildCommand::Status },
+    { "tile", ChildCommand::Tile },
+    { "tilecombine", ChildCommand::TileCombine },
+    { "clientzoom", ChildCommand::ClientZoom },
+    { "clientvisiblearea", ChildCommand::ClientVisibleArea },
+    { "downloadas", ChildCommand::DownloadAs },
+    { "getchildid", ChildCommand::GetChildId },
+    { "gettextselection", ChildCommand::GetTextSelection },
+    { "paste", ChildCommand::Paste },
+    { "insertfile", ChildCommand::InsertFile },
+    { "key", ChildCommand::Key },
+    { "mouse", ChildCommand::Mouse },
+    { "uno", ChildCommand::Uno },
+    { "selecttext", ChildCommand::SelectText },
+    { "selectgraphic", ChildCommand::SelectGraphic },
+    { "resetselection", ChildCommand::ResetSelection },
+    { "saveas", ChildCommand::SaveAs },
+    { "useractive", ChildCommand::UserActive },
+    { "userinactive", ChildCommand::UserInactive }
+};
+
+}
+
 std::recursive_mutex ChildSession::Mutex;
 
 ChildSession::ChildSession(const std::string& id,
@@ -50,6 +124,13 @@ ChildSession::~ChildSession()
 {
     Log::info("~ChildSession dtor [" + getName() + "].");
 
+    // Deliver the results of any in-flight exports while we can
+    // still send; may wait for an export sibling to finish.
+    for (auto& watcher : _exportWatchers)
+    {
+        watcher.join();
+    }
+
     disconnect();
 }
 
@@ -119,40 +200,44 @@ bool ChildSession::_handleInput(const char *buffer, int length)
         Log::debug("Finished replaying messages.");
     }
 
-    if (tokens[0] == "dummymsg")
-    {
-        // Just to update the activity of a view-only client.
-        return true;
-    }
-    else if (tokens[0] == "commandvalues")
-    {
-        return getCommandValues(buffer, length, tokens);
-    }
-    else if (tokens[0] == "partpagerectangles")
-    {
-        return getPartPageRectangles(buffer, length);
-    }
-    else if (tokens[0] == "load")
+    const auto commandIt = ChildCommands.find(tokens[0]);
+    const auto command = (commandIt != ChildCommands.end() ? commandIt->second
+                                                           : ChildCommand::Unknown);
+
+    switch (command)
     {
-        if (_isDocLoaded)
+        case ChildCommand::DummyMsg:
+            // Just to update the activity of a view-only client.
+            return true;
+        case ChildCommand::CommandValues:
+            return getCommandValues(buffer, length, tokens);
+        case ChildCommand::PartPageRectangles:
+            return getPartPageRectangles(buffer, length);
+        case ChildCommand::Load:
         {
-            sendTextFrame("error: cmd=load kind=docalreadyloaded");
-            return false;
-        }
+            if (_isDocLoaded)
+            {
+                sendTextFrame("error: cmd=load kind=docalreadyloaded");
+                return false;
+            }
 
-        _isDocLoaded = loadDocument(buffer, length, tokens);
-        if (!_isDocLoaded)
-        {
-            sendTextFrame("error: cmd=load kind=faileddocloading");
-        }
+            _isDocLoaded = loadDocument(buffer, length, tokens);
+            if (!_isDocLoaded)
+            {
+                sendTextFrame("error: cmd=load kind=faileddocloading");
+            }
 
-        return _isDocLoaded;
+            return _isDocLoaded;
+        }
+        default:
+            break;
     }
-    else if (!_isDocLoaded)
+
+    if (!_isDocLoaded)
     {
         // Be forgiving to these messages while we load.
-        if (tokens[0] == "useractive" ||
-            tokens[0] == "userinactive")
+        if (command == ChildCommand::UserActive ||
+            command == ChildCommand::UserInactive)
         {
             return true;
         }
@@ -160,116 +245,61 @@ bool ChildSession::_handleInput(const char *buffer, int length)
         sendTextFrame("error: cmd=" + tokens[0] + " kind=nodocloaded");
         return false;
     }
-    else if (tokens[0] == "renderfont")
-    {
-        sendFontRendering(buffer, length, tokens);
-    }
-    else if (tokens[0] == "setclientpart")
-    {
-        return setClientPart(buffer, length, tokens);
-    }
-    else if (tokens[0] == "setpage")
-    {
-        return setPage(buffer, length, tokens);
-    }
-    else if (tokens[0] == "status")
-    {
-        return getStatus(buffer, length);
-    }
-    else if (tokens[0] == "tile" || tokens[0] == "tilecombine")
-    {
-        assert(false && "Tile traffic should go through the DocumentBroker-LoKit WS.");
-    }
-    else
+
+    // All other commands require a LibreOfficeKitDocument session,
+    // i.e. need to be handled in a child process.
+    switch (command)
     {
-        // All other commands are such that they always require a LibreOfficeKitDocument session,
-        // i.e. need to be handled in a child process.
-
-        assert(tokens[0] == "clientzoom" ||
-               tokens[0] == "clientvisiblearea" ||
-               tokens[0] == "downloadas" ||
-               tokens[0] == "getchildid" ||
-               tokens[0] == "gettextselection" ||
-               tokens[0] == "paste" ||
-               tokens[0] == "insertfile" ||
-               tokens[0] == "key" ||
-               tokens[0] == "mouse" ||
-               tokens[0] == "uno" ||
-               tokens[0] == "selecttext" ||
-               tokens[0] == "selectgraphic" ||
-               tokens[0] == "resetselection" ||
-               tokens[0] == "saveas" ||
-               tokens[0] == "useractive" ||
-               tokens[0] == "userinactive");
-
-        if (tokens[0] == "clientzoom")
-        {
+        case ChildCommand::RenderFont:
+            sendFontRendering(buffer, length, tokens);
+            break;
+        case ChildCommand::SetClientPart:
+            return setClientPart(buffer, length, tokens);
+        case ChildCommand::SetPage:
+            return setPage(buffer, length, tokens);
+        case ChildCommand::Status:
+            return getStatus(buffer, length);
+        case ChildCommand::Tile:
+        case ChildCommand::TileCombine:
+            assert(false && "Tile traffic should go through the DocumentBroker-LoKit WS.");
+            break;
+        case ChildCommand::ClientZoom:
             return clientZoom(buffer, length, tokens);
-        }
-        else if (tokens[0] == "clientvisiblearea")
-        {
+        case ChildCommand::ClientVisibleArea:
             return clientVisibleArea(buffer, length, tokens);
-        }
-        else if (tokens[0] == "downloadas")
-        {
+        case ChildCommand::DownloadAs:
             return downloadAs(buffer, length, tokens);
-        }
-        else if (tokens[0] == "getchildid")
-        {
+        case ChildCommand::GetChildId:
             return getChildId();
-        }
-        else if (tokens[0] == "gettextselection")
-        {
+        case ChildCommand::GetTextSelection:
             return getTextSelection(buffer, length, tokens);
-        }
-        else if (tokens[0] == "paste")
-        {
+        case ChildCommand::Paste:
             return paste(buffer, length, tokens);
-        }
-        else if (tokens[0] == "insertfile")
-        {
+        case ChildCommand::InsertFile:
             return insertFile(buffer, length, tokens);
-        }
-        else if (tokens[0] == "key")
-        {
+        case ChildCommand::Key:
             return keyEvent(buffer, length, tokens);
-        }
-        else if (tokens[0] == "mouse")
-        {
+        case ChildCommand::Mouse:
             return mouseEvent(buffer, length, tokens);
-        }
-        else if (tokens[0] == "uno")
-        {
+        case ChildCommand::Uno:
             return unoCommand(buffer, length, tokens);
-        }
-        else if (tokens[0] == "selecttext")
-        {
+        case ChildCommand::SelectText:
             return selectText(buffer, length, tokens);
-        }
-        else if (tokens[0] == "selectgraphic")
-        {
+        case ChildCommand::SelectGraphic:
             return selectGraphic(buffer, length, tokens);
-        }
-        else if (tokens[0] == "resetselection")
-        {
+        case ChildCommand::ResetSelection:
             return resetSelection(buffer, length, tokens);
-        }
-        else if (tokens[0] == "saveas")
-        {
+        case ChildCommand::SaveAs:
             return saveAs(buffer, length, tokens);
-        }
-        else if (tokens[0] == "useractive")
-        {
+        case ChildCommand::UserActive:
             setIsActive(true);
-        }
-        else if (tokens[0] == "userinactive")
-        {
+            break;
+        case ChildCommand::UserInactive:
             setIsActive(false);
-        }
-        else
-        {
+            break;
+        default:
             assert(false && "Unknown command token.");
-        }
+            break;
     }
 
     return true;
@@ -325,7 +355,7 @@ bool ChildSession::loadDocument(const char * /*buffer*/, int /*length*/, StringT
 
     // Respond by the document status
     Log::debug("Sending status after loading view " + std::to_string(_viewId) + ".");
-    const auto status = LOKitHelper::documentStatus(_loKitDocument->get());
+    const auto status = composeStatus();
     if (status.empty() || !sendTextFrame("status: " + status))
     {
         Log::error("Failed to get/forward document status [" + status + "].");
@@ -389,6 +419,31 @@ bool ChildSession::sendFontRendering(const char* /*buffer*/, int /*length*/, Str
     return sendBinaryFrame(output.data(), output.size());
 }
 
+std::string ChildSession::composeStatus()
+{
+    // The header fields (current part, view id) differ per view and
+    // are cheap; the part names and hashes are one LOK call per part
+    // and identical for every view, so they come from the shared
+    // document cache.
+    auto status = LOKitHelper::documentStatusHeader(_loKitDocument->get());
+    if (!status.empty())
+    {
+        auto parts = _docManager.getCachedResponse("parts");
+        if (parts.empty())
+        {
+            parts = LOKitHelper::documentPartsListing(_loKitDocument->get());
+            if (!parts.empty())
+            {
+                _docManager.cacheResponse("parts", parts);
+            }
+        }
+
+        status += parts;
+    }
+
+    return status;
+}
+
 bool ChildSession::getStatus(const char* /*buffer*/, int /*length*/)
 {
     std::string status;
@@ -397,7 +452,7 @@ bool ChildSession::getStatus(const char* /*buffer*/, int /*length*/)
 
         _loKitDocument->setView(_viewId);
 
-        status = LOKitHelper::documentStatus(_loKitDocument->get());
+        status = composeStatus();
     }
 
     if (status.empty())
@@ -484,16 +539,26 @@ bool ChildSession::getCommandValues(const char* /*buffer*/, int /*length*/, Stri
 
 bool ChildSession::getPartPageRectangles(const char* /*buffer*/, int /*length*/)
 {
-    char* partPage = nullptr;
+    // The layout query costs hundreds of ms on long documents and
+    // its result is view-independent; every newly attached view
+    // asks for it, so serve it from the shared document cache.
+    auto partPage = _docManager.getCachedResponse("partpagerectangles");
+    if (partPage.empty())
     {
-        auto lock(_loKitDocument->getLock());
+        char* rectangles = nullptr;
+        {
+            auto lock(_loKitDocument->getLock());
 
-        _loKitDocument->setView(_viewId);
-        partPage = _loKitDocument->getPartPageRectangles();
+            _loKitDocument->setView(_viewId);
+            rectangles = _loKitDocument->getPartPageRectangles();
+        }
+
+        partPage = std::string(rectangles);
+        std::free(rectangles);
+        _docManager.cacheResponse("partpagerectangles", partPage);
     }
 
-    sendTextFrame("partpagerectangles: " + std::string(partPage));
-    std::free(partPage);
+    sendTextFrame("partpagerectangles: " + partPage);
     return true;
 }
 
@@ -573,17 +638,73 @@ bool ChildSession::downloadAs(const char* /*buffer*/, int /*length*/, StringToke
     const Poco::Path filenameParam(name);
     const auto url = JAILED_DOCUMENT_ROOT + tmpDir + "/" + filenameParam.getFileName();
 
+    // The client retries on error, so announce the file whether or
+    // not the export succeeded, as the blocking version did.
+    exportInBackground(url, format, filterOptions,
+                       [this, tmpDir, name, id](const bool /*success*/)
+                       {
+                           sendTextFrame("downloadas: jail=" + _jailId + " dir=" + tmpDir +
+                                         " name=" + name +
+                                         " port=" + std::to_string(ClientPortNumber) + " id=" + id);
+                       });
+    return true;
+}
+
+void ChildSession::exportInBackground(const std::string& url, const std::string& format,
+                                      const std::string& filterOptions,
+                                      const std::function<void(bool)>& whenDone)
+{
+    pid_t pid = -1;
     {
+        // Hold the document lock over the fork, so the sibling gets
+        // a quiescent copy-on-write snapshot of the document.
         auto lock(_loKitDocument->getLock());
 
-        _loKitDocument->saveAs(url.c_str(),
-                format.size() == 0 ? nullptr :format.c_str(),
-                filterOptions.size() == 0 ? nullptr : filterOptions.c_str());
+        pid = fork();
+        if (pid == 0)
+        {
+            // The export sibling owns a private snapshot; touch only
+            // the document, then exit hard: no atexit handlers, no
+            // flushing of streams shared with the interactive kit.
+            _loKitDocument->setView(_viewId);
+            const auto success = _loKitDocument->saveAs(url.c_str(),
+                    format.size() == 0 ? nullptr : format.c_str(),
+                    filterOptions.size() == 0 ? nullptr : filterOptions.c_str());
+            _exit(success ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
     }
 
-    sendTextFrame("downloadas: jail=" + _jailId + " dir=" + tmpDir + " name=" + name +
-                  " port=" + std::to_string(ClientPortNumber) + " id=" + id);
-    return true;
+    if (pid < 0)
+    {
+        // Cannot fork; export on the document thread as before.
+        Log::syserror("Failed to fork export sibling for [" + url + "].");
+        bool success = false;
+        {
+            auto lock(_loKitDocument->getLock());
+
+            _loKitDocument->setView(_viewId);
+
+            success = _loKitDocument->saveAs(url.c_str(),
+                    format.size() == 0 ? nullptr : format.c_str(),
+                    filterOptions.size() == 0 ? nullptr : filterOptions.c_str());
+        }
+
+        whenDone(success);
+        return;
+    }
+
+    Log::info() << "Exporting [" << url << "] in sibling process " << pid << "." << Log::end;
+    _exportWatchers.emplace_back([pid, whenDone]()
+        {
+            Util::setThreadName("export_watch");
+
+            int status = 0;
+            while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+            {
+            }
+
+            whenDone(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+        });
 }
 
 bool ChildSession::getChildId()
@@ -875,23 +996,15 @@ bool ChildSession::saveAs(const char* /*buffer*/, int /*length*/, StringTokenize
         }
     }
 
-    bool success = false;
-    {
-        auto lock(_loKitDocument->getLock());
-
-        _loKitDocument->setView(_viewId);
-
-        success = _loKitDocument->saveAs(url.c_str(),
-                format.size() == 0 ? nullptr :format.c_str(),
-                filterOptions.size() == 0 ? nullptr : filterOptions.c_str());
-    }
-
-    sendTextFrame("saveas: url=" + url);
-    std::string successStr = success ? "true" : "false";
-    sendTextFrame("unocommandresult: {"
-            "\"commandName\":\"saveas\","
-            "\"success\":\"" + successStr + "\"}");
-
+    exportInBackground(url, format, filterOptions,
+                       [this, url](const bool success)
+                       {
+                           sendTextFrame("saveas: url=" + url);
+                           const std::string successStr = success ? "true" : "false";
+                           sendTextFrame("unocommandresult: {"
+                                   "\"commandName\":\"saveas\","
+                                   "\"success\":\"" + successStr + "\"}");
+                       });
     return true;
 }
 
@@ -985,6 +1098,14 @@ void ChildSession::loKitCallback(const int nType, const std::string& rPayload)
         _lastDocStates[nType] = rPayload;
     }
 
+    // Any document change makes the cached state responses stale.
+    if (nType == LOK_CALLBACK_INVALIDATE_TILES ||
+        nType == LOK_CALLBACK_STATE_CHANGED ||
+        nType == LOK_CALLBACK_DOCUMENT_SIZE_CHANGED)
+    {
+        _docManager.invalidateResponseCache();
+    }
+
     switch (nType)
     {
     case LOK_CALLBACK_INVALIDATE_TILES:
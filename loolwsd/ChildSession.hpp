@@ -10,7 +10,10 @@
 #ifndef INCLUDED_CHILDSESSION_HPP
 #define INCLUDED_CHILDSESSION_HPP
 
+#include <functional>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 #include <Poco/Thread.h>
 #include <Poco/NotificationQueue.h>
@@ -53,6 +56,17 @@ public:
 
     virtual
     bool sendTextFrame(const std::string& message) = 0;
+
+    /// Look up a cached document-state response (part listings,
+    /// part page rectangles); empty when not cached.
+    virtual
+    std::string getCachedResponse(const std::string& name) = 0;
+    /// Cache a document-state response, shared by all views.
+    virtual
+    void cacheResponse(const std::string& name, const std::string& response) = 0;
+    /// Drop the cached responses after a document change.
+    virtual
+    void invalidateResponseCache() = 0;
 };
 
 /// Represents a session to the WSD process, in a Kit process. Note that this is not a singleton.
@@ -96,6 +110,10 @@ public:
 private:
     bool loadDocument(const char *buffer, int length, Poco::StringTokenizer& tokens);
 
+    /// Compose the status response for this view, reusing the
+    /// cached parts listing. The LOK document lock must be held.
+    std::string composeStatus();
+
     bool sendFontRendering(const char *buffer, int length, Poco::StringTokenizer& tokens);
     bool getCommandValues(const char *buffer, int length, Poco::StringTokenizer& tokens);
 
@@ -113,6 +131,15 @@ private:
     bool selectGraphic(const char *buffer, int length, Poco::StringTokenizer& tokens);
     bool resetSelection(const char *buffer, int length, Poco::StringTokenizer& tokens);
     bool saveAs(const char *buffer, int length, Poco::StringTokenizer& tokens);
+
+    /// Export the document to url in a forked sibling process, so a
+    /// slow conversion doesn't stall rendering and typing for the
+    /// other views. whenDone is invoked with the success of the
+    /// export, from a watcher thread. Falls back to exporting
+    /// in-process when the fork fails.
+    void exportInBackground(const std::string& url, const std::string& format,
+                            const std::string& filterOptions,
+                            const std::function<void(bool)>& whenDone);
     bool setClientPart(const char *buffer, int length, Poco::StringTokenizer& tokens);
     bool setPage(const char *buffer, int length, Poco::StringTokenizer& tokens);
 
@@ -133,6 +160,9 @@ private:
     std::string _docType;
     std::map<int, std::string> _lastDocStates;
 
+    /// Watchers of in-flight background exports; joined on destruction.
+    std::vector<std::thread> _exportWatchers;
+
     /// Synchronize _loKitDocument access.
     /// This should be owned by Document.
     static std::recursive_mutex Mutex;
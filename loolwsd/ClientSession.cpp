@@ -11,6 +11,7 @@
 #include "config.h"
 
 #include <fstream>
+#include <unordered_map>
 
 #include <Poco/FileStream.h>
 #include <Poco/JSON/Object.h>
@@ -18,6 +19,7 @@
 #include <Poco/URI.h>
 #include <Poco/URIStreamOpener.h>
 
+#include "CommandValuesCache.hpp"
 #include "Common.hpp"
 #include "IoUtil.hpp"
 #include "LOOLProtocol.hpp"
@@ -34,6 +36,81 @@ using namespace LOOLProtocol;
 
 using Poco::StringTokenizer;
 
+namespace
+{
+
+/// The commands understood by the client session. Routing is a single
+/// hash lookup on the first token instead of a string-compare cascade.
+enum class ClientCommand
+{
+    Unknown,
+    LoolClient,
+    Load,
+    CancelTiles,
+    ClientZoom,
+    ClientVisibleArea,
+    CommandValues,
+    DownloadAs,
+    GetChildId,
+    GetTextSelection,
+    Paste,
+    InsertFile,
+    Key,
+    Mouse,
+    PartPageRectangles,
+    Ping,
+    RenderFont,
+    RequestLokSession,
+    ResetSelection,
+    SaveAs,
+    SelectGraphic,
+    SelectText,
+    SetClientPart,
+    SetPage,
+    Status,
+    Tile,
+    TileCombine,
+    Uno,
+    UserActive,
+    UserInactive
+};
+
+/// Token to command table, built once at startup.
+const std::unordered_map<std::string, ClientCommand> ClientCommands
+{
+    { "loolclient", ClientCommand::LoolClient },
+    { "load", ClientCommand::Load },
+    { "canceltiles", ClientCommand::CancelTiles },
+    { "clientzoom", ClientCommand::ClientZoom },
+    { "clientvisiblearea", ClientCommand::ClientVisibleArea },
+    { "commandvalues", ClientCommand::CommandValues },
+    { "downloadas", ClientCommand::DownloadAs },
+    { "getchildid", ClientCommand::GetChildId },
+    { "gettextselection", ClientCommand::GetTextSelection },
+    { "paste", ClientCommand::Paste },
+    { "insertfile", ClientCommand::InsertFile },
+    { "key", ClientCommand::Key },
+    { "mouse", ClientCommand::Mouse },
+    { "partpagerectangles", ClientCommand::PartPageRectangles },
+    { "ping", ClientCommand::Ping },
+    { "renderfont", ClientCommand::RenderFont },
+    { "requestloksession", ClientCommand::RequestLokSession },
+    { "resetselection", ClientCommand::ResetSelection },
+    { "saveas", ClientCommand::SaveAs },
+    { "selectgraphic", ClientCommand::SelectGraphic },
+    { "selecttext", ClientCommand::SelectText },
+    { "setclientpart", ClientCommand::SetClientPart },
+    { "setpage", ClientCommand::SetPage },
+    { "status", ClientCommand::Status },
+    { "tile", ClientCommand::Tile },
+    { "tilecombine", ClientCommand::TileCombine },
+    { "uno", ClientCommand::Uno },
+    { "useractive", ClientCommand::UserActive },
+    { "userinactive", ClientCommand::UserInactive }
+};
+
+}
+
 ClientSession::ClientSession(const std::string& id,
                              const std::shared_ptr<Poco::Net::WebSocket>& ws,
                              const std::shared_ptr<DocumentBroker>& docBroker,
@@ -43,7 +120,11 @@ ClientSession::ClientSession(const std::string& id,
     _docBroker(docBroker),
     _uriPublic(uriPublic),
     _isReadOnly(readOnly),
-    _loadPart(-1)
+    _loadPart(-1),
+    _reconnectToken(Util::encodeId(Util::rng::getNext(), 8) +
+                    Util::encodeId(Util::rng::getNext(), 8)),
+    _isResumed(false),
+    _resumeTilesValid(false)
 {
     Log::info("ClientSession ctor [" + getName() + "].");
 }
@@ -77,7 +158,19 @@ bool ClientSession::_handleInput(const char *buffer, int length)
         updateLastActivityTime();
     }
 
-    if (tokens[0] == "loolclient")
+    // An incoming message on a hibernated document transparently
+    // respawns its kit. Almost always a no-op.
+    if (!docBroker->wakeupFromHibernation())
+    {
+        sendTextFrame("error: cmd=" + tokens[0] + " kind=serviceunavailable");
+        return false;
+    }
+
+    const auto commandIt = ClientCommands.find(tokens[0]);
+    const auto command = (commandIt != ClientCommands.end() ? commandIt->second
+                                                            : ClientCommand::Unknown);
+
+    if (command == ClientCommand::LoolClient)
     {
         const auto versionTuple = ParseVersion(tokens[1]);
         if (std::get<0>(versionTuple) != ProtocolMajorVersionNumber ||
@@ -101,7 +194,7 @@ bool ClientSession::_handleInput(const char *buffer, int length)
         return true;
     }
 
-    if (tokens[0] == "load")
+    if (command == ClientCommand::Load)
     {
         if (_docURL != "")
         {
@@ -111,33 +204,7 @@ bool ClientSession::_handleInput(const char *buffer, int length)
 
         return loadDocument(buffer, length, tokens, docBroker);
     }
-    else if (tokens[0] != "canceltiles" &&
-             tokens[0] != "clientzoom" &&
-             tokens[0] != "clientvisiblearea" &&
-             tokens[0] != "commandvalues" &&
-             tokens[0] != "downloadas" &&
-             tokens[0] != "getchildid" &&
-             tokens[0] != "gettextselection" &&
-             tokens[0] != "paste" &&
-             tokens[0] != "insertfile" &&
-             tokens[0] != "key" &&
-             tokens[0] != "mouse" &&
-             tokens[0] != "partpagerectangles" &&
-             tokens[0] != "ping" &&
-             tokens[0] != "renderfont" &&
-             tokens[0] != "requestloksession" &&
-             tokens[0] != "resetselection" &&
-             tokens[0] != "saveas" &&
-             tokens[0] != "selectgraphic" &&
-             tokens[0] != "selecttext" &&
-             tokens[0] != "setclientpart" &&
-             tokens[0] != "setpage" &&
-             tokens[0] != "status" &&
-             tokens[0] != "tile" &&
-             tokens[0] != "tilecombine" &&
-             tokens[0] != "uno" &&
-             tokens[0] != "useractive" &&
-             tokens[0] != "userinactive")
+    else if (command == ClientCommand::Unknown)
     {
         sendTextFrame("error: cmd=" + tokens[0] + " kind=unknown");
         return false;
@@ -147,59 +214,58 @@ bool ClientSession::_handleInput(const char *buffer, int length)
         sendTextFrame("error: cmd=" + tokens[0] + " kind=nodocloaded");
         return false;
     }
-    else if (tokens[0] == "canceltiles")
-    {
-        docBroker->cancelTileRequests(shared_from_this());
-        return true;
-    }
-    else if (tokens[0] == "commandvalues")
-    {
-        return getCommandValues(buffer, length, tokens, docBroker);
-    }
-    else if (tokens[0] == "partpagerectangles")
-    {
-        return getPartPageRectangles(buffer, length, docBroker);
-    }
-    else if (tokens[0] == "ping")
-    {
-        std::string count = std::to_string(docBroker->getRenderedTileCount());
-        sendTextFrame("pong rendercount=" + count);
-        return true;
-    }
-    else if (tokens[0] == "renderfont")
-    {
-        return sendFontRendering(buffer, length, tokens, docBroker);
-    }
-    else if (tokens[0] == "status")
-    {
-        assert(firstLine.size() == static_cast<size_t>(length));
-        return forwardToChild(firstLine, docBroker);
-    }
-    else if (tokens[0] == "tile")
-    {
-        return sendTile(buffer, length, tokens, docBroker);
-    }
-    else if (tokens[0] == "tilecombine")
-    {
-        return sendCombinedTiles(buffer, length, tokens, docBroker);
-    }
-    else
+
+    switch (command)
     {
-        // Allow 'downloadas' for all kinds of views
-        if ( (isReadOnly()) && tokens[0] != "downloadas" &&
-             tokens[0] != "userinactive" && tokens[0] != "useractive")
+        case ClientCommand::CancelTiles:
+            docBroker->cancelTileRequests(shared_from_this());
+            return true;
+        case ClientCommand::CommandValues:
+            return getCommandValues(buffer, length, tokens, docBroker);
+        case ClientCommand::PartPageRectangles:
+            return getPartPageRectangles(buffer, length, docBroker);
+        case ClientCommand::Ping:
         {
-            const std::string dummyFrame = "dummymsg";
-            return forwardToChild(dummyFrame, docBroker);
+            std::string count = std::to_string(docBroker->getRenderedTileCount());
+            sendTextFrame("pong rendercount=" + count);
+            return true;
         }
-        else if (tokens[0] != "requestloksession")
-        {
+        case ClientCommand::RenderFont:
+            return sendFontRendering(buffer, length, tokens, docBroker);
+        case ClientCommand::Status:
+            assert(firstLine.size() == static_cast<size_t>(length));
+            return forwardToChild(firstLine, docBroker);
+        case ClientCommand::Tile:
+            return sendTile(buffer, length, tokens, docBroker);
+        case ClientCommand::TileCombine:
+            return sendCombinedTiles(buffer, length, tokens, docBroker);
+        case ClientCommand::UserActive:
+        case ClientCommand::UserInactive:
+            // Mirror the state wsd-side, so pushes to a hidden tab are
+            // suppressed here as well as in the kit. The client sends
+            // these on page-visibility changes, too, not only from the
+            // inactivity timer.
+            setIsActive(command == ClientCommand::UserActive);
             return forwardToChild(std::string(buffer, length), docBroker);
-        }
-        else
+        default:
         {
-            assert(tokens[0] == "requestloksession");
-            return true;
+            // The rest are handled in the child process.
+            // Allow 'downloadas' for all kinds of views
+            if (isReadOnly() && command != ClientCommand::DownloadAs &&
+                command != ClientCommand::UserInactive &&
+                command != ClientCommand::UserActive)
+            {
+                const std::string dummyFrame = "dummymsg";
+                return forwardToChild(dummyFrame, docBroker);
+            }
+            else if (command != ClientCommand::RequestLokSession)
+            {
+                return forwardToChild(std::string(buffer, length), docBroker);
+            }
+            else
+            {
+                return true;
+            }
         }
     }
 
@@ -222,29 +288,7 @@ bool ClientSession::loadDocument(const char* /*buffer*/, int /*length*/, StringT
         std::string timestamp;
         parseDocOptions(tokens, _loadPart, timestamp);
 
-        std::ostringstream oss;
-        oss << "load";
-        oss << " url=" << docBroker->getPublicUri().toString();
-        oss << " jail=" << docBroker->getJailedUri().toString();
-
-        if (!_userName.empty())
-        {
-            std::string encodedUserName;
-            Poco::URI::encode(_userName, "", encodedUserName);
-            oss << " author=" + encodedUserName;
-        }
-
-        if (_loadPart >= 0)
-            oss << " part=" + std::to_string(_loadPart);
-
-        if (_haveDocPassword)
-            oss << " password=" << _docPassword;
-
-        if (!_docOptions.empty())
-            oss << " options=" << _docOptions;
-
-        const auto loadRequest = oss.str();
-        return forwardToChild(loadRequest, docBroker);
+        return forwardToChild(makeLoadRequest(docBroker), docBroker);
     }
     catch (const Poco::SyntaxException&)
     {
@@ -254,6 +298,32 @@ bool ClientSession::loadDocument(const char* /*buffer*/, int /*length*/, StringT
     return false;
 }
 
+std::string ClientSession::makeLoadRequest(const std::shared_ptr<DocumentBroker>& docBroker) const
+{
+    std::ostringstream oss;
+    oss << "load";
+    oss << " url=" << docBroker->getPublicUri().toString();
+    oss << " jail=" << docBroker->getJailedUri().toString();
+
+    if (!_userName.empty())
+    {
+        std::string encodedUserName;
+        Poco::URI::encode(_userName, "", encodedUserName);
+        oss << " author=" + encodedUserName;
+    }
+
+    if (_loadPart >= 0)
+        oss << " part=" + std::to_string(_loadPart);
+
+    if (_haveDocPassword)
+        oss << " password=" << _docPassword;
+
+    if (!_docOptions.empty())
+        oss << " options=" << _docOptions;
+
+    return oss.str();
+}
+
 bool ClientSession::getCommandValues(const char *buffer, int length, StringTokenizer& tokens,
                                      const std::shared_ptr<DocumentBroker>& docBroker)
 {
@@ -263,6 +333,15 @@ bool ClientSession::getCommandValues(const char *buffer, int length, StringToken
         return sendTextFrame("error: cmd=commandvalues kind=syntax");
     }
 
+    // The font and style lists are shared across documents of the
+    // same type; the process-wide cache answers without a kit
+    // round-trip.
+    const std::string cached = CommandValuesCache::get().lookup(command, docBroker->getDocType());
+    if (cached.size() > 0)
+    {
+        return sendTextFrame(cached);
+    }
+
     const std::string cmdValues = docBroker->tileCache().getTextFile("cmdValues" + command + ".txt");
     if (cmdValues.size() > 0)
     {
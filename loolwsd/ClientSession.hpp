@@ -38,6 +38,27 @@ public:
     bool shutdownPeer(Poco::UInt16 statusCode);
 
     void setUserName(const std::string& userName) { _userName = userName; }
+    const std::string& getUserName() const { return _userName; }
+
+    /// The token this session's client can present to resume its view
+    /// after a dropped connection.
+    const std::string& getReconnectToken() const { return _reconnectToken; }
+
+    /// The token the client presented on connect, if any.
+    void setResumeToken(const std::string& token) { _resumeToken = token; }
+    const std::string& getResumeToken() const { return _resumeToken; }
+
+    /// Mark this session as resumed from a stashed view, instead of
+    /// freshly authenticated against storage. tilesValid says whether
+    /// the client's cached tiles are still current.
+    void setResumed(const bool tilesValid)
+    {
+        _isResumed = true;
+        _resumeTilesValid = tilesValid;
+    }
+
+    bool isResumed() const { return _isResumed; }
+    bool resumeTilesValid() const { return _resumeTilesValid; }
 
     /**
      * Return the URL of the saved-as document when it's ready. If called
@@ -60,6 +81,11 @@ public:
     /// client made the request to us
     const Poco::URI& getPublicUri() const { return _uriPublic; }
 
+    /// Compose the kit 'load' command from the session's document
+    /// options. The jailed URI changes when a hibernated kit is
+    /// respawned, so the command is recomputed, not cached.
+    std::string makeLoadRequest(const std::shared_ptr<DocumentBroker>& docBroker) const;
+
 private:
 
     virtual bool _handleInput(const char *buffer, int length) override;
@@ -102,6 +128,19 @@ private:
     MessageQueue _saveAsQueue;
 
     int _loadPart;
+
+    /// The token under which this session's view is stashed when the
+    /// connection drops.
+    const std::string _reconnectToken;
+
+    /// The token the client presented on connect, if any.
+    std::string _resumeToken;
+
+    /// Whether load() resumed a stashed view.
+    bool _isResumed;
+
+    /// Whether the client's cached tiles survived the gap.
+    bool _resumeTilesValid;
 };
 
 #endif
@@ -0,0 +1,59 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef INCLUDED_COMMANDVALUESCACHE_HPP
+#define INCLUDED_COMMANDVALUESCACHE_HPP
+
+#include <map>
+#include <mutex>
+#include <string>
+
+/// Process-wide cache of commandvalues: responses that don't depend
+/// on the document instance, only on its type: the font and style
+/// lists are identical for every text document on the host. Serving
+/// them from here saves a kit round-trip and hundreds of KB of JSON
+/// per newly attached session.
+class CommandValuesCache
+{
+public:
+
+    static CommandValuesCache& get()
+    {
+        static CommandValuesCache instance;
+        return instance;
+    }
+
+    /// The cached response for the given command and document type,
+    /// or the empty string when not cached yet.
+    std::string lookup(const std::string& command, const std::string& docType)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto it = _cache.find(docType + '|' + command);
+        return (it != _cache.end() ? it->second : std::string());
+    }
+
+    void store(const std::string& command, const std::string& docType, const std::string& response)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cache[docType + '|' + command] = response;
+    }
+
+private:
+    CommandValuesCache()
+    {
+    }
+
+    /// The full commandvalues: messages, keyed by doctype|command.
+    std::map<std::string, std::string> _cache;
+    std::mutex _mutex;
+};
+
+#endif
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
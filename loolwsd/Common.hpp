@@ -32,6 +32,9 @@ constexpr int READ_BUFFER_SIZE = 2048;
 /// the size of larger coming message. All messages up to this
 /// size are considered small messages.
 constexpr int SMALL_MESSAGE_SIZE = READ_BUFFER_SIZE / 2;
+/// Text messages below this size are not worth deflating even
+/// when the peer negotiated websocket compression.
+constexpr int COMPRESS_MESSAGE_SIZE = 256;
 
 constexpr auto JAILED_DOCUMENT_ROOT = "/user/docs/";
 constexpr auto CHILD_URI = "/loolws/child?";
@@ -10,6 +10,7 @@
 #include "DocumentBroker.hpp"
 #include "config.h"
 
+#include <algorithm>
 #include <cassert>
 #include <fstream>
 
@@ -17,6 +18,7 @@
 #include <Poco/SHA1Engine.h>
 #include <Poco/StringTokenizer.h>
 
+#include "Admin.hpp"
 #include "ClientSession.hpp"
 #include "Exceptions.hpp"
 #include "LOOLProtocol.hpp"
@@ -31,31 +33,78 @@ using namespace LOOLProtocol;
 
 using Poco::StringTokenizer;
 
-void ChildProcess::socketProcessor()
+namespace
 {
-    IoUtil::SocketProcessor(_ws,
-        [this](const std::vector<char>& payload)
-        {
-            if (UnitWSD::get().filterChildMessage(payload))
-            {
-                return true;
-            }
 
-            auto docBroker = this->_docBroker.lock();
-            if (docBroker)
-            {
-                return docBroker->handleInput(payload);
-            }
+/// The shared servicer of the child-process websockets, started on
+/// first use when socket_reactor is enabled in the configuration.
+IoUtil::SocketReactor& childSocketReactor()
+{
+    static IoUtil::SocketReactor reactor("child_ws_reactor");
+    return reactor;
+}
 
-            Log::warn() << "Child " << this->_pid << " has no DocumentBroker to handle message: ["
-                        << LOOLProtocol::getAbbreviatedMessage(payload) << "]." << Log::end;
-            return true;
-        },
+}
+
+void ChildProcess::startSocketProcessor()
+{
+    if (LOOLWSD::UseSocketReactor)
+    {
+        childSocketReactor().addSocket(_ws,
+            [this](const std::vector<char>& payload) { return handleMessage(payload); },
+            []() { },
+            [this]() { return TerminationFlag || this->_stop; },
+            [this]() { onSocketFinished(); });
+    }
+    else
+    {
+        _thread = std::thread([this]() { this->socketProcessor(); });
+    }
+}
+
+void ChildProcess::stopSocketProcessor()
+{
+    if (_thread.joinable())
+    {
+        _thread.join();
+    }
+    else if (LOOLWSD::UseSocketReactor && _ws)
+    {
+        childSocketReactor().removeSocket(_ws);
+    }
+}
+
+void ChildProcess::socketProcessor()
+{
+    IoUtil::SocketProcessor(_ws,
+        [this](const std::vector<char>& payload) { return handleMessage(payload); },
         []() { },
         [this]() { return TerminationFlag || this->_stop; });
 
-    Log::debug() << "Child [" << getPid() << "] WS terminated. Notifying DocBroker." << Log::end;
+    onSocketFinished();
+}
 
+bool ChildProcess::handleMessage(const std::vector<char>& payload)
+{
+    if (UnitWSD::get().filterChildMessage(payload))
+    {
+        return true;
+    }
+
+    auto docBroker = _docBroker.lock();
+    if (docBroker)
+    {
+        return docBroker->handleInput(payload);
+    }
+
+    Log::warn() << "Child " << _pid << " has no DocumentBroker to handle message: ["
+                << LOOLProtocol::getAbbreviatedMessage(payload) << "]." << Log::end;
+    return true;
+}
+
+void ChildProcess::onSocketFinished()
+{
+    Log::debug() << "Child [" << getPid() << "] WS terminated. Notifying DocBroker." << Log::end;
 
     // Notify the broker that we're done.
     auto docBroker = _docBroker.lock();
@@ -81,6 +130,9 @@ std::string getCachePath(const std::string& uri)
 
 }
 
+std::atomic<unsigned> DocumentBroker::RenderShareMsPerSec(0);
+std::atomic<unsigned> DocumentBroker::ActiveCount(0);
+
 Poco::URI DocumentBroker::sanitizeURI(const std::string& uri)
 {
     // The URI of the document should be url-encoded.
@@ -117,7 +169,9 @@ DocumentBroker::DocumentBroker() :
     _cacheRoot(),
     _childProcess(),
     _lastSaveTime(std::chrono::steady_clock::now()),
+    _inReconnectGrace(false),
     _markToDestroy(true),
+    _hibernated(false),
     _lastEditableSession(true),
     _isLoaded(false),
     _isModified(false),
@@ -127,9 +181,16 @@ DocumentBroker::DocumentBroker() :
     _cursorHeight(0),
     _mutex(),
     _saveMutex(),
+    _saveInProgress(false),
+    _saveRepeat(false),
     _tileVersion(0),
-    _debugRenderedTileCount(0)
+    _invalidationCount(0),
+    _debugRenderedTileCount(0),
+    _renderWindowStart(std::chrono::steady_clock::now()),
+    _renderMsInWindow(0),
+    _unreportedMessages(0)
 {
+    ++ActiveCount;
     Log::info("Empty DocumentBroker (marked to destroy) created.");
 }
 
@@ -143,7 +204,9 @@ DocumentBroker::DocumentBroker(const Poco::URI& uriPublic,
     _cacheRoot(getCachePath(uriPublic.toString())),
     _childProcess(childProcess),
     _lastSaveTime(std::chrono::steady_clock::now()),
+    _inReconnectGrace(false),
     _markToDestroy(false),
+    _hibernated(false),
     _lastEditableSession(false),
     _isLoaded(false),
     _isModified(false),
@@ -153,15 +216,31 @@ DocumentBroker::DocumentBroker(const Poco::URI& uriPublic,
     _cursorHeight(0),
     _mutex(),
     _saveMutex(),
+    _saveInProgress(false),
+    _saveRepeat(false),
     _tileVersion(0),
-    _debugRenderedTileCount(0)
+    _invalidationCount(0),
+    _debugRenderedTileCount(0),
+    _renderWindowStart(std::chrono::steady_clock::now()),
+    _renderMsInWindow(0),
+    _unreportedMessages(0)
 {
+    ++ActiveCount;
+
     assert(!_docKey.empty());
     assert(!_childRoot.empty());
 
     Log::info("DocumentBroker [" + _uriPublic.toString() + "] created. DocKey: [" + _docKey + "]");
 }
 
+void DocumentBroker::takeStorage(std::unique_ptr<StorageBase> storage,
+                                 const StorageBase::FileInfo& fileInfo)
+{
+    assert(storage);
+    _storage = std::move(storage);
+    _preAuthFileInfo.reset(new StorageBase::FileInfo(fileInfo));
+}
+
 bool DocumentBroker::load(const std::string& sessionId, const std::string& jailId)
 {
     if (_markToDestroy)
@@ -202,12 +281,45 @@ bool DocumentBroker::load(const std::string& sessionId, const std::string& jailI
         Log::debug("Creating new storage instance for URI [" + uriPublic.toString() + "].");
         _storage = StorageBase::create(uriPublic, jailRoot, jailPath.toString());
     }
+    else if (_preAuthFileInfo)
+    {
+        // The admission pipeline authenticated this storage before
+        // the jail existed; teach it the jail paths now.
+        _storage->setJailPaths(jailRoot, jailPath.toString());
+    }
 
     if (_storage)
     {
+        // A session resuming with a valid reconnect token inherits the
+        // authentication of its previous incarnation; restore the
+        // stashed view state and skip the storage round-trip.
+        const auto& resumeToken = it->second->getResumeToken();
+        if (!resumeToken.empty() && _storage->isLoaded())
+        {
+            const auto saved = _reconnectViews.find(resumeToken);
+            if (saved != _reconnectViews.end() && std::time(nullptr) < saved->second.validUntil)
+            {
+                Log::info("Resuming session [" + sessionId + "] from its reconnect token.");
+                it->second->setUserName(saved->second.userName);
+                if (saved->second.readOnly)
+                {
+                    it->second->setReadOnly();
+                }
+
+                it->second->setResumed(saved->second.invalidationCount == _invalidationCount);
+                _reconnectViews.erase(saved);
+                return true;
+            }
+        }
+
         // Set the username for the session
         // TODO: security: Set the permission (readonly etc.) of the session here also
-        const auto fileInfo = _storage->getFileInfo(uriPublic);
+        // The admission pipeline authenticates with the URI of the
+        // session it goes on to add, so the pre-fetched file info
+        // is valid for the first session here.
+        const auto fileInfo = _preAuthFileInfo ? *_preAuthFileInfo
+                                               : _storage->getFileInfo(uriPublic);
+        _preAuthFileInfo.reset();
         if (!fileInfo.isValid())
         {
             Log::error("Invalid fileinfo for URI [" + uriPublic.toString() + "].");
@@ -234,7 +346,17 @@ bool DocumentBroker::load(const std::string& sessionId, const std::string& jailI
 
         // Use the local temp file's timestamp.
         _lastFileModifiedTime = Poco::File(_storage->getLocalRootPath()).getLastModified();
-        _tileCache.reset(new TileCache(_uriPublic.toString(), _lastFileModifiedTime, _cacheRoot));
+        if (!_tileCache)
+        {
+            _tileCache.reset(new TileCache(_uriPublic.toString(), _lastFileModifiedTime, _cacheRoot));
+        }
+        else
+        {
+            // Reloading after hibernation; we saved before releasing
+            // the kit, so the content is unchanged and the warm cache
+            // stays valid. Only refresh the recorded timestamp.
+            _tileCache->saveLastModified(_lastFileModifiedTime);
+        }
 
         return true;
     }
@@ -281,20 +403,65 @@ bool DocumentBroker::save(const std::string& sessionId, bool success, const std:
     Log::debug("Saving to URI [" + uri + "].");
 
     assert(_storage && _tileCache);
-    if (_storage->saveLocalFileToStorage(uriPublic))
-    {
-        _isModified = false;
-        _tileCache->setUnsavedChanges(false);
-        _lastFileModifiedTime = newFileModifiedTime;
-        _tileCache->saveLastModified(_lastFileModifiedTime);
-        _lastSaveTime = std::chrono::steady_clock::now();
-        Log::debug("Saved to URI [" + uri + "] and updated tile cache.");
-        _saveCV.notify_all();
+
+    // Upload in the background, so this thread is immediately free
+    // to process edits while the save is in flight. The completion
+    // updates the timestamps and signals _saveCV.
+    _saveRepeat = true;
+    if (_saveInProgress)
+    {
+        // The running upload will notice the flag and re-upload.
+        Log::debug("Upload to URI [" + uri + "] already in progress. Coalescing.");
         return true;
     }
 
-    Log::error("Failed to save to URI [" + uri + "].");
-    return false;
+    if (_saveThread.joinable())
+    {
+        // The previous upload has completed; reap the thread.
+        _saveThread.join();
+    }
+
+    _saveInProgress = true;
+    _saveThread = std::thread([this, uriPublic]() { saveToStorage(uriPublic); });
+    return true;
+}
+
+void DocumentBroker::saveToStorage(const Poco::URI& uriPublic)
+{
+    Util::setThreadName("docbroker_save");
+
+    const auto uri = uriPublic.toString();
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_saveMutex);
+            if (!_saveRepeat)
+            {
+                _saveInProgress = false;
+                return;
+            }
+
+            _saveRepeat = false;
+        }
+
+        const auto newFileModifiedTime = Poco::File(_storage->getLocalRootPath()).getLastModified();
+        if (_storage->saveLocalFileToStorage(uriPublic))
+        {
+            std::unique_lock<std::mutex> lock(_saveMutex);
+            _isModified = false;
+            _tileCache->setUnsavedChanges(false);
+            _lastFileModifiedTime = newFileModifiedTime;
+            _tileCache->saveLastModified(_lastFileModifiedTime);
+            _lastSaveTime = std::chrono::steady_clock::now();
+            Log::debug("Saved to URI [" + uri + "] and updated tile cache.");
+            _saveCV.notify_all();
+        }
+        else
+        {
+            Log::error("Failed to save to URI [" + uri + "].");
+            alertAllUsersOfDocument("internal", "diskfull");
+        }
+    }
 }
 
 bool DocumentBroker::autoSave(const bool force, const size_t waitTimeoutMs)
@@ -404,6 +571,240 @@ bool DocumentBroker::sendUnoSave(const bool dontSaveIfUnmodified)
     return false;
 }
 
+bool DocumentBroker::hibernateIfIdle()
+{
+    if (LOOLWSD::IdleHibernateSecs == 0 || _hibernated)
+    {
+        return false;
+    }
+
+    std::shared_ptr<ChildProcess> child;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_sessions.empty() || !_isLoaded || _markToDestroy ||
+            !_childProcess || !_childProcess->isAlive())
+        {
+            return false;
+        }
+
+        // Find the most recent activity across the sessions.
+        double inactivityTimeMs = std::numeric_limits<double>::max();
+        for (auto& sessionIt : _sessions)
+        {
+            inactivityTimeMs = std::min(sessionIt.second->getInactivityMS(), inactivityTimeMs);
+        }
+
+        if (inactivityTimeMs < LOOLWSD::IdleHibernateSecs * 1000.)
+        {
+            return false;
+        }
+
+        if (_isModified)
+        {
+            // The autosave sweep is already persisting idle documents;
+            // we hibernate on a later pass, once the document is clean.
+            Log::trace("Doc [" + _docKey + "] is idle but modified; not hibernating yet.");
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> saveLock(_saveMutex);
+            if (_saveInProgress)
+            {
+                // The upload reads from the jail; keep the kit around.
+                return false;
+            }
+        }
+
+        Log::info() << "Hibernating doc [" << _docKey << "]: releasing kit ["
+                    << _childProcess->getPid() << "] after "
+                    << (inactivityTimeMs / 1000.) << " seconds of inactivity." << Log::end;
+
+        // Mark first, so childSocketTerminated() leaves the sessions alone.
+        _hibernated = true;
+        child = _childProcess;
+    }
+
+    // Close unlocked; the child's socket thread takes _mutex to
+    // process messages and close() joins it.
+    child->close(false);
+    return true;
+}
+
+bool DocumentBroker::wakeupFromHibernation()
+{
+    if (!_hibernated)
+    {
+        return true;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (!_hibernated)
+    {
+        // Another session won the race and woke the document up.
+        return true;
+    }
+
+    Log::info("Waking up hibernated doc [" + _docKey + "].");
+
+    auto child = LOOLWSD::getNewChild();
+    if (!child)
+    {
+        Log::error("Failed to get a child process to wake up doc [" + _docKey + "].");
+        return false;
+    }
+
+    child->setDocumentBroker(shared_from_this());
+    _childProcess = child;
+
+    // The new kit has a new jail and thus a new tile ring;
+    // re-attach on its first notification.
+    _tileRing.reset();
+
+    // The local copy went away with the old jail; recreate the
+    // storage against the new jail and re-fetch the document.
+    if (_saveThread.joinable())
+    {
+        _saveThread.join();
+    }
+
+    _storage.reset();
+    _hibernated = false;
+
+    // Re-register every session with the new kit and reload.
+    const auto jailId = std::to_string(_childProcess->getPid());
+    for (auto& sessionIt : _sessions)
+    {
+        const auto& id = sessionIt.first;
+        _childProcess->sendTextFrame("session " + id + " " + _docKey + "\n");
+        if (load(id, jailId))
+        {
+            forwardToChild(id, sessionIt.second->makeLoadRequest(shared_from_this()));
+        }
+        else
+        {
+            Log::error("Failed to reload doc [" + _docKey + "] for session [" + id + "].");
+        }
+    }
+
+    return true;
+}
+
+bool DocumentBroker::migrate(const std::string& serverName)
+{
+    Util::assertIsNotLocked(_mutex);
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    if (!_isLoaded || _markToDestroy || _sessions.empty())
+    {
+        return false;
+    }
+
+    if (_isModified)
+    {
+        // The autosave sweep persists idle documents; hand this one
+        // over on a later attempt, once it is clean.
+        Log::debug("Doc [" + _docKey + "] is modified; not migrating.");
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> saveLock(_saveMutex);
+        if (_saveInProgress)
+        {
+            return false;
+        }
+    }
+
+    Log::info("Migrating doc [" + _docKey + "] to [" + serverName + "].");
+
+    // Redirect the clients to the new host. Their reconnect loads
+    // the document there without a visible reload; the session
+    // teardown here takes the broker and kit down the usual way.
+    const auto redirect = "migrate: server=" + serverName;
+    for (auto& sessionIt : _sessions)
+    {
+        sessionIt.second->sendTextFrame(redirect);
+        sessionIt.second->shutdown(Poco::Net::WebSocket::WS_ENDPOINT_GOING_AWAY);
+    }
+
+    return true;
+}
+
+void DocumentBroker::stashViewForReconnect(const std::shared_ptr<ClientSession>& session)
+{
+    if (LOOLWSD::ReconnectGraceSecs == 0 || !_isLoaded)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    SavedView view;
+    view.userName = session->getUserName();
+    view.readOnly = session->isReadOnly();
+    view.invalidationCount = _invalidationCount;
+    view.validUntil = std::time(nullptr) + LOOLWSD::ReconnectGraceSecs;
+    _reconnectViews[session->getReconnectToken()] = view;
+
+    Log::debug("Stashed view of session [" + session->getId() + "] for reconnect.");
+}
+
+bool DocumentBroker::keepAliveForReconnect()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const auto now = std::time(nullptr);
+    for (auto it = _reconnectViews.begin(); it != _reconnectViews.end(); )
+    {
+        if (now >= it->second.validUntil)
+        {
+            it = _reconnectViews.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    if (_reconnectViews.empty())
+    {
+        return false;
+    }
+
+    // The usual teardown marked us for destruction; a resuming client
+    // must not be made to wait for the unload.
+    _markToDestroy = false;
+    _inReconnectGrace = true;
+    return true;
+}
+
+bool DocumentBroker::isReconnectGraceExpired()
+{
+    if (!_inReconnectGrace)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (!_sessions.empty())
+    {
+        return false;
+    }
+
+    const auto now = std::time(nullptr);
+    for (const auto& it : _reconnectViews)
+    {
+        if (now < it.second.validUntil)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 std::string DocumentBroker::getJailRoot() const
 {
     assert(!_jailId.empty());
@@ -412,6 +813,9 @@ std::string DocumentBroker::getJailRoot() const
 
 size_t DocumentBroker::addSession(std::shared_ptr<ClientSession>& session)
 {
+    // A new view on a hibernated document needs the kit back first.
+    wakeupFromHibernation();
+
     const auto id = session->getId();
     const std::string aMessage = "session " + id + " " + _docKey + "\n";
 
@@ -438,6 +842,7 @@ size_t DocumentBroker::addSession(std::shared_ptr<ClientSession>& session)
         // document). It is safe to reset their values to their defaults whenever a new session is added.
         _lastEditableSession = false;
         _markToDestroy = false;
+        _inReconnectGrace = false;
 
         bool loaded = load(id, std::to_string(_childProcess->getPid()));
         if (!loaded)
@@ -489,6 +894,18 @@ size_t DocumentBroker::removeSession(const std::string& id)
     auto it = _sessions.find(id);
     if (it != _sessions.end())
     {
+        // Drop the session's pending tile renders; with its last
+        // subscriber gone the kit would paint them for nobody.
+        if (_tileCache)
+        {
+            const auto canceltiles = _tileCache->cancelTiles(it->second);
+            if (!canceltiles.empty())
+            {
+                Log::debug() << "Forwarding canceltiles on disconnect: " << canceltiles << Log::end;
+                _childProcess->sendTextFrame(canceltiles);
+            }
+        }
+
         _sessions.erase(it);
 
         // Let the child know the client has disconnected.
@@ -528,6 +945,10 @@ bool DocumentBroker::handleInput(const std::vector<char>& payload)
     {
        handleTileCombinedResponse(payload);
     }
+    else if (command == "ringtile:")
+    {
+        return handleRingTile();
+    }
     else if (LOOLProtocol::getFirstToken(command, '-') == "client")
     {
         forwardToClient(command, payload);
@@ -556,6 +977,8 @@ void DocumentBroker::invalidateTiles(const std::string& tiles)
 {
     std::unique_lock<std::mutex> lock(_mutex);
 
+    ++_invalidationCount;
+
     // Remove from cache.
     _tileCache->invalidateTiles(tiles);
 }
@@ -569,9 +992,20 @@ void DocumentBroker::handleTileRequest(TileDesc& tile,
     const auto tileMsg = tile.serialize();
     Log::trace() << "Tile request for " << tile.serialize() << Log::end;
 
-    std::unique_ptr<std::fstream> cachedTile = _tileCache->lookupTile(tile);
+    const auto cachedTile = _tileCache->lookupTileData(tile);
     if (cachedTile)
     {
+        const auto hash = _tileCache->ensureTileHash(tile, cachedTile);
+        if (tile.getOldHash() != 0 && tile.getOldHash() == hash)
+        {
+            // The client already has identical content; an empty
+            // delta confirms it without re-sending the payload.
+            const std::string response = tile.serialize("tiledelta:") + '\n';
+            session->sendBinaryFrame(response.data(), response.size());
+            return;
+        }
+
+        tile.setHash(hash);
 #if ENABLE_DEBUG
         const std::string response = tile.serialize("tile:") + " renderid=cached\n";
 #else
@@ -579,18 +1013,10 @@ void DocumentBroker::handleTileRequest(TileDesc& tile,
 #endif
 
         std::vector<char> output;
-        output.reserve(static_cast<size_t>(4) * tile.getWidth() * tile.getHeight());
+        output.reserve(response.size() + cachedTile->size());
         output.resize(response.size());
         std::memcpy(output.data(), response.data(), response.size());
-
-        assert(cachedTile->is_open());
-        cachedTile->seekg(0, std::ios_base::end);
-        const auto pos = output.size();
-        std::streamsize size = cachedTile->tellg();
-        output.resize(pos + size);
-        cachedTile->seekg(0, std::ios_base::beg);
-        cachedTile->read(output.data() + pos, size);
-        cachedTile->close();
+        output.insert(output.end(), cachedTile->begin(), cachedTile->end());
 
         session->sendBinaryFrame(output.data(), output.size());
         return;
@@ -598,10 +1024,20 @@ void DocumentBroker::handleTileRequest(TileDesc& tile,
 
     tileCache().subscribeToTileRendering(tile, session);
 
-    // Forward to child to render.
+    // Hold the request back when this document is over its render
+    // share and another render is in flight to trigger the flush.
+    if (isOverRenderShare() && tileCache().getTilesBeingRenderedCount() > 1)
+    {
+        Log::debug() << "Over render share; deferring tile (" << tile.getPart() << ','
+                     << tile.getTilePosX() << ',' << tile.getTilePosY() << ")." << Log::end;
+        _deferredTiles.push_back(tile);
+        return;
+    }
+
+    // Forward to child to render, as a fixed-layout binary frame.
     Log::debug() << "Sending render request for tile (" << tile.getPart() << ',' << tile.getTilePosX() << ',' << tile.getTilePosY() << ")." << Log::end;
-    const std::string request = "tile " + tile.serialize();
-    _childProcess->sendTextFrame(request);
+    _childProcess->sendBinaryFrame(tile.serializeBinary());
+    ++_unreportedMessages;
     _debugRenderedTileCount++;
 }
 
@@ -616,9 +1052,19 @@ void DocumentBroker::handleTileCombinedRequest(TileCombined& tileCombined,
     std::vector<TileDesc> tiles;
     for (auto& tile : tileCombined.getTiles())
     {
-        std::unique_ptr<std::fstream> cachedTile = _tileCache->lookupTile(tile);
+        const auto cachedTile = _tileCache->lookupTileData(tile);
         if (cachedTile)
         {
+            const auto hash = _tileCache->ensureTileHash(tile, cachedTile);
+            if (tile.getOldHash() != 0 && tile.getOldHash() == hash)
+            {
+                // Identical content; confirm without the payload.
+                const std::string response = tile.serialize("tiledelta:") + '\n';
+                session->sendBinaryFrame(response.data(), response.size());
+                continue;
+            }
+
+            tile.setHash(hash);
             //TODO: Combine the response to reduce latency.
 #if ENABLE_DEBUG
             const std::string response = tile.serialize("tile:") + " renderid=cached\n";
@@ -627,18 +1073,10 @@ void DocumentBroker::handleTileCombinedRequest(TileCombined& tileCombined,
 #endif
 
             std::vector<char> output;
-            output.reserve(static_cast<size_t>(4) * tile.getWidth() * tile.getHeight());
+            output.reserve(response.size() + cachedTile->size());
             output.resize(response.size());
             std::memcpy(output.data(), response.data(), response.size());
-
-            assert(cachedTile->is_open());
-            cachedTile->seekg(0, std::ios_base::end);
-            const auto pos = output.size();
-            std::streamsize size = cachedTile->tellg();
-            output.resize(pos + size);
-            cachedTile->seekg(0, std::ios_base::beg);
-            cachedTile->read(output.data() + pos, size);
-            cachedTile->close();
+            output.insert(output.end(), cachedTile->begin(), cachedTile->end());
 
             session->sendBinaryFrame(output.data(), output.size());
         }
@@ -654,13 +1092,20 @@ void DocumentBroker::handleTileCombinedRequest(TileCombined& tileCombined,
 
     if (!tiles.empty())
     {
+        if (isOverRenderShare() && tileCache().getTilesBeingRenderedCount() > tiles.size())
+        {
+            Log::debug() << "Over render share; deferring " << tiles.size() << " tiles." << Log::end;
+            _deferredTiles.insert(_deferredTiles.end(), tiles.begin(), tiles.end());
+            return;
+        }
+
         auto newTileCombined = TileCombined::create(tiles);
         newTileCombined.setVersion(++_tileVersion);
 
-        // Forward to child to render.
-        const auto req = newTileCombined.serialize("tilecombine");
-        Log::debug() << "Sending residual tilecombine: " << req << Log::end;
-        _childProcess->sendTextFrame(req);
+        // Forward to child to render, as a fixed-layout binary frame.
+        Log::debug() << "Sending residual tilecombine of " << tiles.size() << " tiles." << Log::end;
+        _childProcess->sendBinaryFrame(newTileCombined.serializeBinary());
+        ++_unreportedMessages;
     }
 }
 
@@ -676,6 +1121,29 @@ void DocumentBroker::cancelTileRequests(const std::shared_ptr<ClientSession>& se
     }
 }
 
+bool DocumentBroker::handleRingTile()
+{
+    if (!_tileRing)
+    {
+        const auto path = getJailRoot() + TILERING_PATH_IN_JAIL;
+        _tileRing = TileRing::open(path);
+        if (!_tileRing)
+        {
+            Log::error("Cannot attach to the tile ring of [" + _docKey + "].");
+            return false;
+        }
+    }
+
+    std::vector<char> payload;
+    if (!_tileRing->read(payload))
+    {
+        Log::error("Tile ring notification without a record for [" + _docKey + "].");
+        return false;
+    }
+
+    return handleInput(payload);
+}
+
 void DocumentBroker::handleTileResponse(const std::vector<char>& payload)
 {
     const std::string firstLine = getFirstLine(payload);
@@ -685,11 +1153,37 @@ void DocumentBroker::handleTileResponse(const std::vector<char>& payload)
         const auto buffer = payload.data();
         const auto length = payload.size();
 
+        // The kit appends a band delta to the full tile when only a
+        // horizontal stripe changed since the last render.
+        int deltaYStart = -1;
+        int deltaSize = -1;
+        StringTokenizer tokens(firstLine, " ", StringTokenizer::TOK_IGNORE_EMPTY | StringTokenizer::TOK_TRIM);
+        for (size_t i = 0; i < tokens.count(); ++i)
+        {
+            getTokenInteger(tokens[i], "ystart", deltaYStart);
+            getTokenInteger(tokens[i], "deltasize", deltaSize);
+        }
+
         if (firstLine.size() < static_cast<std::string::size_type>(length) - 1)
         {
-            tileCache().saveTileAndNotify(
-                tile, buffer + firstLine.size() + 1,
-                length - firstLine.size() - 1);
+            const auto data = buffer + firstLine.size() + 1;
+            const auto size = length - firstLine.size() - 1;
+
+            // Read before notifying, which forgets the render.
+            const auto renderMs = tileCache().getTileRoundTripMs(tile);
+
+            if (deltaYStart >= 0 && deltaSize >= 0 && tile.getImgSize() > 0 &&
+                static_cast<size_t>(tile.getImgSize()) + deltaSize == size)
+            {
+                tileCache().saveTileAndNotify(tile, data, tile.getImgSize(),
+                                              deltaYStart, data + tile.getImgSize(), deltaSize);
+            }
+            else
+            {
+                tileCache().saveTileAndNotify(tile, data, size);
+            }
+
+            accountRenderedTiles(1, size, renderMs);
         }
         else
         {
@@ -720,11 +1214,18 @@ void DocumentBroker::handleTileCombinedResponse(const std::vector<char>& payload
 
         if (firstLine.size() < static_cast<std::string::size_type>(length) - 1)
         {
+            double renderMs = 0;
             for (const auto& tile : tileCombined.getTiles())
             {
+                renderMs = std::max(renderMs, tileCache().getTileRoundTripMs(tile));
                 tileCache().saveTileAndNotify(tile, buffer + offset, tile.getImgSize());
                 offset += tile.getImgSize();
             }
+
+            // The combined request rendered as one; charge its
+            // round-trip once, not per sub-tile.
+            accountRenderedTiles(tileCombined.getTiles().size(), offset - firstLine.size() - 1,
+                                 renderMs);
         }
         else
         {
@@ -744,6 +1245,68 @@ void DocumentBroker::handleTileCombinedResponse(const std::vector<char>& payload
     }
 }
 
+void DocumentBroker::accountRenderedTiles(const unsigned tiles, const size_t bytes,
+                                          const double renderMs)
+{
+    unsigned messages;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now - _renderWindowStart >= std::chrono::seconds(1))
+        {
+            _renderWindowStart = now;
+            _renderMsInWindow = 0;
+        }
+
+        _renderMsInWindow += renderMs;
+
+        messages = _unreportedMessages;
+        _unreportedMessages = 0;
+
+        flushDeferredTiles();
+        messages += _unreportedMessages;
+        _unreportedMessages = 0;
+    }
+
+    Admin::instance().updateDocumentStats(_docKey, tiles, bytes,
+                                          static_cast<unsigned long>(renderMs), messages);
+}
+
+bool DocumentBroker::isOverRenderShare()
+{
+    const unsigned shareMs = RenderShareMsPerSec;
+    const unsigned active = ActiveCount;
+    if (shareMs == 0 || active <= 1)
+    {
+        return false;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now - _renderWindowStart >= std::chrono::seconds(1))
+    {
+        _renderWindowStart = now;
+        _renderMsInWindow = 0;
+    }
+
+    // Every active document gets an equal slice of the budget.
+    return _renderMsInWindow >= (shareMs / active);
+}
+
+void DocumentBroker::flushDeferredTiles()
+{
+    while (!_deferredTiles.empty() && !isOverRenderShare())
+    {
+        const auto tile = _deferredTiles.front();
+        _deferredTiles.pop_front();
+
+        Log::debug() << "Dispatching deferred tile (" << tile.getPart() << ','
+                     << tile.getTilePosX() << ',' << tile.getTilePosY() << ")." << Log::end;
+        _childProcess->sendBinaryFrame(tile.serializeBinary());
+        ++_unreportedMessages;
+    }
+}
+
 bool DocumentBroker::startDestroy(const std::string& id)
 {
     std::unique_lock<std::mutex> lock(_mutex);
@@ -774,6 +1337,12 @@ bool DocumentBroker::startDestroy(const std::string& id)
 
 void DocumentBroker::setModified(const bool value)
 {
+    if (value && !_isModified)
+    {
+        // Arm a deadline so the main loop need not poll us.
+        LOOLWSD::scheduleAutoSave(_docKey);
+    }
+
     _tileCache->setUnsavedChanges(value);
     _isModified = value;
 }
@@ -798,6 +1367,26 @@ bool DocumentBroker::forwardToChild(const std::string& viewId, const std::string
     return false;
 }
 
+bool DocumentBroker::broadcastToClients(const std::string& message)
+{
+    Util::assertIsNotLocked(_mutex);
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // The message is built a single time and every send shares its
+    // buffer; only sessions in close handshake are skipped.
+    bool sent = true;
+    for (auto& it : _sessions)
+    {
+        const auto& session = it.second;
+        if (!session->isCloseFrame())
+        {
+            sent = session->sendTextFrame(message) && sent;
+        }
+    }
+
+    return sent;
+}
+
 bool DocumentBroker::forwardToClient(const std::string& prefix, const std::vector<char>& payload)
 {
     std::string message(payload.data() + prefix.size(), payload.size() - prefix.size());
@@ -808,6 +1397,13 @@ bool DocumentBroker::forwardToClient(const std::string& prefix, const std::vecto
     std::string sid;
     if (LOOLProtocol::parseNameValuePair(prefix, name, sid, '-') && name == "client")
     {
+        if (sid == "all")
+        {
+            // The child addressed all sessions at once; fan out here
+            // rather than re-sending the message per session.
+            return broadcastToClients(message);
+        }
+
         const auto it = _sessions.find(sid);
         if (it != _sessions.end())
         {
@@ -846,6 +1442,13 @@ const std::chrono::duration<double> DocumentBroker::getStorageLoadDuration() con
 
 void DocumentBroker::childSocketTerminated()
 {
+    if (_hibernated)
+    {
+        // The kit was released on purpose; the sessions stay up.
+        Log::debug("Child for doc [" + _docKey + "] released by hibernation.");
+        return;
+    }
+
     if (!_childProcess->isAlive())
     {
         Log::error("Child for doc [" + _docKey + "] terminated prematurely.");
@@ -15,6 +15,8 @@
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <ctime>
+#include <deque>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -28,6 +30,7 @@
 #include "Log.hpp"
 #include "Storage.hpp"
 #include "TileCache.hpp"
+#include "TileRing.hpp"
 #include "Util.hpp"
 
 // Forwards.
@@ -45,7 +48,7 @@ public:
         _ws(ws),
         _stop(false)
     {
-        _thread = std::thread([this]() { this->socketProcessor(); });
+        startSocketProcessor();
         Log::info("ChildProcess ctor [" + std::to_string(_pid) + "].");
     }
 
@@ -74,10 +77,7 @@ public:
         {
             _stop = true;
             IoUtil::shutdownWebSocket(_ws);
-            if (_thread.joinable())
-            {
-                _thread.join();
-            }
+            stopSocketProcessor();
 
             _ws.reset();
             if (_pid != -1)
@@ -102,6 +102,13 @@ public:
     /// Send a text payload to the child-process WS.
     bool sendTextFrame(const std::string& data)
     {
+        if (!_ws)
+        {
+            // Closed (e.g. hibernated); there is no kit to talk to.
+            Log::debug() << "Dropping data [" << data << "] for closed child [" << _pid << "]." << Log::end;
+            return false;
+        }
+
         try
         {
             _ws->sendFrame(data.data(), data.size());
@@ -117,6 +124,32 @@ public:
         return false;
     }
 
+    /// Send a binary payload to the child-process WS; used for the
+    /// fixed-layout tile frames of the hot path.
+    bool sendBinaryFrame(const std::vector<char>& data)
+    {
+        if (!_ws)
+        {
+            // Closed (e.g. hibernated); there is no kit to talk to.
+            Log::debug() << "Dropping a binary frame for closed child [" << _pid << "]." << Log::end;
+            return false;
+        }
+
+        try
+        {
+            _ws->sendFrame(data.data(), data.size(), Poco::Net::WebSocket::FRAME_BINARY);
+            return true;
+        }
+        catch (const std::exception& exc)
+        {
+            Log::error() << "Failed to send child [" << _pid << "] a binary frame due to: "
+                         << exc.what() << Log::end;
+            throw;
+        }
+
+        return false;
+    }
+
     /// Check whether this child is alive and able to respond.
     bool isAlive() const
     {
@@ -137,8 +170,21 @@ public:
     }
 
 private:
+    /// Start servicing the child WS, either on a dedicated thread or
+    /// on the shared reactor, depending on the configuration.
+    void startSocketProcessor();
+
+    /// Stop servicing the child WS, waiting until done.
+    void stopSocketProcessor();
+
     void socketProcessor();
 
+    /// Dispatch a message from the child WS.
+    bool handleMessage(const std::vector<char>& payload);
+
+    /// Called once the child WS is done, to notify the DocumentBroker.
+    void onSocketFinished();
+
 private:
     Poco::Process::PID _pid;
     std::shared_ptr<Poco::Net::WebSocket> _ws;
@@ -165,6 +211,14 @@ public:
     static
     std::string getDocKey(const Poco::URI& uri);
 
+    /// Set the fair-share render budget, in render milliseconds per
+    /// second, split equally between the active documents. 0 leaves
+    /// dispatch unthrottled. Called at startup from the config.
+    static void setRenderShareMsPerSec(const unsigned ms) { RenderShareMsPerSec = ms; }
+
+    /// The number of live DocumentBrokers on this host.
+    static unsigned getActiveCount() { return ActiveCount; }
+
     /// Dummy document broker that is marked to destroy.
     DocumentBroker();
 
@@ -175,21 +229,86 @@ public:
 
     ~DocumentBroker()
     {
+        --ActiveCount;
+
         Log::info() << "~DocumentBroker [" << _uriPublic.toString()
                     << "] destroyed with " << getSessionsCount()
                     << " sessions left." << Log::end;
+
+        // Wait out any upload still in flight.
+        if (_saveThread.joinable())
+        {
+            _saveThread.join();
+        }
     }
 
+    /// Take ownership of a storage instance that the admission
+    /// pipeline has already authenticated, together with the file
+    /// info it fetched, so that the first load() does not repeat
+    /// the storage round-trip.
+    void takeStorage(std::unique_ptr<StorageBase> storage,
+                     const StorageBase::FileInfo& fileInfo);
+
     /// Loads a document from the public URI into the jail.
     bool load(const std::string& sessionId, const std::string& jailId);
     bool isLoaded() const { return _isLoaded; }
     void setLoaded() { _isLoaded = true; }
 
+    /// The document type from the status: message (text, spreadsheet,
+    /// presentation, ...); empty until the document has loaded.
+    std::string getDocType() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _docType;
+    }
+
+    void setDocType(const std::string& docType)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _docType = docType;
+    }
+
     /// Save the document to Storage if needs persisting.
     bool save(const std::string& sesionId, bool success, const std::string& result = "");
     bool isModified() const { return _isModified; }
     void setModified(const bool value);
 
+    /// Release the kit process of a document whose sessions have
+    /// all been idle past per_document.idle_hibernate_secs, once
+    /// it is saved and no upload is in flight. The sessions and
+    /// the tile cache stay up. Returns true if hibernated.
+    bool hibernateIfIdle();
+
+    /// Respawn the kit of a hibernated document and reload it,
+    /// re-registering every session. Called on the first incoming
+    /// client message; a no-op when not hibernated. Returns false
+    /// when no child process could be claimed.
+    bool wakeupFromHibernation();
+
+    bool isHibernated() const { return _hibernated; }
+
+    /// Stash the session's authenticated view state under its
+    /// reconnect token, so a client whose connection dropped can
+    /// resume without a fresh storage round-trip. The stash is
+    /// valid for LOOLWSD::ReconnectGraceSecs.
+    void stashViewForReconnect(const std::shared_ptr<ClientSession>& session);
+
+    /// Keep the broker alive for a client holding a reconnect token:
+    /// clears the destroy mark while the grace period lasts. Returns
+    /// false when no unexpired stashed view is waiting.
+    bool keepAliveForReconnect();
+
+    /// True when the broker has no sessions and was kept alive only
+    /// for a reconnect whose grace has now lapsed; the periodic
+    /// sweep destroys such brokers.
+    bool isReconnectGraceExpired();
+
+    /// Hand the document over to another server: redirects every
+    /// session to the named host and lets the usual disconnect
+    /// cleanup tear down the broker and kit. Only clean, loaded
+    /// documents migrate; returns false otherwise.
+    bool migrate(const std::string& serverName);
+
     /// Save the document if the document is modified.
     /// @param force when true, will force saving if there
     /// has been any recent activity after the last save.
@@ -199,6 +318,10 @@ public:
     /// and receives save notification. Otherwise, false.
     bool autoSave(const bool force, const size_t waitTimeoutMs);
 
+    /// Delay, in ms, between a document becoming modified and its
+    /// first autosave check.
+    static unsigned getIdleSaveDelayMs() { return IdleSaveDurationMs; }
+
     Poco::URI getPublicUri() const { return _uriPublic; }
     Poco::URI getJailedUri() const { return _uriJailed; }
     const std::string& getJailId() const { return _jailId; }
@@ -248,6 +371,10 @@ public:
     void handleTileResponse(const std::vector<char>& payload);
     void handleTileCombinedResponse(const std::vector<char>& payload);
 
+    /// Pick up a tile payload announced on the control socket from
+    /// the kit's shared-memory ring.
+    bool handleRingTile();
+
     /// Called before destroying any session.
     /// This method calculates and sets important states of
     /// session being destroyed. Returns true if session id
@@ -273,15 +400,35 @@ public:
 
 private:
 
+    /// Account a completed render and feed the admin counters;
+    /// flushes any deferred tiles the freed budget now covers.
+    void accountRenderedTiles(const unsigned tiles, const size_t bytes, const double renderMs);
+
+    /// True when this document has spent more than its equal slice
+    /// of the render budget within the current one-second window.
+    /// Expects _mutex to be held.
+    bool isOverRenderShare();
+
+    /// Dispatch deferred tiles while the budget allows.
+    /// Expects _mutex to be held.
+    void flushDeferredTiles();
+
     /// Sends the .uno:Save command to LoKit.
     bool sendUnoSave(const bool dontSaveIfUnmodified);
 
-    /// Saves the document to Storage (assuming LO Core saved to local copy).
-    bool saveToStorage();
+    /// Uploads the document to Storage (assuming LO Core saved to
+    /// the local copy) and updates the timestamps on completion.
+    /// Runs on _saveThread; save() coalesces repeated requests
+    /// into the running upload via _saveRepeat.
+    void saveToStorage(const Poco::URI& uriPublic);
 
     /// Forward a message from child session to its respective client session.
     bool forwardToClient(const std::string& prefix, const std::vector<char>& payload);
 
+    /// Relay a message the child addressed to all sessions
+    /// ('client-all') to every attached client, sharing one payload.
+    bool broadcastToClients(const std::string& message);
+
 private:
     const Poco::URI _uriPublic;
     const std::string _docKey;
@@ -294,12 +441,36 @@ private:
     std::chrono::steady_clock::time_point _lastSaveTime;
     Poco::Timestamp _lastFileModifiedTime;
     std::map<std::string, std::shared_ptr<ClientSession>> _sessions;
+
+    /// A disconnected session's authenticated view, waiting for its
+    /// client to resume with the matching token.
+    struct SavedView
+    {
+        std::string userName;
+        bool readOnly;
+        size_t invalidationCount;
+        std::time_t validUntil;
+    };
+
+    /// Stashed views by reconnect token. Guarded by _mutex.
+    std::map<std::string, SavedView> _reconnectViews;
+
+    /// Whether the broker outlived its last session only for a
+    /// possible reconnect.
+    std::atomic<bool> _inReconnectGrace;
     std::unique_ptr<StorageBase> _storage;
+    /// File info fetched by the admission pipeline, consumed
+    /// by the first load() after takeStorage().
+    std::unique_ptr<StorageBase::FileInfo> _preAuthFileInfo;
     std::unique_ptr<TileCache> _tileCache;
     std::atomic<bool> _markToDestroy;
+    /// Whether the kit was released while the sessions are idle.
+    std::atomic<bool> _hibernated;
     std::atomic<bool> _lastEditableSession;
     std::atomic<bool> _isLoaded;
     std::atomic<bool> _isModified;
+    /// The document type from the status: message. Guarded by _mutex.
+    std::string _docType;
     int _cursorPosX;
     int _cursorPosY;
     int _cursorWidth;
@@ -307,15 +478,44 @@ private:
     mutable std::mutex _mutex;
     std::condition_variable _saveCV;
     std::mutex _saveMutex;
+    /// The background storage upload. Joined on destruction.
+    std::thread _saveThread;
+    /// Whether _saveThread is uploading. Guarded by _saveMutex.
+    bool _saveInProgress;
+    /// Request to (re-)upload the document. Guarded by _saveMutex.
+    bool _saveRepeat;
 
     /// Versioning is used to prevent races between
     /// painting and invalidation.
     std::atomic<size_t> _tileVersion;
 
+    /// Invalidations seen so far; comparing against the count at
+    /// stash time tells whether a resuming client's cached tiles
+    /// are still current.
+    std::atomic<size_t> _invalidationCount;
+
     int _debugRenderedTileCount;
 
+    /// Tiles held back by the fair-share throttle. Guarded by _mutex.
+    std::deque<TileDesc> _deferredTiles;
+
+    /// Shared-memory transport for tile payloads from the kit.
+    /// Attached lazily on the first ring notification.
+    std::unique_ptr<TileRing> _tileRing;
+    /// Start of the current render accounting window.
+    std::chrono::steady_clock::time_point _renderWindowStart;
+    /// Render ms spent in the current window. Guarded by _mutex.
+    double _renderMsInWindow;
+    /// Messages sent to the child since the last admin report.
+    unsigned _unreportedMessages;
+
     static constexpr auto IdleSaveDurationMs = 30 * 1000;
     static constexpr auto AutoSaveDurationMs = 300 * 1000;
+
+    /// Render budget each second, shared between the active
+    /// documents; 0 means unthrottled.
+    static std::atomic<unsigned> RenderShareMsPerSec;
+    static std::atomic<unsigned> ActiveCount;
 };
 
 #endif
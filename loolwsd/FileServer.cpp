@@ -9,11 +9,20 @@
 
 #include "config.h"
 
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
 #include <vector>
 
+#include <Poco/DeflatingStream.h>
+#include <Poco/DigestEngine.h>
 #include <Poco/Exception.h>
+#include <Poco/File.h>
 #include <Poco/FileStream.h>
+#include <Poco/SHA1Engine.h>
+#include <Poco/Timestamp.h>
 #include <Poco/Net/HTTPCookie.h>
 #include <Poco/Net/HTTPBasicCredentials.h>
 #include <Poco/Net/HTMLForm.h>
@@ -59,6 +68,88 @@ using Poco::Net::HTTPBasicCredentials;
 using Poco::StreamCopier;
 using Poco::Util::Application;
 
+namespace
+{
+
+/// One static loleaflet file, ready for serving: the raw bytes, a
+/// gzip-compressed variant and a strong content ETag. Rebuilt when the
+/// file on disk changes.
+struct CachedAsset
+{
+    std::string mimeType;
+    std::string etag;
+    std::string content;
+    std::string gzipped;
+    Poco::Timestamp lastModified;
+};
+
+std::mutex AssetCacheMutex;
+std::map<std::string, std::shared_ptr<CachedAsset>> AssetCache;
+
+/// Only text-based types are worth deflating; images and fonts
+/// are compressed formats already.
+bool isCompressible(const std::string& mimeType)
+{
+    return mimeType == "application/javascript" ||
+           mimeType == "text/css" ||
+           mimeType == "text/html" ||
+           mimeType == "image/svg+xml";
+}
+
+/// Return the cached entry for a file, (re)reading and compressing
+/// it when missing or stale. Throws FileNotFoundException when the
+/// file has gone away.
+std::shared_ptr<const CachedAsset> getCachedAsset(const std::string& filepath, const std::string& mimeType)
+{
+    const auto lastModified = Poco::File(filepath).getLastModified();
+
+    std::unique_lock<std::mutex> lock(AssetCacheMutex);
+    const auto it = AssetCache.find(filepath);
+    if (it != AssetCache.end() && it->second->lastModified == lastModified)
+    {
+        return it->second;
+    }
+
+    lock.unlock();
+
+    auto asset = std::make_shared<CachedAsset>();
+    asset->mimeType = mimeType;
+    asset->lastModified = lastModified;
+
+    FileInputStream file(filepath);
+    StreamCopier::copyToString(file, asset->content);
+    file.close();
+
+    Poco::SHA1Engine sha1;
+    sha1.update(asset->content);
+    asset->etag = '"' + Poco::DigestEngine::digestToHex(sha1.digest()) + '"';
+
+    if (isCompressible(mimeType))
+    {
+        std::ostringstream oss;
+        Poco::DeflatingOutputStream deflater(oss, Poco::DeflatingStreamBuf::STREAM_GZIP);
+        deflater.write(asset->content.data(), asset->content.size());
+        deflater.close();
+        asset->gzipped = oss.str();
+
+        // Keep the variant only when it actually helps.
+        if (asset->gzipped.size() >= asset->content.size())
+        {
+            asset->gzipped.clear();
+        }
+    }
+
+    Log::debug() << "Cached asset [" << filepath << "]: " << asset->content.size()
+                 << " bytes, gzipped " << asset->gzipped.size()
+                 << ", etag " << asset->etag << Log::end;
+
+    lock.lock();
+    AssetCache[filepath] = asset;
+    return asset;
+}
+
+}
+
 bool FileServerRequestHandler::isAdminLoggedIn(HTTPServerRequest& request, HTTPServerResponse& response)
 {
     const auto& config = Application::instance().config();
@@ -172,8 +263,29 @@ void FileServerRequestHandler::handleRequest(HTTPServerRequest& request, HTTPSer
             else
                 mimeType = "text/plain";
 
+            const auto asset = getCachedAsset(filepath, mimeType);
+
+            response.set("ETag", asset->etag);
+            if (request.get("If-None-Match", "") == asset->etag)
+            {
+                // The client has this very content already.
+                response.setStatusAndReason(HTTPResponse::HTTP_NOT_MODIFIED);
+                response.setContentLength(0);
+                response.send();
+                return;
+            }
+
+            const bool gzip = !asset->gzipped.empty() &&
+                              request.get("Accept-Encoding", "").find("gzip") != std::string::npos;
+            if (gzip)
+            {
+                response.set("Content-Encoding", "gzip");
+            }
+
+            const std::string& body = gzip ? asset->gzipped : asset->content;
             response.setContentType(mimeType);
-            response.sendFile(filepath, mimeType);
+            response.setChunkedTransferEncoding(false);
+            response.sendBuffer(body.data(), body.size());
         }
     }
     catch (const Poco::Net::NotAuthenticatedException& exc)
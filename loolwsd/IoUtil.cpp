@@ -11,8 +11,11 @@
 #include "config.h"
 
 #include <sys/poll.h>
+#include <sys/uio.h>
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
 #include <iomanip>
@@ -31,6 +34,7 @@
 #include "LOOLProtocol.hpp"
 #include "Log.hpp"
 #include "Util.hpp"
+#include "WebSocketDeflate.hpp"
 
 using Poco::Net::Socket;
 using Poco::Net::WebSocket;
@@ -38,6 +42,44 @@ using Poco::Net::WebSocket;
 namespace IoUtil
 {
 
+namespace
+{
+    /// The recycled receive buffers. A buffer grown past the cap by an
+    /// unusually large message is dropped rather than kept hot.
+    constexpr size_t MaxPooledReceiveBuffers = 8;
+    constexpr size_t MaxPooledReceiveBufferBytes = 4 * 1024 * 1024;
+
+    std::mutex ReceiveBufferMutex;
+    std::vector<std::vector<char>> ReceiveBuffers;
+}
+
+std::vector<char> acquireReceiveBuffer(const size_t capacity)
+{
+    std::vector<char> buffer;
+    {
+        std::unique_lock<std::mutex> lock(ReceiveBufferMutex);
+        if (!ReceiveBuffers.empty())
+        {
+            buffer = std::move(ReceiveBuffers.back());
+            ReceiveBuffers.pop_back();
+        }
+    }
+
+    buffer.reserve(capacity);
+    buffer.resize(0);
+    return buffer;
+}
+
+void releaseReceiveBuffer(std::vector<char>&& buffer)
+{
+    std::unique_lock<std::mutex> lock(ReceiveBufferMutex);
+    if (ReceiveBuffers.size() < MaxPooledReceiveBuffers &&
+        buffer.capacity() <= MaxPooledReceiveBufferBytes)
+    {
+        ReceiveBuffers.emplace_back(std::move(buffer));
+    }
+}
+
 int receiveFrame(WebSocket& socket, void* buffer, int length, int& flags)
 {
     while (!TerminationFlag)
@@ -60,17 +102,186 @@ int receiveFrame(WebSocket& socket, void* buffer, int length, int& flags)
     return -1;
 }
 
+int sendFrameFragments(WebSocket& socket,
+                       const std::vector<Fragment>& fragments,
+                       const bool binary)
+{
+    // Cap the wire-frame size to what SocketProcessor's continuation
+    // buffer can take back in a single receiveFrame.
+    constexpr size_t maxFrameSize = READ_BUFFER_SIZE * 10;
+
+    const int opcode = (binary ? WebSocket::FRAME_OP_BINARY : WebSocket::FRAME_OP_TEXT);
+
+    size_t frameCount = 0;
+    for (const auto& fragment : fragments)
+    {
+        frameCount += (fragment.second + maxFrameSize - 1) / maxFrameSize;
+    }
+
+    if (frameCount == 0)
+    {
+        return socket.sendFrame(nullptr, 0, WebSocket::FRAME_FLAG_FIN | opcode);
+    }
+
+    int sent = 0;
+    size_t frame = 0;
+    for (const auto& fragment : fragments)
+    {
+        for (size_t offset = 0; offset < fragment.second; offset += maxFrameSize)
+        {
+            const size_t length = std::min(maxFrameSize, fragment.second - offset);
+            int flags = (frame == 0 ? opcode : WebSocket::FRAME_OP_CONT);
+            if (frame == frameCount - 1)
+            {
+                flags |= WebSocket::FRAME_FLAG_FIN;
+            }
+
+            sent += socket.sendFrame(fragment.first + offset, length, flags);
+            ++frame;
+        }
+    }
+
+    return sent;
+}
+
+namespace
+{
+
+/// Read one complete message from the socket and hand it to the
+/// handler. The socket must be readable. Returns false when the
+/// connection closed or the handler flagged to finish; the caller
+/// stops servicing the socket then.
+bool readAndDispatchMessage(WebSocket& ws,
+                            std::vector<char>& payload,
+                            int& n, int& flags,
+                            const std::function<bool(const std::vector<char>&)>& handler,
+                            const std::function<void()>& closeFrame,
+                            WebSocketInflater* inflater = nullptr)
+{
+    // One WS message split into multiple frames; append the
+    // continuation frames to the payload until the final one.
+    const auto readMessageFrames = [&ws, &closeFrame, &payload, &n, &flags]()
+    {
+        while (true)
+        {
+            char buffer[READ_BUFFER_SIZE * 10];
+            n = ws.receiveFrame(buffer, sizeof(buffer), flags);
+            if (n <= 0 || (flags & WebSocket::FRAME_OP_BITMASK) == WebSocket::FRAME_OP_CLOSE)
+            {
+                closeFrame();
+                Log::warn("Connection closed while reading multiframe message.");
+                break;
+            }
+
+            payload.insert(payload.end(), buffer, buffer + n);
+            if ((flags & WebSocket::FrameFlags::FRAME_FLAG_FIN) == WebSocket::FrameFlags::FRAME_FLAG_FIN)
+            {
+                // No more frames.
+                break;
+            }
+        }
+    };
+
+    payload.resize(payload.capacity());
+    try
+    {
+        n = receiveFrame(ws, payload.data(), payload.capacity(), flags);
+    }
+    catch (const Poco::TimeoutException&)
+    {
+        Log::debug("SocketProcessor: Spurious TimeoutException, ignored");
+        payload.resize(0);
+        return true;
+    }
+    payload.resize(n > 0 ? n : 0);
+
+    if (n <= 0 || ((flags & WebSocket::FRAME_OP_BITMASK) == WebSocket::FRAME_OP_CLOSE))
+    {
+        closeFrame();
+        Log::warn("Connection closed.");
+        return false;
+    }
+
+    assert(n > 0);
+
+    bool compressed = (inflater && (flags & WebSocket::FRAME_FLAG_RSV1) != 0);
+    if ((flags & WebSocket::FrameFlags::FRAME_FLAG_FIN) != WebSocket::FrameFlags::FRAME_FLAG_FIN)
+    {
+        readMessageFrames();
+    }
+
+    if (compressed && n > 0)
+    {
+        inflater->inflate(payload);
+    }
+
+    if ((flags & WebSocket::FrameFlags::FRAME_FLAG_FIN) == WebSocket::FrameFlags::FRAME_FLAG_FIN)
+    {
+        int size = 0;
+        const std::string firstLine = LOOLProtocol::getFirstLine(payload);
+        Poco::StringTokenizer tokens(firstLine, " ", Poco::StringTokenizer::TOK_IGNORE_EMPTY | Poco::StringTokenizer::TOK_TRIM);
+        if (tokens.count() == 2 &&
+            tokens[0] == "nextmessage:" && LOOLProtocol::getTokenInteger(tokens[1], "size", size) && size > 0)
+        {
+            // Check if it is a "nextmessage:" and in that case read the large
+            // follow-up message separately, and handle that only.
+            payload.resize(size);
+
+            n = ws.receiveFrame(payload.data(), size, flags);
+            compressed = (inflater && (flags & WebSocket::FRAME_FLAG_RSV1) != 0);
+            if (n > 0 && (flags & WebSocket::FrameFlags::FRAME_FLAG_FIN) != WebSocket::FrameFlags::FRAME_FLAG_FIN)
+            {
+                // The follow-up message can itself arrive in fragments.
+                payload.resize(n);
+                readMessageFrames();
+            }
+            else if (compressed)
+            {
+                payload.resize(n > 0 ? n : 0);
+            }
+
+            if (compressed && n > 0)
+            {
+                inflater->inflate(payload);
+            }
+        }
+    }
+
+    if (n <= 0 || (flags & WebSocket::FRAME_OP_BITMASK) == WebSocket::FRAME_OP_CLOSE)
+    {
+        closeFrame();
+        Log::warn("Connection closed.");
+        return false;
+    }
+
+    // Call the handler.
+    const auto success = handler(payload);
+    payload.resize(0);
+
+    if (!success)
+    {
+        Log::info("Socket handler flagged to finish.");
+        return false;
+    }
+
+    return true;
+}
+
+}
+
 // Synchronously process WebSocket requests and dispatch to handler.
 // Handler returns false to end.
 void SocketProcessor(const std::shared_ptr<WebSocket>& ws,
                      const std::function<bool(const std::vector<char>&)>& handler,
                      const std::function<void()>& closeFrame,
-                     const std::function<bool()>& stopPredicate)
+                     const std::function<bool()>& stopPredicate,
+                     const std::shared_ptr<WebSocketInflater>& inflater)
 {
     Log::info("SocketProcessor starting.");
 
     // Timeout given is in microseconds.
     static const Poco::Timespan waitTime(POLL_TIMEOUT_MS * 1000);
+    auto payload = acquireReceiveBuffer(READ_BUFFER_SIZE * 100);
     try
     {
         ws->setReceiveTimeout(0);
@@ -78,8 +289,6 @@ void SocketProcessor(const std::shared_ptr<WebSocket>& ws,
         int flags = 0;
         int n = 0;
         bool stop = false;
-        std::vector<char> payload(READ_BUFFER_SIZE * 100);
-        payload.resize(0);
 
         for (;;)
         {
@@ -97,102 +306,243 @@ void SocketProcessor(const std::shared_ptr<WebSocket>& ws,
                 continue;
             }
 
-            payload.resize(payload.capacity());
-            try
-            {
-                n = receiveFrame(*ws, payload.data(), payload.capacity(), flags);
-            }
-            catch (const Poco::TimeoutException&)
+            if (!readAndDispatchMessage(*ws, payload, n, flags, handler, closeFrame,
+                                        inflater.get()))
             {
-                Log::debug("SocketProcessor: Spurious TimeoutException, ignored");
-                continue;
+                break;
             }
-            payload.resize(n > 0 ? n : 0);
+        }
+
+        Log::info() << "SocketProcessor finishing. stop: " << (stop ? "true" : "false")
+                     << ", n: " << n
+                     << ", payload size: " << payload.size()
+                     << ", flags: " << std::hex << flags << Log::end;
 
-            if (n <= 0 || ((flags & WebSocket::FRAME_OP_BITMASK) == WebSocket::FRAME_OP_CLOSE))
+        if ((flags & WebSocket::FRAME_OP_BITMASK) != WebSocket::FRAME_OP_CLOSE && payload.size() > 1)
+        {
+            std::string msg;
+            Poco::URI::encode(std::string(payload.data(), payload.size()), "", msg);
+            Log::warn("Last message (" + std::to_string(payload.size()) +
+                      " bytes) will not be processed: [" + msg + "].");
+        }
+    }
+    catch (const std::exception& exc)
+    {
+        Log::error("SocketProcessor: exception: " + std::string(exc.what()));
+    }
+
+    releaseReceiveBuffer(std::move(payload));
+
+    Log::info("SocketProcessor finished.");
+}
+
+/// The per-socket state of a SocketReactor.
+struct SocketReactor::SocketEntry
+{
+    std::shared_ptr<WebSocket> Ws;
+    std::function<bool(const std::vector<char>&)> Handler;
+    std::function<void()> CloseFrame;
+    std::function<bool()> StopPredicate;
+    std::function<void()> OnFinish;
+    std::vector<char> Payload;
+    int Flags = 0;
+    int N = 0;
+};
+
+SocketReactor::SocketReactor(const std::string& name) :
+    _name(name),
+    _stop(false)
+{
+    _thread = std::thread([this]() { this->run(); });
+}
+
+SocketReactor::~SocketReactor()
+{
+    stop();
+}
+
+void SocketReactor::addSocket(const std::shared_ptr<WebSocket>& ws,
+                              const std::function<bool(const std::vector<char>&)>& handler,
+                              const std::function<void()>& closeFrame,
+                              const std::function<bool()>& stopPredicate,
+                              const std::function<void()>& onFinish)
+{
+    auto entry = std::make_shared<SocketEntry>();
+    entry->Ws = ws;
+    entry->Handler = handler;
+    entry->CloseFrame = closeFrame;
+    entry->StopPredicate = stopPredicate;
+    entry->OnFinish = onFinish;
+    entry->Payload = acquireReceiveBuffer(READ_BUFFER_SIZE * 100);
+
+    ws->setReceiveTimeout(0);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _sockets.push_back(entry);
+    Log::info() << "SocketReactor [" << _name << "] now services "
+                << _sockets.size() << " sockets." << Log::end;
+}
+
+void SocketReactor::removeSocket(const std::shared_ptr<WebSocket>& ws)
+{
+    std::shared_ptr<SocketEntry> entry;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (auto it = _sockets.begin(); it != _sockets.end(); ++it)
+        {
+            if ((*it)->Ws == ws)
             {
-                closeFrame();
-                Log::warn("Connection closed.");
+                entry = *it;
+                _sockets.erase(it);
                 break;
             }
+        }
+
+        if (entry)
+        {
+            // Wait out any dispatch in flight on this socket.
+            _cv.wait(lock, [this, &entry]() { return _current != entry; });
+        }
+    }
+
+    if (entry)
+    {
+        releaseReceiveBuffer(std::move(entry->Payload));
+        entry->OnFinish();
+    }
+}
+
+void SocketReactor::stop()
+{
+    _stop = true;
+    if (_thread.joinable())
+    {
+        _thread.join();
+    }
+}
+
+void SocketReactor::run()
+{
+    Util::setThreadName(_name);
+    Log::debug("Thread [" + _name + "] started.");
+
+    // Timeout given is in microseconds.
+    static const Poco::Timespan waitTime(POLL_TIMEOUT_MS * 1000);
+
+    std::vector<std::shared_ptr<SocketEntry>> sockets;
+    while (!_stop && !TerminationFlag)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            sockets = _sockets;
+        }
+
+        if (sockets.empty())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(POLL_TIMEOUT_MS));
+            continue;
+        }
+
+        Socket::SocketList readList;
+        Socket::SocketList writeList;
+        Socket::SocketList exceptList;
+        readList.reserve(sockets.size());
+        exceptList.reserve(sockets.size());
+        for (const auto& entry : sockets)
+        {
+            readList.push_back(*entry->Ws);
+            exceptList.push_back(*entry->Ws);
+        }
 
-            assert(n > 0);
+        int ready = 0;
+        try
+        {
+            ready = Socket::select(readList, writeList, exceptList, waitTime);
+        }
+        catch (const Poco::Exception& exc)
+        {
+            Log::error("SocketReactor: select failed: " + exc.displayText());
+            std::this_thread::sleep_for(std::chrono::milliseconds(POLL_TIMEOUT_MS));
+            continue;
+        }
 
-            const std::string firstLine = LOOLProtocol::getFirstLine(payload);
-            if ((flags & WebSocket::FrameFlags::FRAME_FLAG_FIN) != WebSocket::FrameFlags::FRAME_FLAG_FIN)
+        for (size_t i = 0; i < sockets.size() && !_stop && !TerminationFlag; ++i)
+        {
+            auto& entry = sockets[i];
+
+            bool finish = entry->StopPredicate();
+            const bool readable =
+                (ready > 0 &&
+                 (std::find(readList.begin(), readList.end(), *entry->Ws) != readList.end() ||
+                  std::find(exceptList.begin(), exceptList.end(), *entry->Ws) != exceptList.end()));
+            if (!finish && !readable)
             {
-                // One WS message split into multiple frames.
-                while (true)
+                continue;
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (std::find(_sockets.begin(), _sockets.end(), entry) == _sockets.end())
                 {
-                    char buffer[READ_BUFFER_SIZE * 10];
-                    n = ws->receiveFrame(buffer, sizeof(buffer), flags);
-                    if (n <= 0 || (flags & WebSocket::FRAME_OP_BITMASK) == WebSocket::FRAME_OP_CLOSE)
-                    {
-                        closeFrame();
-                        Log::warn("Connection closed while reading multiframe message.");
-                        break;
-                    }
-
-                    payload.insert(payload.end(), buffer, buffer + n);
-                    if ((flags & WebSocket::FrameFlags::FRAME_FLAG_FIN) == WebSocket::FrameFlags::FRAME_FLAG_FIN)
-                    {
-                        // No more frames.
-                        break;
-                    }
+                    // Removed while we were polling.
+                    continue;
                 }
+
+                _current = entry;
             }
-            else
+
+            if (!finish)
             {
-                int size = 0;
-                Poco::StringTokenizer tokens(firstLine, " ", Poco::StringTokenizer::TOK_IGNORE_EMPTY | Poco::StringTokenizer::TOK_TRIM);
-                if (tokens.count() == 2 &&
-                    tokens[0] == "nextmessage:" && LOOLProtocol::getTokenInteger(tokens[1], "size", size) && size > 0)
+                try
                 {
-                    // Check if it is a "nextmessage:" and in that case read the large
-                    // follow-up message separately, and handle that only.
-                    payload.resize(size);
-
-                    n = ws->receiveFrame(payload.data(), size, flags);
+                    finish = !readAndDispatchMessage(*entry->Ws, entry->Payload,
+                                                     entry->N, entry->Flags,
+                                                     entry->Handler, entry->CloseFrame);
+                }
+                catch (const std::exception& exc)
+                {
+                    Log::error("SocketReactor: exception: " + std::string(exc.what()));
+                    finish = true;
                 }
             }
 
-            if (n <= 0 || (flags & WebSocket::FRAME_OP_BITMASK) == WebSocket::FRAME_OP_CLOSE)
+            bool wasPresent = false;
             {
-                closeFrame();
-                Log::warn("Connection closed.");
-                break;
-            }
+                std::unique_lock<std::mutex> lock(_mutex);
+                _current.reset();
 
-            // Call the handler.
-            const auto success = handler(payload);
-            payload.resize(0);
+                const auto it = std::find(_sockets.begin(), _sockets.end(), entry);
+                wasPresent = (it != _sockets.end());
+                if (finish && wasPresent)
+                {
+                    _sockets.erase(it);
+                }
 
-            if (!success)
+                _cv.notify_all();
+            }
+
+            if (finish && wasPresent)
             {
-                Log::info("Socket handler flagged to finish.");
-                break;
+                releaseReceiveBuffer(std::move(entry->Payload));
+                entry->OnFinish();
             }
         }
+    }
 
-        Log::info() << "SocketProcessor finishing. stop: " << (stop ? "true" : "false")
-                     << ", n: " << n
-                     << ", payload size: " << payload.size()
-                     << ", flags: " << std::hex << flags << Log::end;
-
-        if ((flags & WebSocket::FRAME_OP_BITMASK) != WebSocket::FRAME_OP_CLOSE && payload.size() > 1)
-        {
-            std::string msg;
-            Poco::URI::encode(std::string(payload.data(), payload.size()), "", msg);
-            Log::warn("Last message (" + std::to_string(payload.size()) +
-                      " bytes) will not be processed: [" + msg + "].");
-        }
+    // Finish whatever is still registered on shutdown.
+    std::vector<std::shared_ptr<SocketEntry>> remaining;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        remaining.swap(_sockets);
     }
-    catch (const std::exception& exc)
+
+    for (const auto& entry : remaining)
     {
-        Log::error("SocketProcessor: exception: " + std::string(exc.what()));
+        releaseReceiveBuffer(std::move(entry->Payload));
+        entry->OnFinish();
     }
 
-    Log::info("SocketProcessor finished.");
+    Log::debug("Thread [" + _name + "] finished.");
 }
 
 void shutdownWebSocket(const std::shared_ptr<Poco::Net::WebSocket>& ws)
@@ -256,21 +606,98 @@ ssize_t readFromPipe(int pipe, char* buffer, ssize_t size)
     return bytes;
 }
 
-/// Reads a single line from a pipe.
-/// Returns 0 for timeout, <0 for error, and >0 on success.
-/// On success, line will contain the read message.
-int PipeReader::readLine(std::string& line,
-                         const std::function<bool()>& stopPredicate)
+bool PipeReader::readIntoBuffer()
 {
-    const char *endOfLine = static_cast<const char *>(std::memchr(_data.data(), '\n', _data.size()));
-    if (endOfLine != nullptr)
+    const size_t used = _head - _tail;
+    size_t space = PipeBufferSize - used;
+    if (space == 0)
+    {
+        // A line larger than the whole buffer; nothing sane to do
+        // with a fragment we can never complete.
+        Log::error("Pipe " + _name + " buffer full without a newline; discarding.");
+        _tail = _head;
+        space = PipeBufferSize;
+    }
+
+    // The free space as up to two segments, wrapping at the end.
+    const size_t pos = _head % PipeBufferSize;
+    const size_t first = (space < PipeBufferSize - pos ? space : PipeBufferSize - pos);
+    struct iovec iov[2];
+    iov[0].iov_base = _buffer + pos;
+    iov[0].iov_len = first;
+    iov[1].iov_base = _buffer;
+    iov[1].iov_len = space - first;
+
+    ssize_t bytes;
+    do
+    {
+        bytes = readv(_pipe, iov, space > first ? 2 : 1);
+    }
+    while (bytes < 0 && errno == EINTR);
+
+    Log::trace() << "readv for pipe: " << _name << " returned: " << bytes << Log::end;
+    if (bytes < 0)
     {
-        // We have a line cached, return it.
-        line += std::string(_data.data(), endOfLine);
-        _data.erase(0, endOfLine - _data.data() + 1); // Including the '\n'.
-        Log::trace() << "Read existing line from pipe: " << _name << ", line: ["
-                     << line << "], data: [" << Util::formatLinesForLog(_data) << "]." << Log::end;
-        return 1;
+        return false;
+    }
+
+    _head += bytes;
+    return true;
+}
+
+int PipeReader::dispatchLines(const std::function<void(const std::string&)>& lineHandler)
+{
+    int count = 0;
+    while (_tail != _head)
+    {
+        // Scan for the newline in place, in up to two segments.
+        const size_t pos = _tail % PipeBufferSize;
+        const size_t used = _head - _tail;
+        const size_t first = (used < PipeBufferSize - pos ? used : PipeBufferSize - pos);
+        const char* endOfLine = static_cast<const char*>(std::memchr(_buffer + pos, '\n', first));
+        size_t lineSize;
+        if (endOfLine != nullptr)
+        {
+            lineSize = endOfLine - (_buffer + pos);
+        }
+        else if (used > first)
+        {
+            endOfLine = static_cast<const char*>(std::memchr(_buffer, '\n', used - first));
+            if (endOfLine == nullptr)
+            {
+                break;
+            }
+
+            lineSize = first + (endOfLine - _buffer);
+        }
+        else
+        {
+            break;
+        }
+
+        std::string line;
+        line.reserve(lineSize);
+        const size_t firstPart = (lineSize < first ? lineSize : first);
+        line.append(_buffer + pos, firstPart);
+        line.append(_buffer, lineSize - firstPart);
+        _tail += lineSize + 1; // Including the '\n'.
+
+        Log::trace() << "Read line from pipe: " << _name << ", line: [" << line << "]." << Log::end;
+        lineHandler(line);
+        ++count;
+    }
+
+    return count;
+}
+
+int PipeReader::processOnce(const std::function<void(const std::string&)>& lineHandler,
+                            const std::function<bool()>& stopPredicate)
+{
+    // Lines can be buffered from the previous read.
+    int lines = dispatchLines(lineHandler);
+    if (lines > 0)
+    {
+        return lines;
     }
 
     // Poll in short intervals to check for stop condition.
@@ -301,32 +728,18 @@ int PipeReader::readLine(std::string& line,
         }
         else if (pipe.revents & (POLLIN | POLLPRI))
         {
-            char buffer[READ_BUFFER_SIZE];
-            const auto bytes = readFromPipe(_pipe, buffer, sizeof(buffer));
-            Log::trace() << "readFromPipe for pipe: " << _name << " returned: " << bytes << Log::end;
-            if (bytes < 0)
+            if (!readIntoBuffer())
             {
                 return -1;
             }
 
-            endOfLine = static_cast<const char *>(std::memchr(buffer, '\n', bytes));
-            if (endOfLine != nullptr)
+            lines = dispatchLines(lineHandler);
+            if (lines > 0)
             {
-                // Got end of line.
-                line = _data;
-                const auto tail = std::string(static_cast<const char*>(buffer), endOfLine);
-                line += tail;
-                _data = std::string(endOfLine + 1, bytes - tail.size() - 1); // Exclude the '\n'.
-                Log::trace() << "Read line from pipe: " << _name << ", line: [" << line
-                             << "], data: [" << Util::formatLinesForLog(_data) << "]." << Log::end;
-                return 1;
-            }
-            else
-            {
-                // More data, keep going.
-                _data += std::string(buffer, bytes);
-                Log::trace() << "data appended to pipe: " << _name << ", data: " << _data << Log::end;
+                return lines;
             }
+
+            // Only a partial line yet; keep reading.
         }
         else if (pipe.revents & (POLLERR | POLLHUP | POLLNVAL))
         {
@@ -10,15 +10,23 @@
 #ifndef INCLUDED_IOUTIL_HPP
 #define INCLUDED_IOUTIL_HPP
 
+#include <atomic>
+#include <condition_variable>
 #include <functional>
 #include <string>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include <sys/poll.h>
 
 #include <Poco/Net/WebSocket.h>
 #include <Poco/Logger.h>
 
+class WebSocketInflater;
+
 namespace IoUtil
 {
     // Wrapper for WebSocket::receiveFrame() that handles PING frames (by replying with a
@@ -26,16 +34,81 @@ namespace IoUtil
     // Should we also factor out the handling of non-final and continuation frames into this?
     int receiveFrame(Poco::Net::WebSocket& socket, void* buffer, int length, int& flags);
 
+    /// A fragment of an outgoing message: pointer and size.
+    typedef std::pair<const char*, size_t> Fragment;
+
+    /// Send a single WebSocket message assembled from multiple fragments
+    /// (e.g. a header and a payload), without copying them into one
+    /// contiguous buffer. The fragments become continuation frames on the
+    /// wire; the receiving side re-assembles them into one message.
+    /// Returns the number of bytes sent.
+    int sendFrameFragments(Poco::Net::WebSocket& socket,
+                           const std::vector<Fragment>& fragments,
+                           const bool binary = true);
+
     /// Synchronously process WebSocket requests and dispatch to handler.
-    /// Handler returns false to end.
+    /// Handler returns false to end. The inflater, when given, decompresses
+    /// incoming permessage-deflate messages before dispatching them.
     void SocketProcessor(const std::shared_ptr<Poco::Net::WebSocket>& ws,
                          const std::function<bool(const std::vector<char>&)>& handler,
                          const std::function<void()>& closeFrame,
-                         const std::function<bool()>& stopPredicate);
+                         const std::function<bool()>& stopPredicate,
+                         const std::shared_ptr<WebSocketInflater>& inflater = nullptr);
 
     /// Call WebSocket::shutdown() ignoring Poco::IOException.
     void shutdownWebSocket(const std::shared_ptr<Poco::Net::WebSocket>& ws);
 
+    /// Services a set of WebSockets from a single thread using poll(2),
+    /// as an alternative to dedicating a thread to each socket.
+    class SocketReactor
+    {
+    public:
+        SocketReactor(const std::string& name);
+        ~SocketReactor();
+
+        SocketReactor(const SocketReactor&) = delete;
+        SocketReactor& operator=(const SocketReactor&) = delete;
+
+        /// Register a WebSocket for servicing. The handler, closeFrame
+        /// and stopPredicate callbacks follow SocketProcessor's
+        /// semantics; onFinish runs exactly once when the socket is
+        /// done (closed, stopped, or handler flagged to finish).
+        void addSocket(const std::shared_ptr<Poco::Net::WebSocket>& ws,
+                       const std::function<bool(const std::vector<char>&)>& handler,
+                       const std::function<void()>& closeFrame,
+                       const std::function<bool()>& stopPredicate,
+                       const std::function<void()>& onFinish);
+
+        /// Deregister a WebSocket and run its onFinish (if not run
+        /// already), waiting out any in-flight dispatch so that no
+        /// callback outlives this call.
+        void removeSocket(const std::shared_ptr<Poco::Net::WebSocket>& ws);
+
+        /// Stop the reactor thread, finishing all registered sockets.
+        void stop();
+
+    private:
+        void run();
+
+        struct SocketEntry;
+
+        const std::string _name;
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        std::vector<std::shared_ptr<SocketEntry>> _sockets;
+        std::shared_ptr<SocketEntry> _current;
+        std::atomic<bool> _stop;
+        std::thread _thread;
+    };
+
+    /// Take a receive buffer from the pool (or allocate one) with at
+    /// least the given capacity, empty and ready to append to.
+    std::vector<char> acquireReceiveBuffer(const size_t capacity);
+
+    /// Return a receive buffer to the pool for reuse, so the
+    /// steady-state receive path does no heap allocation.
+    void releaseReceiveBuffer(std::vector<char>&& buffer);
+
     ssize_t writeToPipe(int pipe, const char* buffer, ssize_t size);
     inline
     ssize_t writeToPipe(int pipe, const std::string& message)
@@ -46,27 +119,47 @@ namespace IoUtil
     ssize_t readFromPipe(int pipe, char* buffer, ssize_t size);
 
     /// Helper class to handle reading from a pipe.
+    /// Reads newline-delimited messages from a pipe into a fixed
+    /// ring buffer, scanning for lines in place; the consumed data
+    /// is never shifted, only the tail index advances.
     class PipeReader
     {
     public:
         PipeReader(const std::string& name, const int pipe) :
             _name(name),
-            _pipe(pipe)
+            _pipe(pipe),
+            _head(0),
+            _tail(0)
         {
         }
 
         const std::string& getName() const { return _name; }
 
-        /// Reads a single line from the pipe.
-        /// Returns 0 for timeout, <0 for error, and >0 on success.
-        /// On success, line will contain the read message.
-        int readLine(std::string& line,
-                     const std::function<bool()>& stopPredicate);
+        /// Polls the pipe and hands every complete buffered line
+        /// to the handler in one batch.
+        /// Returns 0 for timeout, <0 for error, and the number of
+        /// lines dispatched on success.
+        int processOnce(const std::function<void(const std::string&)>& lineHandler,
+                        const std::function<bool()>& stopPredicate);
 
     private:
+        /// Read whatever the pipe has into the free buffer space.
+        bool readIntoBuffer();
+
+        /// Dispatch the complete lines in the buffer, returning
+        /// their number; a trailing partial line stays buffered.
+        int dispatchLines(const std::function<void(const std::string&)>& lineHandler);
+
+    private:
+        static const size_t PipeBufferSize = 16 * 1024;
+
         const std::string _name;
         const int _pipe;
-        std::string _data;
+        char _buffer[PipeBufferSize];
+        /// Monotonic positions; the buffer index is position
+        /// modulo PipeBufferSize.
+        size_t _head;
+        size_t _tail;
     };
 }
 
@@ -116,10 +116,11 @@ namespace LOKitHelper
         return std::to_string(nType);
     }
 
+    /// The header fields of the document status. Cheap, but the
+    /// current part and the view id differ per view.
     inline
-    std::string documentStatus(LibreOfficeKitDocument *loKitDocument)
+    std::string documentStatusHeader(LibreOfficeKitDocument *loKitDocument)
     {
-        char* ptrValue;
         assert(loKitDocument && "null loKitDocument");
         const auto type = static_cast<LibreOfficeKitDocumentType>(loKitDocument->pClass->getDocumentType(loKitDocument));
 
@@ -135,8 +136,23 @@ namespace LOKitHelper
             << " height=" << height
             << " viewid=" << loKitDocument->pClass->getView(loKitDocument);
 
+        return oss.str();
+    }
+
+    /// The per-part names (and hashes, for presentations) block of
+    /// the document status: one LOK call per part, identical for
+    /// every view. Empty for document types without parts.
+    inline
+    std::string documentPartsListing(LibreOfficeKitDocument *loKitDocument)
+    {
+        char* ptrValue;
+        assert(loKitDocument && "null loKitDocument");
+        const auto type = static_cast<LibreOfficeKitDocumentType>(loKitDocument->pClass->getDocumentType(loKitDocument));
+
+        std::ostringstream oss;
         if (type == LOK_DOCTYPE_SPREADSHEET || type == LOK_DOCTYPE_PRESENTATION)
         {
+            const auto parts = loKitDocument->pClass->getParts(loKitDocument);
             for (auto i = 0; i < parts; ++i)
             {
                 oss << "\n";
@@ -159,6 +175,12 @@ namespace LOKitHelper
 
         return oss.str();
     }
+
+    inline
+    std::string documentStatus(LibreOfficeKitDocument *loKitDocument)
+    {
+        return documentStatusHeader(loKitDocument) + documentPartsListing(loKitDocument);
+    }
 };
 
 #endif
@@ -67,14 +67,9 @@ public:
     /// Polls WSD commands and handles them.
     bool pollAndDispatch()
     {
-        std::string message;
-        const auto ready = readLine(message, [](){ return TerminationFlag.load(); });
-        if (ready == 0)
-        {
-            // Timeout.
-            return true;
-        }
-        else if (ready < 0)
+        const auto ready = processOnce([](const std::string& message) { handleInput(message); },
+                                       []() { return TerminationFlag.load(); });
+        if (ready < 0)
         {
             // Termination is done via SIGINT, which breaks the wait.
             if (!TerminationFlag)
@@ -85,6 +80,14 @@ public:
             return false;
         }
 
+        // Timeout, or one or more commands handled.
+        return true;
+    }
+
+private:
+    /// Handles a single WSD command.
+    static void handleInput(const std::string& message)
+    {
         Log::info("ForKit command: [" + message + "].");
         StringTokenizer tokens(message, " ", StringTokenizer::TOK_IGNORE_EMPTY | StringTokenizer::TOK_TRIM);
 
@@ -101,8 +104,6 @@ public:
                 Log::warn("Cannot spawn " + tokens[1] + " children as requested.");
             }
         }
-
-        return true;
     }
 };
 
@@ -370,6 +371,10 @@ int main(int argc, char** argv)
     if (!globalPreinit(loTemplate))
         std::_Exit(Application::EXIT_SOFTWARE);
 
+    // Walk the template trees once; the children inherit the cached
+    // listings and can provision their jails without the tree walk.
+    precacheJailFiles(sysTemplate, loTemplate);
+
     Log::info("Preinit stage OK.");
 
     // We must have at least one child, more are created dynamically.
@@ -18,12 +18,18 @@
 #include <unistd.h>
 #include <utime.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <climits>
 #include <condition_variable>
 #include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <memory>
 #include <sstream>
 #include <thread>
@@ -49,6 +55,7 @@
 #include <Poco/URI.h>
 #include <Poco/Util/Application.h>
 
+#include "AdminMetrics.hpp"
 #include "ChildSession.hpp"
 #include "Common.hpp"
 #include "IoUtil.hpp"
@@ -59,7 +66,9 @@
 #include "Log.hpp"
 #include "Png.hpp"
 #include "Rectangle.hpp"
+#include "TileCodec.hpp"
 #include "TileDesc.hpp"
+#include "TileRing.hpp"
 #include "Unit.hpp"
 #include "UserMessages.hpp"
 #include "Util.hpp"
@@ -94,6 +103,11 @@ using namespace LOOLProtocol;
 class Document;
 static std::shared_ptr<Document> document;
 
+// Shared-memory transport for rendered tiles to WSD; control
+// messages stay on the websocket. Null when the ring could not be
+// set up, in which case tiles go over the socket as before.
+static std::unique_ptr<TileRing> tileRing;
+
 namespace
 {
 #ifndef BUILDING_TESTS
@@ -124,6 +138,29 @@ namespace
         }
     }
 
+    /// One entry of a cached template-tree listing.
+    struct JailEntry
+    {
+        std::string RelativePath;
+        bool IsDir;
+        time_t ATime;
+        time_t MTime;
+    };
+
+    /// Cached listings of the immutable template trees, built once in
+    /// the forkit process before the first fork. Every child inherits
+    /// them and can provision its jail without the recursive tree
+    /// walk, which dominates spawn time on large installations.
+    std::map<std::string, std::vector<JailEntry>> jailEntryCache;
+
+    /// The listing being collected, during the caching nftw walk.
+    std::vector<JailEntry>* cacheForLinkOrCopy = nullptr;
+
+    std::string jailEntryCacheKey(const std::string& source, const LinkOrCopyType type)
+    {
+        return source + ":" + std::to_string(type);
+    }
+
     int linkOrCopyFunction(const char *fpath,
                            const struct stat* /*sb*/,
                            int typeflag,
@@ -186,6 +223,80 @@ namespace
         return 0;
     }
 
+    /// Collects the tree listing instead of linking, for the cache.
+    int cacheJailEntriesFunction(const char *fpath,
+                                 const struct stat* sb,
+                                 int typeflag,
+                                 struct FTW* /*ftwbuf*/)
+    {
+        if (strcmp(fpath, sourceForLinkOrCopy.c_str()) == 0)
+            return 0;
+
+        assert(fpath[strlen(sourceForLinkOrCopy.c_str())] == '/');
+        const char *relativeOldPath = fpath + strlen(sourceForLinkOrCopy.c_str()) + 1;
+
+        switch (typeflag)
+        {
+        case FTW_F:
+        case FTW_SLN:
+            cacheForLinkOrCopy->push_back(JailEntry{relativeOldPath, false, 0, 0});
+            break;
+        case FTW_D:
+            if (!shouldCopyDir(relativeOldPath))
+            {
+                Log::trace("skip redundant paths " + std::string(relativeOldPath));
+                return FTW_SKIP_SUBTREE;
+            }
+            cacheForLinkOrCopy->push_back(JailEntry{relativeOldPath, true, sb->st_atime, sb->st_mtime});
+            break;
+        case FTW_DNR:
+            Log::error("Cannot read directory '" + std::string(fpath) + "'");
+            return 1;
+        case FTW_NS:
+            Log::error("nftw: stat failed for '" + std::string(fpath) + "'");
+            return 1;
+        default:
+            Log::fatal("nftw: unexpected type: '" + std::to_string(typeflag));
+            assert(false);
+            break;
+        }
+        return 0;
+    }
+
+    /// Provision a jail from a cached listing: no readdir/stat storm,
+    /// just a link() or mkdir() per entry. nftw visits directories
+    /// before their contents, so parents exist when files arrive.
+    void linkOrCopyFromCache(const std::vector<JailEntry>& entries,
+                             const std::string& source,
+                             const Path& destination)
+    {
+        for (const auto& entry : entries)
+        {
+            Path newPath(destination, Path(entry.RelativePath));
+            if (entry.IsDir)
+            {
+                File(newPath).createDirectories();
+                struct utimbuf ut;
+                ut.actime = entry.ATime;
+                ut.modtime = entry.MTime;
+                if (utime(newPath.toString().c_str(), &ut) == -1)
+                {
+                    Log::syserror("utime(\"" + newPath.toString() + "\") failed.");
+                }
+            }
+            else
+            {
+                const auto oldPath = source + '/' + entry.RelativePath;
+                if (link(oldPath.c_str(), newPath.toString().c_str()) == -1)
+                {
+                    Log::syserror("link(\"" + oldPath + "\",\"" + newPath.toString() +
+                               "\") failed. Exiting.");
+                    std::_Exit(Application::EXIT_SOFTWARE);
+                }
+            }
+        }
+    }
+
     void linkOrCopy(const std::string& source,
                     const Path& destination,
                     LinkOrCopyType type)
@@ -195,10 +306,44 @@ namespace
         if (sourceForLinkOrCopy.back() == '/')
             sourceForLinkOrCopy.pop_back();
         destinationForLinkOrCopy = destination;
+
+        const auto cached = jailEntryCache.find(jailEntryCacheKey(sourceForLinkOrCopy, type));
+        if (cached != jailEntryCache.end())
+        {
+            linkOrCopyFromCache(cached->second, sourceForLinkOrCopy, destination);
+            return;
+        }
+
         if (nftw(source.c_str(), linkOrCopyFunction, 10, FTW_ACTIONRETVAL) == -1)
             Log::error("linkOrCopy: nftw() failed for '" + source + "'");
     }
 
+    /// Walk a template tree once and cache its listing for
+    /// linkOrCopy. Failures just leave the cache empty; linkOrCopy
+    /// then falls back to the full walk.
+    void precacheJailEntries(const std::string& source, const LinkOrCopyType type)
+    {
+        linkOrCopyType = type;
+        sourceForLinkOrCopy = source;
+        if (sourceForLinkOrCopy.back() == '/')
+            sourceForLinkOrCopy.pop_back();
+
+        std::vector<JailEntry> entries;
+        cacheForLinkOrCopy = &entries;
+        const auto result = nftw(sourceForLinkOrCopy.c_str(), cacheJailEntriesFunction, 10, FTW_ACTIONRETVAL);
+        cacheForLinkOrCopy = nullptr;
+
+        if (result == -1)
+        {
+            Log::error("precacheJailEntries: nftw() failed for '" + source + "'");
+            return;
+        }
+
+        Log::info("Cached " + std::to_string(entries.size()) + " jail entries for '" +
+                  sourceForLinkOrCopy + "'.");
+        jailEntryCache[jailEntryCacheKey(sourceForLinkOrCopy, type)] = std::move(entries);
+    }
+
     void dropCapability(cap_value_t capability)
     {
         cap_t caps;
@@ -256,6 +401,281 @@ namespace
 #endif
 }
 
+/// A thread-safe pool of pixmap buffers, so steady-state tile
+/// rendering reuses a few large allocations instead of churning
+/// the heap on every paint.
+class PixmapPool
+{
+public:
+    /// Get a zeroed buffer of the given size, reusing a pooled
+    /// allocation when one is available.
+    std::vector<unsigned char> acquire(const size_t size)
+    {
+        std::vector<unsigned char> buffer;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (!_buffers.empty())
+            {
+                buffer = std::move(_buffers.back());
+                _buffers.pop_back();
+            }
+        }
+
+        buffer.resize(size);
+        std::fill(buffer.begin(), buffer.end(), 0);
+        return buffer;
+    }
+
+    /// Return a buffer to the pool for reuse.
+    void release(std::vector<unsigned char>&& buffer)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_buffers.size() < MaxPooledBuffers)
+        {
+            _buffers.push_back(std::move(buffer));
+        }
+    }
+
+    /// Drop all pooled buffers. Returns the number of bytes freed.
+    size_t trim()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        size_t bytes = 0;
+        for (const auto& buffer : _buffers)
+        {
+            bytes += buffer.capacity();
+        }
+
+        _buffers.clear();
+        return bytes;
+    }
+
+private:
+    /// Enough for the painting and encoding stages of the
+    /// concurrently rendered tile batches.
+    static const size_t MaxPooledBuffers = 8;
+
+    std::mutex _mutex;
+    std::vector<std::vector<unsigned char>> _buffers;
+};
+
+/// A small pool of worker threads for encoding the sub-tiles of
+/// combined batches in parallel. The jobs of one batch are
+/// dispatched together and joined before the batch is assembled,
+/// so the per-tile send order never changes.
+class EncoderPool
+{
+public:
+    EncoderPool() :
+        _jobs(nullptr),
+        _next(0),
+        _done(0),
+        _stop(false)
+    {
+        const auto count = std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+        for (unsigned i = 0; i < count; ++i)
+        {
+            _threads.emplace_back(&EncoderPool::workerThread, this);
+        }
+    }
+
+    ~EncoderPool()
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+
+        _cv.notify_all();
+        for (auto& thread : _threads)
+        {
+            thread.join();
+        }
+    }
+
+    /// Run all jobs, the calling thread working alongside the pool,
+    /// and return when every one has finished.
+    void run(std::vector<std::function<void()>>& jobs)
+    {
+        if (jobs.size() == 1)
+        {
+            jobs[0]();
+            return;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _jobs = &jobs;
+            _next = 0;
+            _done = 0;
+        }
+
+        _cv.notify_all();
+
+        work();
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _doneCV.wait(lock, [this, &jobs] { return _done == jobs.size(); });
+        _jobs = nullptr;
+    }
+
+private:
+    /// Execute batch jobs until none are left unclaimed.
+    void work()
+    {
+        for (;;)
+        {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (_jobs == nullptr || _next >= _jobs->size())
+                {
+                    return;
+                }
+
+                index = _next++;
+            }
+
+            (*_jobs)[index]();
+
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                ++_done;
+            }
+
+            _doneCV.notify_all();
+        }
+    }
+
+    void workerThread()
+    {
+        Util::setThreadName("tile_encoder");
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!_stop)
+        {
+            if (_jobs != nullptr && _next < _jobs->size())
+            {
+                lock.unlock();
+                work();
+                lock.lock();
+            }
+            else
+            {
+                _cv.wait(lock);
+            }
+        }
+    }
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::condition_variable _doneCV;
+
+    /// The batch being encoded. Guarded by _mutex.
+    std::vector<std::function<void()>>* _jobs;
+
+    /// Index of the next unclaimed job. Guarded by _mutex.
+    size_t _next;
+
+    /// Number of finished jobs. Guarded by _mutex.
+    size_t _done;
+
+    /// Tells the workers to exit. Guarded by _mutex.
+    bool _stop;
+
+    std::vector<std::thread> _threads;
+};
+
+/// A bounded pool of workers that encode and send part previews off
+/// the rendering thread. LOK painting is single-threaded and stays
+/// on the rendering thread; what overlaps here is the expensive
+/// long-lived preview encode (e.g. png:6:all) of one part with the
+/// paint of the next, so a deck's slide sorter fills several times
+/// faster. Interactive tiles never enter this pool.
+class PreviewPool
+{
+public:
+    PreviewPool() :
+        _stop(false)
+    {
+        const auto count = std::max(1u, std::min(2u, std::thread::hardware_concurrency() / 2));
+        for (unsigned i = 0; i < count; ++i)
+        {
+            _threads.emplace_back(&PreviewPool::workerThread, this);
+        }
+    }
+
+    ~PreviewPool()
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+
+        _cv.notify_all();
+        for (auto& thread : _threads)
+        {
+            thread.join();
+        }
+    }
+
+    /// Queue an encode-and-send job. Returns false when the pool is
+    /// saturated, bounding the pixmaps held; the caller then runs
+    /// the job inline.
+    bool queue(std::function<void()> job)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_jobs.size() >= MaxQueuedJobs)
+            {
+                return false;
+            }
+
+            _jobs.push_back(std::move(job));
+        }
+
+        _cv.notify_one();
+        return true;
+    }
+
+private:
+    void workerThread()
+    {
+        Util::setThreadName("preview_encoder");
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true)
+        {
+            _cv.wait(lock, [this] { return _stop || !_jobs.empty(); });
+            if (_stop && _jobs.empty())
+            {
+                return;
+            }
+
+            auto job = std::move(_jobs.front());
+            _jobs.erase(_jobs.begin());
+            lock.unlock();
+            job();
+            lock.lock();
+        }
+    }
+
+    /// Each queued job holds one preview pixmap; 8 slides of
+    /// 256x256 RGBA are 2MB.
+    static const size_t MaxQueuedJobs = 8;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+
+    /// Pending jobs, oldest first. Guarded by _mutex.
+    std::vector<std::function<void()>> _jobs;
+
+    /// Tells the workers to exit. Guarded by _mutex.
+    bool _stop;
+
+    std::vector<std::thread> _threads;
+};
+
 /// A document container.
 /// Owns LOKitDocument instance and connections.
 /// Manages the lifetime of a document.
@@ -291,7 +711,9 @@ public:
         _stop(false),
         _mutex(),
         _isLoading(0),
-        _clientViews(0)
+        _clientViews(0),
+        _allPartsEditCount(0),
+        _trimmed(false)
     {
         Log::info("Document ctor for url [" + _url + "] on child [" + _jailId + "].");
         assert(_loKit && _loKit->get());
@@ -304,6 +726,11 @@ public:
         Log::info("~Document dtor for url [" + _url + "] on child [" + _jailId +
                   "]. There are " + std::to_string(_clientViews) + " views.");
 
+        // The kit's histograms are not visible to the admin console,
+        // so leave their summary in the log on the way out.
+        Log::info("Render stats: " + AdminMetrics::get().TileRenderUs.summarize() +
+                  "; queue wait: " + AdminMetrics::get().TileQueueWaitUs.summarize());
+
         // Wait for the callback worker to finish.
         _stop = true;
 
@@ -422,6 +849,44 @@ public:
         return !hasSessions();
     }
 
+    /// Called from the control-socket poll. When every session has
+    /// been idle for a while, queue a memory trim through the tile
+    /// queue, so it runs on the rendering thread that owns the
+    /// caches. Rendering re-arms the trigger.
+    void trimIfIdle()
+    {
+        if (_trimmed)
+        {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex, std::defer_lock);
+        if (!lock.try_lock())
+        {
+            // Not a good time, try later.
+            return;
+        }
+
+        if (_sessions.empty())
+        {
+            return;
+        }
+
+        double inactivityTimeMs = std::numeric_limits<double>::max();
+        for (auto& it : _sessions)
+        {
+            inactivityTimeMs = std::min(it.second->getInactivityMS(), inactivityTimeMs);
+        }
+
+        if (inactivityTimeMs < IdleTrimMS)
+        {
+            return;
+        }
+
+        _trimmed = true;
+        _tileQueue->put("trim");
+    }
+
     /// Set Document password for given URL
     void setDocumentPassword(int nPasswordType)
     {
@@ -451,26 +916,55 @@ public:
         Log::info("setDocumentPassword returned");
     }
 
-    void renderTile(StringTokenizer& tokens, const std::shared_ptr<Poco::Net::WebSocket>& ws)
+    /// The key a tile's previous pixmap is remembered under:
+    /// its position and geometry, without version or image size.
+    static std::string tilePositionKey(const TileDesc& tile)
     {
-        assert(ws && "Expected a non-null websocket.");
-        auto tile = TileDesc::parse(tokens);
+        std::ostringstream oss;
+        oss << tile.getPart() << ':' << tile.getWidth() << 'x' << tile.getHeight() << ':'
+            << tile.getTilePosX() << ',' << tile.getTilePosY() << ':'
+            << tile.getTileWidth() << 'x' << tile.getTileHeight();
+        return oss.str();
+    }
 
-        // Send back the request with all optional parameters given in the request.
-        const auto tileMsg = tile.serialize("tile:");
-#if ENABLE_DEBUG
-        const std::string response = tileMsg + " renderid=" + Util::UniqueId() + "\n";
-#else
-        const std::string response = tileMsg + "\n";
-#endif
+    /// The current edit count of a part. The caller holds
+    /// _partPreviewsMutex.
+    unsigned partEditCount(const int part) const
+    {
+        const auto it = _partEditCounts.find(part);
+        return _allPartsEditCount + (it != _partEditCounts.end() ? it->second : 0);
+    }
 
-        std::vector<char> output;
-        output.reserve(response.size() + (4 * tile.getWidth() * tile.getHeight()));
-        output.resize(response.size());
-        std::memcpy(output.data(), response.data(), response.size());
+    /// Mark the part named in an invalidate-tiles payload as edited,
+    /// so its next preview request paints instead of answering from
+    /// the cache. A payload that names no part dirties all of them.
+    void invalidatePartPreviews(const std::string& payload)
+    {
+        int part = -1;
+        Poco::StringTokenizer tokens(payload, ",", Poco::StringTokenizer::TOK_IGNORE_EMPTY | Poco::StringTokenizer::TOK_TRIM);
+        if (tokens.count() == 2 && tokens[0] == "EMPTY")
+        {
+            part = std::atoi(tokens[1].c_str());
+        }
+        else if (tokens.count() == 5)
+        {
+            part = std::atoi(tokens[4].c_str());
+        }
 
-        std::vector<unsigned char> pixmap;
-        pixmap.resize(output.capacity());
+        std::lock_guard<std::mutex> previewsLock(_partPreviewsMutex);
+        if (part >= 0)
+        {
+            ++_partEditCounts[part];
+        }
+        else
+        {
+            ++_allPartsEditCount;
+        }
+    }
+
+    void renderTile(TileDesc tile, const std::shared_ptr<Poco::Net::WebSocket>& ws)
+    {
+        assert(ws && "Expected a non-null websocket.");
 
         if (!_loKitDocument)
         {
@@ -485,6 +979,49 @@ public:
             return;
         }
 
+        // The last subscriber may have scrolled away while this tile
+        // waited in the queue; don't paint for nobody.
+        if (tile.getId() < 0 && _tileQueue->isCancelled(tile.getVersion()))
+        {
+            Log::debug() << "Skipping cancelled tile ver: " << tile.getVersion() << "." << Log::end;
+            return;
+        }
+
+        // An unedited part paints the same preview; answer from the
+        // last encode and skip the paint. The edit count read here
+        // rides along to validate a fresh encode otherwise.
+        unsigned previewEditCount = 0;
+        if (tile.getId() >= 0)
+        {
+            std::vector<char> cachedPng;
+            {
+                std::lock_guard<std::mutex> previewsLock(_partPreviewsMutex);
+                previewEditCount = partEditCount(tile.getPart());
+                const auto it = _partPreviews.find(tile.getPart());
+                if (it != _partPreviews.end() &&
+                    it->second.EditCount == previewEditCount &&
+                    it->second.PosKey == tilePositionKey(tile))
+                {
+                    cachedPng = it->second.Png;
+                }
+            }
+
+            if (!cachedPng.empty())
+            {
+                Log::debug() << "Serving preview of unedited part " << tile.getPart()
+                             << " from the cache." << Log::end;
+                lock.unlock();
+                sendPreviewResponse(tile, cachedPng, ws);
+                return;
+            }
+        }
+
+        // Rendering; re-arm the idle trim trigger.
+        _trimmed = false;
+
+        const size_t pixmapSize = 4 * tile.getWidth() * tile.getHeight();
+        auto pixmap = _pixmapPool.acquire(pixmapSize);
+
         const double area = tile.getWidth() * tile.getHeight();
         Timestamp timestamp;
         _loKitDocument->paintPartTile(pixmap.data(), tile.getPart(),
@@ -492,12 +1029,100 @@ public:
                                       tile.getTilePosX(), tile.getTilePosY(),
                                       tile.getTileWidth(), tile.getTileHeight());
         const auto elapsed = timestamp.elapsed();
-        Log::trace() << "paintTile at (" << tile.getPart() << ',' << tile.getTilePosX() << ',' << tile.getTilePosY()
-                     << ") " << "ver: " << tile.getVersion() << " rendered in " << (elapsed/1000.)
-                     << " ms (" << area / elapsed << " MP/s)." << Log::end;
+        AdminMetrics::get().TileRenderUs.record(elapsed);
+        if (Log::traceEnabled())
+        {
+            Log::trace() << "paintTile at (" << tile.getPart() << ',' << tile.getTilePosX() << ',' << tile.getTilePosY()
+                         << ") " << "ver: " << tile.getVersion() << " rendered in " << (elapsed/1000.)
+                         << " ms (" << area / elapsed << " MP/s)." << Log::end;
+        }
         const auto mode = static_cast<LibreOfficeKitTileMode>(_loKitDocument->getTileMode());
 
-        if (!png::encodeBufferToPNG(pixmap.data(), tile.getWidth(), tile.getHeight(), output, mode))
+        // Part previews need no delta tracking, and their long-lived
+        // encode is the expensive one; hand it to the preview pool so
+        // this thread can paint the next part - or an interactive
+        // tile - at once. Runs inline when the pool is saturated.
+        if (tile.getId() >= 0)
+        {
+            lock.unlock();
+
+            auto pixmapPtr = std::make_shared<std::vector<unsigned char>>(std::move(pixmap));
+            auto job = [this, tile, pixmapPtr, mode, ws, previewEditCount]()
+            {
+                encodePreviewAndSend(tile, std::move(*pixmapPtr), mode, ws, previewEditCount);
+            };
+
+            if (!_previewPool.queue(job))
+            {
+                job();
+            }
+
+            return;
+        }
+
+        // Compare against the previous pixmap of this position, if we
+        // still have it, to find the band of rows an edit changed.
+        const auto posKey = tilePositionKey(tile);
+        int deltaYStart = -1;
+        int deltaYEnd = -1;
+        const auto prevIt = _prevPixmaps.find(posKey);
+        if (prevIt != _prevPixmaps.end() &&
+            prevIt->second.size() == pixmapSize)
+        {
+            const size_t rowBytes = 4 * tile.getWidth();
+            const unsigned char* prev = prevIt->second.data();
+            const unsigned char* cur = pixmap.data();
+            int top = 0;
+            int bottom = tile.getHeight();
+            while (top < bottom && std::memcmp(prev + top * rowBytes, cur + top * rowBytes, rowBytes) == 0)
+                ++top;
+            while (bottom > top && std::memcmp(prev + (bottom - 1) * rowBytes, cur + (bottom - 1) * rowBytes, rowBytes) == 0)
+                --bottom;
+
+            deltaYStart = top;
+            deltaYEnd = bottom;
+        }
+
+        // Previews took the pool path above; what is left is an
+        // interactive tile for the editing user, favoring speed.
+        auto& codec = TileCodec::get(TileCodecUse::Interactive);
+        std::vector<char> png;
+        png.reserve(pixmapSize);
+        const bool encoded = codec.encode(pixmap.data(), 0, 0, tile.getWidth(), tile.getHeight(),
+                                          tile.getWidth(), tile.getHeight(), png, mode);
+
+        // A delta pays off only when the changed band is small; an empty
+        // band means the tile did not change at all.
+        std::vector<char> deltaPng;
+        bool haveDelta = false;
+        if (encoded && deltaYStart >= 0 && (deltaYEnd - deltaYStart) * 2 <= tile.getHeight())
+        {
+            haveDelta = (deltaYEnd == deltaYStart) ||
+                        codec.encode(pixmap.data(), 0, deltaYStart, tile.getWidth(),
+                                     deltaYEnd - deltaYStart, tile.getWidth(), tile.getHeight(),
+                                     deltaPng, mode);
+        }
+
+        // Keep the pixmap for the next delta, recycling the
+        // superseded one through the pool.
+        if (prevIt != _prevPixmaps.end())
+        {
+            _pixmapPool.release(std::move(prevIt->second));
+            prevIt->second = std::move(pixmap);
+        }
+        else
+        {
+            if (_prevPixmaps.size() >= MaxPrevPixmaps)
+            {
+                // Crude, but bounds the memory; deltas restart
+                // from full tiles.
+                _prevPixmaps.clear();
+            }
+
+            _prevPixmaps.emplace(posKey, std::move(pixmap));
+        }
+
+        if (!encoded)
         {
             //FIXME: Return error.
             //sendTextFrame("error: cmd=tile kind=failure");
@@ -505,23 +1130,146 @@ public:
             return;
         }
 
-        const auto length = output.size();
+        tile.setImgSize(png.size());
+
+        // Send back the request with all optional parameters given in the request.
+        std::string response = tile.serialize("tile:");
+#if ENABLE_DEBUG
+        response += " renderid=" + Util::UniqueId();
+#endif
+        if (haveDelta)
+        {
+            response += " ystart=" + std::to_string(deltaYStart) +
+                        " deltasize=" + std::to_string(deltaPng.size());
+        }
+
+        response += '\n';
+
+        // Header, tile and delta go out as fragments of one message;
+        // no intermediate buffer is assembled.
+        std::vector<IoUtil::Fragment> fragments;
+        fragments.emplace_back(response.data(), response.size());
+        fragments.emplace_back(png.data(), png.size());
+        if (!deltaPng.empty())
+        {
+            fragments.emplace_back(deltaPng.data(), deltaPng.size());
+        }
+
+        const auto length = response.size() + png.size() + deltaPng.size();
+        std::unique_lock<std::mutex> sendLock(_wsSendMutex);
+
+        Log::trace("Sending render-tile response (" + std::to_string(length) + " bytes) for: " + response);
+        if (tileRing &&
+            tileRing->write({ { response.data(), response.size() },
+                              { png.data(), png.size() },
+                              { deltaPng.data(), deltaPng.size() } }))
+        {
+            // The payload went through shared memory; a note on the
+            // socket keeps the ordering and wakes the consumer.
+            const std::string notify = "ringtile: size=" + std::to_string(length);
+            ws->sendFrame(notify.data(), notify.size());
+            return;
+        }
+
         if (length > SMALL_MESSAGE_SIZE)
         {
             const std::string nextmessage = "nextmessage: size=" + std::to_string(length);
             ws->sendFrame(nextmessage.data(), nextmessage.size());
         }
 
-        Log::trace("Sending render-tile response (" + std::to_string(length) + " bytes) for: " + response);
-        ws->sendFrame(output.data(), length, WebSocket::FRAME_BINARY);
+        IoUtil::sendFrameFragments(*ws, fragments);
+    }
+
+    /// Encode an already painted part preview and send it. Runs on
+    /// a preview pool worker, or inline when the pool is saturated.
+    void encodePreviewAndSend(TileDesc tile, std::vector<unsigned char> pixmap,
+                              const LibreOfficeKitTileMode mode,
+                              const std::shared_ptr<Poco::Net::WebSocket>& ws,
+                              const unsigned editCount)
+    {
+        // Previews live in the cache for long and favor size.
+        auto& codec = TileCodec::get(TileCodecUse::Preview);
+        std::vector<char> png;
+        png.reserve(pixmap.size());
+        const bool encoded = codec.encode(pixmap.data(), 0, 0, tile.getWidth(), tile.getHeight(),
+                                          tile.getWidth(), tile.getHeight(), png, mode);
+        _pixmapPool.release(std::move(pixmap));
+
+        if (!encoded)
+        {
+            Log::error("Failed to encode preview into PNG.");
+            return;
+        }
+
+        {
+            // Remember the encode for as long as the part stays
+            // unedited; renderTile() then answers without painting.
+            std::lock_guard<std::mutex> previewsLock(_partPreviewsMutex);
+            auto& cached = _partPreviews[tile.getPart()];
+            cached.PosKey = tilePositionKey(tile);
+            cached.EditCount = editCount;
+            cached.Png = png;
+        }
+
+        sendPreviewResponse(tile, png, ws);
+    }
+
+    /// Frame and send an encoded preview; shared by fresh encodes
+    /// and the per-part preview cache.
+    void sendPreviewResponse(TileDesc tile, const std::vector<char>& png,
+                             const std::shared_ptr<Poco::Net::WebSocket>& ws)
+    {
+        tile.setImgSize(png.size());
+
+        std::string response = tile.serialize("tile:");
+#if ENABLE_DEBUG
+        response += " renderid=" + Util::UniqueId();
+#endif
+        response += '\n';
+
+        std::vector<IoUtil::Fragment> fragments;
+        fragments.emplace_back(response.data(), response.size());
+        fragments.emplace_back(png.data(), png.size());
+
+        const auto length = response.size() + png.size();
+        std::unique_lock<std::mutex> sendLock(_wsSendMutex);
+
+        Log::trace("Sending preview response (" + std::to_string(length) + " bytes) for: " + response);
+        if (tileRing &&
+            tileRing->write({ { response.data(), response.size() },
+                              { png.data(), png.size() } }))
+        {
+            const std::string notify = "ringtile: size=" + std::to_string(length);
+            ws->sendFrame(notify.data(), notify.size());
+            return;
+        }
+
+        if (length > SMALL_MESSAGE_SIZE)
+        {
+            const std::string nextmessage = "nextmessage: size=" + std::to_string(length);
+            ws->sendFrame(nextmessage.data(), nextmessage.size());
+        }
+
+        IoUtil::sendFrameFragments(*ws, fragments);
     }
 
-    void renderCombinedTiles(StringTokenizer& tokens, const std::shared_ptr<Poco::Net::WebSocket>& ws)
+    void renderCombinedTiles(TileCombined tileCombined, const std::shared_ptr<Poco::Net::WebSocket>& ws)
     {
         assert(ws && "Expected a non-null websocket.");
-        auto tileCombined = TileCombined::parse(tokens);
         auto& tiles = tileCombined.getTiles();
 
+        // Drop tiles whose last subscriber has since scrolled away;
+        // if none are left, skip the paint altogether.
+        tiles.erase(std::remove_if(tiles.begin(), tiles.end(),
+                                   [this](const TileDesc& tile)
+                                   { return _tileQueue->isCancelled(tile.getVersion()); }),
+                    tiles.end());
+        if (tiles.empty())
+        {
+            Log::debug("All tiles of the combine were cancelled; skipping the paint.");
+            return;
+        }
+
         Util::Rectangle renderArea;
         std::vector<Util::Rectangle> tileRecs;
         tileRecs.reserve(tiles.size());
@@ -548,7 +1296,6 @@ public:
         const size_t pixmapWidth = tilesByX * tileCombined.getWidth();
         const size_t pixmapHeight = tilesByY * tileCombined.getHeight();
         const size_t pixmapSize = 4 * pixmapWidth * pixmapHeight;
-        std::vector<unsigned char> pixmap(pixmapSize, 0);
 
         if (!_loKitDocument)
         {
@@ -563,6 +1310,11 @@ public:
             return;
         }
 
+        // Rendering; re-arm the idle trim trigger.
+        _trimmed = false;
+
+        auto pixmap = _pixmapPool.acquire(pixmapSize);
+
         const double area = pixmapWidth * pixmapHeight;
         Timestamp timestamp;
         _loKitDocument->paintPartTile(pixmap.data(), tileCombined.getPart(),
@@ -570,35 +1322,59 @@ public:
                                       renderArea.getLeft(), renderArea.getTop(),
                                       renderArea.getWidth(), renderArea.getHeight());
         const auto elapsed = timestamp.elapsed();
+        AdminMetrics::get().TileRenderUs.record(elapsed);
         Log::debug() << "paintTile (combined) at (" << renderArea.getLeft() << ", " << renderArea.getTop() << "), ("
                      << renderArea.getWidth() << ", " << renderArea.getHeight() << ") ver: " << tileCombined.getVersion()
                      << " rendered in " << (elapsed/1000.) << " ms (" << area / elapsed << " MP/s)." << Log::end;
         const auto mode = static_cast<LibreOfficeKitTileMode>(_loKitDocument->getTileMode());
 
-        std::vector<char> output;
-        output.reserve(pixmapWidth * pixmapHeight * 4);
+        // Combined tiles are always rendered for an interactive viewport.
+        auto& codec = TileCodec::get(TileCodecUse::Interactive);
 
-        size_t tileIndex = 0;
-        for (Util::Rectangle& tileRect : tileRecs)
-        {
-            const size_t positionX = (tileRect.getLeft() - renderArea.getLeft()) / tileCombined.getTileWidth();
-            const size_t positionY = (tileRect.getTop() - renderArea.getTop())  / tileCombined.getTileHeight();
+        // Encode the sub-tiles in parallel, each into its own buffer;
+        // they are concatenated below in the original tile order.
+        const auto pixelWidth = tileCombined.getWidth();
+        const auto pixelHeight = tileCombined.getHeight();
+        std::vector<std::vector<char>> encodedTiles(tileRecs.size());
+        std::atomic<bool> encodeFailed(false);
 
-            const auto oldSize = output.size();
-            const auto pixelWidth = tileCombined.getWidth();
-            const auto pixelHeight = tileCombined.getHeight();
-            if (!png::encodeSubBufferToPNG(pixmap.data(), positionX * pixelWidth, positionY * pixelHeight,
-                                           pixelWidth, pixelHeight, pixmapWidth, pixmapHeight, output, mode))
+        std::vector<std::function<void()>> jobs;
+        jobs.reserve(tileRecs.size());
+        for (size_t i = 0; i < tileRecs.size(); ++i)
+        {
+            jobs.push_back([&, i]
             {
-                //FIXME: Return error.
-                //sendTextFrame("error: cmd=tile kind=failure");
-                Log::error("Failed to encode tile into PNG.");
-                return;
-            }
+                const auto& tileRect = tileRecs[i];
+                const size_t positionX = (tileRect.getLeft() - renderArea.getLeft()) / tileCombined.getTileWidth();
+                const size_t positionY = (tileRect.getTop() - renderArea.getTop())  / tileCombined.getTileHeight();
+
+                if (!codec.encode(pixmap.data(), positionX * pixelWidth, positionY * pixelHeight,
+                                  pixelWidth, pixelHeight, pixmapWidth, pixmapHeight,
+                                  encodedTiles[i], mode))
+                {
+                    encodeFailed = true;
+                }
+            });
+        }
+
+        _encoderPool.run(jobs);
+        _pixmapPool.release(std::move(pixmap));
 
-            const auto imgSize = output.size() - oldSize;
-            Log::trace() << "Encoded tile #" << tileIndex << " in " << imgSize << " bytes." << Log::end;
-            tiles[tileIndex++].setImgSize(imgSize);
+        if (encodeFailed)
+        {
+            //FIXME: Return error.
+            //sendTextFrame("error: cmd=tile kind=failure");
+            Log::error("Failed to encode tile into PNG.");
+            return;
+        }
+
+        size_t tileIndex = 0;
+        size_t encodedSize = 0;
+        for (const auto& encoded : encodedTiles)
+        {
+            Log::trace() << "Encoded tile #" << tileIndex << " in " << encoded.size() << " bytes." << Log::end;
+            tiles[tileIndex++].setImgSize(encoded.size());
+            encodedSize += encoded.size();
         }
 
 #if ENABLE_DEBUG
@@ -608,19 +1384,40 @@ public:
 #endif
         Log::trace("Sending back painted tiles for " + tileMsg);
 
-        std::vector<char> response;
-        response.resize(tileMsg.size() + output.size());
-        std::copy(tileMsg.begin(), tileMsg.end(), response.begin());
-        std::copy(output.begin(), output.end(), response.begin() + tileMsg.size());
+        // Header and sub-tiles go out as fragments of one message;
+        // no intermediate buffer is assembled.
+        std::vector<IoUtil::Fragment> fragments;
+        fragments.reserve(encodedTiles.size() + 1);
+        fragments.emplace_back(tileMsg.data(), tileMsg.size());
+        for (const auto& encoded : encodedTiles)
+        {
+            fragments.emplace_back(encoded.data(), encoded.size());
+        }
+
+        const auto length = tileMsg.size() + encodedSize;
+        std::unique_lock<std::mutex> sendLock(_wsSendMutex);
+
+        std::vector<TileRing::Segment> segments;
+        segments.reserve(fragments.size());
+        for (const auto& fragment : fragments)
+        {
+            segments.push_back({ fragment.first, fragment.second });
+        }
+
+        if (tileRing && tileRing->write(segments))
+        {
+            const std::string notify = "ringtile: size=" + std::to_string(length);
+            ws->sendFrame(notify.data(), notify.size());
+            return;
+        }
 
-        const auto length = response.size();
         if (length > SMALL_MESSAGE_SIZE)
         {
             const std::string nextmessage = "nextmessage: size=" + std::to_string(length);
             ws->sendFrame(nextmessage.data(), nextmessage.size());
         }
 
-        ws->sendFrame(response.data(), length, WebSocket::FRAME_BINARY);
+        IoUtil::sendFrameFragments(*ws, fragments);
     }
 
     bool sendTextFrame(const std::string& message) override
@@ -633,6 +1430,7 @@ public:
                 return false;
             }
 
+            std::unique_lock<std::mutex> sendLock(_wsSendMutex);
             const auto length = message.size();
             if (length > SMALL_MESSAGE_SIZE)
             {
@@ -731,6 +1529,10 @@ public:
                 pDescr->Doc->getTileQueue()->updateCursorPosition(std::stoi(viewId), std::stoi(part), cursorX, cursorY, cursorWidth, cursorHeight);
             }
         }
+        else if (nType == LOK_CALLBACK_INVALIDATE_TILES)
+        {
+            pDescr->Doc->invalidatePartPreviews(payload);
+        }
 
         pDescr->Doc->getTileQueue()->put("callback " + std::to_string(pDescr->ViewId) + " " + std::to_string(nType) + " " + payload);
     }
@@ -749,6 +1551,11 @@ private:
                      << LOKitHelper::kitCallbackTypeToString(nType)
                      << " [" << payload << "]." << Log::end;
         Document* self = reinterpret_cast<Document*>(pData);
+        if (nType == LOK_CALLBACK_INVALIDATE_TILES)
+        {
+            self->invalidatePartPreviews(payload);
+        }
+
         self->broadcastCallbackToClients(nType, pPayload);
     }
 
@@ -840,6 +1647,9 @@ private:
 
         lockLokDoc.unlock();
 
+        // A view went away; reclaim what it held.
+        _tileQueue->put("trim");
+
         // Broadcast updated view info
         notifyViewInfo(viewIds);
     }
@@ -872,6 +1682,25 @@ private:
         return _tileQueue;
     }
 
+    std::string getCachedResponse(const std::string& name) override
+    {
+        std::unique_lock<std::mutex> lock(_responseCacheMutex);
+        const auto it = _responseCache.find(name);
+        return it != _responseCache.end() ? it->second : std::string();
+    }
+
+    void cacheResponse(const std::string& name, const std::string& response) override
+    {
+        std::unique_lock<std::mutex> lock(_responseCacheMutex);
+        _responseCache[name] = response;
+    }
+
+    void invalidateResponseCache() override
+    {
+        std::unique_lock<std::mutex> lock(_responseCacheMutex);
+        _responseCache.clear();
+    }
+
     /// Notify all views of viewId and their associated usernames
     void notifyViewInfo(const std::vector<int>& viewIds) override
     {
@@ -910,13 +1739,35 @@ private:
         std::ostringstream ossViewInfo;
         viewInfoArray->stringify(ossViewInfo);
 
-        // Broadcast updated viewinfo to all _active_ connections
+        // Broadcast updated viewinfo to all _active_ connections.
+        // When every session is active the message is identical for
+        // all of them, so relay it once and let the broker fan it
+        // out, instead of re-serializing it per session.
+        const auto message = "viewinfo: " + ossViewInfo.str();
+        bool allActive = true;
         for (auto& pair : _sessions)
         {
-            const auto session = pair.second;
-            if (!session->isCloseFrame() && session->isActive())
+            const auto& session = pair.second;
+            if (session->isCloseFrame() || !session->isActive())
             {
-                session->sendTextFrame("viewinfo: " + ossViewInfo.str());
+                allActive = false;
+                break;
+            }
+        }
+
+        if (allActive)
+        {
+            sendTextFrame("client-all " + message);
+        }
+        else
+        {
+            for (auto& pair : _sessions)
+            {
+                const auto session = pair.second;
+                if (!session->isCloseFrame() && session->isActive())
+                {
+                    session->sendTextFrame(message);
+                }
             }
         }
     }
@@ -1154,6 +2005,29 @@ private:
         return false;
     }
 
+    /// Release the pixmap caches and return freed heap to the OS.
+    /// Runs on the rendering thread, which owns the caches.
+    /// Dropping LOK views here is not safe: it would lose cursor,
+    /// selection and view state; those are freed on unload instead.
+    void trimMemory()
+    {
+        size_t cachedBytes = 0;
+        for (const auto& it : _prevPixmaps)
+        {
+            cachedBytes += it.second.capacity();
+        }
+
+        _prevPixmaps.clear();
+        cachedBytes += _pixmapPool.trim();
+
+        // Glibc offers no partial purge; return all free heap
+        // above the in-use watermark to the OS.
+        malloc_trim(0);
+
+        Log::info() << "Trimmed " << (cachedBytes / 1024)
+                    << " KB of pixmap caches and returned free heap to the OS." << Log::end;
+    }
+
     void run() override
     {
         Util::setThreadName("lok_handler");
@@ -1170,6 +2044,19 @@ private:
                     break;
                 }
 
+                // Tiles arrive as binary frames; decode without any
+                // string or tokenizer round-trip.
+                if (TileBinary::isTileFrame(input.data(), input.size()))
+                {
+                    renderTile(TileDesc::parseBinary(input.data(), input.size()), _ws);
+                    continue;
+                }
+                else if (TileBinary::isCombineFrame(input.data(), input.size()))
+                {
+                    renderCombinedTiles(TileCombined::parseBinary(input.data(), input.size()), _ws);
+                    continue;
+                }
+
                 const std::string message(input.data(), input.size());
                 StringTokenizer tokens(message, " ");
 
@@ -1179,13 +2066,9 @@ private:
                     break;
                 }
 
-                if (tokens[0] == "tile")
-                {
-                    renderTile(tokens, _ws);
-                }
-                else if (tokens[0] == "tilecombine")
+                if (tokens[0] == "trim")
                 {
-                    renderCombinedTiles(tokens, _ws);
+                    trimMemory();
                 }
                 else if (LOOLProtocol::getFirstToken(tokens[0], '-') == "child")
                 {
@@ -1273,6 +2156,61 @@ private:
     std::map<std::string, std::shared_ptr<ChildSession>> _sessions;
     Poco::Thread _callbackThread;
     std::atomic_size_t _clientViews;
+    PixmapPool _pixmapPool;
+    EncoderPool _encoderPool;
+
+    /// Serializes sends on the kit websocket between the rendering
+    /// thread and the preview workers. Declared before the pool so
+    /// it outlives the workers.
+    std::mutex _wsSendMutex;
+
+    PreviewPool _previewPool;
+
+    /// Bound on the previous-pixmap cache: 128 tiles of 256x256
+    /// RGBA are 32MB per kit process.
+    static const size_t MaxPrevPixmaps = 128;
+
+    /// Idle time after which the pixmap caches are dropped and
+    /// free heap is returned to the OS.
+    static const size_t IdleTrimMS = 30 * 1000;
+
+    /// The last rendered pixmap per tile position, for computing
+    /// delta bands. Only accessed while rendering.
+    std::map<std::string, std::vector<unsigned char>> _prevPixmaps;
+
+    /// The last encoded preview of a part; served without repainting
+    /// while the part stays unedited.
+    struct CachedPreview
+    {
+        /// Position and geometry of the cached render.
+        std::string PosKey;
+        /// The part's edit count when it was painted.
+        unsigned EditCount;
+        std::vector<char> Png;
+    };
+
+    /// Guarded by _partPreviewsMutex, which also covers the counts.
+    std::map<int, CachedPreview> _partPreviews;
+
+    /// Edits seen per part from the invalidate-tiles callbacks; a
+    /// cached preview is valid while its edit count is current.
+    std::map<int, unsigned> _partEditCounts;
+
+    /// Counts invalidations that name no part and so dirty them all.
+    unsigned _allPartsEditCount;
+
+    std::mutex _partPreviewsMutex;
+
+    /// Whether we have trimmed since the last render, so an idle
+    /// document is trimmed once, not every poll.
+    std::atomic<bool> _trimmed;
+
+    /// Responses to document-state queries (part listings, part
+    /// page rectangles), shared by all views; recomputing them is
+    /// O(parts) LOK calls or a full layout pass. Dropped whenever
+    /// a callback reports a document change. Guarded by its mutex.
+    std::mutex _responseCacheMutex;
+    std::map<std::string, std::string> _responseCache;
 };
 
 void documentViewCallback(const int nType, const char* pPayload, void* pData)
@@ -1281,6 +2219,57 @@ void documentViewCallback(const int nType, const char* pPayload, void* pData)
 }
 
 #ifndef BUILDING_TESTS
+namespace
+{
+
+/// Pre-load and immediately discard a blank document of each
+/// type listed in LOOL_KIT_WARMUP, so that the component
+/// libraries, filters and fonts are paged in while the kit is
+/// still waiting to be claimed and the first real documentLoad
+/// only has to replace content.
+void warmupKit(const std::shared_ptr<lok::Office>& loKit)
+{
+    const char* warmup = std::getenv("LOOL_KIT_WARMUP");
+    if (warmup == nullptr || warmup[0] == '\0')
+    {
+        return;
+    }
+
+    std::map<std::string, std::string> factories;
+    factories["writer"] = "private:factory/swriter";
+    factories["calc"] = "private:factory/scalc";
+    factories["impress"] = "private:factory/simpress";
+    factories["draw"] = "private:factory/sdraw";
+
+    StringTokenizer types(warmup, ",", StringTokenizer::TOK_IGNORE_EMPTY | StringTokenizer::TOK_TRIM);
+    for (const auto& type : types)
+    {
+        const auto it = factories.find(type);
+        if (it == factories.end())
+        {
+            Log::warn("Unknown document type [" + type + "] in LOOL_KIT_WARMUP.");
+            continue;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        auto lock(loKit->getLock());
+        const auto document = loKit->documentLoad(it->second.c_str());
+        if (document && document->get())
+        {
+            const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                     std::chrono::steady_clock::now() - start).count();
+            Log::info() << "Warmed up " << type << " components in "
+                        << elapsed << " ms." << Log::end;
+        }
+        else
+        {
+            Log::warn("Warm-up load of [" + it->second + "] failed: " + loKit->getError());
+        }
+    }
+}
+
+}
+
 void lokit_main(const std::string& childRoot,
                 const std::string& sysTemplate,
                 const std::string& loTemplate,
@@ -1429,6 +2418,13 @@ void lokit_main(const std::string& childRoot,
             instdir_path = "/" + loTemplate + "/program";
         }
 
+        // Create the shared-memory tile ring inside the jail, where
+        // WSD maps it through the jail tree.
+        const std::string ringPath = (bRunInsideJail ? std::string() : jailPath.toString())
+                                     + TILERING_PATH_IN_JAIL;
+        File(Path(ringPath).parent()).createDirectories();
+        tileRing = TileRing::create(ringPath);
+
         std::shared_ptr<lok::Office> loKit;
         {
             const char *instdir = instdir_path.c_str();
@@ -1448,6 +2444,11 @@ void lokit_main(const std::string& childRoot,
         }
 
         assert(loKit && loKit->get());
+
+        // Page in the configured document components before
+        // announcing ourselves as available to WSD.
+        warmupKit(loKit);
+
         Log::info("Process is ready.");
 
         // Open websocket connection between the child process and WSD.
@@ -1478,12 +2479,32 @@ void lokit_main(const std::string& childRoot,
         IoUtil::SocketProcessor(ws,
                 [&socketName, &ws, &loKit, &queue](const std::vector<char>& data)
                 {
+                    // The hot path: binary tile frames go straight into the
+                    // queue, without a string or tokenizer in between.
+                    if (TileBinary::isFrame(data.data(), data.size()))
+                    {
+                        if (document)
+                        {
+                            queue->put(data);
+                        }
+                        else
+                        {
+                            Log::warn("No document while processing a binary tile frame.");
+                        }
+
+                        return true;
+                    }
+
                     std::string message(data.data(), data.size());
 
                     if (UnitKit::get().filterKitMessage(ws, message))
                         return true;
 
-                    Log::debug(socketName + ": recv [" + LOOLProtocol::getAbbreviatedMessage(message) + "].");
+                    if (Log::debugEnabled())
+                    {
+                        Log::debug(socketName + ": recv [" + LOOLProtocol::getAbbreviatedMessage(message) + "].");
+                    }
+
                     StringTokenizer tokens(message, " ", StringTokenizer::TOK_IGNORE_EMPTY | StringTokenizer::TOK_TRIM);
 
                     // Note: Syntax or parsing errors here are unexpected and fatal.
@@ -1544,6 +2565,10 @@ void lokit_main(const std::string& childRoot,
                         Log::info("Last session discarded. Terminating.");
                         TerminationFlag = true;
                     }
+                    else if (document)
+                    {
+                        document->trimIfIdle();
+                    }
 
                     return TerminationFlag.load();
                 });
@@ -1569,6 +2594,17 @@ void lokit_main(const std::string& childRoot,
 }
 #endif
 
+#ifndef BUILDING_TESTS
+/// Walks the immutable template trees once and caches their listings.
+/// Called by the forkit process before the first fork, so every child
+/// inherits the cache and provisions its jail without the walk.
+void precacheJailFiles(const std::string& sysTemplate, const std::string& loTemplate)
+{
+    precacheJailEntries(sysTemplate, std::getenv("LOOL_BIND_MOUNT") ? COPY_NO_USR : COPY_ALL);
+    precacheJailEntries(loTemplate, COPY_LO);
+}
+#endif
+
 /// Initializes LibreOfficeKit for cross-fork re-use.
 bool globalPreinit(const std::string &loTemplate)
 {
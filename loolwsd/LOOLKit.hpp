@@ -18,6 +18,10 @@ void lokit_main(const std::string& childRoot,
                 bool displayVersion);
 
 bool globalPreinit(const std::string &loTemplate);
+
+/// Cache the template-tree listings for jail provisioning.
+/// Call in the forkit process, before the first fork.
+void precacheJailFiles(const std::string& sysTemplate, const std::string& loTemplate);
 /// Wrapper around private Document::ViewCallback().
 void documentViewCallback(const int nType, const char* pPayload, void* pData);
 
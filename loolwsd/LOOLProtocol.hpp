@@ -10,6 +10,7 @@
 #ifndef INCLUDED_LOOLPROTOCOL_HPP
 #define INCLUDED_LOOLPROTOCOL_HPP
 
+#include <cstdint>
 #include <cstring>
 #include <map>
 #include <sstream>
@@ -40,7 +41,237 @@ namespace LOOLProtocol
     // Negative numbers for error.
     std::tuple<int, int, std::string> ParseVersion(const std::string& version);
 
+    /// A non-owning view of a character range. A stand-in for
+    /// std::string_view with just what the message parsers need,
+    /// so tokenizing doesn't copy each token onto the heap.
+    /// The viewed message must outlive the view.
+    class TokenView
+    {
+    public:
+        TokenView() :
+            _data(nullptr),
+            _size(0)
+        {
+        }
+
+        TokenView(const char* data, const size_t size) :
+            _data(data),
+            _size(size)
+        {
+        }
+
+        const char* data() const { return _data; }
+        size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+
+        /// Compare with a nul-terminated string; whole-token match.
+        bool equals(const char* str) const
+        {
+            const auto len = std::strlen(str);
+            return _size == len && (len == 0 || std::memcmp(_data, str, len) == 0);
+        }
+
+        /// Copy out, for the cold paths that do need a string.
+        std::string toString() const
+        {
+            return std::string(_data, _size);
+        }
+
+    private:
+        const char* _data;
+        size_t _size;
+    };
+
+    /// Iterates the delimiter-separated tokens of a message in place,
+    /// without allocating a string per token. Empty tokens are
+    /// skipped, like Poco::StringTokenizer with TOK_IGNORE_EMPTY.
+    class Tokenizer
+    {
+    public:
+        Tokenizer(const char* data, const size_t size, const char delim = ' ') :
+            _pos(data),
+            _end(data + size),
+            _delim(delim)
+        {
+        }
+
+        Tokenizer(const std::string& message, const char delim = ' ') :
+            Tokenizer(message.data(), message.size(), delim)
+        {
+        }
+
+        /// Advance token to the next token of the message.
+        /// Returns false at the end of the message.
+        bool next(TokenView& token)
+        {
+            while (_pos < _end && *_pos == _delim)
+            {
+                ++_pos;
+            }
+
+            if (_pos == _end)
+            {
+                return false;
+            }
+
+            const char* start = _pos;
+            while (_pos < _end && *_pos != _delim)
+            {
+                ++_pos;
+            }
+
+            token = TokenView(start, _pos - start);
+            return true;
+        }
+
+    private:
+        const char* _pos;
+        const char* _end;
+        const char _delim;
+    };
+
     bool stringToInteger(const std::string& input, int& value);
+
+    /// Append the decimal representation of value to buffer, without
+    /// streams or locales; the serializers on the tile path use this
+    /// instead of an ostringstream.
+    inline
+    void appendInteger(std::string& buffer, const int value)
+    {
+        char digits[12]; // Fits -2147483648.
+        char* pos = digits + sizeof(digits);
+        const bool negative = value < 0;
+        auto rest = (negative ? 0u - static_cast<unsigned int>(value)
+                              : static_cast<unsigned int>(value));
+        do
+        {
+            *--pos = '0' + (rest % 10);
+            rest /= 10;
+        }
+        while (rest != 0);
+
+        if (negative)
+        {
+            *--pos = '-';
+        }
+
+        buffer.append(pos, digits + sizeof(digits) - pos);
+    }
+
+    /// Append the decimal representation of an unsigned 64-bit
+    /// value; used for the tile content hashes.
+    inline
+    void appendUInt64(std::string& buffer, const uint64_t value)
+    {
+        char digits[20]; // Fits 18446744073709551615.
+        char* pos = digits + sizeof(digits);
+        auto rest = value;
+        do
+        {
+            *--pos = '0' + (rest % 10);
+            rest /= 10;
+        }
+        while (rest != 0);
+
+        buffer.append(pos, digits + sizeof(digits) - pos);
+    }
+
+    /// Parse an unsigned 64-bit value, for the tile content hashes.
+    /// False when the input isn't wholly an unsigned integer.
+    inline
+    bool stringToUInt64(const std::string& input, uint64_t& value)
+    {
+        if (input.empty())
+        {
+            return false;
+        }
+
+        uint64_t result = 0;
+        for (const char ch : input)
+        {
+            if (ch < '0' || ch > '9')
+            {
+                return false;
+            }
+
+            result = result * 10 + (ch - '0');
+        }
+
+        value = result;
+        return true;
+    }
+
+    /// Parse an integer out of a token in place, without the heap
+    /// round-trip of std::stoi. Surrounding spaces are ignored;
+    /// false when what remains isn't wholly an integer.
+    inline
+    bool stringToInteger(const TokenView& token, int& value)
+    {
+        const char* pos = token.data();
+        const char* end = pos + token.size();
+        while (pos < end && *pos == ' ')
+        {
+            ++pos;
+        }
+
+        while (pos < end && end[-1] == ' ')
+        {
+            --end;
+        }
+
+        bool negative = false;
+        if (pos < end && (*pos == '-' || *pos == '+'))
+        {
+            negative = (*pos == '-');
+            ++pos;
+        }
+
+        if (pos == end)
+        {
+            return false;
+        }
+
+        int result = 0;
+        for (; pos < end; ++pos)
+        {
+            if (*pos < '0' || *pos > '9')
+            {
+                return false;
+            }
+
+            result = result * 10 + (*pos - '0');
+        }
+
+        value = (negative ? -result : result);
+        return true;
+    }
+
+    /// Parse an unsigned 64-bit value out of a token in place.
+    inline
+    bool stringToUInt64(const TokenView& token, uint64_t& value)
+    {
+        const char* pos = token.data();
+        const char* end = pos + token.size();
+        if (pos == end)
+        {
+            return false;
+        }
+
+        uint64_t result = 0;
+        for (; pos < end; ++pos)
+        {
+            if (*pos < '0' || *pos > '9')
+            {
+                return false;
+            }
+
+            result = result * 10 + (*pos - '0');
+        }
+
+        value = result;
+        return true;
+    }
+
     inline
     bool parseNameValuePair(const std::string& token, std::string& name, std::string& value, const char delim = '=')
     {
@@ -62,6 +293,28 @@ namespace LOOLProtocol
         return parseNameValuePair(token, name, strValue, delim) && stringToInteger(strValue, value);
     }
 
+    /// Split a name=value token in place; both halves are views into it.
+    inline
+    bool parseNameValuePair(const TokenView& token, TokenView& name, TokenView& value, const char delim = '=')
+    {
+        const char* mid = static_cast<const char*>(std::memchr(token.data(), delim, token.size()));
+        if (mid == nullptr)
+        {
+            return false;
+        }
+
+        name = TokenView(token.data(), mid - token.data());
+        value = TokenView(mid + 1, token.data() + token.size() - (mid + 1));
+        return true;
+    }
+
+    inline
+    bool parseNameIntegerPair(const TokenView& token, TokenView& name, int& value, const char delim = '=')
+    {
+        TokenView strValue;
+        return parseNameValuePair(token, name, strValue, delim) && stringToInteger(strValue, value);
+    }
+
     bool getTokenInteger(const std::string& token, const std::string& name, int& value);
     bool getTokenString(const std::string& token, const std::string& name, std::string& value);
     bool getTokenKeyword(const std::string& token, const std::string& name, const std::map<std::string, int>& map, int& value);
@@ -103,6 +356,26 @@ namespace LOOLProtocol
         return getFirstToken(message.data(), message.size(), delim);
     }
 
+    /// Returns the first token of a message as a view into it,
+    /// without copying it out.
+    inline
+    TokenView getFirstTokenView(const char *message, const int length, const char delim = ' ')
+    {
+        if (message == nullptr || length <= 0)
+        {
+            return TokenView();
+        }
+
+        const char *founddelim = static_cast<const char *>(std::memchr(message, delim, length));
+        return TokenView(message, founddelim == nullptr ? length : founddelim - message);
+    }
+
+    template <typename T>
+    TokenView getFirstTokenView(const T& message, const char delim = ' ')
+    {
+        return getFirstTokenView(message.data(), message.size(), delim);
+    }
+
     /// Returns true if the token is a user-interaction token.
     /// Currently this excludes commands sent automatically.
     /// Notice that this doesn't guarantee editing activity,
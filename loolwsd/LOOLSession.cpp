@@ -33,12 +33,15 @@
 #include <Poco/StringTokenizer.h>
 #include <Poco/URI.h>
 
+#include "AdminMetrics.hpp"
 #include "Common.hpp"
 #include "IoUtil.hpp"
 #include "LOOLProtocol.hpp"
 #include "Log.hpp"
 #include "TileCache.hpp"
+#include "TileDesc.hpp"
 #include "Util.hpp"
+#include "WebSocketDeflate.hpp"
 
 using namespace LOOLProtocol;
 
@@ -48,6 +51,15 @@ using Poco::Net::Socket;
 using Poco::Net::WebSocket;
 using Poco::StringTokenizer;
 
+namespace
+{
+    /// Cap on the bytes queued for one session. Above it new tile
+    /// frames are dropped rather than queued; the client re-requests
+    /// whatever it still needs once it catches up. Non-tile frames
+    /// are never dropped.
+    constexpr size_t MAX_SESSION_OUT_BYTES = 16 * 1024 * 1024;
+}
+
 LOOLSession::LOOLSession(const std::string& id, const Kind kind,
                          std::shared_ptr<WebSocket> ws) :
     _id(id),
@@ -61,6 +73,8 @@ LOOLSession::LOOLSession(const std::string& id, const Kind kind,
     _lastActivityTime(std::chrono::steady_clock::now()),
     _isCloseFrame(false),
     _mutex(),
+    _outQueueBytes(0),
+    _stopWriter(false),
     _docPassword(""),
     _haveDocPassword(false),
     _isDocPasswordProtected(false)
@@ -69,11 +83,173 @@ LOOLSession::LOOLSession(const std::string& id, const Kind kind,
 
 LOOLSession::~LOOLSession()
 {
+    if (_writerThread.joinable())
+    {
+        {
+            std::unique_lock<std::mutex> lock(_outMutex);
+            _stopWriter = true;
+        }
+
+        _outCV.notify_all();
+        _writerThread.join();
+    }
+}
+
+void LOOLSession::setWebSocketCompression()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _deflater.reset(new WebSocketDeflater());
 }
 
 bool LOOLSession::sendTextFrame(const char* buffer, const int length)
 {
-    Log::trace(getName() + ": Send: " + getAbbreviatedMessage(buffer, length));
+    if (Log::traceEnabled())
+    {
+        Log::trace(getName() + ": Send: " + getAbbreviatedMessage(buffer, length));
+    }
+
+    return queueFrame(false, buffer, length, nullptr, 0);
+}
+
+bool LOOLSession::sendBinaryFrame(const char *buffer, int length)
+{
+    Log::trace(getName() + ": Send: " + std::to_string(length) + " bytes");
+    return queueFrame(true, buffer, length, nullptr, 0);
+}
+
+bool LOOLSession::sendBinaryFrame(const char* header, const size_t headerSize,
+                                  const char* body, const size_t bodySize)
+{
+    Log::trace(getName() + ": Send: " + std::to_string(headerSize + bodySize) + " bytes");
+    return queueFrame(true, header, headerSize, body, bodySize);
+}
+
+bool LOOLSession::queueFrame(const bool binary, const char* header, const size_t headerSize,
+                             const char* body, const size_t bodySize)
+{
+    const auto size = headerSize + bodySize;
+
+    // Full tiles for the same position supersede each other; remember
+    // the position so a newer tile can replace a stale queued one.
+    // Deltas stay put: they apply on top of what the client has.
+    std::string tileKey;
+    if (binary && headerSize > strlen("tile:"))
+    {
+        const auto firstLine = getFirstLine(header, headerSize);
+        if (firstLine.compare(0, 5, "tile:") == 0)
+        {
+            try
+            {
+                tileKey = TileDesc::parse(firstLine).generateKey();
+            }
+            catch (const std::exception&)
+            {
+                // Not a tile header after all; queue it as-is.
+            }
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(_outMutex);
+
+    if (!tileKey.empty())
+    {
+        for (auto& frame : _outQueue)
+        {
+            if (frame.tileKey == tileKey)
+            {
+                // Newest-wins: the queued tile is already stale.
+                AdminMetrics::get().SendQueueBytes -= frame.data.size();
+                _outQueueBytes -= frame.data.size();
+                frame.data.assign(header, headerSize);
+                if (bodySize > 0)
+                    frame.data.append(body, bodySize);
+                _outQueueBytes += frame.data.size();
+                AdminMetrics::get().SendQueueBytes += frame.data.size();
+                AdminMetrics::get().TileFramesDropped++;
+                return true;
+            }
+        }
+
+        if (_outQueueBytes + size > MAX_SESSION_OUT_BYTES)
+        {
+            Log::warn(getName() + ": Send queue full (" + std::to_string(_outQueueBytes) +
+                      " bytes); dropping tile " + tileKey + ".");
+            AdminMetrics::get().TileFramesDropped++;
+            return false;
+        }
+    }
+
+    _outQueue.emplace_back();
+    auto& frame = _outQueue.back();
+    frame.data.assign(header, headerSize);
+    if (bodySize > 0)
+        frame.data.append(body, bodySize);
+    frame.tileKey = std::move(tileKey);
+    frame.binary = binary;
+    _outQueueBytes += frame.data.size();
+    AdminMetrics::get().SendQueueBytes += frame.data.size();
+
+    if (!_writerThread.joinable())
+    {
+        _writerThread = std::thread([this]() { writeLoop(); });
+    }
+
+    lock.unlock();
+    _outCV.notify_one();
+    return true;
+}
+
+void LOOLSession::writeLoop()
+{
+    Util::setThreadName("ws_send");
+
+    for (;;)
+    {
+        OutFrame frame;
+        {
+            std::unique_lock<std::mutex> lock(_outMutex);
+            _outCV.wait(lock, [this]() { return _stopWriter || !_outQueue.empty(); });
+            if (_outQueue.empty())
+            {
+                // Stopping, and nothing left to drain.
+                break;
+            }
+
+            frame = std::move(_outQueue.front());
+            _outQueue.pop_front();
+            _outQueueBytes -= frame.data.size();
+            AdminMetrics::get().SendQueueBytes -= frame.data.size();
+        }
+
+        const bool success = frame.binary
+                           ? writeBinaryFrame(frame.data.data(), frame.data.size())
+                           : writeTextFrame(frame.data.data(), frame.data.size());
+        if (!success)
+        {
+            // The socket is gone; no point writing what's left.
+            std::unique_lock<std::mutex> lock(_outMutex);
+            AdminMetrics::get().SendQueueBytes -= _outQueueBytes;
+            _outQueue.clear();
+            _outQueueBytes = 0;
+        }
+
+        _outCV.notify_all();
+    }
+}
+
+void LOOLSession::drainOutQueue()
+{
+    std::unique_lock<std::mutex> lock(_outMutex);
+    if (!_outCV.wait_for(lock, std::chrono::milliseconds(COMMAND_TIMEOUT_MS),
+                         [this]() { return _outQueue.empty(); }))
+    {
+        Log::warn(getName() + ": Timed out draining the send queue; " +
+                  std::to_string(_outQueueBytes) + " bytes abandoned.");
+    }
+}
+
+bool LOOLSession::writeTextFrame(const char* buffer, const int length)
+{
     try
     {
         std::unique_lock<std::mutex> lock(_mutex);
@@ -90,12 +266,23 @@ bool LOOLSession::sendTextFrame(const char* buffer, const int length)
             _ws->sendFrame(nextmessage.data(), nextmessage.size());
         }
 
+        if (_deflater && length > COMPRESS_MESSAGE_SIZE)
+        {
+            const auto compressed = _deflater->compress(buffer, length);
+            _ws->sendFrame(compressed.data(), compressed.size(),
+                           WebSocket::FRAME_FLAG_FIN | WebSocket::FRAME_FLAG_RSV1 |
+                           WebSocket::FRAME_OP_TEXT);
+            AdminMetrics::get().BytesSent += compressed.size();
+            return true;
+        }
+
         _ws->sendFrame(buffer, length);
+        AdminMetrics::get().BytesSent += length;
         return true;
     }
     catch (const Exception& exc)
     {
-        Log::error() << "LOOLSession::sendTextFrame: "
+        Log::error() << "LOOLSession::writeTextFrame: "
                      << "Exception: " << exc.displayText()
                      << (exc.nested() ? "( " + exc.nested()->displayText() + ")" : "");
     }
@@ -103,9 +290,8 @@ bool LOOLSession::sendTextFrame(const char* buffer, const int length)
     return false;
 }
 
-bool LOOLSession::sendBinaryFrame(const char *buffer, int length)
+bool LOOLSession::writeBinaryFrame(const char* buffer, const int length)
 {
-    Log::trace(getName() + ": Send: " + std::to_string(length) + " bytes");
     try
     {
         std::unique_lock<std::mutex> lock(_mutex);
@@ -123,11 +309,12 @@ bool LOOLSession::sendBinaryFrame(const char *buffer, int length)
         }
 
         _ws->sendFrame(buffer, length, WebSocket::FRAME_BINARY);
+        AdminMetrics::get().BytesSent += length;
         return true;
     }
     catch (const Exception& exc)
     {
-        Log::error() << "LOOLSession::sendBinaryFrame: "
+        Log::error() << "LOOLSession::writeBinaryFrame: "
                      << "Exception: " << exc.displayText()
                      << (exc.nested() ? "( " + exc.nested()->displayText() + ")" : "");
     }
@@ -193,6 +380,7 @@ void LOOLSession::disconnect()
         if (!_disconnected)
         {
             _disconnected = true;
+            drainOutQueue();
             IoUtil::shutdownWebSocket(_ws);
         }
     }
@@ -205,6 +393,7 @@ void LOOLSession::disconnect()
 bool LOOLSession::handleDisconnect()
 {
     _disconnected = true;
+    drainOutQueue();
     IoUtil::shutdownWebSocket(_ws);
     return false;
 }
@@ -213,20 +402,26 @@ bool LOOLSession::handleInput(const char *buffer, int length)
 {
     assert(buffer != nullptr);
 
-    const auto summary = getAbbreviatedMessage(buffer, length);
     try
     {
-        Log::trace(getName() + ": Recv: " + summary);
+        // Abbreviate only when someone will read it; the truncated
+        // copy of every payload is pure logging overhead otherwise.
+        if (Log::traceEnabled())
+        {
+            Log::trace(getName() + ": Recv: " + getAbbreviatedMessage(buffer, length));
+        }
+
         if (TerminationFlag)
         {
-            Log::warn("Input while terminating: [" + summary + "].");
+            Log::warn("Input while terminating: [" + getAbbreviatedMessage(buffer, length) + "].");
         }
 
         return _handleInput(buffer, length);
     }
     catch (const Exception& exc)
     {
-        Log::error() << "LOOLSession::handleInput: Exception while handling [" + summary + "] in "
+        Log::error() << "LOOLSession::handleInput: Exception while handling ["
+                     << getAbbreviatedMessage(buffer, length) << "] in "
                      << getName() << ": "
                      << exc.displayText()
                      << (exc.nested() ? " (" + exc.nested()->displayText() + ")" : "")
@@ -234,7 +429,8 @@ bool LOOLSession::handleInput(const char *buffer, int length)
     }
     catch (const std::exception& exc)
     {
-        Log::error("LOOLSession::handleInput: Exception while handling [" + summary + "]: " + exc.what());
+        Log::error("LOOLSession::handleInput: Exception while handling ["
+                   + getAbbreviatedMessage(buffer, length) + "]: " + exc.what());
     }
 
     return false;
@@ -12,9 +12,12 @@
 
 #include <atomic>
 #include <cassert>
+#include <condition_variable>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <ostream>
+#include <thread>
 
 #include <Poco/Net/WebSocket.h>
 #include <Poco/Buffer.h>
@@ -28,6 +31,8 @@
 #include "TileCache.hpp"
 #include "Log.hpp"
 
+class WebSocketDeflater;
+
 /// Base class of a WebSocket session.
 class LOOLSession
 {
@@ -44,6 +49,16 @@ public:
 
     virtual
     bool sendBinaryFrame(const char *buffer, int length);
+    /// Send a shared immutable payload; all subscribers
+    /// serialize the same buffer without taking a copy.
+    bool sendBinaryFrame(const TileData& payload)
+    {
+        return payload != nullptr && sendBinaryFrame(payload->data(), payload->size());
+    }
+    /// Send a single binary message assembled from a header and a body
+    /// fragment, without copying them into one contiguous buffer.
+    bool sendBinaryFrame(const char* header, const size_t headerSize,
+                         const char* body, const size_t bodySize);
     virtual
     bool sendTextFrame(const char* buffer, const int length);
     bool sendTextFrame(const std::string& text)
@@ -63,6 +78,8 @@ public:
     {
         if (_ws)
         {
+            // Don't let the close frame overtake queued messages.
+            drainOutQueue();
             Log::trace("Shutting down WS [" + getName() + "].");
             _ws->shutdown(statusCode);
         }
@@ -85,6 +102,12 @@ public:
 
     bool isHeadless() const { return _ws == nullptr; }
 
+    /// Start compressing outgoing text frames per RFC 7692
+    /// (permessage-deflate). Call only after the peer negotiated the
+    /// extension in the websocket handshake. Binary frames (tiles)
+    /// stay uncompressed; they are PNG-compressed already.
+    void setWebSocketCompression();
+
 protected:
     LOOLSession(const std::string& id, const Kind kind,
                 std::shared_ptr<Poco::Net::WebSocket> ws);
@@ -136,6 +159,30 @@ private:
 
     virtual bool _handleInput(const char *buffer, int length) = 0;
 
+    /// One outbound frame waiting for the writer thread.
+    struct OutFrame
+    {
+        std::string data;
+        std::string tileKey; //< Set for full tile frames; newest wins.
+        bool binary;
+    };
+
+    /// Append a frame to the outbound queue, collapsing superseded
+    /// tile frames and dropping tiles for congested clients. Starts
+    /// the writer thread on first use.
+    bool queueFrame(bool binary, const char* header, size_t headerSize,
+                    const char* body, size_t bodySize);
+
+    /// The blocking socket writes; called only from the writer thread.
+    bool writeTextFrame(const char* buffer, int length);
+    bool writeBinaryFrame(const char* buffer, int length);
+
+    /// Sends the queued frames in order.
+    void writeLoop();
+
+    /// Wait until the queued frames are on the wire, or time out.
+    void drainOutQueue();
+
 private:
 
     /// A session ID specific to an end-to-end connection (from user to lokit).
@@ -154,6 +201,9 @@ private:
     // jailed process, the websocket to the parent.
     std::shared_ptr<Poco::Net::WebSocket> _ws;
 
+    /// Compresses outgoing text frames, when negotiated. Guarded by _mutex.
+    std::unique_ptr<WebSocketDeflater> _deflater;
+
     /// True if we have been disconnected.
     std::atomic<bool> _disconnected;
     /// True if the user is active, otherwise false (switched tabs).
@@ -166,6 +216,19 @@ private:
 
     std::mutex _mutex;
 
+    /// Outbound frames waiting for the writer thread. Guarded by _outMutex.
+    std::deque<OutFrame> _outQueue;
+
+    /// Bytes in _outQueue, for backpressure. Guarded by _outMutex.
+    size_t _outQueueBytes;
+
+    /// Tells the writer to exit once the queue is drained.
+    bool _stopWriter;
+
+    std::mutex _outMutex;
+    std::condition_variable _outCV;
+    std::thread _writerThread;
+
 protected:
     // The actual URL, also in the child, even if the child never accesses that.
     std::string _docURL;
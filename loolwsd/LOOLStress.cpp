@@ -53,7 +53,10 @@ public:
     ~Stress() {}
 
     static bool Benchmark;
+    static bool LoadGen;
     static size_t Iterations;
+    static size_t Warmup;
+    static unsigned TileMixPercent;
     static bool NoDelay;
     unsigned _numClients;
     std::string _serverURI;
@@ -97,6 +100,25 @@ long percentile(std::vector<long>& v, const double percentile)
     return v[k - 1] + d * (v[k] - v[k - 1]);
 }
 
+/// Print a one-line latency summary with percentiles for one message type.
+void summarizeStats(const std::string& name, std::vector<long>& v)
+{
+    if (v.empty())
+    {
+        std::cerr << name << ": no samples." << std::endl;
+        return;
+    }
+
+    std::sort(v.begin(), v.end());
+    std::cerr << name << ": " << v.size() << " samples"
+              << ", min: " << v[0]
+              << ", p50: " << percentile(v, 50)
+              << ", p90: " << percentile(v, 90)
+              << ", p99: " << percentile(v, 99)
+              << ", max: " << v[v.size() - 1]
+              << " microsecs." << std::endl;
+}
+
 /// Connection class with WSD.
 class Connection
 {
@@ -172,10 +194,13 @@ public:
 
     Worker(Stress& app, const std::string& uri) :
         _app(app),
-        _uri(uri)
+        _uri(uri),
+        _record(true),
+        _rng(std::random_device()())
     {
     }
 
+    std::vector<long> getLoadStats() const { return _loadStats; }
     std::vector<long> getLatencyStats() const { return _latencyStats; }
     std::vector<long> getRenderingStats() const { return _renderingStats; }
     std::vector<long> getCacheStats() const { return _cacheStats; }
@@ -184,7 +209,11 @@ public:
     {
         try
         {
-            if (Stress::Benchmark)
+            if (Stress::LoadGen)
+            {
+                loadgen();
+            }
+            else if (Stress::Benchmark)
             {
                 benchmark();
             }
@@ -216,7 +245,10 @@ private:
 
         const auto now = std::chrono::steady_clock::now();
         const auto deltaModify = std::chrono::duration_cast<std::chrono::microseconds>(now - startModify).count();
-        _latencyStats.push_back(deltaModify);
+        if (_record)
+        {
+            _latencyStats.push_back(deltaModify);
+        }
 
         return success;
     }
@@ -239,7 +271,10 @@ private:
 
         const auto now = std::chrono::steady_clock::now();
         const auto delta = std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
-        _renderingStats.push_back(delta / expectedTilesCount);
+        if (_record)
+        {
+            _renderingStats.push_back(delta / expectedTilesCount);
+        }
 
         return true;
     }
@@ -260,7 +295,10 @@ private:
 
         const auto now = std::chrono::steady_clock::now();
         const auto delta = std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
-        _cacheStats.push_back(delta / expectedTilesCount);
+        if (_record)
+        {
+            _cacheStats.push_back(delta / expectedTilesCount);
+        }
 
         return true;
     }
@@ -287,6 +325,48 @@ private:
         }
     }
 
+    /// Synthetic load generation: one session hammering a document with
+    /// a configurable mix of fresh-tile and cached-tile requests, after
+    /// a warm-up phase that is excluded from the statistics.
+    void loadgen()
+    {
+        _latencyStats.reserve(Stress::Iterations);
+        _renderingStats.reserve(Stress::Iterations);
+        _cacheStats.reserve(Stress::Iterations);
+
+        static std::atomic<unsigned> SessionId;
+        const auto sessionId = ++SessionId;
+        auto connection = Connection::create(_app._serverURI, _uri, std::to_string(sessionId));
+
+        const auto startLoad = std::chrono::steady_clock::now();
+        connection->load();
+        const auto deltaLoad = std::chrono::duration_cast<std::chrono::microseconds>(
+                                   std::chrono::steady_clock::now() - startLoad).count();
+        _loadStats.push_back(deltaLoad);
+
+        // Warm up: get the kit and the caches hot without recording.
+        _record = false;
+        for (size_t i = 0; i < Stress::Warmup; ++i)
+        {
+            renderTile(connection);
+            fetchCachedTile(connection);
+        }
+
+        _record = true;
+        std::uniform_int_distribution<unsigned> dist(0, 99);
+        for (size_t i = 0; i < Stress::Iterations; ++i)
+        {
+            if (dist(_rng) < Stress::TileMixPercent)
+            {
+                renderTile(connection);
+            }
+            else
+            {
+                fetchCachedTile(connection);
+            }
+        }
+    }
+
     void replay()
     {
         TraceFileReader traceFile(_uri);
@@ -409,14 +489,22 @@ private:
     /// Doc URI to _sessions map. _sessions are maps of SessionID to Connection.
     std::map<std::string, std::map<std::string, std::shared_ptr<Connection>>> _sessions;
 
+    std::vector<long> _loadStats;
     std::vector<long> _latencyStats;
     std::vector<long> _renderingStats;
     std::vector<long> _cacheStats;
+
+    /// When false, the helpers measure but discard their samples.
+    bool _record;
+    std::mt19937 _rng;
 };
 
 bool Stress::NoDelay = false;
 bool Stress::Benchmark = false;
+bool Stress::LoadGen = false;
 size_t Stress::Iterations = 100;
+size_t Stress::Warmup = 10;
+unsigned Stress::TileMixPercent = 50;
 
 Stress::Stress() :
     _numClients(1),
@@ -436,9 +524,17 @@ void Stress::defineOptions(OptionSet& optionSet)
                         .required(false).repeatable(false));
     optionSet.addOption(Option("bench", "", "Performance benchmark. The argument is a document URL to load.")
                         .required(false).repeatable(false));
+    optionSet.addOption(Option("load", "", "Load generation. The arguments are document URLs to hit with synthetic sessions.")
+                        .required(false).repeatable(false));
     optionSet.addOption(Option("iter", "", "Number of iterations to use for Benchmarking.")
                         .required(false).repeatable(false)
                         .argument("iter"));
+    optionSet.addOption(Option("warmup", "", "Number of unrecorded warm-up iterations before load generation.")
+                        .required(false).repeatable(false)
+                        .argument("warmup"));
+    optionSet.addOption(Option("tilemix", "", "Percentage of load-generation iterations that modify and re-render, the rest fetch cached tiles.")
+                        .required(false).repeatable(false)
+                        .argument("percent"));
     optionSet.addOption(Option("nodelay", "", "Replay at full speed disregarding original timing.")
                         .required(false).repeatable(false));
     optionSet.addOption(Option("clientsperdoc", "", "Number of simultaneous clients on each doc.")
@@ -466,8 +562,14 @@ void Stress::handleOption(const std::string& optionName,
     }
     else if (optionName == "bench")
         Stress::Benchmark = true;
+    else if (optionName == "load")
+        Stress::LoadGen = true;
     else if (optionName == "iter")
         Stress::Iterations = std::max(std::stoi(value), 1);
+    else if (optionName == "warmup")
+        Stress::Warmup = std::max(std::stoi(value), 0);
+    else if (optionName == "tilemix")
+        Stress::TileMixPercent = std::min(std::max(std::stoi(value), 0), 100);
     else if (optionName == "nodelay")
         Stress::NoDelay = true;
     else if (optionName == "clientsperdoc")
@@ -487,7 +589,7 @@ int Stress::main(const std::vector<std::string>& args)
 
     if (args.size() == 0)
     {
-        std::cerr << "Usage: loolstress [--bench] <tracefile | url> " << std::endl;
+        std::cerr << "Usage: loolstress [--bench | --load] <tracefile | url> " << std::endl;
         std::cerr << "       Trace files may be plain text or gzipped (with .gz extension)." << std::endl;
         std::cerr << "       --help for full arguments list." << std::endl;
         return Application::EXIT_NOINPUT;
@@ -512,7 +614,40 @@ int Stress::main(const std::vector<std::string>& args)
         client->join();
     }
 
-    if (Stress::Benchmark)
+    if (Stress::LoadGen)
+    {
+        std::vector<long> loadStats;
+        std::vector<long> latencyStats;
+        std::vector<long> renderingStats;
+        std::vector<long> cachedStats;
+
+        for (const auto& worker : workers)
+        {
+            const auto loadStat = worker->getLoadStats();
+            loadStats.insert(loadStats.end(), loadStat.begin(), loadStat.end());
+
+            const auto latencyStat = worker->getLatencyStats();
+            latencyStats.insert(latencyStats.end(), latencyStat.begin(), latencyStat.end());
+
+            const auto renderingStat = worker->getRenderingStats();
+            renderingStats.insert(renderingStats.end(), renderingStat.begin(), renderingStat.end());
+
+            const auto cachedStat = worker->getCacheStats();
+            cachedStats.insert(cachedStats.end(), cachedStat.begin(), cachedStat.end());
+        }
+
+        std::cerr << "\nResults:\n";
+        std::cerr << "Sessions: " << clients.size()
+                  << ", iterations each: " << Stress::Iterations
+                  << " (+" << Stress::Warmup << " warm-up)"
+                  << ", tile mix: " << Stress::TileMixPercent << "% fresh.\n";
+
+        summarizeStats("load", loadStats);
+        summarizeStats("modify", latencyStats);
+        summarizeStats("tile", renderingStats);
+        summarizeStats("cachedtile", cachedStats);
+    }
+    else if (Stress::Benchmark)
     {
         std::vector<long> latencyStats;
         std::vector<long> renderingStats;
@@ -36,10 +36,13 @@
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <deque>
+#include <functional>
 #include <fstream>
 #include <iostream>
 #include <map>
 #include <mutex>
+#include <set>
 #include <sstream>
 #include <thread>
 
@@ -106,11 +109,13 @@
 #include "PrisonerSession.hpp"
 #include "QueueHandler.hpp"
 #include "Storage.hpp"
+#include "TileCache.hpp"
 #include "TraceFile.hpp"
 #include "Unit.hpp"
 #include "UnitHTTP.hpp"
 #include "UserMessages.hpp"
 #include "Util.hpp"
+#include "WebSocketDeflate.hpp"
 
 using namespace LOOLProtocol;
 
@@ -167,8 +172,88 @@ static std::vector<std::shared_ptr<ChildProcess>> NewChildren;
 static std::mutex NewChildrenMutex;
 static std::condition_variable NewChildrenCV;
 static std::chrono::steady_clock::time_point LastForkRequestTime = std::chrono::steady_clock::now();
-static std::map<std::string, std::shared_ptr<DocumentBroker>> DocBrokers;
-static std::mutex DocBrokersMutex;
+/// The DocumentBrokers, sharded by docKey hash so that connection
+/// setup and teardown on one document do not serialize against every
+/// other document. Lock the shard of a docKey to touch its map entry;
+/// never lock two shards at once.
+constexpr size_t DocBrokersShardCount = 16;
+static std::map<std::string, std::shared_ptr<DocumentBroker>> DocBrokers[DocBrokersShardCount];
+static std::mutex DocBrokersMutex[DocBrokersShardCount];
+
+static size_t docBrokersShard(const std::string& docKey)
+{
+    return std::hash<std::string>()(docKey) % DocBrokersShardCount;
+}
+
+/// Pending autosave checks, ordered by due time. Only modified
+/// documents are entered, so with mostly idle documents the main
+/// loop scans nothing and takes no broker lock until one is due.
+static std::multimap<std::chrono::steady_clock::time_point, std::string> AutoSaveDeadlines;
+static std::set<std::string> AutoSavePending;
+static std::mutex AutoSaveDeadlinesMutex;
+
+void LOOLWSD::scheduleAutoSave(const std::string& docKey)
+{
+    std::unique_lock<std::mutex> deadlinesLock(AutoSaveDeadlinesMutex);
+    if (AutoSavePending.insert(docKey).second)
+    {
+        AutoSaveDeadlines.emplace(std::chrono::steady_clock::now() +
+                                  std::chrono::milliseconds(DocumentBroker::getIdleSaveDelayMs()),
+                                  docKey);
+    }
+}
+
+/// Run the autosave check of every document whose deadline passed.
+/// A document still modified afterwards (its views were too recently
+/// active to save yet) is re-armed; a stale deadline whose broker is
+/// already gone is simply dropped.
+static void autoSaveDueDocuments()
+{
+    std::vector<std::string> dueDocKeys;
+    {
+        std::unique_lock<std::mutex> deadlinesLock(AutoSaveDeadlinesMutex);
+        const auto now = std::chrono::steady_clock::now();
+        while (!AutoSaveDeadlines.empty() && AutoSaveDeadlines.begin()->first <= now)
+        {
+            dueDocKeys.push_back(AutoSaveDeadlines.begin()->second);
+            AutoSavePending.erase(AutoSaveDeadlines.begin()->second);
+            AutoSaveDeadlines.erase(AutoSaveDeadlines.begin());
+        }
+    }
+
+    for (const auto& docKey : dueDocKeys)
+    {
+        std::shared_ptr<DocumentBroker> docBroker;
+        {
+            const auto shard = docBrokersShard(docKey);
+            std::unique_lock<std::mutex> DocBrokersLock(DocBrokersMutex[shard]);
+            const auto it = DocBrokers[shard].find(docKey);
+            if (it != DocBrokers[shard].end())
+            {
+                docBroker = it->second;
+            }
+        }
+
+        if (docBroker)
+        {
+            docBroker->autoSave(false, 0);
+            if (docBroker->isModified())
+            {
+                LOOLWSD::scheduleAutoSave(docKey);
+            }
+        }
+    }
+}
+
+/// Conversions in flight on the convert-to endpoint. Each one holds a
+/// kit child for its whole run.
+static std::atomic<unsigned> ConvertToActive(0);
+
+/// Releases a ConvertToActive slot when the conversion leaves the handler.
+struct ConvertToSlot
+{
+    ~ConvertToSlot() { --ConvertToActive; }
+};
 
 #if ENABLE_DEBUG
 static int careerSpanSeconds = 0;
@@ -176,15 +261,21 @@ static int careerSpanSeconds = 0;
 
 namespace {
 
+/// Logs the registry state. Takes each shard lock; do not call with
+/// a shard lock held.
 static void logNumDocBrokers(int lineNo)
 {
     int size = 0;
     int nonEmpty = 0;
-    for (auto& i : DocBrokers)
+    for (size_t shard = 0; shard < DocBrokersShardCount; ++shard)
     {
-        size++;
-        if (i.second->getPublicUri().toString() != "")
-            nonEmpty++;
+        std::unique_lock<std::mutex> lock(DocBrokersMutex[shard]);
+        for (auto& i : DocBrokers[shard])
+        {
+            size++;
+            if (i.second->getPublicUri().toString() != "")
+                nonEmpty++;
+        }
     }
     Log::debug() << "line " << lineNo << ": NumDocBrokers=" << LOOLWSD::NumDocBrokers << " size: " << size << " of which non-empty: " << nonEmpty << Log::end;
 }
@@ -228,6 +319,30 @@ void shutdownLimitReached(WebSocket& ws)
 
 }
 
+/// Child claims within the forecast window. Guarded by NewChildrenMutex.
+constexpr int ChildClaimWindowMs = 10000;
+static std::deque<std::chrono::steady_clock::time_point> ChildClaims;
+
+/// The number of spare children to keep, forecast from the recent
+/// claim rate: a login burst should find warm children waiting
+/// instead of draining the pool and paying for cold forks.
+static int targetSpareChildren()
+{
+    Util::assertIsLocked(NewChildrenMutex);
+
+    const auto now = std::chrono::steady_clock::now();
+    while (!ChildClaims.empty() &&
+           std::chrono::duration_cast<std::chrono::milliseconds>(now - ChildClaims.front()).count() > ChildClaimWindowMs)
+    {
+        ChildClaims.pop_front();
+    }
+
+    const int forecast = (ChildClaims.size() * LOOLWSD::PreSpawnBurstPercent + 50) / 100;
+    const int minimum = LOOLWSD::NumPreSpawnedChildren;
+    const int maximum = std::max<int>(LOOLWSD::MaxPreSpawnedChildren, minimum);
+    return std::min(std::max(forecast, minimum), maximum);
+}
+
 static void forkChildren(const int number)
 {
     Util::assertIsLocked(NewChildrenMutex);
@@ -278,7 +393,7 @@ static void prespawnChildren()
         }
     }
 
-    int balance = LOOLWSD::NumPreSpawnedChildren;
+    int balance = targetSpareChildren();
     balance -= NewChildren.size();
     if (balance <= 0)
     {
@@ -315,10 +430,14 @@ static std::shared_ptr<ChildProcess> getNewChild()
 
     namespace chrono = std::chrono;
     const auto startTime = chrono::steady_clock::now();
+
+    // Record the claim; the forecast follows the claim rate.
+    ChildClaims.push_back(chrono::steady_clock::now());
+
     do
     {
         const int available = NewChildren.size();
-        int balance = LOOLWSD::NumPreSpawnedChildren;
+        int balance = targetSpareChildren();
         if (available == 0)
         {
             Log::error("getNewChild: No available child. Sending spawn request to forkit and failing.");
@@ -430,6 +549,18 @@ private:
         StringTokenizer tokens(request.getURI(), "/?");
         if (tokens.count() >= 3 && tokens[2] == "convert-to")
         {
+            // Each conversion claims a kit child until it completes; cap
+            // how many run at a time so a batch of uploads cannot drain
+            // the pre-spawned pool and force interactive loads to cold-fork.
+            ++ConvertToActive;
+            const ConvertToSlot slot;
+            if (LOOLWSD::MaxConvertToActive > 0 && ConvertToActive > LOOLWSD::MaxConvertToActive)
+            {
+                Log::warn("Conversion limit (" + std::to_string(LOOLWSD::MaxConvertToActive) +
+                          ") reached, rejecting conversion request.");
+                throw std::runtime_error("Too many concurrent conversions.");
+            }
+
             std::string fromPath;
             ConvertToPartHandler handler(fromPath);
             HTMLForm form(request, request.stream(), handler);
@@ -456,13 +587,11 @@ private:
                     auto docBroker = std::make_shared<DocumentBroker>(uriPublic, docKey, LOOLWSD::ChildRoot, child);
                     child->setDocumentBroker(docBroker);
 
-                    // This lock could become a bottleneck.
-                    // In that case, we can use a pool and index by publicPath.
-                    std::unique_lock<std::mutex> lock(DocBrokersMutex);
+                    std::unique_lock<std::mutex> lock(DocBrokersMutex[docBrokersShard(docKey)]);
 
                     //FIXME: What if the same document is already open? Need a fake dockey here?
                     Log::debug("New DocumentBroker for docKey [" + docKey + "].");
-                    DocBrokers.emplace(docKey, docBroker);
+                    DocBrokers[docBrokersShard(docKey)].emplace(docKey, docBroker);
 
                     // Load the document.
                     std::shared_ptr<WebSocket> ws;
@@ -519,7 +648,7 @@ private:
                         Log::debug("Closing child for docKey [" + docKey + "].");
                         child->close(true);
                         Log::debug("Removing DocumentBroker for docKey [" + docKey + "].");
-                        DocBrokers.erase(docKey);
+                        DocBrokers[docBrokersShard(docKey)].erase(docKey);
                     }
                     else
                     {
@@ -560,14 +689,15 @@ private:
                 const std::string formName(form.get("name"));
 
                 // Validate the docKey
-                std::unique_lock<std::mutex> DocBrokersLock(DocBrokersMutex);
                 std::string decodedUri;
                 URI::decode(tokens[2], decodedUri);
                 const auto docKey = DocumentBroker::getDocKey(DocumentBroker::sanitizeURI(decodedUri));
-                auto docBrokerIt = DocBrokers.find(docKey);
+                const auto shard = docBrokersShard(docKey);
+                std::unique_lock<std::mutex> DocBrokersLock(DocBrokersMutex[shard]);
+                auto docBrokerIt = DocBrokers[shard].find(docKey);
 
                 // Maybe just free the client from sending childid in form ?
-                if (docBrokerIt == DocBrokers.end() || docBrokerIt->second->getJailId() != formChildid)
+                if (docBrokerIt == DocBrokers[shard].end() || docBrokerIt->second->getJailId() != formChildid)
                 {
                     throw BadRequestException("DocKey [" + docKey + "] or childid [" + formChildid + "] is invalid.");
                 }
@@ -595,9 +725,10 @@ private:
             std::string decodedUri;
             URI::decode(tokens[2], decodedUri);
             const auto docKey = DocumentBroker::getDocKey(DocumentBroker::sanitizeURI(decodedUri));
-            std::unique_lock<std::mutex> DocBrokersLock(DocBrokersMutex);
-            auto docBrokerIt = DocBrokers.find(docKey);
-            if (docBrokerIt == DocBrokers.end())
+            const auto shard = docBrokersShard(docKey);
+            std::unique_lock<std::mutex> DocBrokersLock(DocBrokersMutex[shard]);
+            auto docBrokerIt = DocBrokers[shard].find(docKey);
+            if (docBrokerIt == DocBrokers[shard].end())
             {
                 throw BadRequestException("DocKey [" + docKey + "] is invalid.");
             }
@@ -652,26 +783,23 @@ private:
     }
 
     /// Handle GET requests.
-    static void handleGetRequest(const std::string& uri, std::shared_ptr<WebSocket>& ws, const std::string& id)
+    /// @param compress whether the client negotiated permessage-deflate.
+    /// First stage of connection admission: look up the broker
+    /// hosting docKey, or reserve the key with a dummy broker so
+    /// that racing requests for the same document block. Returns
+    /// the live broker, or nullptr when the caller now owns the
+    /// reservation and must create (or clean up) the real one.
+    static std::shared_ptr<DocumentBroker> resolveDocBroker(const std::string& docKey, const size_t shard)
     {
-        Log::info("Starting GET request handler for session [" + id + "].");
-
-        // indicator to the client that document broker is searching
-        std::string status("statusindicator: find");
-        Log::trace("Sending to Client [" + status + "].");
-        ws->sendFrame(status.data(), (int) status.size());
-
-        const auto uriPublic = DocumentBroker::sanitizeURI(uri);
-        const auto docKey = DocumentBroker::getDocKey(uriPublic);
         std::shared_ptr<DocumentBroker> docBroker;
 
         // scope the DocBrokersLock
         {
-            std::unique_lock<std::mutex> DocBrokersLock(DocBrokersMutex);
+            std::unique_lock<std::mutex> DocBrokersLock(DocBrokersMutex[shard]);
 
             // Lookup this document.
-            auto it = DocBrokers.find(docKey);
-            if (it != DocBrokers.end())
+            auto it = DocBrokers[shard].find(docKey);
+            if (it != DocBrokers[shard].end())
             {
                 // Get the DocumentBroker from the Cache.
                 Log::debug("Found DocumentBroker for docKey [" + docKey + "].");
@@ -685,7 +813,7 @@ private:
                 Log::debug("Inserting a dummy DocumentBroker for docKey [" + docKey + "] temporarily.");
 
                 std::shared_ptr<DocumentBroker> tempBroker = std::make_shared<DocumentBroker>();
-                DocBrokers.emplace(docKey, tempBroker);
+                DocBrokers[shard].emplace(docKey, tempBroker);
             }
         }
 
@@ -700,16 +828,16 @@ private:
             {
                 std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
 
-                std::unique_lock<std::mutex> lock(DocBrokersMutex);
-                auto it = DocBrokers.find(docKey);
-                if (it == DocBrokers.end())
+                std::unique_lock<std::mutex> lock(DocBrokersMutex[shard]);
+                auto it = DocBrokers[shard].find(docKey);
+                if (it == DocBrokers[shard].end())
                 {
                     // went away successfully
                     docBroker.reset();
                     Log::debug("Inserting a dummy DocumentBroker for docKey [" + docKey + "] temporarily after the other instance is gone.");
 
                     std::shared_ptr<DocumentBroker> tempBroker = std::make_shared<DocumentBroker>();
-                    DocBrokers.emplace(docKey, tempBroker);
+                    DocBrokers[shard].emplace(docKey, tempBroker);
 
                     timedOut = false;
                     break;
@@ -730,37 +858,91 @@ private:
             }
         }
 
+        return docBroker;
+    }
+
+    static void handleGetRequest(const std::string& uri, std::shared_ptr<WebSocket>& ws,
+                                 const std::string& id, const bool compress)
+    {
+        Log::info("Starting GET request handler for session [" + id + "].");
+
+        // indicator to the client that document broker is searching
+        std::string status("statusindicator: find");
+        Log::trace("Sending to Client [" + status + "].");
+        ws->sendFrame(status.data(), (int) status.size());
+
+        const auto uriPublic = DocumentBroker::sanitizeURI(uri);
+        const auto docKey = DocumentBroker::getDocKey(uriPublic);
+        const auto shard = docBrokersShard(docKey);
+
+        // Admission runs in explicit stages, so that the only slow
+        // one - talking to storage - holds no shared resource:
+        // resolve broker -> authenticate -> claim child -> attach.
+        auto docBroker = resolveDocBroker(docKey, shard);
+
         bool newDoc = false;
         if (!docBroker)
         {
             newDoc = true;
-            // Request a kit process for this doc.
-            auto child = getNewChild();
-            if (!child)
-            {
-                // Let the client know we can't serve now.
-                Log::error("Failed to get new child. Service Unavailable.");
-                throw WebSocketErrorMessageException(SERVICE_UNAVAILABLE_INTERNAL_ERROR);
-            }
 
 #if MAX_DOCUMENTS > 0
-            std::unique_lock<std::mutex> DocBrokersLock(DocBrokersMutex);
             logNumDocBrokers(__LINE__);
             if (++LOOLWSD::NumDocBrokers > MAX_DOCUMENTS)
             {
                 --LOOLWSD::NumDocBrokers;
                 Log::error("Maximum number of open documents reached.");
                 logNumDocBrokers(__LINE__);
+                {
+                    std::unique_lock<std::mutex> DocBrokersLock(DocBrokersMutex[shard]);
+                    DocBrokers[shard].erase(docKey);
+                }
                 shutdownLimitReached(*ws);
                 return;
             }
-            DocBrokersLock.unlock();
 #endif
 
-            // Set one we just created.
-            Log::debug("New DocumentBroker for docKey [" + docKey + "].");
-            docBroker = std::make_shared<DocumentBroker>(uriPublic, docKey, LOOLWSD::ChildRoot, child);
-            child->setDocumentBroker(docBroker);
+            try
+            {
+                // Authenticate against storage before claiming a child,
+                // so a slow or denying storage host consumes neither a
+                // pre-spawned child nor stalls unrelated documents.
+                // Later sessions of a live document authenticate in
+                // DocumentBroker::load() with their own tokens.
+                auto storage = StorageBase::create(uriPublic, "", "");
+                const auto fileInfo = storage->getFileInfo(uriPublic);
+                if (!fileInfo.isValid())
+                {
+                    throw UnauthorizedRequestException("Invalid fileinfo for URI [" + uriPublic.toString() + "].");
+                }
+
+                // Request a kit process for this doc.
+                auto child = getNewChild();
+                if (!child)
+                {
+                    // Let the client know we can't serve now.
+                    Log::error("Failed to get new child. Service Unavailable.");
+                    throw WebSocketErrorMessageException(SERVICE_UNAVAILABLE_INTERNAL_ERROR);
+                }
+
+                // Set one we just created.
+                Log::debug("New DocumentBroker for docKey [" + docKey + "].");
+                docBroker = std::make_shared<DocumentBroker>(uriPublic, docKey, LOOLWSD::ChildRoot, child);
+                docBroker->takeStorage(std::move(storage), fileInfo);
+                child->setDocumentBroker(docBroker);
+            }
+            catch (...)
+            {
+                // Unreserve the docKey.
+                {
+                    std::unique_lock<std::mutex> DocBrokersLock(DocBrokersMutex[shard]);
+                    DocBrokers[shard].erase(docKey);
+                }
+#if MAX_DOCUMENTS > 0
+                --LOOLWSD::NumDocBrokers;
+                logNumDocBrokers(__LINE__);
+#endif
+                throw;
+            }
         }
 
         // Validate the broker.
@@ -770,8 +952,10 @@ private:
             if (!newDoc)
             {
                 // Remove.
-                std::unique_lock<std::mutex> lock(DocBrokersMutex);
-                DocBrokers.erase(docKey);
+                {
+                    std::unique_lock<std::mutex> lock(DocBrokersMutex[shard]);
+                    DocBrokers[shard].erase(docKey);
+                }
 #if MAX_DOCUMENTS > 0
                 --LOOLWSD::NumDocBrokers;
                 logNumDocBrokers(__LINE__);
@@ -783,23 +967,35 @@ private:
 
         if (newDoc)
         {
-            std::unique_lock<std::mutex> lock(DocBrokersMutex);
-            DocBrokers[docKey] = docBroker;
+            std::unique_lock<std::mutex> lock(DocBrokersMutex[shard]);
+            DocBrokers[shard][docKey] = docBroker;
         }
 
         // Check if readonly session is required
         bool isReadOnly = false;
+        std::string resumeToken;
         for (const auto& param: uriPublic.getQueryParameters())
         {
             Log::debug("Query param: " + param.first + ", value: " + param.second);
             if (param.first == "permission")
                 isReadOnly = param.second == "readonly";
+            else if (param.first == "reconnect_token")
+                resumeToken = param.second;
         }
 
         // In case of WOPI and if this session is not set as readonly, it might be set so
         // later after making a call to WOPI host which tells us the permission on files
         // (UserCanWrite param)
         auto session = std::make_shared<ClientSession>(id, ws, docBroker, uriPublic, isReadOnly);
+        if (!resumeToken.empty())
+        {
+            session->setResumeToken(resumeToken);
+        }
+
+        if (compress)
+        {
+            session->setWebSocketCompression();
+        }
 
         // Above this point exceptions are safe and will auto-cleanup.
         // Below this, we need to cleanup internal references.
@@ -821,6 +1017,24 @@ private:
             auto sessionsCount = docBroker->addSession(session);
             Log::trace(docKey + ", ws_sessions++: " + std::to_string(sessionsCount));
 
+            // Hand the client a token with which it can resume this
+            // view after a dropped connection, without another storage
+            // round-trip. tilesvalid tells a resumed client whether
+            // its cached tiles survived the gap.
+            if (LOOLWSD::ReconnectGraceSecs > 0)
+            {
+                status = "reconnect: token=" + session->getReconnectToken() +
+                         " timeout=" + std::to_string(LOOLWSD::ReconnectGraceSecs);
+                if (session->isResumed())
+                {
+                    status += std::string(" resumed=1 tilesvalid=") +
+                              (session->resumeTilesValid() ? "1" : "0");
+                }
+
+                Log::trace("Sending to Client [" + status + "].");
+                ws->sendFrame(status.data(), (int) status.size());
+            }
+
             // If its a WOPI host, return time taken to make calls to it
             const auto storageCallDuration = docBroker->getStorageLoadDuration();
             if (storageCallDuration != std::chrono::duration<double>::zero())
@@ -835,24 +1049,43 @@ private:
 
             LOOLWSD::dumpEventTrace(docBroker->getJailId(), id, "NewSession: " + uri);
 
-            // Let messages flow.
+            // Let messages flow. When compression was negotiated the
+            // client may deflate its messages, too.
+            std::shared_ptr<WebSocketInflater> inflater;
+            if (compress)
+            {
+                inflater.reset(new WebSocketInflater());
+            }
+
             IoUtil::SocketProcessor(ws,
                 [&session](const std::vector<char>& payload)
                 {
                     return session->handleInput(payload.data(), payload.size());
                 },
                 [&session]() { session->closeFrame(); },
-                []() { return !!TerminationFlag; });
+                []() { return !!TerminationFlag; },
+                inflater);
 
             // Connection terminated. Destroy session.
             Log::debug("Client session [" + id + "] terminated. Cleaning up.");
             {
-                std::unique_lock<std::mutex> DocBrokersLock(DocBrokersMutex);
+                // Hold our shard lock so nobody latches onto this
+                // document while we decide whether to destroy it.
+                std::unique_lock<std::mutex> DocBrokersLock(DocBrokersMutex[shard]);
 
                 // We cannot destroy it, before save, if this is the last session.
                 // Otherwise, we may end up removing the one and only session.
                 bool removedSession = false;
 
+                // A connection that dropped without a close frame may
+                // come back with its reconnect token; stash the
+                // authenticated view so the resume skips the storage
+                // round-trip.
+                if (!session->isCloseFrame())
+                {
+                    docBroker->stashViewForReconnect(session);
+                }
+
                 // We issue a force-save when last editable (non-readonly) session is going away
                 const bool forceSave = docBroker->startDestroy(id);
 
@@ -889,15 +1122,26 @@ private:
 
             if (sessionsCount == 0)
             {
-                std::unique_lock<std::mutex> DocBrokersLock(DocBrokersMutex);
-                Log::debug("Removing DocumentBroker for docKey [" + docKey + "].");
-                DocBrokers.erase(docKey);
+                if (docBroker->keepAliveForReconnect())
+                {
+                    // The periodic sweep destroys the broker if the
+                    // client does not come back within the grace.
+                    Log::info("Keeping doc [" + docKey + "] alive for a reconnecting client.");
+                }
+                else
+                {
+                    {
+                        std::unique_lock<std::mutex> DocBrokersLock(DocBrokersMutex[shard]);
+                        Log::debug("Removing DocumentBroker for docKey [" + docKey + "].");
+                        DocBrokers[shard].erase(docKey);
+                    }
 #if MAX_DOCUMENTS > 0
-                --LOOLWSD::NumDocBrokers;
-                logNumDocBrokers(__LINE__);
+                    --LOOLWSD::NumDocBrokers;
+                    logNumDocBrokers(__LINE__);
 #endif
-                Log::info("Removing complete doc [" + docKey + "] from Admin.");
-                Admin::instance().rmDoc(docKey);
+                    Log::info("Removing complete doc [" + docKey + "] from Admin.");
+                    Admin::instance().rmDoc(docKey);
+                }
             }
 
             LOOLWSD::dumpEventTrace(docBroker->getJailId(), id, "EndSession: " + uri);
@@ -1069,6 +1313,16 @@ public:
             }
             else if (reqPathTokens.count() > 2 && reqPathTokens[0] == "lool" && reqPathTokens[2] == "ws")
             {
+                // Accept websocket compression, if offered, before the
+                // handshake response goes out with the WS construction.
+                const bool compress = negotiateWebSocketCompression(request, response);
+
+                // Advertise which host serves this document, so a sticky
+                // load balancer can route further viewers of the same
+                // document to the warm DocumentBroker here.
+                response.set("X-LOOL-WSD-Server", LOOLWSD::ServerName.empty() ?
+                                                  Environment::nodeName() : LOOLWSD::ServerName);
+
                 auto ws = std::make_shared<WebSocket>(request, response);
                 responded = true; // After upgrading to WS we should not set HTTP response.
                 try
@@ -1078,7 +1332,7 @@ public:
                     ws->setSendTimeout(WS_SEND_TIMEOUT_MS * 1000);
                     std::string decodedUri;
                     URI::decode(reqPathTokens[1], decodedUri);
-                    handleGetRequest(decodedUri, ws, id);
+                    handleGetRequest(decodedUri, ws, id, compress);
                 }
                 catch (const WebSocketErrorMessageException& exc)
                 {
@@ -1308,6 +1562,7 @@ std::string getLaunchURI()
 std::atomic<unsigned> LOOLWSD::NextSessionId;
 int LOOLWSD::ForKitWritePipe = -1;
 bool LOOLWSD::NoCapsForKit = false;
+bool LOOLWSD::UseSocketReactor = false;
 std::string LOOLWSD::Cache = LOOLWSD_CACHEDIR;
 std::string LOOLWSD::SysTemplate;
 std::string LOOLWSD::LoTemplate;
@@ -1321,6 +1576,11 @@ Util::RuntimeConstant<bool> LOOLWSD::SSLTermination;
 static std::string UnitTestLibrary;
 
 unsigned int LOOLWSD::NumPreSpawnedChildren = 0;
+unsigned int LOOLWSD::MaxPreSpawnedChildren = 0;
+unsigned int LOOLWSD::PreSpawnBurstPercent = 0;
+unsigned int LOOLWSD::IdleHibernateSecs = 0;
+unsigned int LOOLWSD::ReconnectGraceSecs = 0;
+unsigned int LOOLWSD::MaxConvertToActive = 0;
 std::atomic<unsigned> LOOLWSD::NumDocBrokers;
 std::atomic<unsigned> LOOLWSD::NumConnections;
 std::unique_ptr<TraceFileWriter> LOOLWSD::TraceDumper;
@@ -1364,6 +1624,11 @@ void LOOLWSD::initialize(Application& self)
     // Add default values of new entries here.
     static const std::map<std::string, std::string> DefAppConfig = {
         { "tile_cache_path", LOOLWSD_CACHEDIR },
+        { "tile_cache_max_doc_size_mb", "64" },
+        { "tile_cache_max_total_size_mb", "1024" },
+        { "tile_cache_max_age_secs", "86400" },
+        { "tile_codec.interactive", "png:1:none" },
+        { "tile_codec.preview", "png:6:all" },
         { "sys_template_path", "systemplate" },
         { "lo_template_path", "/opt/collaboraoffice5.1" },
         { "child_root_path", "jails" },
@@ -1372,6 +1637,9 @@ void LOOLWSD::initialize(Application& self)
         { "file_server_root_path", "../loleaflet/../" },
         { "num_prespawn_children", "1" },
         { "per_document.max_concurrency", "4" },
+        { "per_document.idle_hibernate_secs", "0" },
+        { "per_document.reconnect_grace_secs", "60" },
+        { "per_document.render_share_ms_per_sec", "0" },
         { "loleaflet_html", "loleaflet.html" },
         { "logging.color", "true" },
         { "logging.level", "trace" },
@@ -1480,12 +1748,25 @@ void LOOLWSD::initialize(Application& self)
 #endif
 
     Cache = getPathFromConfig("tile_cache_path");
+
+    const size_t maxDocCacheMB = getConfigValue<unsigned int>(conf, "tile_cache_max_doc_size_mb", 64);
+    const size_t maxTotalCacheMB = getConfigValue<unsigned int>(conf, "tile_cache_max_total_size_mb", 1024);
+    TileCache::setEvictionPolicy(maxDocCacheMB * 1024 * 1024, maxTotalCacheMB * 1024 * 1024,
+                                 getConfigValue<unsigned int>(conf, "tile_cache_max_age_secs", 86400));
+
+    // Font and style renderings are shared by all documents on the host.
+    TileCache::setRenderingCacheDir(Cache + "/rendering");
+
     SysTemplate = getPathFromConfig("sys_template_path");
     LoTemplate = getPathFromConfig("lo_template_path");
     ChildRoot = getPathFromConfig("child_root_path");
     ServerName = config().getString("server_name");
     FileServerRoot = getPathFromConfig("file_server_root_path");
     NumPreSpawnedChildren = getConfigValue<unsigned int>(conf, "num_prespawn_children", 1);
+    MaxPreSpawnedChildren = std::max(getConfigValue<unsigned int>(conf, "prefork.max_children", 8),
+                                     NumPreSpawnedChildren);
+    PreSpawnBurstPercent = getConfigValue<unsigned int>(conf, "prefork.burst_percent", 150);
+    UseSocketReactor = getConfigValue<bool>(conf, "socket_reactor", false);
 
     const auto maxConcurrency = getConfigValue<unsigned int>(conf, "per_document.max_concurrency", 4);
     if (maxConcurrency > 0)
@@ -1493,6 +1774,26 @@ void LOOLWSD::initialize(Application& self)
         setenv("MAX_CONCURRENCY", std::to_string(maxConcurrency).c_str(), 1);
     }
 
+    IdleHibernateSecs = getConfigValue<unsigned int>(conf, "per_document.idle_hibernate_secs", 0);
+    ReconnectGraceSecs = getConfigValue<unsigned int>(conf, "per_document.reconnect_grace_secs", 60);
+    MaxConvertToActive = getConfigValue<unsigned int>(conf, "convert_to.max_active", 4);
+
+    DocumentBroker::setRenderShareMsPerSec(
+        getConfigValue<unsigned int>(conf, "per_document.render_share_ms_per_sec", 0));
+
+    // The warm-up list is consumed in the kit process.
+    const auto kitWarmup = getConfigValue<std::string>(conf, "kit_warmup", "");
+    if (!kitWarmup.empty())
+    {
+        setenv("LOOL_KIT_WARMUP", kitWarmup.c_str(), 1);
+    }
+
+    // The tile codec specs are consumed in the kit process.
+    const auto interactiveCodec = getConfigValue<std::string>(conf, "tile_codec.interactive", "png:1:none");
+    setenv("LOOL_TILE_CODEC_INTERACTIVE", interactiveCodec.c_str(), 1);
+    const auto previewCodec = getConfigValue<std::string>(conf, "tile_codec.preview", "png:6:all");
+    setenv("LOOL_TILE_CODEC_PREVIEW", previewCodec.c_str(), 1);
+
     // Otherwise we profile the soft-device at jail creation time.
     setenv ("SAL_DISABLE_OPENCL", "true", 1);
 
@@ -1615,6 +1916,30 @@ void LOOLWSD::dumpOutgoingTrace(const std::string& pId, const std::string& sessi
     }
 }
 
+std::shared_ptr<ChildProcess> LOOLWSD::getNewChild()
+{
+    return ::getNewChild();
+}
+
+bool LOOLWSD::migrateDocument(const std::string& docKey, const std::string& serverName)
+{
+    std::shared_ptr<DocumentBroker> docBroker;
+    {
+        const auto shard = docBrokersShard(docKey);
+        std::lock_guard<std::mutex> docBrokersLock(DocBrokersMutex[shard]);
+        const auto it = DocBrokers[shard].find(docKey);
+        if (it == DocBrokers[shard].end())
+        {
+            Log::warn("Cannot migrate unknown docKey [" + docKey + "].");
+            return false;
+        }
+
+        docBroker = it->second;
+    }
+
+    return docBroker->migrate(serverName);
+}
+
 void LOOLWSD::defineOptions(OptionSet& optionSet)
 {
     ServerApplication::defineOptions(optionSet);
@@ -1919,14 +2244,49 @@ int LOOLWSD::main(const std::vector<std::string>& /*args*/)
         {
             if (!std::getenv("LOOL_NO_AUTOSAVE"))
             {
+                try
+                {
+                    // Deadline-driven: documents arm themselves on
+                    // modification, so idle ones cost nothing here.
+                    autoSaveDueDocuments();
+                }
+                catch (const std::exception& exc)
+                {
+                    Log::error("Exception: " + std::string(exc.what()));
+                }
+
+                // Hibernation and reconnect-grace expiry follow the
+                // passage of time, not modification, so they keep a
+                // periodic sweep.
                 if (time(nullptr) >= last30SecCheck + 30)
                 {
                     try
                     {
-                        std::unique_lock<std::mutex> DocBrokersLock(DocBrokersMutex);
-                        for (auto& brokerIt : DocBrokers)
+                        for (size_t shard = 0; shard < DocBrokersShardCount; ++shard)
                         {
-                            brokerIt.second->autoSave(false, 0);
+                            std::unique_lock<std::mutex> DocBrokersLock(DocBrokersMutex[shard]);
+                            for (auto brokerIt = DocBrokers[shard].begin(); brokerIt != DocBrokers[shard].end(); )
+                            {
+                                brokerIt->second->hibernateIfIdle();
+
+                                // Destroy documents kept alive only for a
+                                // reconnect that never came.
+                                if (brokerIt->second->isReconnectGraceExpired())
+                                {
+                                    Log::info("Reconnect grace of docKey [" + brokerIt->first + "] expired; removing.");
+                                    Admin::instance().rmDoc(brokerIt->first);
+                                    brokerIt = DocBrokers[shard].erase(brokerIt);
+#if MAX_DOCUMENTS > 0
+                                    // Cannot logNumDocBrokers() here; it takes
+                                    // the shard lock we are holding.
+                                    --LOOLWSD::NumDocBrokers;
+#endif
+                                }
+                                else
+                                {
+                                    ++brokerIt;
+                                }
+                            }
                         }
                     }
                     catch (const std::exception& exc)
@@ -2017,11 +2377,14 @@ namespace Util
 
 void alertAllUsers(const std::string& cmd, const std::string& kind)
 {
-    std::lock_guard<std::mutex> DocBrokersLock(DocBrokersMutex);
-
-    for (auto& brokerIt : DocBrokers)
+    for (size_t shard = 0; shard < DocBrokersShardCount; ++shard)
     {
-        brokerIt.second->alertAllUsersOfDocument(cmd, kind);
+        std::lock_guard<std::mutex> DocBrokersLock(DocBrokersMutex[shard]);
+
+        for (auto& brokerIt : DocBrokers[shard])
+        {
+            brokerIt.second->alertAllUsersOfDocument(cmd, kind);
+        }
     }
 }
 
@@ -39,7 +39,13 @@ public:
     // so just keep these as statics.
     static std::atomic<unsigned> NextSessionId;
     static unsigned int NumPreSpawnedChildren;
+    static unsigned int MaxPreSpawnedChildren;
+    static unsigned int PreSpawnBurstPercent;
+    static unsigned int IdleHibernateSecs;
+    static unsigned int ReconnectGraceSecs;
+    static unsigned int MaxConvertToActive;
     static bool NoCapsForKit;
+    static bool UseSocketReactor;
     static int ForKitWritePipe;
     static std::string Cache;
     static std::string SysTemplate;
@@ -79,6 +85,22 @@ public:
     static
     void dumpOutgoingTrace(const std::string& pId, const std::string& sessionId, const std::string& data);
 
+    /// Claim a spare child process, spawning more if needed.
+    /// Used to wake hibernated documents; returns nullptr on timeout.
+    static
+    std::shared_ptr<ChildProcess> getNewChild();
+
+    /// Hand the given document over to the named server.
+    /// Returns false if the document is unknown or not migratable.
+    static
+    bool migrateDocument(const std::string& docKey, const std::string& serverName);
+
+    /// Arm an autosave deadline for a document that became modified.
+    /// The main loop checks it when due, instead of polling every
+    /// broker; a no-op when a deadline is already pending.
+    static
+    void scheduleAutoSave(const std::string& docKey);
+
 protected:
     void initialize(Poco::Util::Application& self) override;
     void uninitialize() override;
@@ -25,12 +25,18 @@ class Document
 private:
     LibreOfficeKitDocument* _pDoc;
     std::mutex _mutex;
+    /// The view last made current via setView/createView, or -1 when unknown.
+    /// Core changes the current view only through these entry points, so the
+    /// cache stays valid and lets us skip redundant view switches. Guarded by
+    /// the same external lock as every other member (see getLock()).
+    int _currentView;
 
 public:
     /// A lok::Document is typically created by the lok::Office::documentLoad() method.
     inline Document(LibreOfficeKitDocument* pDoc) :
         _pDoc(pDoc),
-        _mutex()
+        _mutex(),
+        _currentView(-1)
     {
         Log::trace("lok::Document ctor.");
     }
@@ -212,6 +218,8 @@ public:
     {
         Log::trace() << "lok::Document: initializeForRendering: Arguments: [" << pArguments << "]." << Log::end;
         _pDoc->pClass->initializeForRendering(_pDoc, pArguments);
+        // This can create a new view in Impress, changing the current one.
+        _currentView = -1;
     }
 
     /**
@@ -392,7 +400,9 @@ public:
     int createView()
     {
         Log::trace() << "lok::Document: createView" << Log::end;
-        return _pDoc->pClass->createView(_pDoc);
+        // The freshly created view becomes current.
+        _currentView = _pDoc->pClass->createView(_pDoc);
+        return _currentView;
     }
 
     /**
@@ -402,6 +412,12 @@ public:
     void destroyView(int nId)
     {
         Log::trace() << "lok::Document: destroyView: " << nId << Log::end;
+        if (nId == _currentView)
+        {
+            // Core picks another view as current; we don't know which.
+            _currentView = -1;
+        }
+
         _pDoc->pClass->destroyView(_pDoc, nId);
     }
 
@@ -411,9 +427,17 @@ public:
      */
     void setView(int nId)
     {
-        Log::trace() << "lok::Document: setView: " << nId << Log::end;
         assert(nId >= 0 && "ViewID must be non-negative.");
+        if (nId == _currentView)
+        {
+            // Already current; switching views in core is not free,
+            // and a session issues this before nearly every command.
+            return;
+        }
+
+        Log::trace() << "lok::Document: setView: " << nId << Log::end;
         _pDoc->pClass->setView(_pDoc, nId);
+        _currentView = nId;
     }
 
     /**
@@ -422,7 +446,10 @@ public:
      */
     int getView()
     {
-        return _pDoc->pClass->getView(_pDoc);
+        // Re-query core; this is the recovery path for the
+        // cases where core switched views behind our back.
+        _currentView = _pDoc->pClass->getView(_pDoc);
+        return _currentView;
     }
 
     /**
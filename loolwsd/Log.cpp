@@ -11,9 +11,14 @@
 
 #include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <iomanip>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 
 #include <sys/syscall.h>
 #include <unistd.h>
@@ -21,6 +26,7 @@
 #include <Poco/ConsoleChannel.h>
 #include <Poco/FileChannel.h>
 #include <Poco/FormattingChannel.h>
+#include <Poco/Message.h>
 #include <Poco/PatternFormatter.h>
 #include <Poco/Process.h>
 #include <Poco/SplitterChannel.h>
@@ -52,6 +58,36 @@ namespace Log
     };
     static StaticNames Source;
 
+    /// The configured level, cached at initialize() so gating a
+    /// message is one relaxed load instead of a Poco::Logger lookup.
+    /// Trace until initialize() runs; nothing is lost before then.
+    static std::atomic<int> ActiveLevel(Poco::Message::PRIO_TRACE);
+
+    bool traceEnabled()
+    {
+        return ActiveLevel.load(std::memory_order_relaxed) >= Poco::Message::PRIO_TRACE;
+    }
+
+    bool debugEnabled()
+    {
+        return ActiveLevel.load(std::memory_order_relaxed) >= Poco::Message::PRIO_DEBUG;
+    }
+
+    bool infoEnabled()
+    {
+        return ActiveLevel.load(std::memory_order_relaxed) >= Poco::Message::PRIO_INFORMATION;
+    }
+
+    bool warnEnabled()
+    {
+        return ActiveLevel.load(std::memory_order_relaxed) >= Poco::Message::PRIO_WARNING;
+    }
+
+    bool errorEnabled()
+    {
+        return ActiveLevel.load(std::memory_order_relaxed) >= Poco::Message::PRIO_ERROR;
+    }
+
     // We need a signal safe means of writing messages
     //   $ man 7 signal
     void signalLog(const char *message)
@@ -114,6 +150,232 @@ namespace Log
         signalLog(buffer);
     }
 
+    /// Capacity of the line ring below; must be a power of two.
+    static const std::size_t LogRingSize = 4096;
+
+    /// The output backend. Callers enqueue fully-formatted lines into
+    /// a bounded ring and a dedicated writer thread hands them to the
+    /// Poco channel, so a slow or contended sink never stalls the
+    /// thread doing the logging. When the ring is full, lines are
+    /// dropped and counted rather than blocking the caller; the count
+    /// is reported when the writer catches up.
+    class AsyncWriter
+    {
+    public:
+        AsyncWriter() :
+            _head(0),
+            _tail(0),
+            _dropped(0),
+            _ownerPid(0),
+            _stop(false),
+            _waitMutex(new std::mutex),
+            _cond(new std::condition_variable)
+        {
+        }
+
+        ~AsyncWriter()
+        {
+            stop();
+        }
+
+        /// (Re)start the writer thread. Called from initialize(),
+        /// notably again in a forked child (forkit forks kits without
+        /// exec), where the parent's writer thread does not survive.
+        void start()
+        {
+            if (_thread && _ownerPid == getpid())
+            {
+                return;
+            }
+
+            if (_thread)
+            {
+                // The handle came over a fork; its thread died with
+                // the parent's address space and joining or detaching
+                // an invalid id is undefined, as is touching a mutex
+                // that may have been held at the fork. Leak them and
+                // start afresh; we fork only a handful of times.
+                _thread.release();
+                _waitMutex.release();
+                _cond.release();
+                _waitMutex.reset(new std::mutex);
+                _cond.reset(new std::condition_variable);
+                for (auto& slot : _slots)
+                {
+                    slot.ready = false;
+                }
+
+                _head = 0;
+                _tail = 0;
+                _dropped = 0;
+            }
+
+            _stop = false;
+            _ownerPid = getpid();
+            _thread.reset(new std::thread([this] { run(); }));
+        }
+
+        void stop()
+        {
+            if (_thread && _ownerPid == getpid())
+            {
+                _stop = true;
+                _cond->notify_one();
+                _thread->join();
+                _thread.reset();
+            }
+            else if (_thread)
+            {
+                _thread.release();
+            }
+        }
+
+        bool running() const
+        {
+            return _thread != nullptr && _ownerPid == getpid();
+        }
+
+        /// Queue a line for the writer thread. Returns false when no
+        /// writer is running and the caller should emit synchronously.
+        /// When the ring is full the line is counted and dropped, as
+        /// blocking here would perturb whatever we are measuring.
+        bool enqueue(const Poco::Message::Priority priority, const std::string& line)
+        {
+            if (!running())
+            {
+                return false;
+            }
+
+            auto pos = _head.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                if (pos - _tail.load(std::memory_order_acquire) >= LogRingSize)
+                {
+                    _dropped.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+
+                if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_acq_rel))
+                {
+                    break;
+                }
+            }
+
+            auto& slot = _slots[pos & (LogRingSize - 1)];
+            slot.priority = priority;
+            slot.line = line; // Reuses the slot's buffer after warm-up.
+            slot.ready.store(true, std::memory_order_release);
+            _cond->notify_one();
+            return true;
+        }
+
+        /// Hand one line to the Poco logger; the synchronous tail end.
+        static void emit(const Poco::Message::Priority priority, const std::string& line)
+        {
+            auto& log = logger();
+            Poco::Message message(log.name(), line, priority);
+            log.log(message);
+        }
+
+    private:
+        struct Slot
+        {
+            Slot() :
+                ready(false),
+                priority(Poco::Message::PRIO_INFORMATION)
+            {
+            }
+
+            std::atomic<bool> ready;
+            Poco::Message::Priority priority;
+            std::string line;
+        };
+
+        void run()
+        {
+            prctl(PR_SET_NAME, reinterpret_cast<unsigned long>("log_writer"), 0, 0, 0);
+
+            std::unique_lock<std::mutex> lock(*_waitMutex);
+            for (;;)
+            {
+                lock.unlock();
+                drain();
+                lock.lock();
+
+                if (_stop &&
+                    _tail.load(std::memory_order_relaxed) == _head.load(std::memory_order_relaxed))
+                {
+                    break;
+                }
+
+                // The timeout covers a notify racing past the wait.
+                _cond->wait_for(lock, std::chrono::milliseconds(50));
+            }
+        }
+
+        void drain()
+        {
+            for (;;)
+            {
+                const auto tail = _tail.load(std::memory_order_relaxed);
+                auto& slot = _slots[tail & (LogRingSize - 1)];
+                if (tail == _head.load(std::memory_order_acquire) ||
+                    !slot.ready.load(std::memory_order_acquire))
+                {
+                    // Empty, or a producer is still filling the slot.
+                    break;
+                }
+
+                emit(slot.priority, slot.line);
+                slot.ready.store(false, std::memory_order_relaxed);
+                _tail.store(tail + 1, std::memory_order_release);
+            }
+
+            const auto dropped = _dropped.exchange(0, std::memory_order_relaxed);
+            if (dropped > 0)
+            {
+                emit(Poco::Message::PRIO_WARNING, prefix("WRN") + "Logging overloaded: dropped " +
+                                                  std::to_string(dropped) + " messages.");
+            }
+        }
+
+        Slot _slots[LogRingSize];
+        std::atomic<std::size_t> _head;
+        std::atomic<std::size_t> _tail;
+        std::atomic<std::size_t> _dropped;
+        pid_t _ownerPid;
+        std::atomic<bool> _stop;
+        std::unique_ptr<std::mutex> _waitMutex;
+        std::unique_ptr<std::condition_variable> _cond;
+        std::unique_ptr<std::thread> _thread;
+    };
+
+    static AsyncWriter Writer;
+
+    /// Format a line into a per-thread buffer and hand it off.
+    /// Falls back to emitting synchronously before initialize() and
+    /// during shutdown, when no writer thread is running.
+    static void log(const Poco::Message::Priority priority, const char* level, const std::string& msg)
+    {
+        if (priority > ActiveLevel.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        static thread_local std::string line;
+        line.clear();
+
+        char buffer[1024];
+        getPrefix(buffer, level);
+        line.append(buffer);
+        line.append(msg);
+
+        if (!Writer.enqueue(priority, line))
+        {
+            AsyncWriter::emit(priority, line);
+        }
+    }
+
     void initialize(const std::string& name,
                     const std::string& logLevel,
                     const bool withColor,
@@ -147,6 +409,9 @@ namespace Log
         auto& logger = Poco::Logger::create(Source.name, channel, Poco::Message::PRIO_TRACE);
 
         logger.setLevel(logLevel.empty() ? std::string("trace") : logLevel);
+        ActiveLevel.store(logger.getLevel(), std::memory_order_relaxed);
+
+        Writer.start();
 
         info("Initializing " + name);
         info("Log level is [" + std::to_string(logger.getLevel()) + "].");
@@ -159,36 +424,39 @@ namespace Log
 
     void trace(const std::string& msg)
     {
-        logger().trace(prefix("TRC") + msg);
+        log(Poco::Message::PRIO_TRACE, "TRC", msg);
     }
 
     void debug(const std::string& msg)
     {
-        logger().debug(prefix("DBG") + msg);
+        log(Poco::Message::PRIO_DEBUG, "DBG", msg);
     }
 
     void info(const std::string& msg)
     {
-        logger().information(prefix("INF") + msg);
+        log(Poco::Message::PRIO_INFORMATION, "INF", msg);
     }
 
     void warn(const std::string& msg)
     {
-        logger().warning(prefix("WRN") + msg);
+        log(Poco::Message::PRIO_WARNING, "WRN", msg);
     }
 
     void error(const std::string& msg)
     {
-        logger().error(prefix("ERR") + msg);
+        log(Poco::Message::PRIO_ERROR, "ERR", msg);
     }
 
     void syserror(const std::string& msg)
     {
-        logger().error(prefix("ERR") + msg + " (errno: " + std::string(std::strerror(errno)) + ")");
+        log(Poco::Message::PRIO_ERROR, "ERR",
+            msg + " (errno: " + std::string(std::strerror(errno)) + ")");
     }
 
     void fatal(const std::string& msg)
     {
+        // Fatal lines go out synchronously; the process is most
+        // likely about to exit and must not lose them to the ring.
         logger().fatal(prefix("FTL") + msg);
     }
 
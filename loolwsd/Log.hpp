@@ -35,6 +35,17 @@ namespace Log
     void fatal(const std::string& msg);
     void sysfatal(const std::string& msg);
 
+    /// Level predicates, backed by a level cached at initialize().
+    /// Hot paths gate on these before building a message whose
+    /// arguments are themselves expensive (serializing a tile,
+    /// abbreviating a payload), so a disabled level costs a single
+    /// relaxed load per message.
+    bool traceEnabled();
+    bool debugEnabled();
+    bool infoEnabled();
+    bool warnEnabled();
+    bool errorEnabled();
+
     /// Signal safe prefix logging
     void signalLogPrefix();
     /// Signal safe logging
@@ -51,79 +62,99 @@ namespace Log
     } end;
 
     /// Helper class to support implementing streaming
-    /// operator for logging.
+    /// operator for logging. When constructed for a disabled
+    /// level, nothing is ever formatted or flushed.
     class StreamLogger
     {
         public:
-            StreamLogger(std::function<void(const std::string&)> func)
-              : _func(std::move(func))
+            StreamLogger(std::function<void(const std::string&)> func, const bool enabled)
+              : _func(std::move(func)),
+                _enabled(enabled)
             {
             }
 
             StreamLogger(StreamLogger&& sl) noexcept
               : _stream(sl._stream.str())
               , _func(std::move(sl._func))
+              , _enabled(sl._enabled)
             {
             }
 
+            bool enabled() const
+            {
+                return _enabled;
+            }
+
             void flush() const
             {
-                _func(_stream.str());
+                if (_enabled)
+                {
+                    _func(_stream.str());
+                }
             }
 
             std::ostringstream _stream;
 
         private:
             std::function<void(const std::string&)> _func;
+            bool _enabled;
     };
 
     inline
     StreamLogger trace()
     {
-        return StreamLogger([](const std::string& msg) { trace(msg);});
+        return StreamLogger([](const std::string& msg) { trace(msg);}, traceEnabled());
     }
 
     inline
     StreamLogger debug()
     {
-        return StreamLogger([](const std::string& msg) { debug(msg);});
+        return StreamLogger([](const std::string& msg) { debug(msg);}, debugEnabled());
     }
 
     inline
     StreamLogger info()
     {
-        return StreamLogger([](const std::string& msg) { info(msg);});
+        return StreamLogger([](const std::string& msg) { info(msg);}, infoEnabled());
     }
 
     inline
     StreamLogger warn()
     {
-        return StreamLogger([](const std::string& msg) { warn(msg);});
+        return StreamLogger([](const std::string& msg) { warn(msg);}, warnEnabled());
     }
 
     inline
     StreamLogger error()
     {
-        return StreamLogger([](const std::string& msg) { error(msg);});
+        return StreamLogger([](const std::string& msg) { error(msg);}, errorEnabled());
     }
 
     inline
     StreamLogger fatal()
     {
-        return StreamLogger([](const std::string& msg) { fatal(msg);});
+        return StreamLogger([](const std::string& msg) { fatal(msg);}, true);
     }
 
     template <typename U>
     StreamLogger& operator <<(StreamLogger& lhs, const U& rhs)
     {
-        lhs._stream << rhs;
+        if (lhs.enabled())
+        {
+            lhs._stream << rhs;
+        }
+
         return lhs;
     }
 
     template <typename U>
     StreamLogger& operator <<(StreamLogger&& lhs, U&& rhs)
     {
-        lhs._stream << rhs;
+        if (lhs.enabled())
+        {
+            lhs._stream << rhs;
+        }
+
         return lhs;
     }
 
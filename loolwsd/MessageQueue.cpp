@@ -10,32 +10,128 @@
 #include "MessageQueue.hpp"
 
 #include <algorithm>
+#include <chrono>
+#include <utility>
 
 #include <Poco/StringTokenizer.h>
 
+#include <AdminMetrics.hpp>
 #include <LOOLProtocol.hpp>
 #include <Log.hpp>
+#include <Rectangle.hpp>
 #include <TileDesc.hpp>
 
 using Poco::StringTokenizer;
 
+namespace
+{
+    /// How long to keep the coalescing window open after each tile arrival.
+    constexpr unsigned TileCoalesceWindowMs = 2;
+    /// Bound on the total time a get() may linger coalescing.
+    constexpr unsigned TileCoalesceMaxMs = 10;
+
+    /// Parse an invalidate-tiles payload 'x, y, width, height[, part]'.
+    /// Returns false for EMPTY or otherwise malformed payloads; part
+    /// is -1 when the payload carries none (Writer).
+    bool parseInvalidatePayload(const std::string& payload, Util::Rectangle& rect, int& part)
+    {
+        LOOLProtocol::Tokenizer tokenizer(payload, ',');
+        LOOLProtocol::TokenView token;
+        int values[5];
+        size_t count = 0;
+        while (tokenizer.next(token))
+        {
+            if (count == 5 || !LOOLProtocol::stringToInteger(token, values[count]))
+            {
+                return false;
+            }
+
+            ++count;
+        }
+
+        if (count != 4 && count != 5)
+        {
+            return false;
+        }
+
+        rect = Util::Rectangle(values[0], values[1], values[2], values[3]);
+        part = (count == 5 ? values[4] : -1);
+        return true;
+    }
+
+    /// Record how long a tile sat queued before being handed out.
+    void recordTileQueueWait(const std::chrono::steady_clock::time_point enqueueTime)
+    {
+        AdminMetrics::get().TileQueueWaitUs.record(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - enqueueTime).count());
+    }
+}
+
 MessageQueue::~MessageQueue()
 {
     clear();
 }
 
-void MessageQueue::put(const Payload& value)
+void MessageQueue::put(Payload value)
 {
     std::unique_lock<std::mutex> lock(_mutex);
-    put_impl(value);
+    put_impl(std::move(value));
+    const auto callback = _putCallback;
     lock.unlock();
     _cv.notify_one();
+
+    if (callback)
+    {
+        callback();
+    }
 }
 
 MessageQueue::Payload MessageQueue::get(const unsigned timeoutMs)
 {
     std::unique_lock<std::mutex> lock(_mutex);
 
+    waitForMessage(lock, timeoutMs);
+
+    return get_impl();
+}
+
+std::vector<MessageQueue::Payload> MessageQueue::getBatch(const unsigned timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    waitForMessage(lock, timeoutMs);
+
+    std::vector<Payload> result;
+    while (wait_impl())
+    {
+        result.emplace_back(get_impl());
+    }
+
+    return result;
+}
+
+std::vector<MessageQueue::Payload> MessageQueue::tryGetBatch()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    std::vector<Payload> result;
+    while (wait_impl())
+    {
+        result.emplace_back(get_impl());
+    }
+
+    return result;
+}
+
+void MessageQueue::setPutCallback(const std::function<void()>& callback)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _putCallback = callback;
+}
+
+void MessageQueue::waitForMessage(std::unique_lock<std::mutex>& lock, const unsigned timeoutMs)
+{
     if (timeoutMs > 0)
     {
         if (!_cv.wait_for(lock, std::chrono::milliseconds(timeoutMs),
@@ -49,7 +145,24 @@ MessageQueue::Payload MessageQueue::get(const unsigned timeoutMs)
         _cv.wait(lock, [this] { return wait_impl(); });
     }
 
-    return get_impl();
+    // Keep a short window open while messages keep arriving, so that
+    // get_impl() can hand adjacent ones over combined.
+    const unsigned windowMs = coalesceWindowMs();
+    if (windowMs > 0)
+    {
+        const auto deadline = std::chrono::steady_clock::now() +
+                              std::chrono::milliseconds(TileCoalesceMaxMs);
+        auto lastSize = _queue.size();
+        while (std::chrono::steady_clock::now() < deadline &&
+               _cv.wait_for(lock, std::chrono::milliseconds(windowMs),
+                            [this, lastSize] { return _queue.size() != lastSize; }))
+        {
+            lastSize = _queue.size();
+        }
+
+        // The queue may have been cleared while lingering.
+        _cv.wait(lock, [this] { return wait_impl(); });
+    }
 }
 
 void MessageQueue::clear()
@@ -64,10 +177,9 @@ void MessageQueue::remove_if(const std::function<bool(const Payload&)>& pred)
     std::remove_if(_queue.begin(), _queue.end(), pred);
 }
 
-void MessageQueue::put_impl(const Payload& value)
+void MessageQueue::put_impl(Payload&& value)
 {
-    const auto msg = std::string(value.data(), value.size());
-    _queue.push_back(value);
+    _queue.push_back(std::move(value));
 }
 
 bool MessageQueue::wait_impl() const
@@ -77,7 +189,7 @@ bool MessageQueue::wait_impl() const
 
 MessageQueue::Payload MessageQueue::get_impl()
 {
-    Payload result = _queue.front();
+    Payload result(std::move(_queue.front()));
     _queue.pop_front();
     return result;
 }
@@ -87,170 +199,295 @@ void MessageQueue::clear_impl()
     _queue.clear();
 }
 
-void TileQueue::put_impl(const Payload& value)
+void TileQueue::put_impl(Payload&& value)
 {
-    const auto msg = std::string(value.data(), value.size());
-    const std::string firstToken = LOOLProtocol::getFirstToken(value);
+    // The hot path: tiles arrive as fixed-layout binary frames and
+    // are decoded without any formatting or tokenizing.
+    if (TileBinary::isTileFrame(value.data(), value.size()))
+    {
+        putTile(TileDesc::parseBinary(value.data(), value.size()));
+        return;
+    }
+    else if (TileBinary::isCombineFrame(value.data(), value.size()))
+    {
+        const auto tileCombined = TileCombined::parseBinary(value.data(), value.size());
+        for (const auto& tile : tileCombined.getTiles())
+        {
+            putTile(tile);
+        }
+
+        return;
+    }
 
-    if (firstToken == "canceltiles")
+    const auto firstToken = LOOLProtocol::getFirstTokenView(value);
+
+    if (firstToken.equals("canceltiles"))
     {
+        const auto msg = std::string(value.data(), value.size());
         Log::trace("Processing " + msg);
         Log::trace() << "Before canceltiles have " << _queue.size() << " in queue." << Log::end;
         const auto seqs = msg.substr(12);
         StringTokenizer tokens(seqs, ",", StringTokenizer::TOK_IGNORE_EMPTY | StringTokenizer::TOK_TRIM);
-        _queue.erase(std::remove_if(_queue.begin(), _queue.end(),
-                [&tokens](const Payload& v)
-                {
-                    const std::string s(v.data(), v.size());
-                    for (size_t i = 0; i < tokens.count(); ++i)
-                    {
-                        if (s.find("ver=" + tokens[i]) != std::string::npos)
-                        {
-                            Log::trace("Matched " + tokens[i] + ", Removing [" + s + "]");
-                            return true;
-                        }
-                    }
-
-                    return false;
-
-                }), _queue.end());
+        std::vector<int> versions;
+        for (size_t i = 0; i < tokens.count(); ++i)
+        {
+            versions.push_back(std::atoi(tokens[i].c_str()));
+        }
+
+        {
+            // Remember them beyond the queue sweep below: the render
+            // thread may have popped a matching tile already, and
+            // checks this set before painting it.
+            std::lock_guard<std::mutex> cancelLock(_cancelMutex);
+            _cancelledVersions.insert(versions.begin(), versions.end());
+            while (_cancelledVersions.size() > 64)
+            {
+                _cancelledVersions.erase(_cancelledVersions.begin());
+            }
+        }
+
+        for (size_t i = 0; i < _queue.size(); )
+        {
+            const auto& item = _items[i];
+            if (item.isTile() &&
+                std::find(versions.begin(), versions.end(), item.Desc->getVersion()) != versions.end())
+            {
+                Log::trace("Matched " + std::to_string(item.Desc->getVersion()) +
+                           ", Removing [" + item.Desc->serialize("tile") + "]");
+                erase(i);
+            }
+            else
+            {
+                ++i;
+            }
+        }
 
         // Don't push canceltiles into the queue.
         Log::trace() << "After canceltiles have " << _queue.size() << " in queue." << Log::end;
         return;
     }
-    else if (firstToken == "tilecombine")
+    else if (firstToken.equals("tilecombine"))
     {
         // Breakup tilecombine and deduplicate (we are re-combining the tiles
         // in the get_impl() again)
-        const auto tileCombined = TileCombined::parse(msg);
+        const auto tileCombined = TileCombined::parse(std::string(value.data(), value.size()));
         for (auto& tile : tileCombined.getTiles())
         {
-            const std::string newMsg = tile.serialize("tile");
-
-            removeDuplicate(newMsg);
-
-            MessageQueue::put_impl(Payload(newMsg.data(), newMsg.data() + newMsg.size()));
+            putTile(tile);
         }
         return;
     }
-    else if (firstToken == "tile")
+    else if (firstToken.equals("tile"))
     {
-        removeDuplicate(msg);
-
-        MessageQueue::put_impl(value);
+        putTile(TileDesc::parse(value.data(), value.size()));
         return;
     }
 
-    // TODO probably we could deduplacite the invalidation callbacks (later
-    // one wins) the same way as we do for the tiles - to be tested.
+    else if (firstToken.equals("callback"))
+    {
+        // A bulk edit (e.g. global find-and-replace) emits thousands
+        // of overlapping invalidation rectangles; while they sit
+        // here waiting for the consumer, merge touching ones into
+        // their cover, so downstream sees a handful of rectangles.
+        if (coalesceInvalidate(std::string(value.data(), value.size())))
+        {
+            return;
+        }
+    }
 
-    MessageQueue::put_impl(value);
+    MessageQueue::put_impl(std::move(value));
+    _items.push_back(QueueItem());
 }
 
-void TileQueue::removeDuplicate(const std::string& tileMsg)
+bool TileQueue::coalesceInvalidate(const std::string& msg)
 {
-    assert(LOOLProtocol::getFirstToken(tileMsg) == "tile");
+    LOOLProtocol::Tokenizer tokenizer(msg);
+    LOOLProtocol::TokenView name, viewId, type;
+    int callbackType = -1;
+    if (!tokenizer.next(name) || !tokenizer.next(viewId) || !tokenizer.next(type) ||
+        !LOOLProtocol::stringToInteger(type, callbackType) ||
+        callbackType != LOK_CALLBACK_INVALIDATE_TILES)
+    {
+        return false;
+    }
+
+    // The payload is everything after 'callback <viewId> <type> '.
+    const auto prefix = "callback " + viewId.toString() + ' ' + type.toString() + ' ';
+    if (msg.compare(0, prefix.size(), prefix) != 0)
+    {
+        return false;
+    }
 
-    // FIXME: This looks rather fragile; but OTOH if I understand correctly this doesn't handle
-    // input from clients, but strings we have created ourselves here in C++ code, so probably we
-    // can be sure that the "ver" parameter is always in such a location that this does what we
-    // mean.
-    // FIXME: also the ver=... is only for debugging from what I can see, so
-    // double-check if we can actually avoid the 'ver' everywhere in the non-debug
-    // builds
-    const std::string newMsg = tileMsg.substr(0, tileMsg.find(" ver"));
+    Util::Rectangle rect;
+    int part;
+    if (!parseInvalidatePayload(msg.substr(prefix.size()), rect, part))
+    {
+        return false;
+    }
 
     for (size_t i = 0; i < _queue.size(); ++i)
     {
-        auto& it = _queue[i];
-        const std::string old(it.data(), it.size());
-        const std::string oldMsg = old.substr(0, old.find(" ver"));
-        if (newMsg == oldMsg)
+        if (_items[i].isTile())
+        {
+            continue;
+        }
+
+        const std::string queued(_queue[i].data(), _queue[i].size());
+        if (queued.compare(0, prefix.size(), prefix) != 0)
+        {
+            continue;
+        }
+
+        Util::Rectangle queuedRect;
+        int queuedPart;
+        if (!parseInvalidatePayload(queued.substr(prefix.size()), queuedRect, queuedPart) ||
+            queuedPart != part || !rect.intersects(queuedRect))
+        {
+            continue;
+        }
+
+        queuedRect.extend(rect);
+
+        std::ostringstream oss;
+        oss << prefix << queuedRect.getLeft() << ", " << queuedRect.getTop() << ", "
+            << queuedRect.getWidth() << ", " << queuedRect.getHeight();
+        if (part >= 0)
         {
-            Log::debug() << "Remove duplicate message: " << old << " -> " << tileMsg << Log::end;
-            _queue.erase(_queue.begin() + i);
-            break;
+            oss << ", " << part;
         }
+
+        const auto merged = oss.str();
+        Log::trace("Merged invalidate [" + msg + "] into [" + merged + "].");
+        _queue[i] = Payload(merged.data(), merged.data() + merged.size());
+        return true;
     }
+
+    return false;
 }
 
-int TileQueue::priority(const std::string& tileMsg)
+std::string TileQueue::tileKey(const TileDesc& tile)
 {
-    auto tile = TileDesc::parse(tileMsg); //FIXME: Expensive, avoid.
+    return tile.generateKey();
+}
 
-    for (int i = static_cast<int>(_viewOrder.size()) - 1; i >= 0; --i)
+void TileQueue::putTile(const TileDesc& tile)
+{
+    const auto key = tileKey(tile);
+
+    if (_queuedKeys.find(key) != _queuedKeys.end())
     {
-        auto& cursor = _cursorPositions[_viewOrder[i]];
-        if (tile.intersectsWithRect(cursor.X, cursor.Y, cursor.Width, cursor.Height))
-            return i;
+        // A duplicate is queued already; the new request supersedes it.
+        for (size_t i = 0; i < _queue.size(); ++i)
+        {
+            if (_items[i].Key == key)
+            {
+                Log::debug() << "Remove duplicate message: "
+                             << _items[i].Desc->serialize("tile")
+                             << " -> " << tile.serialize("tile") << Log::end;
+                erase(i);
+                break;
+            }
+        }
     }
 
-    return -1;
+    // Queued as its binary frame; the consumer decodes it in place.
+    MessageQueue::put_impl(tile.serializeBinary());
+
+    QueueItem item;
+    item.Desc = std::make_shared<TileDesc>(tile);
+    item.Key = key;
+    item.EnqueueTime = std::chrono::steady_clock::now();
+    _items.push_back(item);
+    _queuedKeys.insert(key);
 }
 
-void TileQueue::deprioritizePreviews()
+void TileQueue::erase(const size_t index)
 {
-    for (size_t i = 0; i < _queue.size(); ++i)
+    if (_items[index].isTile())
     {
-        const auto front = _queue.front();
-        const std::string message(front.data(), front.size());
+        _queuedKeys.erase(_items[index].Key);
+    }
 
-        // stop at the first non-tile or non-'id' (preview) message
-        std::string id;
-        if (LOOLProtocol::getFirstToken(message) != "tile" || !LOOLProtocol::getTokenStringFromMessage(message, "id", id))
-            break;
+    _queue.erase(_queue.begin() + index);
+    _items.erase(_items.begin() + index);
+}
 
-        _queue.pop_front();
-        _queue.push_back(front);
-    }
+void TileQueue::clear_impl()
+{
+    MessageQueue::clear_impl();
+    _items.clear();
+    _queuedKeys.clear();
+
+    std::lock_guard<std::mutex> cancelLock(_cancelMutex);
+    _cancelledVersions.clear();
 }
 
-MessageQueue::Payload TileQueue::get_impl()
+unsigned TileQueue::coalesceWindowMs() const
 {
-    const auto front = _queue.front();
+    // Linger only when the next message out would be a plain tile;
+    // input, callbacks, previews and prefetches go out at once.
+    bool havePlainTile = false;
+    for (const auto& item : _items)
+    {
+        if (!item.isTile())
+            return 0;
 
-    auto msg = std::string(front.data(), front.size());
+        if (!item.isPreview() && !item.isPreFetch())
+            havePlainTile = true;
+    }
 
-    std::string id;
-    bool isTile = (LOOLProtocol::getFirstToken(msg) == "tile");
-    bool isPreview = isTile && LOOLProtocol::getTokenStringFromMessage(msg, "id", id);
-    if (!isTile || isPreview)
+    return (havePlainTile ? TileCoalesceWindowMs : 0);
+}
+
+int TileQueue::priority(const TileDesc& tile)
+{
+    for (int i = static_cast<int>(_viewOrder.size()) - 1; i >= 0; --i)
     {
-        // Don't combine non-tiles or tiles with id.
-        Log::trace() << "MessageQueue res: " << msg << Log::end;
-        _queue.pop_front();
+        auto& cursor = _cursorPositions[_viewOrder[i]];
+        if (tile.intersectsWithRect(cursor.X, cursor.Y, cursor.Width, cursor.Height))
+            return i;
+    }
 
-        // de-prioritize the other tiles with id - usually the previews in
-        // Impress
-        if (isPreview)
-            deprioritizePreviews();
+    return -1;
+}
 
-        return front;
+MessageQueue::Payload TileQueue::get_impl()
+{
+    // Input and callback messages bypass any pending tile renders, so
+    // keystroke latency stays flat however many tiles are queued.
+    for (size_t i = 0; i < _queue.size(); ++i)
+    {
+        if (!_items[i].isTile())
+        {
+            auto payload = std::move(_queue[i]);
+            if (Log::traceEnabled())
+            {
+                Log::trace() << "MessageQueue res: " << std::string(payload.data(), payload.size()) << Log::end;
+            }
+
+            erase(i);
+            return payload;
+        }
     }
 
-    // We are handling a tile; first try to find one that is at the cursor's
-    // position, otherwise handle the one that is at the front
-    int prioritized = 0;
+    // Next the plain tiles the user is waiting for; try to find one that is
+    // at the cursor's position, otherwise handle the one that is at the front.
+    int prioritized = -1;
     int prioritySoFar = -1;
     for (size_t i = 0; i < _queue.size(); ++i)
     {
-        auto& it = _queue[i];
-        const std::string prio(it.data(), it.size());
+        const auto& item = _items[i];
 
-        // avoid starving - stop the search when we reach a non-tile,
-        // otherwise we may keep growing the queue of unhandled stuff (both
-        // tiles and non-tiles)
-        if (LOOLProtocol::getFirstToken(prio) != "tile" || LOOLProtocol::getTokenStringFromMessage(prio, "id", id))
-            break;
+        // the previews and prefetches go out last
+        if (item.isPreview() || item.isPreFetch())
+            continue;
 
-        int p = priority(prio);
+        const int p = priority(*item.Desc);
 
-        if (p > prioritySoFar)
+        if (prioritized < 0 || p > prioritySoFar)
         {
             prioritySoFar = p;
             prioritized = i;
-            msg = prio;
 
             // found the highest priority already?
             if (prioritySoFar == static_cast<int>(_viewOrder.size()) - 1)
@@ -258,31 +495,48 @@ MessageQueue::Payload TileQueue::get_impl()
         }
     }
 
-    _queue.erase(_queue.begin() + prioritized);
+    if (prioritized < 0)
+    {
+        // Only previews and prefetches are left; hand them out in order.
+        auto payload = std::move(_queue.front());
+        if (Log::traceEnabled())
+        {
+            Log::trace() << "MessageQueue res: " << _items[0].Desc->serialize("tile") << Log::end;
+        }
+
+        recordTileQueueWait(_items[0].EnqueueTime);
+        erase(0);
+        return payload;
+    }
 
     std::vector<TileDesc> tiles;
-    tiles.emplace_back(TileDesc::parse(msg));
+    tiles.emplace_back(*_items[prioritized].Desc);
+    recordTileQueueWait(_items[prioritized].EnqueueTime);
+    erase(prioritized);
 
     // Combine as many tiles as possible with the top one.
     for (size_t i = 0; i < _queue.size(); )
     {
-        auto& it = _queue[i];
-        msg = std::string(it.data(), it.size());
-        if (LOOLProtocol::getFirstToken(msg) != "tile" || LOOLProtocol::getTokenStringFromMessage(msg, "id", id))
+        const auto& item = _items[i];
+        if (item.isPreview() || item.isPreFetch())
         {
-            // Don't combine non-tiles or tiles with id.
+            // Don't combine the previews or prefetches; they must not
+            // ride along at the prioritized tile's place in the queue.
             ++i;
             continue;
         }
 
-        auto tile2 = TileDesc::parse(msg);
-        Log::trace() << "combining candidate: " << msg << Log::end;
+        if (Log::traceEnabled())
+        {
+            Log::trace() << "combining candidate: " << item.Desc->serialize("tile") << Log::end;
+        }
 
         // Check if it's on the same row.
-        if (tiles[0].onSameRow(tile2))
+        if (tiles[0].onSameRow(*item.Desc))
         {
-            tiles.emplace_back(tile2);
-            _queue.erase(_queue.begin() + i);
+            tiles.emplace_back(*item.Desc);
+            recordTileQueueWait(item.EnqueueTime);
+            erase(i);
         }
         else
         {
@@ -294,14 +548,21 @@ MessageQueue::Payload TileQueue::get_impl()
 
     if (tiles.size() == 1)
     {
-        msg = tiles[0].serialize("tile");
-        Log::trace() << "MessageQueue res: " << msg << Log::end;
-        return Payload(msg.data(), msg.data() + msg.size());
+        if (Log::traceEnabled())
+        {
+            Log::trace() << "MessageQueue res: " << tiles[0].serialize("tile") << Log::end;
+        }
+
+        return tiles[0].serializeBinary();
+    }
+
+    const auto tileCombined = TileCombined::create(tiles);
+    if (Log::traceEnabled())
+    {
+        Log::trace() << "MessageQueue res: " << tileCombined.serialize("tilecombine") << Log::end;
     }
 
-    auto tileCombined = TileCombined::create(tiles).serialize("tilecombine");
-    Log::trace() << "MessageQueue res: " << tileCombined << Log::end;
-    return Payload(tileCombined.data(), tileCombined.data() + tileCombined.size());
+    return tileCombined.serializeBinary();
 }
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -11,12 +11,18 @@
 #define INCLUDED_MESSAGEQUEUE_HPP
 
 #include <algorithm>
+#include <chrono>
 #include <condition_variable>
 #include <deque>
+#include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <set>
 #include <vector>
 
+#include <TileDesc.hpp>
+
 /** Thread-safe message queue (FIFO).
 */
 class MessageQueue
@@ -35,8 +41,10 @@ public:
     MessageQueue(const MessageQueue&) = delete;
     MessageQueue& operator=(const MessageQueue&) = delete;
 
-    /// Thread safe insert the message.
-    void put(const Payload& value);
+    /// Thread safe insert the message. Takes the payload by value so
+    /// that callers with a temporary (or an std::move'd buffer) hand it
+    /// over without a copy; from here on it is only moved.
+    void put(Payload value);
     void put(const std::string& value)
     {
         put(Payload(value.data(), value.data() + value.size()));
@@ -46,6 +54,19 @@ public:
     /// timeoutMs can be 0 to signify infinity.
     Payload get(const unsigned timeoutMs = 0);
 
+    /// Thread safe obtaining of all pending messages: waits like
+    /// get(), then drains the queue under the same lock, avoiding a
+    /// lock round-trip and wakeup per message during bursts.
+    std::vector<Payload> getBatch(const unsigned timeoutMs = 0);
+
+    /// Thread safe, non-blocking drain of all pending messages.
+    /// Returns an empty vector when nothing is queued.
+    std::vector<Payload> tryGetBatch();
+
+    /// Register a callback invoked after each put, so an external
+    /// scheduler can service this queue without blocking on it.
+    void setPutCallback(const std::function<void()>& callback);
+
     /// Thread safe removal of all the pending messages.
     void clear();
 
@@ -53,17 +74,29 @@ public:
     void remove_if(const std::function<bool(const Payload&)>& pred);
 
 private:
+    /// Wait until a message is pending, observing the coalescing window.
+    void waitForMessage(std::unique_lock<std::mutex>& lock, const unsigned timeoutMs);
+
     std::mutex _mutex;
     std::condition_variable _cv;
+    std::function<void()> _putCallback;
 
 protected:
-    virtual void put_impl(const Payload& value);
+    virtual void put_impl(Payload&& value);
 
     bool wait_impl() const;
 
+    /// How many milliseconds get() may linger for further messages to
+    /// arrive before draining, so that get_impl() can combine them.
+    /// 0 (the default) disables the window.
+    virtual unsigned coalesceWindowMs() const
+    {
+        return 0;
+    }
+
     virtual Payload get_impl();
 
-    void clear_impl();
+    virtual void clear_impl();
 
     std::deque<Payload> _queue;
 };
@@ -86,6 +119,37 @@ private:
         int Height;
     };
 
+    /// The parse results of a queued message, kept alongside the
+    /// payload so that dedup and prioritization don't have to re-parse
+    /// it on every pass over the queue.
+    class QueueItem
+    {
+    public:
+        /// The parsed descriptor; null for non-tile messages.
+        std::shared_ptr<TileDesc> Desc;
+
+        /// The tile's position key; empty for non-tile messages.
+        std::string Key;
+
+        /// When the tile was queued, for the wait histogram.
+        std::chrono::steady_clock::time_point EnqueueTime;
+
+        bool isTile() const
+        {
+            return Desc != nullptr;
+        }
+
+        bool isPreview() const
+        {
+            return Desc && Desc->getId() >= 0;
+        }
+
+        bool isPreFetch() const
+        {
+            return Desc && Desc->isPreFetch();
+        }
+    };
+
 public:
 
     void updateCursorPosition(int viewId, int part, int x, int y, int width, int height)
@@ -123,23 +187,50 @@ public:
         _cursorPositions.erase(viewId);
     }
 
+    /// Whether the given tile version was cancelled because its last
+    /// subscriber disappeared. The render thread checks this before
+    /// painting a tile that left the queue before the cancellation
+    /// arrived.
+    bool isCancelled(const int version)
+    {
+        std::lock_guard<std::mutex> lock(_cancelMutex);
+        return _cancelledVersions.find(version) != _cancelledVersions.end();
+    }
+
 protected:
-    virtual void put_impl(const Payload& value) override;
+    virtual void put_impl(Payload&& value) override;
 
     virtual Payload get_impl() override;
 
+    virtual void clear_impl() override;
+
+    /// Tiles requested while scrolling arrive within milliseconds of
+    /// each other; linger briefly so get_impl() combines them into
+    /// one tilecombine instead of many single paints.
+    virtual unsigned coalesceWindowMs() const override;
+
 private:
-    /// Search the queue for a duplicate tile and remove it (if present).
-    void removeDuplicate(const std::string& tileMsg);
+    /// The key queued tiles are deduplicated by: the tile's position
+    /// and geometry, without version or image size.
+    static std::string tileKey(const TileDesc& tile);
+
+    /// Queue a tile message together with its parse results,
+    /// replacing a queued duplicate (if present).
+    void putTile(const TileDesc& tile);
 
-    /// De-prioritize the previews (tiles with 'id') - move them to the end of
-    /// the queue.
-    void deprioritizePreviews();
+    /// Remove the index'th entry from the queue and its parse results.
+    void erase(const size_t index);
 
-    /// Priority of the given tile message.
+    /// Merge an incoming invalidate-tiles callback into a queued one
+    /// of the same view and part when their rectangles touch, so an
+    /// invalidation storm leaves a minimal cover set in the queue.
+    /// Returns true when msg was absorbed into a queued entry.
+    bool coalesceInvalidate(const std::string& msg);
+
+    /// Priority of the given tile.
     /// -1 means the lowest prio (the tile does not intersect any of the cursors),
     /// the higher the number, the bigger is priority [up to _viewOrder.size()-1].
-    int priority(const std::string& tileMsg);
+    int priority(const TileDesc& tile);
 
 private:
     std::map<int, CursorPosition> _cursorPositions;
@@ -147,6 +238,19 @@ private:
     /// Check the views in the order of how the editing (cursor movement) has
     /// been happening (0 == oldest, size() - 1 == newest).
     std::vector<int> _viewOrder;
+
+    /// The parse results, parallel to _queue.
+    std::deque<QueueItem> _items;
+
+    /// Keys of the tiles currently queued, so that detecting a
+    /// duplicate is a lookup instead of a scan over the queue.
+    std::set<std::string> _queuedKeys;
+
+    /// Versions named in canceltiles messages, kept beyond the queue
+    /// sweep for the render thread. Bounded; versions are assigned
+    /// monotonically, so the oldest entries are dropped first.
+    std::set<int> _cancelledVersions;
+    std::mutex _cancelMutex;
 };
 
 #endif
@@ -50,6 +50,10 @@
 
 #include <cassert>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace png
 {
 
@@ -74,13 +78,13 @@ extern "C"
 }
 
 
-/* Unpremultiplies data and converts native endian ARGB => RGBA bytes */
+/* Unpremultiplies the pixels in [from, to) and converts native endian ARGB => RGBA bytes */
 static void
-unpremultiply_data (png_structp /*png*/, png_row_infop row_info, png_bytep data)
+unpremultiply_row_scalar (png_bytep data, const unsigned int from, const unsigned int to)
 {
     unsigned int i;
 
-    for (i = 0; i < row_info->rowbytes; i += 4)
+    for (i = from; i < to; i += 4)
     {
         uint8_t *b = &data[i];
         uint32_t pixel;
@@ -102,13 +106,92 @@ unpremultiply_data (png_structp /*png*/, png_row_infop row_info, png_bytep data)
     }
 }
 
+#if defined(__SSE2__)
+/* Ditto, four pixels per iteration. The three per-pixel divides are
+ * replaced by one reciprocal and three multiplications. The quarter
+ * added to the rounding bias keeps exact-integer quotients from
+ * dropping below the integer when the rounded-down reciprocal is a
+ * whisker small, and valid quotients are never within 1/255 below an
+ * integer, so truncation produces exactly the scalar results. */
+static void
+unpremultiply_row_sse2 (png_bytep data, const unsigned int from, const unsigned int to)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128 ones = _mm_set1_ps (1.0f);
+    const __m128 half = _mm_set1_ps (0.5f);
+    const __m128 ff = _mm_set1_ps (255.0f);
+
+    unsigned int i;
+
+    for (i = from; i < to; i += 16)
+    {
+        const __m128i px = _mm_loadu_si128 ((const __m128i *)&data[i]);
+
+        /* Widen the four BGRA pixels into one vector per channel. */
+        const __m128i lo = _mm_unpacklo_epi8 (px, zero);
+        const __m128i hi = _mm_unpackhi_epi8 (px, zero);
+        __m128 p0 = _mm_cvtepi32_ps (_mm_unpacklo_epi16 (lo, zero));
+        __m128 p1 = _mm_cvtepi32_ps (_mm_unpackhi_epi16 (lo, zero));
+        __m128 p2 = _mm_cvtepi32_ps (_mm_unpacklo_epi16 (hi, zero));
+        __m128 p3 = _mm_cvtepi32_ps (_mm_unpackhi_epi16 (hi, zero));
+
+        _MM_TRANSPOSE4_PS (p0, p1, p2, p3);
+        /* Now p0 = blues, p1 = greens, p2 = reds, p3 = alphas. */
+
+        const __m128 recip = _mm_div_ps (ones, p3);
+        const __m128 bias = _mm_add_ps (_mm_mul_ps (p3, half), _mm_set1_ps (0.25f));
+
+        const __m128i blue = _mm_cvttps_epi32 (
+            _mm_mul_ps (_mm_add_ps (_mm_mul_ps (p0, ff), bias), recip));
+        const __m128i green = _mm_cvttps_epi32 (
+            _mm_mul_ps (_mm_add_ps (_mm_mul_ps (p1, ff), bias), recip));
+        const __m128i red = _mm_cvttps_epi32 (
+            _mm_mul_ps (_mm_add_ps (_mm_mul_ps (p2, ff), bias), recip));
+        const __m128i alpha = _mm_cvttps_epi32 (p3);
+
+        /* Interleave back, swizzled to RGBA. A zero alpha leaves
+         * 0x80000000 in the color lanes above; the saturating packs
+         * clamp that to the zero pixel the scalar code produces. */
+        const __m128i rglo = _mm_unpacklo_epi32 (red, green);
+        const __m128i rghi = _mm_unpackhi_epi32 (red, green);
+        const __m128i balo = _mm_unpacklo_epi32 (blue, alpha);
+        const __m128i bahi = _mm_unpackhi_epi32 (blue, alpha);
+
+        const __m128i q0 = _mm_unpacklo_epi64 (rglo, balo);
+        const __m128i q1 = _mm_unpackhi_epi64 (rglo, balo);
+        const __m128i q2 = _mm_unpacklo_epi64 (rghi, bahi);
+        const __m128i q3 = _mm_unpackhi_epi64 (rghi, bahi);
+
+        const __m128i out = _mm_packus_epi16 (_mm_packs_epi32 (q0, q1),
+                                              _mm_packs_epi32 (q2, q3));
+        _mm_storeu_si128 ((__m128i *)&data[i], out);
+    }
+}
+#endif
+
+/* Unpremultiplies data and converts native endian ARGB => RGBA bytes */
+static void
+unpremultiply_data (png_structp /*png*/, png_row_infop row_info, png_bytep data)
+{
+    unsigned int i = 0;
+
+#if defined(__SSE2__)
+    const unsigned int vectorBytes = row_info->rowbytes & ~15u;
+    unpremultiply_row_sse2 (data, 0, vectorBytes);
+    i = vectorBytes;
+#endif
+
+    unpremultiply_row_scalar (data, i, row_info->rowbytes);
+}
+
 // Sadly, older libpng headers don't use const for the pixmap pointer parameter to
 // png_write_row(), so can't use const here for pixmap.
 inline
 bool encodeSubBufferToPNG(unsigned char* pixmap, size_t startX, size_t startY,
                           int width, int height,
                           int bufferWidth, int bufferHeight,
-                          std::vector<char>& output, LibreOfficeKitTileMode mode)
+                          std::vector<char>& output, LibreOfficeKitTileMode mode,
+                          int compressionLevel = -1, int filters = PNG_ALL_FILTERS)
 {
     if (bufferWidth < width || bufferHeight < height)
     {
@@ -127,6 +210,14 @@ bool encodeSubBufferToPNG(unsigned char* pixmap, size_t startX, size_t startY,
 
     png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
+    // A negative level leaves the zlib default in force.
+    if (compressionLevel >= 0)
+    {
+        png_set_compression_level(png_ptr, compressionLevel);
+    }
+
+    png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, filters);
+
     png_set_write_fn(png_ptr, &output, user_write_fn, user_flush_fn);
     png_set_write_status_fn(png_ptr, user_write_status_fn);
 
@@ -152,9 +243,11 @@ bool encodeSubBufferToPNG(unsigned char* pixmap, size_t startX, size_t startY,
 
 inline
 bool encodeBufferToPNG(unsigned char* pixmap, int width, int height,
-                       std::vector<char>& output, LibreOfficeKitTileMode mode)
+                       std::vector<char>& output, LibreOfficeKitTileMode mode,
+                       int compressionLevel = -1, int filters = PNG_ALL_FILTERS)
 {
-    return encodeSubBufferToPNG(pixmap, 0, 0, width, height, width, height, output, mode);
+    return encodeSubBufferToPNG(pixmap, 0, 0, width, height, width, height, output, mode,
+                                compressionLevel, filters);
 }
 
 static
@@ -16,6 +16,7 @@
 #include <Poco/URI.h>
 #include <Poco/URIStreamOpener.h>
 
+#include "CommandValuesCache.hpp"
 #include "Common.hpp"
 #include "LOOLProtocol.hpp"
 #include "LOOLSession.hpp"
@@ -169,6 +170,18 @@ bool PrisonerSession::_handleInput(const char *buffer, int length)
         {
             _docBroker->setLoaded();
 
+            // Note the document type; the process-wide commandvalues
+            // cache is keyed by it.
+            for (size_t i = 1; i < tokens.count(); ++i)
+            {
+                std::string docType;
+                if (getTokenString(tokens[i], "type", docType))
+                {
+                    _docBroker->setDocType(docType);
+                    break;
+                }
+            }
+
             // Forward the status response to the client.
             return forwardToPeer(_peer, buffer, length, isBinary);
         }
@@ -188,6 +201,10 @@ bool PrisonerSession::_handleInput(const char *buffer, int length)
                 {
                     // other commands should not be cached
                     _docBroker->tileCache().saveTextFile(stringMsg, "cmdValues" + commandName + ".txt");
+
+                    // The font and style lists are identical for every
+                    // document of this type on the host; share them.
+                    CommandValuesCache::get().store(commandName, _docBroker->getDocType(), stringMsg);
                 }
             }
         }
@@ -7,62 +7,237 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.
  */
 
-#include <Poco/Runnable.h>
+#ifndef INCLUDED_QUEUEHANDLER_HPP
+#define INCLUDED_QUEUEHANDLER_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "MessageQueue.hpp"
 #include "LOOLSession.hpp"
 #include "LOOLProtocol.hpp"
 #include "Util.hpp"
 
-/// This thread handles incoming messages on a given kit instance.
-class QueueHandler: public Poco::Runnable
+/// Services the input queues of many sessions from a small, shared
+/// pool of worker threads, instead of one mostly-sleeping thread per
+/// session. Per-session ordering is preserved: a session's queue is
+/// drained by at most one worker at a time, and a worker takes
+/// everything pending in one batch.
+class QueueHandlerPool
 {
+    class Entry
+    {
+    public:
+        std::shared_ptr<MessageQueue> Queue;
+        std::shared_ptr<LOOLSession> Session;
+
+        /// A worker is draining this queue right now.
+        bool Busy = false;
+        /// Queued in _ready, waiting for a worker.
+        bool Ready = false;
+        /// A put arrived while the queue was being drained.
+        bool Pending = false;
+        /// Got "eof" or the session asked to finish.
+        bool Finished = false;
+    };
+
 public:
-    QueueHandler(std::shared_ptr<MessageQueue> queue,
-                 const std::shared_ptr<LOOLSession>& session,
-                 const std::string& name):
-        _queue(std::move(queue)),
-        _session(session),
-        _name(name)
+    QueueHandlerPool(const std::string& name,
+                     const size_t threadCount = std::max(2u, std::thread::hardware_concurrency())) :
+        _name(name),
+        _stop(false)
+    {
+        for (size_t i = 0; i < threadCount; ++i)
+        {
+            _threads.emplace_back(&QueueHandlerPool::workerThread, this);
+        }
+    }
+
+    ~QueueHandlerPool()
     {
+        stop();
     }
 
-    void run() override
+    QueueHandlerPool(const QueueHandlerPool&) = delete;
+    QueueHandlerPool& operator=(const QueueHandlerPool&) = delete;
+
+    /// Service the given session's queue until it gets "eof" or the
+    /// session's handleInput asks to finish.
+    void addSession(const std::shared_ptr<MessageQueue>& queue,
+                    const std::shared_ptr<LOOLSession>& session)
+    {
+        auto entry = std::make_shared<Entry>();
+        entry->Queue = queue;
+        entry->Session = session;
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _entries.push_back(entry);
+        }
+
+        std::weak_ptr<Entry> weakEntry = entry;
+        queue->setPutCallback([this, weakEntry]
+        {
+            auto strongEntry = weakEntry.lock();
+            if (strongEntry)
+            {
+                wakeup(strongEntry);
+            }
+        });
+
+        // Service anything queued before we were attached.
+        wakeup(entry);
+    }
+
+    void stop()
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_stop)
+            {
+                return;
+            }
+
+            _stop = true;
+        }
+
+        _cv.notify_all();
+        for (auto& thread : _threads)
+        {
+            if (thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+private:
+    /// Mark the entry's queue ready for draining and wake a worker.
+    void wakeup(const std::shared_ptr<Entry>& entry)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (entry->Finished || entry->Ready)
+            {
+                return;
+            }
+
+            if (entry->Busy)
+            {
+                // The draining worker re-queues the entry when done.
+                entry->Pending = true;
+                return;
+            }
+
+            entry->Ready = true;
+            _ready.push_back(entry);
+        }
+
+        _cv.notify_one();
+    }
+
+    void workerThread()
     {
         Util::setThreadName(_name);
 
         Log::debug("Thread started.");
 
-        try
+        while (true)
         {
-            while (true)
+            std::shared_ptr<Entry> entry;
             {
-                const auto input = _queue->get();
-                if (LOOLProtocol::getFirstToken(input) == "eof")
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cv.wait(lock, [this] { return _stop || !_ready.empty(); });
+                if (_stop)
                 {
-                    Log::info("Received EOF. Finishing.");
                     break;
                 }
 
-                if (!_session->handleInput(input.data(), input.size()))
+                entry = _ready.front();
+                _ready.pop_front();
+                entry->Ready = false;
+                entry->Busy = true;
+            }
+
+            bool finished = false;
+            try
+            {
+                const auto batch = entry->Queue->tryGetBatch();
+                for (const auto& input : batch)
                 {
-                    Log::info("Socket handler flagged for finishing.");
-                    break;
+                    if (LOOLProtocol::getFirstToken(input) == "eof")
+                    {
+                        Log::info("Received EOF. Finishing.");
+                        finished = true;
+                        break;
+                    }
+
+                    if (!entry->Session->handleInput(input.data(), input.size()))
+                    {
+                        Log::info("Socket handler flagged for finishing.");
+                        finished = true;
+                        break;
+                    }
                 }
             }
-        }
-        catch (const std::exception& exc)
-        {
-            Log::error(std::string("QueueHandler::run: Exception: ") + exc.what());
+            catch (const std::exception& exc)
+            {
+                Log::error(std::string("QueueHandlerPool: Exception: ") + exc.what());
+                finished = true;
+            }
+
+            bool rearm = false;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                entry->Busy = false;
+                if (finished)
+                {
+                    entry->Finished = true;
+                    _entries.erase(std::remove(_entries.begin(), _entries.end(), entry),
+                                   _entries.end());
+                }
+                else if (entry->Pending)
+                {
+                    entry->Pending = false;
+                    entry->Ready = true;
+                    _ready.push_back(entry);
+                    rearm = true;
+                }
+            }
+
+            if (finished)
+            {
+                entry->Queue->setPutCallback(nullptr);
+            }
+            else if (rearm)
+            {
+                _cv.notify_one();
+            }
         }
 
         Log::debug("Thread finished.");
     }
 
 private:
-    std::shared_ptr<MessageQueue> _queue;
-    std::shared_ptr<LOOLSession> _session;
     const std::string _name;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _stop;
+
+    /// All the sessions being serviced.
+    std::vector<std::shared_ptr<Entry>> _entries;
+
+    /// The sessions with queued messages and no worker on them yet.
+    std::deque<std::shared_ptr<Entry>> _ready;
+
+    std::vector<std::thread> _threads;
 };
 
+#endif
+
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -73,6 +73,13 @@ struct Rectangle
     {
         return _x1 <= _x2 && _y1 <= _y2;
     }
+
+    /// True when the rectangles touch or overlap.
+    bool intersects(const Rectangle& other) const
+    {
+        return _x1 <= other._x2 && other._x1 <= _x2 &&
+               _y1 <= other._y2 && other._y1 <= _y2;
+    }
 };
 
 }
@@ -10,9 +10,19 @@
 #include "Storage.hpp"
 #include "config.h"
 
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
 #include <cassert>
 #include <fstream>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <Poco/JSON/Object.h>
 #include <Poco/JSON/Parser.h>
@@ -23,6 +33,7 @@
 #include <Poco/Net/HTTPSClientSession.h>
 #include <Poco/Net/NetworkInterface.h>
 #include <Poco/Net/SSLManager.h>
+#include <Poco/SHA1Engine.h>
 #include <Poco/StreamCopier.h>
 
 #include "Auth.hpp"
@@ -35,6 +46,9 @@
 
 bool StorageBase::FilesystemEnabled;
 bool StorageBase::WopiEnabled;
+size_t StorageBase::WopiDownloadChunks;
+bool StorageBase::WopiDifferentialUpload;
+unsigned StorageBase::WopiFileInfoCacheSecs;
 Util::RegexListMatcher StorageBase::WopiHosts;
 
 std::string StorageBase::getLocalRootPath() const
@@ -66,6 +80,9 @@ void StorageBase::initialize()
     // Parse the WOPI settings.
     WopiHosts.clear();
     WopiEnabled = app.config().getBool("storage.wopi[@allow]", false);
+    WopiDownloadChunks = app.config().getUInt("storage.wopi.download_chunks", 1);
+    WopiDifferentialUpload = app.config().getBool("storage.wopi.differential_upload", false);
+    WopiFileInfoCacheSecs = app.config().getUInt("storage.wopi.file_info_cache_secs", 10);
     if (WopiEnabled)
     {
         for (size_t i = 0; ; ++i)
@@ -188,6 +205,44 @@ StorageBase::FileInfo LocalStorage::getFileInfo(const Poco::URI& uriPublic)
     return FileInfo({filename, lastModified, size, "localhost", std::string("Local Host #") + std::to_string(_localStorageId), true});
 }
 
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+namespace
+{
+
+/// Clone source to target via FICLONE, sharing the extents
+/// copy-on-write. Instant regardless of file size on filesystems
+/// that support reflinks (btrfs, xfs); fails cleanly elsewhere.
+bool reflinkFile(const std::string& source, const std::string& target)
+{
+    const int src = open(source.c_str(), O_RDONLY);
+    if (src < 0)
+    {
+        return false;
+    }
+
+    const int dst = open(target.c_str(), O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (dst < 0)
+    {
+        close(src);
+        return false;
+    }
+
+    const bool cloned = (ioctl(dst, FICLONE, src) == 0);
+    close(src);
+    close(dst);
+    if (!cloned)
+    {
+        unlink(target.c_str());
+    }
+
+    return cloned;
+}
+
+}
+
 std::string LocalStorage::loadStorageFileToLocal()
 {
     const auto rootPath = getLocalRootPath();
@@ -206,11 +261,23 @@ std::string LocalStorage::loadStorageFileToLocal()
     if (!Util::checkDiskSpace(publicFilePath))
         throw StorageSpaceLowException("Low disk space for " + publicFilePath);
 
-    Log::info("Linking " + publicFilePath + " to " + _jailedFilePath);
-    if (!Poco::File(_jailedFilePath).exists() && link(publicFilePath.c_str(), _jailedFilePath.c_str()) == -1)
+    // A reflink clone shares the extents copy-on-write: edits in the
+    // jail leave the original untouched, so it saves back exactly
+    // like a copy, without the up-front byte-copy I/O.
+    if (!Poco::File(_jailedFilePath).exists() && reflinkFile(publicFilePath, _jailedFilePath))
+    {
+        Log::info("Reflinked " + publicFilePath + " to " + _jailedFilePath);
+        _isCopy = true;
+    }
+
+    if (!Poco::File(_jailedFilePath).exists())
     {
-        // Failed
-        Log::warn("link(\"" + publicFilePath + "\", \"" + _jailedFilePath + "\") failed. Will copy.");
+        Log::info("Linking " + publicFilePath + " to " + _jailedFilePath);
+        if (link(publicFilePath.c_str(), _jailedFilePath.c_str()) == -1)
+        {
+            // Failed
+            Log::warn("link(\"" + publicFilePath + "\", \"" + _jailedFilePath + "\") failed. Will copy.");
+        }
     }
 
     try
@@ -263,14 +330,239 @@ Poco::Net::HTTPClientSession* getHTTPClientSession(const Poco::URI& uri)
                        : new Poco::Net::HTTPClientSession(uri.getHost(), uri.getPort());
 }
 
+/// Keep-alive connections to storage hosts, keyed on host:port and
+/// shared across all storage instances, so that WOPI round-trips
+/// skip the TCP and TLS handshakes of a fresh connection.
+class HTTPSessionPool
+{
+public:
+    static HTTPSessionPool& instance()
+    {
+        static HTTPSessionPool pool;
+        return pool;
+    }
+
+    /// Returns a warm connection to the host of uri, or a new one.
+    std::unique_ptr<Poco::Net::HTTPClientSession> acquire(const Poco::URI& uri)
+    {
+        const auto key = poolKey(uri);
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            const auto it = _pool.find(key);
+            while (it != _pool.end() && !it->second.empty())
+            {
+                auto session = std::move(it->second.back());
+                it->second.pop_back();
+                if (session->connected())
+                {
+                    return session;
+                }
+
+                // The host closed it while pooled; try the next one.
+            }
+        }
+
+        auto session = std::unique_ptr<Poco::Net::HTTPClientSession>(getHTTPClientSession(uri));
+        session->setKeepAlive(true);
+        return session;
+    }
+
+    /// Hand a connection back for reuse. Only call once the
+    /// response has been read in full, otherwise drop the session.
+    void release(const Poco::URI& uri, std::unique_ptr<Poco::Net::HTTPClientSession> session)
+    {
+        if (!session || !session->connected())
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto& sessions = _pool[poolKey(uri)];
+        if (sessions.size() < MaxSessionsPerHost)
+        {
+            sessions.push_back(std::move(session));
+        }
+    }
+
+private:
+    HTTPSessionPool()
+    {
+    }
+
+    static std::string poolKey(const Poco::URI& uri)
+    {
+        return uri.getHost() + ':' + std::to_string(uri.getPort());
+    }
+
+    /// Warm connections kept per host.
+    static constexpr size_t MaxSessionsPerHost = 8;
+
+    std::mutex _mutex;
+    std::map<std::string, std::vector<std::unique_ptr<Poco::Net::HTTPClientSession>>> _pool;
+};
+
+/// Documents below this size are fetched with a single stream.
+constexpr size_t MinimumChunkedDownloadSize = 4 * 1024 * 1024;
+
+/// Attempts per chunk before giving up on the ranged download.
+constexpr int ChunkDownloadRetries = 3;
+
+/// Fetch bytes [offset, offset + length) of uriObject with an HTTP
+/// range request into buffer. Returns false when the host does not
+/// honor the range, or the connection fails.
+bool downloadWopiRange(const Poco::URI& uriObject, const size_t offset, const size_t length, char* buffer)
+{
+    try
+    {
+        auto psession = HTTPSessionPool::instance().acquire(uriObject);
+
+        Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_GET, uriObject.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
+        request.set("User-Agent", "LOOLWSD WOPI Agent");
+        request.set("Range", "bytes=" + std::to_string(offset) + '-' + std::to_string(offset + length - 1));
+        psession->sendRequest(request);
+
+        Poco::Net::HTTPResponse response;
+        std::istream& rs = psession->receiveResponse(response);
+        if (response.getStatus() != Poco::Net::HTTPResponse::HTTP_PARTIAL_CONTENT)
+        {
+            Log::debug() << "WOPI host did not honor range request: "
+                         << response.getStatus() << " " << response.getReason() << Log::end;
+            return false;
+        }
+
+        rs.read(buffer, length);
+        if (rs.gcount() != static_cast<std::streamsize>(length))
+        {
+            return false;
+        }
+
+        HTTPSessionPool::instance().release(uriObject, std::move(psession));
+        return true;
+    }
+    catch (const std::exception& exc)
+    {
+        Log::warn(std::string("WOPI range request failed: ") + exc.what());
+        return false;
+    }
+}
+
+/// A content-defined chunk of the local document file.
+struct DiffChunk
+{
+    size_t Offset;
+    size_t Size;
+    std::string Hash;
+};
+
+/// Chunk boundaries fall where the low bits of a rolling sum over
+/// a 64-byte window vanish: on average every 64KB, clamped so that
+/// pathological content cannot degenerate.
+constexpr size_t DiffWindowSize = 64;
+constexpr unsigned DiffBoundaryMask = 0xFFFF;
+constexpr size_t DiffMinChunkSize = 16 * 1024;
+constexpr size_t DiffMaxChunkSize = 256 * 1024;
+
+/// Split the file into content-defined chunks, so that an edit
+/// shifts chunk boundaries only locally. Returns the chunks and
+/// fills data with the file contents; empty on failure.
+std::vector<DiffChunk> chunkFileForDiff(const std::string& path, std::vector<char>& data)
+{
+    std::vector<DiffChunk> chunks;
+
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs)
+    {
+        return chunks;
+    }
+
+    data.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+
+    size_t start = 0;
+    unsigned sum = 0;
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        sum += static_cast<unsigned char>(data[i]);
+        if (i >= start + DiffWindowSize)
+        {
+            sum -= static_cast<unsigned char>(data[i - DiffWindowSize]);
+        }
+
+        const size_t size = i + 1 - start;
+        if ((size >= DiffMinChunkSize && (sum & DiffBoundaryMask) == 0) ||
+            size >= DiffMaxChunkSize || i + 1 == data.size())
+        {
+            Poco::SHA1Engine engine;
+            engine.update(data.data() + start, size);
+            chunks.push_back({start, size, Poco::DigestEngine::digestToHex(engine.digest())});
+            start = i + 1;
+            sum = 0;
+        }
+    }
+
+    return chunks;
+}
+
+/// A cached CheckFileInfo response. Keyed on the full public URI:
+/// the user fields depend on the access token in the query, so the
+/// document alone would leak one user's identity and permissions
+/// to another.
+struct CachedFileInfo
+{
+    StorageBase::FileInfo info;
+    /// The URI path, sans query; save invalidates by document.
+    std::string path;
+    std::chrono::steady_clock::time_point fetchTime;
+};
+
+std::mutex fileInfoCacheMutex;
+std::map<std::string, CachedFileInfo> fileInfoCache;
+
+/// Drop every cached CheckFileInfo of the given document, for all
+/// access tokens; a save changed Size and Version on the host.
+void invalidateFileInfo(const std::string& path)
+{
+    std::unique_lock<std::mutex> lock(fileInfoCacheMutex);
+    for (auto it = fileInfoCache.begin(); it != fileInfoCache.end();)
+    {
+        if (it->second.path == path)
+        {
+            it = fileInfoCache.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
 } // anonymous namespace
 
 StorageBase::FileInfo WopiStorage::getFileInfo(const Poco::URI& uriPublic)
 {
     Log::debug("Getting info for wopi uri [" + uriPublic.toString() + "].");
 
+    const auto uriString = uriPublic.toString();
+    if (WopiFileInfoCacheSecs > 0)
+    {
+        std::unique_lock<std::mutex> lock(fileInfoCacheMutex);
+        const auto it = fileInfoCache.find(uriString);
+        if (it != fileInfoCache.end())
+        {
+            if (std::chrono::steady_clock::now() - it->second.fetchTime <=
+                std::chrono::seconds(WopiFileInfoCacheSecs))
+            {
+                Log::debug("WOPI::CheckFileInfo served from cache for URI [" + uriString + "].");
+                _fileInfo = it->second.info;
+                return _fileInfo;
+            }
+
+            fileInfoCache.erase(it);
+        }
+    }
+
     const auto startTime = std::chrono::steady_clock::now();
-    std::unique_ptr<Poco::Net::HTTPClientSession> psession(getHTTPClientSession(uriPublic));
+    auto psession = HTTPSessionPool::instance().acquire(uriPublic);
 
     Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_GET, uriPublic.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
     request.set("User-Agent", "LOOLWSD WOPI Agent");
@@ -296,6 +588,7 @@ StorageBase::FileInfo WopiStorage::getFileInfo(const Poco::URI& uriPublic)
     bool canWrite = false;
     std::string resMsg;
     Poco::StreamCopier::copyToString(rs, resMsg);
+    HTTPSessionPool::instance().release(uriPublic, std::move(psession));
 
     const auto endTime = std::chrono::steady_clock::now();
     const std::chrono::duration<double> diff = (endTime - startTime);
@@ -320,10 +613,75 @@ StorageBase::FileInfo WopiStorage::getFileInfo(const Poco::URI& uriPublic)
 
     // WOPI doesn't support file last modified time.
     _fileInfo = FileInfo({filename, Poco::Timestamp(), size, userId, userName, canWrite});
+
+    if (WopiFileInfoCacheSecs > 0 && _fileInfo.isValid())
+    {
+        std::unique_lock<std::mutex> lock(fileInfoCacheMutex);
+        fileInfoCache[uriString] = { _fileInfo, uriPublic.getPath(),
+                                     std::chrono::steady_clock::now() };
+    }
+
     return _fileInfo;
 }
 
 /// uri format: http://server/<...>/wopi*/files/<id>/content
+bool WopiStorage::downloadInChunks(const Poco::URI& uriObject)
+{
+    const size_t size = _fileInfo._size;
+    const size_t chunks = WopiDownloadChunks;
+    const size_t chunkSize = (size + chunks - 1) / chunks;
+
+    std::vector<char> data(size);
+
+    // Probe with the first chunk; hosts that do not support range
+    // requests answer 200 and we fall back to a single stream.
+    if (!downloadWopiRange(uriObject, 0, std::min(chunkSize, size), data.data()))
+    {
+        return false;
+    }
+
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> workers;
+    for (size_t chunk = 1; chunk < chunks; ++chunk)
+    {
+        const size_t offset = chunk * chunkSize;
+        if (offset >= size)
+        {
+            break;
+        }
+
+        const size_t length = std::min(chunkSize, size - offset);
+        workers.emplace_back([&uriObject, &data, &failed, offset, length]()
+            {
+                // Retry transient failures before giving up.
+                for (int attempt = 0; attempt < ChunkDownloadRetries; ++attempt)
+                {
+                    if (downloadWopiRange(uriObject, offset, length, data.data() + offset))
+                    {
+                        return;
+                    }
+                }
+
+                failed = true;
+            });
+    }
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+
+    if (failed)
+    {
+        Log::warn("Chunked download of [" + uriObject.toString() + "] failed. Will fetch with a single stream.");
+        return false;
+    }
+
+    std::ofstream ofs(_jailedFilePath, std::ios::binary);
+    ofs.write(data.data(), data.size());
+    return ofs.good();
+}
+
 std::string WopiStorage::loadStorageFileToLocal()
 {
     Log::info("Downloading URI [" + _uri.toString() + "].");
@@ -335,7 +693,28 @@ std::string WopiStorage::loadStorageFileToLocal()
     Log::debug("Wopi requesting: " + uriObject.toString());
 
     const auto startTime = std::chrono::steady_clock::now();
-    std::unique_ptr<Poco::Net::HTTPClientSession> psession(getHTTPClientSession(uriObject));
+
+    _jailedFilePath = Poco::Path(getLocalRootPath(), _fileInfo._filename).toString();
+
+    // Fetch large documents with parallel range requests, if so
+    // configured, and fall back to the single stream otherwise.
+    if (WopiDownloadChunks > 1 && _fileInfo._size >= MinimumChunkedDownloadSize &&
+        downloadInChunks(uriObject))
+    {
+        const auto endTime = std::chrono::steady_clock::now();
+        const std::chrono::duration<double> diff = (endTime - startTime);
+        _wopiLoadDuration += diff;
+        Log::info() << "WOPI::GetFile downloaded " << _fileInfo._size << " bytes from ["
+                    << uriObject.toString() << "] -> " << _jailedFilePath << " in "
+                    << std::to_string(diff.count()) << "s using "
+                    << WopiDownloadChunks << " chunks." << Log::end;
+
+        _isLoaded = true;
+        // Now return the jailed path.
+        return Poco::Path(_jailPath, _fileInfo._filename).toString();
+    }
+
+    auto psession = HTTPSessionPool::instance().acquire(uriObject);
 
     Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_GET, uriObject.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
     request.set("User-Agent", "LOOLWSD WOPI Agent");
@@ -353,11 +732,11 @@ std::string WopiStorage::loadStorageFileToLocal()
 
     logger << Log::end;
 
-    _jailedFilePath = Poco::Path(getLocalRootPath(), _fileInfo._filename).toString();
     std::ofstream ofs(_jailedFilePath);
     std::copy(std::istreambuf_iterator<char>(rs),
               std::istreambuf_iterator<char>(),
               std::ostreambuf_iterator<char>(ofs));
+    HTTPSessionPool::instance().release(uriObject, std::move(psession));
     const auto endTime = std::chrono::steady_clock::now();
     const std::chrono::duration<double> diff = (endTime - startTime);
     _wopiLoadDuration += diff;
@@ -371,6 +750,93 @@ std::string WopiStorage::loadStorageFileToLocal()
     return Poco::Path(_jailPath, _fileInfo._filename).toString();
 }
 
+bool WopiStorage::uploadDiffToStorage(const Poco::URI& uriObject)
+{
+    std::vector<char> data;
+    const auto chunks = chunkFileForDiff(_jailedFilePath, data);
+    if (chunks.empty())
+    {
+        return false;
+    }
+
+    // Manifest of all chunks, in order; data of only the chunks
+    // the host does not have from the last upload follows it.
+    std::ostringstream manifest;
+    manifest << "{\"chunks\":[";
+    size_t newBytes = 0;
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        const bool isNew = _uploadedChunkHashes.find(chunks[i].Hash) == _uploadedChunkHashes.end();
+        if (isNew)
+        {
+            newBytes += chunks[i].Size;
+        }
+
+        manifest << (i > 0 ? "," : "")
+                 << "{\"hash\":\"" << chunks[i].Hash
+                 << "\",\"size\":" << chunks[i].Size
+                 << ",\"new\":" << (isNew ? "true" : "false") << "}";
+    }
+    manifest << "]}";
+
+    const auto manifestStr = manifest.str();
+
+    try
+    {
+        auto psession = HTTPSessionPool::instance().acquire(uriObject);
+
+        Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, uriObject.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
+        request.set("X-WOPI-Override", "PUT");
+        request.set("X-LOOL-WOPI-Diff", "1");
+        request.setContentType("application/octet-stream");
+        request.setContentLength(manifestStr.size() + 1 + newBytes);
+
+        std::ostream& os = psession->sendRequest(request);
+        os.write(manifestStr.data(), manifestStr.size());
+        os.put('\n');
+        for (const auto& chunk : chunks)
+        {
+            if (_uploadedChunkHashes.find(chunk.Hash) == _uploadedChunkHashes.end())
+            {
+                os.write(data.data() + chunk.Offset, chunk.Size);
+            }
+        }
+
+        Poco::Net::HTTPResponse response;
+        std::istream& rs = psession->receiveResponse(response);
+        std::ostringstream oss;
+        Poco::StreamCopier::copyStream(rs, oss);
+        HTTPSessionPool::instance().release(uriObject, std::move(psession));
+
+        if (response.getStatus() != Poco::Net::HTTPResponse::HTTP_OK)
+        {
+            // The host does not understand the mode; stop offering it.
+            Log::info() << "WOPI host declined differential upload: "
+                        << response.getStatus() << " " << response.getReason()
+                        << ". Falling back to full uploads." << Log::end;
+            _diffUploadSupport = DiffUploadSupport::Unsupported;
+            return false;
+        }
+
+        _diffUploadSupport = DiffUploadSupport::Supported;
+        _uploadedChunkHashes.clear();
+        for (const auto& chunk : chunks)
+        {
+            _uploadedChunkHashes.insert(chunk.Hash);
+        }
+
+        Log::info() << "WOPI::PutFile diff uploaded " << newBytes << " of " << data.size()
+                    << " bytes in " << chunks.size() << " chunks to ["
+                    << uriObject.toString() << "]." << Log::end;
+        return true;
+    }
+    catch (const std::exception& exc)
+    {
+        Log::warn(std::string("Differential upload failed: ") + exc.what());
+        return false;
+    }
+}
+
 bool WopiStorage::saveLocalFileToStorage(const Poco::URI& uriPublic)
 {
     Log::info("Uploading URI [" + uriPublic.toString() + "] from [" + _jailedFilePath + "].");
@@ -381,7 +847,16 @@ bool WopiStorage::saveLocalFileToStorage(const Poco::URI& uriPublic)
     uriObject.setPath(uriObject.getPath() + "/contents");
     Log::debug("Wopi posting: " + uriObject.toString());
 
-    std::unique_ptr<Poco::Net::HTTPClientSession> psession(getHTTPClientSession(uriObject));
+    // Upload only changed chunks when so configured and the host
+    // has accepted (or not yet declined) the mode.
+    if (WopiDifferentialUpload && _diffUploadSupport != DiffUploadSupport::Unsupported &&
+        !_uploadedChunkHashes.empty() && uploadDiffToStorage(uriObject))
+    {
+        invalidateFileInfo(uriPublic.getPath());
+        return true;
+    }
+
+    auto psession = HTTPSessionPool::instance().acquire(uriObject);
 
     Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, uriObject.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
     request.set("X-WOPI-Override", "PUT");
@@ -396,13 +871,32 @@ bool WopiStorage::saveLocalFileToStorage(const Poco::URI& uriPublic)
     std::istream& rs = psession->receiveResponse(response);
     std::ostringstream oss;
     Poco::StreamCopier::copyStream(rs, oss);
+    HTTPSessionPool::instance().release(uriObject, std::move(psession));
 
     Log::info("WOPI::PutFile response: " + oss.str());
     const auto success = (response.getStatus() == Poco::Net::HTTPResponse::HTTP_OK);
+    if (success)
+    {
+        invalidateFileInfo(uriPublic.getPath());
+    }
+
     Log::info() << "WOPI::PutFile uploaded " << size << " bytes from [" << _jailedFilePath  << "]:"
                 << "] -> [" << uriObject.toString() << "]: "
                 <<  response.getStatus() << " " << response.getReason() << Log::end;
 
+    if (success && WopiDifferentialUpload &&
+        _diffUploadSupport != DiffUploadSupport::Unsupported)
+    {
+        // Remember what the host now holds, so the next save can
+        // upload only the changed chunks.
+        std::vector<char> data;
+        _uploadedChunkHashes.clear();
+        for (const auto& chunk : chunkFileForDiff(_jailedFilePath, data))
+        {
+            _uploadedChunkHashes.insert(chunk.Hash);
+        }
+    }
+
     return success;
 }
 
@@ -75,6 +75,14 @@ public:
 
     std::string getLocalRootPath() const;
 
+    /// The jail paths are not known while a connection is being
+    /// admitted; set them once the hosting child is claimed.
+    void setJailPaths(const std::string& localStorePath, const std::string& jailPath)
+    {
+        _localStorePath = localStorePath;
+        _jailPath = jailPath;
+    }
+
     const std::string getUri() const { return _uri.toString(); }
 
     bool isLoaded() const { return _isLoaded; }
@@ -110,6 +118,14 @@ protected:
 
     static bool FilesystemEnabled;
     static bool WopiEnabled;
+    /// Parallel HTTP range requests to fetch a WOPI document with;
+    /// 1 downloads with a single stream.
+    static size_t WopiDownloadChunks;
+    /// Whether to offer differential uploads to the WOPI host.
+    static bool WopiDifferentialUpload;
+    /// How long a CheckFileInfo response may be reused, in seconds;
+    /// 0 asks the host on every session attach.
+    static unsigned WopiFileInfoCacheSecs;
     /// Allowed/denied WOPI hosts, if any and if WOPI is enabled.
     static Util::RegexListMatcher WopiHosts;
 };
@@ -151,7 +167,8 @@ public:
                 const std::string& localStorePath,
                 const std::string& jailPath) :
         StorageBase(uri, localStorePath, jailPath),
-        _wopiLoadDuration(0)
+        _wopiLoadDuration(0),
+        _diffUploadSupport(DiffUploadSupport::Unknown)
     {
         Log::info("WopiStorage ctor with localStorePath: [" + localStorePath +
                   "], jailPath: [" + jailPath + "], uri: [" + uri.toString() + "].");
@@ -168,8 +185,29 @@ public:
     const std::chrono::duration<double> getWopiLoadDuration() const { return _wopiLoadDuration; }
 
 private:
+    /// Whether the WOPI host accepts differential uploads,
+    /// discovered on the first attempt.
+    enum class DiffUploadSupport { Unknown, Supported, Unsupported };
+
+    /// Fetch the document into the jail with parallel HTTP range
+    /// requests. Returns false when the host does not support
+    /// ranges or a chunk repeatedly fails; the caller then falls
+    /// back to a single-stream download.
+    bool downloadInChunks(const Poco::URI& uriObject);
+
+    /// Upload only the chunks the host does not have from the last
+    /// upload, with a hash manifest. Returns false when the host
+    /// rejects the mode or the diff fails; the caller then falls
+    /// back to a full upload.
+    bool uploadDiffToStorage(const Poco::URI& uriObject);
+
     // Time spend in waiting for WOPI host during document load
     std::chrono::duration<double> _wopiLoadDuration;
+
+    DiffUploadSupport _diffUploadSupport;
+    /// Chunk hashes the host holds from the last full or
+    /// differential upload.
+    std::set<std::string> _uploadedChunkHashes;
 };
 
 /// WebDAV protocol backed storage.
@@ -10,19 +10,22 @@
 #include "TileCache.hpp"
 #include "config.h"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <climits>
 #include <cstdio>
+#include <ctime>
 #include <fstream>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include <Poco/DigestEngine.h>
-#include <Poco/DirectoryIterator.h>
 #include <Poco/Exception.h>
 #include <Poco/File.h>
 #include <Poco/Path.h>
@@ -30,25 +33,176 @@
 #include <Poco/Timestamp.h>
 #include <Poco/URI.h>
 
+#include "AdminMetrics.hpp"
 #include "ClientSession.hpp"
 #include "Common.hpp"
 #include "LOOLProtocol.hpp"
+#include "TileStore.hpp"
 #include "Unit.hpp"
 #include "Util.hpp"
 
-using Poco::DirectoryIterator;
 using Poco::File;
 using Poco::StringTokenizer;
 using Poco::Timestamp;
 
 using namespace LOOLProtocol;
 
+namespace
+{
+/// Bound on the in-memory tile payload cache, per document.
+constexpr size_t MaxTileMemCacheBytes = 32 * 1024 * 1024;
+
+/// Edge length of a TileGrid bucket, in twips.
+constexpr int TileGridBucketTwips = 16384;
+
+/// Persisted tile store index, for serving tiles across restarts.
+constexpr auto TileIndexFileName = "tiles.idx";
+
+/// Bump when the index or store format changes incompatibly.
+constexpr auto TileIndexVersion = "tilecache-index-1";
+
+/// Bound on the background tile-write queue.
+constexpr size_t MaxPendingTileWrites = 256;
+
+/// Interval between eviction sweeps of an idle writer thread.
+constexpr int EvictionSweepSecs = 30;
+}
+
+std::atomic<size_t> TileCache::MaxDocCacheBytes(64 * 1024 * 1024);
+std::atomic<size_t> TileCache::MaxTotalCacheBytes(static_cast<size_t>(1024) * 1024 * 1024);
+std::atomic<std::time_t> TileCache::MaxTileAgeSecs(86400);
+std::atomic<size_t> TileCache::TotalCacheSize(0);
+std::atomic<size_t> TileCache::EvictedTileCount(0);
+std::atomic<size_t> TileCache::EvictedBytes(0);
+std::string TileCache::RenderingCacheDir;
+
+void TileCache::setEvictionPolicy(const size_t maxDocSizeBytes, const size_t maxTotalSizeBytes,
+                                  const std::time_t maxTileAgeSecs)
+{
+    MaxDocCacheBytes = maxDocSizeBytes;
+    MaxTotalCacheBytes = maxTotalSizeBytes;
+    MaxTileAgeSecs = maxTileAgeSecs;
+}
+
+void TileCache::setRenderingCacheDir(const std::string& dir)
+{
+    RenderingCacheDir = dir;
+}
+
+void TileCache::TileGrid::bucketSpan(const Util::Rectangle& area, int& x1, int& y1, int& x2, int& y2)
+{
+    x1 = area._x1 / TileGridBucketTwips;
+    y1 = area._y1 / TileGridBucketTwips;
+    x2 = area._x2 / TileGridBucketTwips;
+    y2 = area._y2 / TileGridBucketTwips;
+}
+
+void TileCache::TileGrid::insert(const std::string& name, const TileDesc& tile)
+{
+    // Re-rendered tiles are re-inserted; their location never changes.
+    if (_entries.find(name) != _entries.end())
+    {
+        return;
+    }
+
+    _entries.emplace(name, tile);
+
+    int x1, y1, x2, y2;
+    bucketSpan(tileArea(tile), x1, y1, x2, y2);
+    auto& buckets = _buckets[tile.getPart()];
+    for (int x = x1; x <= x2; ++x)
+    {
+        for (int y = y1; y <= y2; ++y)
+        {
+            buckets[std::make_pair(x, y)].push_back(name);
+        }
+    }
+}
+
+void TileCache::TileGrid::remove(const std::string& name)
+{
+    const auto it = _entries.find(name);
+    if (it == _entries.end())
+    {
+        return;
+    }
+
+    const auto partIt = _buckets.find(it->second.getPart());
+    if (partIt != _buckets.end())
+    {
+        int x1, y1, x2, y2;
+        bucketSpan(tileArea(it->second), x1, y1, x2, y2);
+        for (int x = x1; x <= x2; ++x)
+        {
+            for (int y = y1; y <= y2; ++y)
+            {
+                const auto bucketIt = partIt->second.find(std::make_pair(x, y));
+                if (bucketIt != partIt->second.end())
+                {
+                    auto& names = bucketIt->second;
+                    names.erase(std::remove(names.begin(), names.end(), name), names.end());
+                    if (names.empty())
+                    {
+                        partIt->second.erase(bucketIt);
+                    }
+                }
+            }
+        }
+
+        if (partIt->second.empty())
+        {
+            _buckets.erase(partIt);
+        }
+    }
+
+    _entries.erase(it);
+}
+
+std::vector<std::string> TileCache::TileGrid::intersecting(const int part, const Util::Rectangle& area) const
+{
+    std::set<std::string> names;
+    for (const auto& partPair : _buckets)
+    {
+        if (part != -1 && partPair.first != part)
+        {
+            continue;
+        }
+
+        for (const auto& bucketPair : partPair.second)
+        {
+            // Cheap test on the bucket's own area first.
+            const Util::Rectangle bucketArea(bucketPair.first.first * TileGridBucketTwips,
+                                             bucketPair.first.second * TileGridBucketTwips,
+                                             TileGridBucketTwips, TileGridBucketTwips);
+            if (!bucketArea.intersects(area))
+            {
+                continue;
+            }
+
+            for (const auto& name : bucketPair.second)
+            {
+                const auto it = _entries.find(name);
+                assert(it != _entries.end());
+                if (tileArea(it->second).intersects(area))
+                {
+                    names.insert(name);
+                }
+            }
+        }
+    }
+
+    return std::vector<std::string>(names.begin(), names.end());
+}
+
 TileCache::TileCache(const std::string& docURL,
                      const Timestamp& modifiedTime,
                      const std::string& cacheDir) :
     _docURL(docURL),
     _cacheDir(cacheDir),
     _cacheMutex(),
+    _memCacheSize(0),
+    _accountedSize(0),
+    _stopWriter(false),
     _tilesBeingRenderedMutex()
 {
     Log::info() << "TileCache ctor for uri [" << _docURL
@@ -67,11 +221,60 @@ TileCache::TileCache(const std::string& docURL,
     File(_cacheDir).createDirectories();
 
     saveLastModified(modifiedTime);
+
+    _tileStore.reset(new TileStore(_cacheDir + "/tiles.store"));
+
+    // Warm restart: revive tiles persisted by a previous instance,
+    // otherwise start the store afresh.
+    if (loadCacheIndex())
+    {
+        Log::info() << "Restored " << _tileStore->getEntryCount()
+                    << " tiles from a previous instance for [" << _docURL << "]." << Log::end;
+        _tileStore->preload();
+    }
+    else
+    {
+        _tileStore->clear();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(_cacheMutex);
+
+        // Restored tiles start with a fresh access time.
+        const auto now = std::time(nullptr);
+        for (const auto& pair : _tileGrid.getEntries())
+        {
+            _accessTimes[pair.first] = now;
+        }
+
+        updateTotalCacheSize();
+    }
+
+    _writerThread = std::thread(&TileCache::tileWriterThread, this);
 }
 
 TileCache::~TileCache()
 {
     Log::info("~TileCache dtor for uri [" + _docURL + "].");
+
+    // Let the writer drain its queue and exit.
+    {
+        std::unique_lock<std::mutex> writerLock(_writerMutex);
+        _stopWriter = true;
+    }
+
+    _writerCV.notify_all();
+    if (_writerThread.joinable())
+    {
+        _writerThread.join();
+    }
+
+    std::unique_lock<std::mutex> lock(_cacheMutex);
+    saveCacheIndex();
+
+    // This document's tiles no longer count against the global bound.
+    TotalCacheSize -= _accountedSize;
+    _accountedSize = 0;
 }
 
 /// Tracks the rendering of a given tile
@@ -79,7 +282,18 @@ TileCache::~TileCache()
 /// rendering latency.
 struct TileCache::TileBeingRendered
 {
-    std::vector<std::weak_ptr<ClientSession>> _subscribers;
+    /// A waiting session, with the content hash it said it already
+    /// has (0 when none), so an identical re-render can be answered
+    /// without the payload, and whether it asked for the tile as a
+    /// prefetch, so the response echoes the flag for that session.
+    struct Subscriber
+    {
+        std::weak_ptr<ClientSession> _session;
+        uint64_t _oldHash;
+        bool _preFetch;
+    };
+
+    std::vector<Subscriber> _subscribers;
 
     TileBeingRendered(const std::string& cachedName, const TileDesc& tile)
      : _startTime(std::chrono::steady_clock::now()),
@@ -124,68 +338,201 @@ void TileCache::forgetTileBeingRendered(const TileDesc& tile)
     Util::assertIsLocked(_tilesBeingRenderedMutex);
 
     _tilesBeingRendered.erase(cachedName);
+    AdminMetrics::get().TilesBeingRendered = _tilesBeingRendered.size();
+}
+
+double TileCache::getTileRoundTripMs(const TileDesc& tile)
+{
+    std::unique_lock<std::mutex> lock(_tilesBeingRenderedMutex);
+
+    const auto tileBeingRendered = findTileBeingRendered(tile);
+    return (tileBeingRendered ? tileBeingRendered->getElapsedTimeMs() : 0.);
 }
 
-std::unique_ptr<std::fstream> TileCache::lookupTile(const TileDesc& tile)
+size_t TileCache::getTilesBeingRenderedCount()
 {
-    const std::string fileName = _cacheDir + "/" + cacheFileName(tile);
+    std::unique_lock<std::mutex> lock(_tilesBeingRenderedMutex);
+
+    return _tilesBeingRendered.size();
+}
+
+TileData TileCache::lookupTileData(const TileDesc& tile)
+{
+    const std::string cachedName = cacheFileName(tile);
+
+    TileData data;
+    {
+        std::unique_lock<std::mutex> lock(_cacheMutex);
+
+        const auto it = _memCache.find(cachedName);
+        if (it != _memCache.end())
+        {
+            // Freshen the entry.
+            _memCacheLRU.splice(_memCacheLRU.begin(), _memCacheLRU, it->second.lruPosition);
+            data = it->second.data;
+            Log::trace("Found tile in memory cache: " + cachedName);
+        }
+        else
+        {
+            // Copy out of the mapped store and keep it in memory.
+            size_t size = 0;
+            const char* payload = _tileStore->lookup(cachedName, size);
+            if (payload != nullptr)
+            {
+                auto stored = std::make_shared<std::vector<char>>(payload, payload + size);
+                saveDataToMemCache(cachedName, stored);
+                data = stored;
+                Log::trace("Found tile in store: " + cachedName);
+            }
+        }
+
+        if (data)
+        {
+            _accessTimes[cachedName] = std::time(nullptr);
+        }
+    }
 
-    std::unique_ptr<std::fstream> result(new std::fstream(fileName, std::ios::in));
     UnitWSD::get().lookupTile(tile.getPart(), tile.getWidth(), tile.getHeight(),
                               tile.getTilePosX(), tile.getTilePosY(),
-                              tile.getTileWidth(), tile.getTileHeight(), result);
+                              tile.getTileWidth(), tile.getTileHeight(), data);
+
+    return data;
+}
 
-    if (result && result->is_open())
+uint64_t TileCache::hashTileData(const char* data, const size_t size)
+{
+    // FNV-1a, 64 bit. Not cryptographic, but the payloads compared
+    // are renders of the same tile of the same document.
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i)
     {
-        Log::trace("Found cache tile: " + fileName);
-        return result;
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
     }
 
-    return nullptr;
+    // 0 means 'no hash' on the wire.
+    return (hash != 0 ? hash : 1);
 }
 
-void TileCache::saveTileAndNotify(const TileDesc& tile, const char *data, const size_t size)
+uint64_t TileCache::ensureTileHash(const TileDesc& tile, const TileData& data)
 {
-    std::unique_lock<std::mutex> lock(_tilesBeingRenderedMutex);
+    if (!data)
+    {
+        return 0;
+    }
 
-    std::shared_ptr<TileBeingRendered> tileBeingRendered = findTileBeingRendered(tile);
+    const auto cachedName = cacheFileName(tile);
 
-    // Save to disk.
-    const auto cachedName = (tileBeingRendered ? tileBeingRendered->getCacheName()
-                                               : cacheFileName(tile));
+    std::unique_lock<std::mutex> lock(_cacheMutex);
+    auto& hash = _tileHashes[cachedName];
+    if (hash == 0)
+    {
+        // Known payload without a hash: cached before stamping
+        // existed, or read back from the tile store.
+        hash = hashTileData(data->data(), data->size());
+    }
+
+    return hash;
+}
+
+void TileCache::saveTileAndNotify(const TileDesc& tile, const char *data, const size_t size,
+                                  const int deltaYStart, const char *deltaData,
+                                  const size_t deltaSize)
+{
+    const auto cachedName = cacheFileName(tile);
+
+    AdminMetrics::get().TilesRendered += 1;
+    AdminMetrics::get().TileBytesRendered += size;
+
+    // Populate the in-memory cache and the spatial index, so lookups
+    // are served immediately; the store write is handed to the
+    // background writer so storage latency never delays delivery.
+    auto payload = std::make_shared<const std::vector<char>>(data, data + size);
+    const auto hash = hashTileData(data, size);
+    {
+        std::unique_lock<std::mutex> memLock(_cacheMutex);
+        _tileGrid.insert(cachedName, tile);
+        saveDataToMemCache(cachedName, payload);
+        _accessTimes[cachedName] = std::time(nullptr);
+        _tileHashes[cachedName] = hash;
+    }
+
+    queueTileWrite(cachedName, payload);
 
-    // Ignore if we can't save the tile, things will work anyway, but slower. An error indication
-    // has been supposed to be sent to all users in that case.
-    const auto fileName = _cacheDir + "/" + cachedName;
-    if (Util::saveDataToFileSafely(fileName, data, size))
-        Log::trace() << "Saved cache tile: " << fileName << Log::end;
+    std::unique_lock<std::mutex> lock(_tilesBeingRenderedMutex);
+
+    std::shared_ptr<TileBeingRendered> tileBeingRendered = findTileBeingRendered(tile);
 
     // Notify subscribers, if any.
     if (tileBeingRendered)
     {
         if (!tileBeingRendered->_subscribers.empty())
         {
-            std::string response = tile.serialize("tile:");
+            // Prefer sending just the changed band when the kit found one;
+            // subscribers without the previous tile re-request and get the
+            // full payload straight from the cache we just populated.
+            const bool haveDelta = (deltaYStart >= 0);
+            auto stamped = tile;
+            stamped.setHash(hash);
+            stamped.setPreFetch(0);
+            std::string response = stamped.serialize(haveDelta ? "tiledelta:" : "tile:");
+            if (haveDelta)
+            {
+                response += " ystart=" + std::to_string(deltaYStart);
+            }
+
             Log::debug("Sending tile message to subscribers: " + response);
             response += '\n';
 
-            std::vector<char> output;
-            output.reserve(static_cast<size_t>(4) * tile.getWidth() * tile.getHeight());
-            output.resize(response.size());
-            std::memcpy(output.data(), response.data(), response.size());
+            // Prefetch subscribers get the flag echoed, so their
+            // client files the tile in its cache instead of
+            // displaying it.
+            stamped.setPreFetch(1);
+            std::string preFetchResponse = stamped.serialize(haveDelta ? "tiledelta:" : "tile:");
+            if (haveDelta)
+            {
+                preFetchResponse += " ystart=" + std::to_string(deltaYStart);
+            }
+
+            preFetchResponse += '\n';
+            stamped.setPreFetch(0);
+
+            // An empty delta confirms the content a subscriber said
+            // it has is still current, without the payload.
+            const std::string unchanged = stamped.serialize("tiledelta:") + '\n';
 
-            const auto pos = output.size();
-            output.resize(pos + size);
-            std::memcpy(output.data() + pos, data, size);
+            const char* body = (haveDelta ? deltaData : data);
+            const size_t bodySize = (haveDelta ? deltaSize : size);
 
+            const auto sendStart = std::chrono::steady_clock::now();
+
+            // Header and payload go out as fragments of one message,
+            // so no intermediate buffer is assembled.
             for (const auto& i: tileBeingRendered->_subscribers)
             {
-                auto subscriber = i.lock();
+                auto subscriber = i._session.lock();
                 if (subscriber)
                 {
+                    if (!subscriber->isActive())
+                    {
+                        // A hidden tab cannot show the tile; it
+                        // refreshes in full when it becomes visible.
+                        Log::trace("Skipping tile push to inactive session " + subscriber->getName());
+                        continue;
+                    }
+
                     try
                     {
-                        subscriber->sendBinaryFrame(output.data(), output.size());
+                        if (i._oldHash != 0 && i._oldHash == hash)
+                        {
+                            subscriber->sendBinaryFrame(unchanged.data(), unchanged.size());
+                        }
+                        else
+                        {
+                            const auto& header = (i._preFetch ? preFetchResponse : response);
+                            subscriber->sendBinaryFrame(header.data(), header.size(),
+                                                        body, bodySize);
+                        }
                     }
                     catch (const std::exception& ex)
                     {
@@ -193,6 +540,10 @@ void TileCache::saveTileAndNotify(const TileDesc& tile, const char *data, const
                     }
                 }
             }
+
+            AdminMetrics::get().TileSendUs.record(
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - sendStart).count());
         }
         else
         {
@@ -204,7 +555,12 @@ void TileCache::saveTileAndNotify(const TileDesc& tile, const char *data, const
         {
             Log::debug() << "STATISTICS: tile " << tile.getVersion() << " internal roundtrip "
                          << tileBeingRendered->getElapsedTimeMs() << " ms." << Log::end;
+            AdminMetrics::get().RenderLatencyMs +=
+                static_cast<unsigned long>(tileBeingRendered->getElapsedTimeMs());
+            AdminMetrics::get().TileRoundTripUs.record(
+                static_cast<unsigned long>(tileBeingRendered->getElapsedTimeMs() * 1000.));
             _tilesBeingRendered.erase(cachedName);
+            AdminMetrics::get().TilesBeingRendered = _tilesBeingRendered.size();
         }
     }
     else
@@ -271,7 +627,10 @@ void TileCache::setUnsavedChanges(bool state)
 void TileCache::saveRendering(const std::string& name, const std::string& dir, const char *data, size_t size)
 {
     // can fonts be invalidated?
-    const std::string dirName = _cacheDir + "/" + dir;
+    // The font set is identical for every document on the host, so the
+    // renderings go into the host-global cache (when configured): the
+    // first document to render them serves all the others.
+    const std::string dirName = (RenderingCacheDir.empty() ? _cacheDir : RenderingCacheDir) + "/" + dir;
 
     File(dirName).createDirectories();
 
@@ -282,7 +641,7 @@ void TileCache::saveRendering(const std::string& name, const std::string& dir, c
 
 std::unique_ptr<std::fstream> TileCache::lookupRendering(const std::string& name, const std::string& dir)
 {
-    const std::string dirName = _cacheDir + "/" + dir;
+    const std::string dirName = (RenderingCacheDir.empty() ? _cacheDir : RenderingCacheDir) + "/" + dir;
     const std::string fileName = dirName + "/" + name;
     File directory(dirName);
 
@@ -302,23 +661,34 @@ void TileCache::invalidateTiles(int part, int x, int y, int width, int height)
                  << ", width: " << width
                  << ", height: " << height << Log::end;
 
-    File dir(_cacheDir);
-
     std::unique_lock<std::mutex> lock(_cacheMutex);
     std::unique_lock<std::mutex> lockSubscribers(_tilesBeingRenderedMutex);
 
-    if (dir.exists() && dir.isDirectory())
+    const auto names = _tileGrid.intersecting(part, Util::Rectangle(x, y, width, height));
+    if (names.empty())
     {
-        for (auto tileIterator = DirectoryIterator(dir); tileIterator != DirectoryIterator(); ++tileIterator)
+        return;
+    }
+
+    // Discard any not-yet-persisted writes of the invalidated tiles.
+    {
+        std::unique_lock<std::mutex> writerLock(_writerMutex);
+        for (const auto& cachedName : names)
         {
-            const std::string fileName = tileIterator.path().getFileName();
-            if (intersectsTile(fileName, part, x, y, width, height))
-            {
-                Log::debug("Removing tile: " + tileIterator.path().toString());
-                Util::removeFile(tileIterator.path());
-            }
+            _pendingWrites.erase(cachedName);
         }
     }
+
+    for (const auto& cachedName : names)
+    {
+        Log::debug("Removing tile: " + cachedName);
+        _tileGrid.remove(cachedName);
+        _tileStore->remove(cachedName);
+        removeFromMemCache(cachedName);
+        _accessTimes.erase(cachedName);
+    }
+
+    updateTotalCacheSize();
 }
 
 void TileCache::invalidateTiles(const std::string& tiles)
@@ -359,6 +729,51 @@ void TileCache::invalidateTiles(const std::string& tiles)
     Log::error("Unexpected invalidatetiles request: " + tiles);
 }
 
+void TileCache::saveDataToMemCache(const std::string& cachedName, TileData data)
+{
+    Util::assertIsLocked(_cacheMutex);
+
+    const auto it = _memCache.find(cachedName);
+    if (it != _memCache.end())
+    {
+        // Replace the stale payload and freshen the entry.
+        _memCacheSize -= it->second.data->size();
+        _memCacheSize += data->size();
+        it->second.data = std::move(data);
+        _memCacheLRU.splice(_memCacheLRU.begin(), _memCacheLRU, it->second.lruPosition);
+    }
+    else
+    {
+        _memCacheLRU.push_front(cachedName);
+        _memCacheSize += data->size();
+        _memCache.emplace(cachedName, MemCacheEntry{std::move(data), _memCacheLRU.begin()});
+    }
+
+    // Evict the least-recently-used entries beyond the bound.
+    while (_memCacheSize > MaxTileMemCacheBytes && !_memCacheLRU.empty())
+    {
+        const auto victim = _memCache.find(_memCacheLRU.back());
+        assert(victim != _memCache.end());
+        Log::trace("Evicting tile from memory cache: " + victim->first);
+        _memCacheSize -= victim->second.data->size();
+        _memCache.erase(victim);
+        _memCacheLRU.pop_back();
+    }
+}
+
+void TileCache::removeFromMemCache(const std::string& cachedName)
+{
+    Util::assertIsLocked(_cacheMutex);
+
+    const auto it = _memCache.find(cachedName);
+    if (it != _memCache.end())
+    {
+        _memCacheSize -= it->second.data->size();
+        _memCacheLRU.erase(it->second.lruPosition);
+        _memCache.erase(it);
+    }
+}
+
 void TileCache::removeFile(const std::string& fileName)
 {
     const std::string fullFileName = _cacheDir + "/" + fileName;
@@ -376,29 +791,261 @@ std::string TileCache::cacheFileName(const TileDesc& tile)
     return oss.str();
 }
 
-bool TileCache::parseCacheFileName(const std::string& fileName, int& part, int& width, int& height, int& tilePosX, int& tilePosY, int& tileWidth, int& tileHeight) const
+bool TileCache::loadCacheIndex()
+{
+    const std::string indexFileName = _cacheDir + "/" + TileIndexFileName;
+
+    std::fstream indexFile(indexFileName, std::ios::in);
+    if (!indexFile.is_open())
+    {
+        return false;
+    }
+
+    // Consume the index; a crashed instance must not revive a stale one.
+    Util::removeFile(indexFileName);
+
+    std::string version;
+    std::getline(indexFile, version);
+    if (version != TileIndexVersion)
+    {
+        Log::warn("Incompatible tile index [" + indexFileName + "]: " + version);
+        return false;
+    }
+
+    size_t entries = 0;
+    std::string line;
+    while (std::getline(indexFile, line))
+    {
+        size_t offset, size;
+        int part, width, height, tilePosX, tilePosY, tileWidth, tileHeight;
+        std::istringstream iss(line);
+        if (!(iss >> offset >> size >> part >> width >> height
+                  >> tilePosX >> tilePosY >> tileWidth >> tileHeight))
+        {
+            Log::warn("Invalid tile index entry [" + line + "] in " + indexFileName);
+            return false;
+        }
+
+        try
+        {
+            const TileDesc tile(part, width, height, tilePosX, tilePosY, tileWidth, tileHeight);
+            const auto cachedName = cacheFileName(tile);
+            if (_tileStore->restoreEntry(cachedName, offset, size))
+            {
+                _tileGrid.insert(cachedName, tile);
+                ++entries;
+            }
+        }
+        catch (const BadArgumentException&)
+        {
+            Log::warn("Invalid tile descriptor [" + line + "] in " + indexFileName);
+            return false;
+        }
+    }
+
+    return entries > 0;
+}
+
+void TileCache::saveCacheIndex()
 {
-    return (std::sscanf(fileName.c_str(), "%d_%dx%d.%d,%d.%dx%d.png", &part, &width, &height, &tilePosX, &tilePosY, &tileWidth, &tileHeight) == 7);
+    Util::assertIsLocked(_cacheMutex);
+
+    std::ostringstream oss;
+    oss << TileIndexVersion << '\n';
+
+    size_t entries = 0;
+    for (const auto& pair : _tileGrid.getEntries())
+    {
+        size_t offset, size;
+        const auto& tile = pair.second;
+        if (_tileStore->getEntry(pair.first, offset, size))
+        {
+            oss << offset << ' ' << size
+                << ' ' << tile.getPart()
+                << ' ' << tile.getWidth() << ' ' << tile.getHeight()
+                << ' ' << tile.getTilePosX() << ' ' << tile.getTilePosY()
+                << ' ' << tile.getTileWidth() << ' ' << tile.getTileHeight() << '\n';
+            ++entries;
+        }
+    }
+
+    const auto index = oss.str();
+    if (Util::saveDataToFileSafely(_cacheDir + "/" + TileIndexFileName, index.data(), index.size()))
+    {
+        Log::debug() << "Persisted index of " << entries << " tiles for [" << _docURL << "]." << Log::end;
+    }
 }
 
-bool TileCache::intersectsTile(const std::string& fileName, int part, int x, int y, int width, int height) const
+void TileCache::queueTileWrite(const std::string& cachedName, const TileData& data)
 {
-    int tilePart, tilePixelWidth, tilePixelHeight, tilePosX, tilePosY, tileWidth, tileHeight;
-    if (parseCacheFileName(fileName, tilePart, tilePixelWidth, tilePixelHeight, tilePosX, tilePosY, tileWidth, tileHeight))
     {
-        if (part != -1 && tilePart != part)
-            return false;
+        std::unique_lock<std::mutex> writerLock(_writerMutex);
 
-        const int left = std::max(x, tilePosX);
-        const int right = std::min(x + width, tilePosX + tileWidth);
-        const int top = std::max(y, tilePosY);
-        const int bottom = std::min(y + height, tilePosY + tileHeight);
+        if (_pendingWrites.find(cachedName) == _pendingWrites.end())
+        {
+            if (_writeOrder.size() >= MaxPendingTileWrites)
+            {
+                // Drop the oldest pending write; its tile is still served
+                // from memory and will be re-rendered if evicted.
+                const auto victim = _writeOrder.front();
+                _writeOrder.pop_front();
+                _pendingWrites.erase(victim);
+                Log::warn("Tile write queue full, dropping: " + victim);
+            }
 
-        if (left <= right && top <= bottom)
-            return true;
+            _writeOrder.push_back(cachedName);
+        }
+
+        // A re-render supersedes the queued payload.
+        _pendingWrites[cachedName] = data;
+    }
+
+    _writerCV.notify_one();
+}
+
+void TileCache::flushTileWrite(const std::string& cachedName, const TileData& data)
+{
+    std::unique_lock<std::mutex> lock(_cacheMutex);
+
+    // Skip tiles invalidated while queued.
+    const auto& entries = _tileGrid.getEntries();
+    if (entries.find(cachedName) == entries.end())
+    {
+        return;
+    }
+
+    if (_tileStore->append(cachedName, data->data(), data->size()))
+        Log::trace() << "Stored cache tile: " << cachedName << Log::end;
+
+    updateTotalCacheSize();
+}
+
+void TileCache::evictTile(const std::string& cachedName)
+{
+    Util::assertIsLocked(_cacheMutex);
+
+    Log::debug("Evicting tile: " + cachedName);
+
+    size_t offset, size;
+    if (_tileStore->getEntry(cachedName, offset, size))
+    {
+        EvictedBytes += size;
     }
 
-    return false;
+    ++EvictedTileCount;
+
+    _tileGrid.remove(cachedName);
+    _tileStore->remove(cachedName);
+    removeFromMemCache(cachedName);
+    _accessTimes.erase(cachedName);
+}
+
+void TileCache::evictTiles()
+{
+    std::unique_lock<std::mutex> lock(_cacheMutex);
+
+    const std::time_t maxAge = MaxTileAgeSecs;
+    const std::time_t now = std::time(nullptr);
+
+    // Oldest-first by last access.
+    std::vector<std::pair<std::time_t, std::string>> byAge;
+    byAge.reserve(_accessTimes.size());
+    for (const auto& pair : _accessTimes)
+    {
+        byAge.emplace_back(pair.second, pair.first);
+    }
+
+    std::sort(byAge.begin(), byAge.end());
+
+    size_t evicted = 0;
+    for (const auto& pair : byAge)
+    {
+        const bool tooOld = (maxAge > 0 && now - pair.first > maxAge);
+        const bool overDocBound = (MaxDocCacheBytes > 0 &&
+                                   _tileStore->getLiveSize() > MaxDocCacheBytes);
+        const bool overTotalBound = (MaxTotalCacheBytes > 0 &&
+                                     TotalCacheSize > MaxTotalCacheBytes);
+        if (!tooOld && !overDocBound && !overTotalBound)
+        {
+            break;
+        }
+
+        evictTile(pair.second);
+        updateTotalCacheSize();
+        ++evicted;
+    }
+
+    if (evicted > 0)
+    {
+        Log::debug() << "Evicted " << evicted << " tiles for [" << _docURL
+                     << "]; store: " << _tileStore->getLiveSize()
+                     << " bytes, global: " << TotalCacheSize << " bytes." << Log::end;
+    }
+}
+
+void TileCache::updateTotalCacheSize()
+{
+    Util::assertIsLocked(_cacheMutex);
+
+    const size_t size = _tileStore->getLiveSize();
+    if (size >= _accountedSize)
+    {
+        TotalCacheSize += size - _accountedSize;
+    }
+    else
+    {
+        TotalCacheSize -= _accountedSize - size;
+    }
+
+    _accountedSize = size;
+}
+
+void TileCache::tileWriterThread()
+{
+    Util::setThreadName("tile_writer");
+
+    for (;;)
+    {
+        std::string cachedName;
+        TileData data;
+        {
+            std::unique_lock<std::mutex> writerLock(_writerMutex);
+            if (!_writerCV.wait_for(writerLock, std::chrono::seconds(EvictionSweepSecs),
+                                    [this] { return _stopWriter || !_writeOrder.empty(); }))
+            {
+                // The queue has been idle for a while; a good moment
+                // for a low-priority eviction sweep.
+                writerLock.unlock();
+                evictTiles();
+                continue;
+            }
+
+            if (_writeOrder.empty())
+            {
+                if (_stopWriter)
+                {
+                    break;
+                }
+
+                continue;
+            }
+
+            cachedName = _writeOrder.front();
+            _writeOrder.pop_front();
+
+            const auto it = _pendingWrites.find(cachedName);
+            if (it == _pendingWrites.end())
+            {
+                // Invalidated while queued.
+                continue;
+            }
+
+            data = it->second;
+            _pendingWrites.erase(it);
+        }
+
+        flushTileWrite(cachedName, data);
+    }
 }
 
 Timestamp TileCache::getLastModified()
@@ -437,12 +1084,14 @@ void TileCache::subscribeToTileRendering(const TileDesc& tile, const std::shared
 
     if (tileBeingRendered)
     {
-        for (const auto &s : tileBeingRendered->_subscribers)
+        for (auto &s : tileBeingRendered->_subscribers)
         {
-            if (s.lock().get() == subscriber.get())
+            if (s._session.lock().get() == subscriber.get())
             {
                 Log::debug("Redundant request to subscribe on tile " + name);
                 tileBeingRendered->setVersion(tile.getVersion());
+                s._oldHash = tile.getOldHash();
+                s._preFetch = tile.isPreFetch();
                 return;
             }
         }
@@ -450,7 +1099,7 @@ void TileCache::subscribeToTileRendering(const TileDesc& tile, const std::shared
         Log::debug() << "Subscribing to tile " << name << " which has "
                      << tileBeingRendered->_subscribers.size()
                      << " subscribers already. Adding one more." << Log::end;
-        tileBeingRendered->_subscribers.push_back(subscriber);
+        tileBeingRendered->_subscribers.push_back({subscriber, tile.getOldHash(), tile.isPreFetch()});
 
         const auto duration = (std::chrono::steady_clock::now() - tileBeingRendered->getStartTime());
         if (std::chrono::duration_cast<std::chrono::milliseconds>(duration).count() > COMMAND_TIMEOUT_MS)
@@ -469,8 +1118,9 @@ void TileCache::subscribeToTileRendering(const TileDesc& tile, const std::shared
         assert(_tilesBeingRendered.find(cachedName) == _tilesBeingRendered.end());
 
         tileBeingRendered = std::make_shared<TileBeingRendered>(cachedName, tile);
-        tileBeingRendered->_subscribers.push_back(subscriber);
+        tileBeingRendered->_subscribers.push_back({subscriber, tile.getOldHash(), tile.isPreFetch()});
         _tilesBeingRendered[cachedName] = tileBeingRendered;
+        AdminMetrics::get().TilesBeingRendered = _tilesBeingRendered.size();
     }
 }
 
@@ -498,7 +1148,7 @@ std::string TileCache::cancelTiles(const std::shared_ptr<ClientSession> &subscri
         Log::trace("Tile " + it->first + " has " + std::to_string(subscribers.size()) + " subscribers.");
 
         const auto itRem = std::find_if(subscribers.begin(), subscribers.end(),
-                                        [sub](std::weak_ptr<ClientSession>& ptr){ return ptr.lock().get() == sub; });
+                                        [sub](TileBeingRendered::Subscriber& s){ return s._session.lock().get() == sub; });
         if (itRem != subscribers.end())
         {
             Log::trace("Tile " + it->first + " has " + std::to_string(subscribers.size()) + " subscribers. Removing one.");
@@ -515,6 +1165,8 @@ std::string TileCache::cancelTiles(const std::shared_ptr<ClientSession> &subscri
         ++it;
     }
 
+    AdminMetrics::get().TilesBeingRendered = _tilesBeingRendered.size();
+
     const auto canceltiles = oss.str();
     return (canceltiles.empty() ? canceltiles : "canceltiles " + canceltiles);
 }
@@ -10,17 +10,31 @@
 #ifndef INCLUDED_TILECACHE_HPP
 #define INCLUDED_TILECACHE_HPP
 
+#include <atomic>
+#include <condition_variable>
+#include <ctime>
+#include <deque>
 #include <iosfwd>
+#include <list>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <Poco/Timestamp.h>
 
+#include "Rectangle.hpp"
 #include "TileDesc.hpp"
 
 class ClientSession;
+class TileStore;
+
+/// A shared, immutable tile or message payload. Reference-counted, so
+/// the cache layers and all subscribers serialize the same buffer
+/// instead of taking per-consumer copies.
+using TileData = std::shared_ptr<const std::vector<char>>;
 
 /// Handles the caching of tiles of one document.
 class TileCache
@@ -45,9 +59,25 @@ public:
     /// Cancels all tile requests by the given subscriber.
     std::string cancelTiles(const std::shared_ptr<ClientSession> &subscriber);
 
-    std::unique_ptr<std::fstream> lookupTile(const TileDesc& tile);
+    /// Lookup the tile's PNG payload, in-memory cache first, tile store second.
+    /// A store hit populates the in-memory cache. Returns nullptr when not cached.
+    TileData lookupTileData(const TileDesc& tile);
+
+    /// The content hash of the given payload; what stamps the tile
+    /// responses so clients can avoid re-fetching identical content.
+    static uint64_t hashTileData(const char* data, size_t size);
+
+    /// The content hash of this tile's cached payload, computing and
+    /// remembering it from the given payload when not yet known.
+    uint64_t ensureTileHash(const TileDesc& tile, const TileData& data);
 
-    void saveTileAndNotify(const TileDesc& tile, const char *data, const size_t size);
+    /// Cache the full tile and notify subscribers. When the kit supplied a
+    /// band delta (deltaYStart >= 0), subscribers get a "tiledelta:" with just
+    /// the changed band instead of the full tile; the cache always keeps the
+    /// full payload. An empty delta means the tile is unchanged.
+    void saveTileAndNotify(const TileDesc& tile, const char *data, const size_t size,
+                           const int deltaYStart = -1, const char *deltaData = nullptr,
+                           const size_t deltaSize = 0);
 
     std::string getTextFile(const std::string& fileName);
 
@@ -73,17 +103,118 @@ public:
 
     void forgetTileBeingRendered(const TileDesc& tile);
 
+    /// The round-trip ms accumulated so far by a tile currently out
+    /// for rendering, or 0 when it isn't tracked.
+    double getTileRoundTripMs(const TileDesc& tile);
+
+    /// The number of tiles currently out for rendering.
+    size_t getTilesBeingRenderedCount();
+
+    /// Set the eviction policy bounds from the configuration.
+    /// A zero bound disables the respective limit.
+    static void setEvictionPolicy(size_t maxDocSizeBytes, size_t maxTotalSizeBytes,
+                                  std::time_t maxTileAgeSecs);
+
+    /// Set the host-global rendering cache directory. Font and style
+    /// previews do not depend on the document, so one rendering can
+    /// serve every document on the host; when set, saveRendering and
+    /// lookupRendering use this directory instead of the per-document
+    /// cache. Must be called before any TileCache is in use.
+    static void setRenderingCacheDir(const std::string& dir);
+
+    /// Bytes of tile payload stored on behalf of all documents.
+    static size_t getTotalCacheSize() { return TotalCacheSize; }
+
+    /// Number of tiles evicted by policy, over all documents.
+    static size_t getEvictedTileCount() { return EvictedTileCount; }
+
+    /// Bytes of tile payload evicted by policy, over all documents.
+    static size_t getEvictedBytes() { return EvictedBytes; }
+
 private:
+    /// In-memory LRU cache entry of a tile's PNG payload.
+    struct MemCacheEntry
+    {
+        TileData data;
+        std::list<std::string>::iterator lruPosition;
+    };
+
+    /// Spatial index of the cached tiles, bucketed into a coarse
+    /// per-part grid, so an invalidation rectangle maps directly
+    /// to the affected tiles without re-parsing cache names.
+    class TileGrid
+    {
+    public:
+        void insert(const std::string& name, const TileDesc& tile);
+        void remove(const std::string& name);
+
+        /// Names of the tiles intersecting area. A part of -1 matches all parts.
+        std::vector<std::string> intersecting(int part, const Util::Rectangle& area) const;
+
+        /// All indexed tiles, keyed by cache name; for persisting the index.
+        const std::map<std::string, TileDesc>& getEntries() const { return _entries; }
+
+    private:
+        /// Grid bucket coordinates covering an area.
+        static void bucketSpan(const Util::Rectangle& area, int& x1, int& y1, int& x2, int& y2);
+
+        static Util::Rectangle tileArea(const TileDesc& tile)
+        {
+            return Util::Rectangle(tile.getTilePosX(), tile.getTilePosY(),
+                                   tile.getTileWidth(), tile.getTileHeight());
+        }
+
+        std::map<std::string, TileDesc> _entries;
+        std::map<int, std::map<std::pair<int, int>, std::vector<std::string>>> _buckets;
+    };
+
     void invalidateTiles(int part, int x, int y, int width, int height);
 
+    /// Add (or replace) a tile payload in the in-memory cache,
+    /// evicting the least-recently-used entries beyond the size bound.
+    /// Requires _cacheMutex to be held.
+    void saveDataToMemCache(const std::string& cachedName, TileData data);
+
+    /// Remove a tile payload from the in-memory cache, if present.
+    /// Requires _cacheMutex to be held.
+    void removeFromMemCache(const std::string& cachedName);
+
+    /// Restore the tile store index and spatial index persisted by a
+    /// previous instance. Returns false when nothing valid survived.
+    bool loadCacheIndex();
+
+    /// Persist the tile store index so a restarted server can serve
+    /// previously rendered tiles without re-rendering.
+    void saveCacheIndex();
+
+    /// Hand a rendered tile to the background writer for persistence.
+    void queueTileWrite(const std::string& cachedName, const TileData& data);
+
+    /// Persist one queued tile write into the tile store.
+    void flushTileWrite(const std::string& cachedName, const TileData& data);
+
+    /// Apply the eviction policy: drop tiles not accessed within
+    /// the age bound, then the least-recently-used tiles until the
+    /// per-document and global size bounds are met.
+    void evictTiles();
+
+    /// Drop one tile from the store, the indexes and the in-memory
+    /// cache, updating the eviction counters.
+    /// Requires _cacheMutex to be held.
+    void evictTile(const std::string& cachedName);
+
+    /// Reconcile TotalCacheSize with this document's store size.
+    /// Requires _cacheMutex to be held.
+    void updateTotalCacheSize();
+
+    /// Main loop of the background tile writer. Runs the eviction
+    /// policy while the write queue is idle.
+    void tileWriterThread();
+
     // Removes the given file from the cache
     void removeFile(const std::string& fileName);
 
     std::string cacheFileName(const TileDesc& tile);
-    bool parseCacheFileName(const std::string& fileName, int& part, int& width, int& height, int& tilePosX, int& tilePosY, int& tileWidth, int& tileHeight) const;
-
-    /// Extract location from fileName, and check if it intersects with [x, y, width, height].
-    bool intersectsTile(const std::string& fileName, int part, int x, int y, int width, int height) const;
 
     /// Load the timestamp from modtime.txt.
     Poco::Timestamp getLastModified();
@@ -94,9 +225,64 @@ private:
 
     std::mutex _cacheMutex;
 
+    /// In-memory tile payloads, keyed by cache file name. Guarded by _cacheMutex.
+    std::map<std::string, MemCacheEntry> _memCache;
+
+    /// Cache names in most-recently-used-first order. Guarded by _cacheMutex.
+    std::list<std::string> _memCacheLRU;
+
+    /// Total bytes of payload held in _memCache. Guarded by _cacheMutex.
+    size_t _memCacheSize;
+
+    /// The packed on-disk store of this document's tiles. Guarded by _cacheMutex.
+    std::unique_ptr<TileStore> _tileStore;
+
+    /// Spatial index of the cached tiles. Guarded by _cacheMutex.
+    TileGrid _tileGrid;
+
+    /// Last access time of each cached tile, for age- and
+    /// LRU-bounded eviction. Guarded by _cacheMutex.
+    std::map<std::string, std::time_t> _accessTimes;
+
+    /// Content hash of each cached tile payload. Guarded by _cacheMutex.
+    std::map<std::string, uint64_t> _tileHashes;
+
+    /// This document's contribution to TotalCacheSize. Guarded by _cacheMutex.
+    size_t _accountedSize;
+
+    /// Tile persistence runs on a background thread with a bounded
+    /// queue, so storage latency never delays tile delivery.
+    std::mutex _writerMutex;
+    std::condition_variable _writerCV;
+
+    /// Pending payloads by cache name. Guarded by _writerMutex.
+    std::map<std::string, TileData> _pendingWrites;
+
+    /// Write order of the pending payloads. Guarded by _writerMutex.
+    std::deque<std::string> _writeOrder;
+
+    /// Tells the writer thread to drain and exit. Guarded by _writerMutex.
+    bool _stopWriter;
+
+    std::thread _writerThread;
+
     mutable std::mutex _tilesBeingRenderedMutex;
 
     std::map<std::string, std::shared_ptr<TileBeingRendered>> _tilesBeingRendered;
+
+    /// Host-global rendering cache directory, shared by all documents.
+    /// Empty keeps the renderings per-document. Set once at startup.
+    static std::string RenderingCacheDir;
+
+    /// Eviction policy bounds, shared by all documents. Zero disables a bound.
+    static std::atomic<size_t> MaxDocCacheBytes;
+    static std::atomic<size_t> MaxTotalCacheBytes;
+    static std::atomic<std::time_t> MaxTileAgeSecs;
+
+    /// Cache-pressure counters, shared by all documents.
+    static std::atomic<size_t> TotalCacheSize;
+    static std::atomic<size_t> EvictedTileCount;
+    static std::atomic<size_t> EvictedBytes;
 };
 
 #endif
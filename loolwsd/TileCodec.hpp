@@ -0,0 +1,128 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef INCLUDED_TILECODEC_HPP
+#define INCLUDED_TILECODEC_HPP
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Poco/StringTokenizer.h>
+
+#include "Log.hpp"
+#include "Png.hpp"
+
+/// What a tile encoding is used for, which decides how much
+/// compression effort it is worth.
+enum class TileCodecUse
+{
+    /// Short-lived tiles rendered while the user edits or scrolls.
+    Interactive,
+    /// Long-lived tiles, such as cached part previews and thumbnails.
+    Preview
+};
+
+/// A tile encoder. Encoders are selected and tuned per use via
+/// tile_codec in loolwsd.xml, handed to the kit process in the
+/// LOOL_TILE_CODEC_* environment variables. Only "png" is
+/// implemented so far; alternative encoders implement this
+/// interface and register in createTileCodec below.
+class TileCodec
+{
+public:
+    virtual ~TileCodec()
+    {
+    }
+
+    /// Encode a (width x height) region of the pixmap starting at
+    /// (startX, startY) and append the result to output.
+    virtual bool encode(unsigned char* pixmap, size_t startX, size_t startY,
+                        int width, int height, int bufferWidth, int bufferHeight,
+                        std::vector<char>& output, LibreOfficeKitTileMode mode) = 0;
+
+    /// The configured encoder for the given use.
+    static TileCodec& get(TileCodecUse use);
+};
+
+/// The libpng-based encoder, with configurable zlib compression
+/// level and filter strategy.
+class PngCodec final : public TileCodec
+{
+public:
+    PngCodec(const int compressionLevel, const int filters) :
+        _compressionLevel(compressionLevel),
+        _filters(filters)
+    {
+    }
+
+    bool encode(unsigned char* pixmap, size_t startX, size_t startY,
+                int width, int height, int bufferWidth, int bufferHeight,
+                std::vector<char>& output, LibreOfficeKitTileMode mode) override
+    {
+        return png::encodeSubBufferToPNG(pixmap, startX, startY, width, height,
+                                         bufferWidth, bufferHeight, output, mode,
+                                         _compressionLevel, _filters);
+    }
+
+private:
+    const int _compressionLevel;
+    const int _filters;
+};
+
+/// Create the encoder described by a "name:zlib-level:filter-strategy"
+/// spec from the environment, falling back to defaultSpec.
+static TileCodec* createTileCodec(const char* envVar, const std::string& defaultSpec)
+{
+    const char* env = std::getenv(envVar);
+    const std::string spec = (env != nullptr && env[0] != '\0' ? env : defaultSpec);
+
+    Poco::StringTokenizer tokens(spec, ":", Poco::StringTokenizer::TOK_TRIM);
+
+    // A negative level leaves the zlib default in force.
+    int compressionLevel = -1;
+    if (tokens.count() > 1 && !tokens[1].empty())
+    {
+        compressionLevel = std::max(0, std::min(9, std::atoi(tokens[1].c_str())));
+    }
+
+    int filters = PNG_ALL_FILTERS;
+    if (tokens.count() > 2)
+    {
+        if (tokens[2] == "none")
+            filters = PNG_FILTER_NONE;
+        else if (tokens[2] == "sub")
+            filters = PNG_FILTER_SUB;
+        else if (tokens[2] != "all")
+            Log::warn("Unknown tile codec filter strategy: " + tokens[2]);
+    }
+
+    if (tokens.count() > 0 && tokens[0] != "png")
+    {
+        Log::warn("Unknown tile codec [" + tokens[0] + "], falling back to png.");
+    }
+
+    return new PngCodec(compressionLevel, filters);
+}
+
+inline TileCodec& TileCodec::get(const TileCodecUse use)
+{
+    static std::unique_ptr<TileCodec> interactive(
+        createTileCodec("LOOL_TILE_CODEC_INTERACTIVE", "png:1:none"));
+    static std::unique_ptr<TileCodec> preview(
+        createTileCodec("LOOL_TILE_CODEC_PREVIEW", "png:6:all"));
+
+    return (use == TileCodecUse::Interactive ? *interactive : *preview);
+}
+
+#endif
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
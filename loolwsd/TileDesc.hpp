@@ -10,22 +10,68 @@
 #ifndef INCLUDED_TILEDESC_HPP
 #define INCLUDED_TILEDESC_HPP
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 #include <map>
-#include <sstream>
 #include <string>
+#include <vector>
 
 #include <Poco/StringTokenizer.h>
 
 #include "Exceptions.hpp"
 #include "LOOLProtocol.hpp"
 
+/// Fixed-layout binary framing for the high-frequency tile messages
+/// on the wsd <-> kit socket, so the hot path does no integer
+/// formatting or parsing at all. Both ends always run on the same
+/// machine, so the fields travel in host byte order. Everything else
+/// on that socket stays text.
+namespace TileBinary
+{
+    /// First byte of a binary frame; never the first byte of a
+    /// text message.
+    constexpr char Magic = '\x02';
+    constexpr char TypeTile = 'T';
+    constexpr char TypeCombine = 'C';
+
+    inline bool isTileFrame(const char* data, const size_t size)
+    {
+        return size >= 2 && data[0] == Magic && data[1] == TypeTile;
+    }
+
+    inline bool isCombineFrame(const char* data, const size_t size)
+    {
+        return size >= 2 && data[0] == Magic && data[1] == TypeCombine;
+    }
+
+    inline bool isFrame(const char* data, const size_t size)
+    {
+        return size >= 2 && data[0] == Magic;
+    }
+
+    inline void appendInt(std::vector<char>& buffer, const int value)
+    {
+        const char* pos = reinterpret_cast<const char*>(&value);
+        buffer.insert(buffer.end(), pos, pos + sizeof(value));
+    }
+
+    inline int readInt(const char*& pos)
+    {
+        int value;
+        std::memcpy(&value, pos, sizeof(value));
+        pos += sizeof(value);
+        return value;
+    }
+}
+
 /// Tile Descriptor
 /// Represents a tile's coordinates and dimensions.
 class TileDesc
 {
 public:
-    TileDesc(int part, int width, int height, int tilePosX, int tilePosY, int tileWidth, int tileHeight, int ver = -1, int imgSize = 0, int id = -1) :
+    TileDesc(int part, int width, int height, int tilePosX, int tilePosY, int tileWidth, int tileHeight, int ver = -1, int imgSize = 0, int id = -1, int preFetch = 0) :
         _part(part),
         _width(width),
         _height(height),
@@ -35,7 +81,10 @@ public:
         _tileHeight(tileHeight),
         _ver(ver),
         _imgSize(imgSize),
-        _id(id)
+        _id(id),
+        _preFetch(preFetch),
+        _oldHash(0),
+        _hash(0)
     {
         if (_part < 0 ||
             _width <= 0 ||
@@ -63,6 +112,19 @@ public:
     void setImgSize(const int imgSize) { _imgSize = imgSize; }
     int getId() const { return _id; }
 
+    /// Requested ahead of need to warm the client's cache;
+    /// rendered and sent at preview priority.
+    bool isPreFetch() const { return _preFetch != 0; }
+    void setPreFetch(const int preFetch) { _preFetch = preFetch; }
+
+    /// The content hash the client already has for this tile;
+    /// 0 when unknown. Travels only on the client leg.
+    uint64_t getOldHash() const { return _oldHash; }
+    void setOldHash(const uint64_t oldHash) { _oldHash = oldHash; }
+    /// The content hash of this tile's payload; 0 when not stamped.
+    uint64_t getHash() const { return _hash; }
+    void setHash(const uint64_t hash) { _hash = hash; }
+
     bool intersectsWithRect(int x, int y, int w, int h) const
     {
         return x + w >= getTilePosX() &&
@@ -110,28 +172,86 @@ public:
     /// Optionally prepend a prefix.
     std::string serialize(const std::string& prefix = "") const
     {
-        std::ostringstream oss;
-        oss << prefix
-            << " part=" << _part
-            << " width=" << _width
-            << " height=" << _height
-            << " tileposx=" << _tilePosX
-            << " tileposy=" << _tilePosY
-            << " tilewidth=" << _tileWidth
-            << " tileheight=" << _tileHeight
-            << " ver=" << _ver;
+        std::string buffer;
+        buffer.reserve(prefix.size() + 128);
+        appendSerialized(buffer, prefix);
+        return buffer;
+    }
+
+    /// Append the serialization to a caller-supplied buffer, with
+    /// fixed integer formatting; this runs for every tile response,
+    /// so no streams or locales.
+    void appendSerialized(std::string& buffer, const std::string& prefix = "") const
+    {
+        buffer.append(prefix);
+        buffer.append(" part=");
+        LOOLProtocol::appendInteger(buffer, _part);
+        buffer.append(" width=");
+        LOOLProtocol::appendInteger(buffer, _width);
+        buffer.append(" height=");
+        LOOLProtocol::appendInteger(buffer, _height);
+        buffer.append(" tileposx=");
+        LOOLProtocol::appendInteger(buffer, _tilePosX);
+        buffer.append(" tileposy=");
+        LOOLProtocol::appendInteger(buffer, _tilePosY);
+        buffer.append(" tilewidth=");
+        LOOLProtocol::appendInteger(buffer, _tileWidth);
+        buffer.append(" tileheight=");
+        LOOLProtocol::appendInteger(buffer, _tileHeight);
+        buffer.append(" ver=");
+        LOOLProtocol::appendInteger(buffer, _ver);
 
         if (_imgSize > 0)
         {
-            oss << " imgsize=" << _imgSize;
+            buffer.append(" imgsize=");
+            LOOLProtocol::appendInteger(buffer, _imgSize);
         }
 
         if (_id >= 0)
         {
-            oss << " id=" << _id;
+            buffer.append(" id=");
+            LOOLProtocol::appendInteger(buffer, _id);
+        }
+
+        if (_preFetch != 0)
+        {
+            buffer.append(" prefetch=");
+            LOOLProtocol::appendInteger(buffer, _preFetch);
+        }
+
+        if (_oldHash != 0)
+        {
+            buffer.append(" oldhash=");
+            LOOLProtocol::appendUInt64(buffer, _oldHash);
+        }
+
+        if (_hash != 0)
+        {
+            buffer.append(" hash=");
+            LOOLProtocol::appendUInt64(buffer, _hash);
         }
+    }
 
-        return oss.str();
+    /// The canonical key of this tile's position and geometry,
+    /// without version or image size; what the queue dedups by.
+    std::string generateKey() const
+    {
+        std::string key;
+        key.reserve(64);
+        LOOLProtocol::appendInteger(key, _part);
+        key += ':';
+        LOOLProtocol::appendInteger(key, _width);
+        key += 'x';
+        LOOLProtocol::appendInteger(key, _height);
+        key += ':';
+        LOOLProtocol::appendInteger(key, _tilePosX);
+        key += ',';
+        LOOLProtocol::appendInteger(key, _tilePosY);
+        key += ':';
+        LOOLProtocol::appendInteger(key, _tileWidth);
+        key += 'x';
+        LOOLProtocol::appendInteger(key, _tileHeight);
+        return key;
     }
 
     /// Deserialize a TileDesc from a tokenized string.
@@ -146,32 +266,175 @@ public:
         pairs["ver"] = -1;
         pairs["imgsize"] = 0;
         pairs["id"] = -1;
+        pairs["prefetch"] = 0;
 
+        uint64_t oldHash = 0;
+        uint64_t hash = 0;
         for (size_t i = 0; i < tokens.count(); ++i)
         {
             std::string name;
+            std::string value;
+            if (!LOOLProtocol::parseNameValuePair(tokens[i], name, value))
+            {
+                continue;
+            }
+
+            // The hashes don't fit an int.
+            if (name == "oldhash")
+            {
+                LOOLProtocol::stringToUInt64(value, oldHash);
+            }
+            else if (name == "hash")
+            {
+                LOOLProtocol::stringToUInt64(value, hash);
+            }
+            else
+            {
+                int intValue = -1;
+                if (LOOLProtocol::stringToInteger(value, intValue))
+                {
+                    pairs[name] = intValue;
+                }
+            }
+        }
+
+        auto result = TileDesc(pairs["part"], pairs["width"], pairs["height"],
+                               pairs["tileposx"], pairs["tileposy"],
+                               pairs["tilewidth"], pairs["tileheight"],
+                               pairs["ver"],
+                               pairs["imgsize"], pairs["id"], pairs["prefetch"]);
+        result.setOldHash(oldHash);
+        result.setHash(hash);
+        return result;
+    }
+
+    /// Serialize into the compact binary frame used on the
+    /// wsd <-> kit socket.
+    std::vector<char> serializeBinary() const
+    {
+        std::vector<char> buffer;
+        buffer.reserve(2 + 11 * sizeof(int));
+        buffer.push_back(TileBinary::Magic);
+        buffer.push_back(TileBinary::TypeTile);
+        TileBinary::appendInt(buffer, _part);
+        TileBinary::appendInt(buffer, _width);
+        TileBinary::appendInt(buffer, _height);
+        TileBinary::appendInt(buffer, _tilePosX);
+        TileBinary::appendInt(buffer, _tilePosY);
+        TileBinary::appendInt(buffer, _tileWidth);
+        TileBinary::appendInt(buffer, _tileHeight);
+        TileBinary::appendInt(buffer, _ver);
+        TileBinary::appendInt(buffer, _imgSize);
+        TileBinary::appendInt(buffer, _id);
+        TileBinary::appendInt(buffer, _preFetch);
+        return buffer;
+    }
+
+    /// Deserialize a TileDesc from its binary frame.
+    static
+    TileDesc parseBinary(const char* data, const size_t size)
+    {
+        if (!TileBinary::isTileFrame(data, size) || size < 2 + 11 * sizeof(int))
+        {
+            throw BadArgumentException("Invalid binary tile frame.");
+        }
+
+        const char* pos = data + 2;
+        const auto part = TileBinary::readInt(pos);
+        const auto width = TileBinary::readInt(pos);
+        const auto height = TileBinary::readInt(pos);
+        const auto tilePosX = TileBinary::readInt(pos);
+        const auto tilePosY = TileBinary::readInt(pos);
+        const auto tileWidth = TileBinary::readInt(pos);
+        const auto tileHeight = TileBinary::readInt(pos);
+        const auto ver = TileBinary::readInt(pos);
+        const auto imgSize = TileBinary::readInt(pos);
+        const auto id = TileBinary::readInt(pos);
+        const auto preFetch = TileBinary::readInt(pos);
+        return TileDesc(part, width, height, tilePosX, tilePosY, tileWidth, tileHeight,
+                        ver, imgSize, id, preFetch);
+    }
+
+    /// Deserialize a TileDesc from a raw message, in place. This is
+    /// the hot path - every queued tile message is re-parsed - so it
+    /// neither tokenizes onto the heap nor builds a name/value map.
+    static
+    TileDesc parse(const char* data, const size_t size)
+    {
+        // We don't expect undocumented fields and
+        // assume all values to be int.
+        int part = 0, width = 0, height = 0;
+        int tilePosX = 0, tilePosY = 0, tileWidth = 0, tileHeight = 0;
+
+        // Optional.
+        int ver = -1, imgSize = 0, id = -1, preFetch = 0;
+        uint64_t oldHash = 0, hash = 0;
+
+        LOOLProtocol::Tokenizer tokenizer(data, size);
+        LOOLProtocol::TokenView token;
+        while (tokenizer.next(token))
+        {
+            LOOLProtocol::TokenView name;
+            LOOLProtocol::TokenView strValue;
+            if (!LOOLProtocol::parseNameValuePair(token, name, strValue))
+            {
+                continue;
+            }
+
+            // The hashes don't fit an int.
+            if (name.equals("oldhash"))
+            {
+                LOOLProtocol::stringToUInt64(strValue, oldHash);
+                continue;
+            }
+            else if (name.equals("hash"))
+            {
+                LOOLProtocol::stringToUInt64(strValue, hash);
+                continue;
+            }
+
             int value = -1;
-            if (LOOLProtocol::parseNameIntegerPair(tokens[i], name, value))
+            if (!LOOLProtocol::stringToInteger(strValue, value))
             {
-                pairs[name] = value;
+                continue;
             }
+
+            if (name.equals("part"))
+                part = value;
+            else if (name.equals("width"))
+                width = value;
+            else if (name.equals("height"))
+                height = value;
+            else if (name.equals("tileposx"))
+                tilePosX = value;
+            else if (name.equals("tileposy"))
+                tilePosY = value;
+            else if (name.equals("tilewidth"))
+                tileWidth = value;
+            else if (name.equals("tileheight"))
+                tileHeight = value;
+            else if (name.equals("ver"))
+                ver = value;
+            else if (name.equals("imgsize"))
+                imgSize = value;
+            else if (name.equals("id"))
+                id = value;
+            else if (name.equals("prefetch"))
+                preFetch = value;
         }
 
-        return TileDesc(pairs["part"], pairs["width"], pairs["height"],
-                        pairs["tileposx"], pairs["tileposy"],
-                        pairs["tilewidth"], pairs["tileheight"],
-                        pairs["ver"],
-                        pairs["imgsize"], pairs["id"]);
+        auto result = TileDesc(part, width, height, tilePosX, tilePosY, tileWidth, tileHeight,
+                               ver, imgSize, id, preFetch);
+        result.setOldHash(oldHash);
+        result.setHash(hash);
+        return result;
     }
 
     /// Deserialize a TileDesc from a string format.
     static
     TileDesc parse(const std::string& message)
     {
-        Poco::StringTokenizer tokens(message, " ",
-                                     Poco::StringTokenizer::TOK_IGNORE_EMPTY |
-                                     Poco::StringTokenizer::TOK_TRIM);
-        return parse(tokens);
+        return parse(message.data(), message.size());
     }
 
 private:
@@ -185,6 +448,9 @@ private:
     int _ver;       //< Versioning support.
     int _imgSize;   //< Used for responses.
     int _id;
+    int _preFetch;      //< Nonzero for cache-warming requests.
+    uint64_t _oldHash;  //< Client's content hash, in requests.
+    uint64_t _hash;     //< Payload content hash, in responses.
 };
 
 /// One or more tile header.
@@ -196,14 +462,16 @@ private:
     TileCombined(int part, int width, int height,
                  const std::string& tilePositionsX, const std::string& tilePositionsY,
                  int tileWidth, int tileHeight, int ver = -1,
-                 const std::string& imgSizes = "", int id = -1) :
+                 const std::string& imgSizes = "", int id = -1,
+                 const std::string& oldHashes = "", int preFetch = 0) :
         _part(part),
         _width(width),
         _height(height),
         _tileWidth(tileWidth),
         _tileHeight(tileHeight),
         _ver(ver),
-        _id(id)
+        _id(id),
+        _preFetch(preFetch)
     {
         if (_part < 0 ||
             _width <= 0 ||
@@ -217,11 +485,14 @@ private:
         Poco::StringTokenizer positionXtokens(tilePositionsX, ",", Poco::StringTokenizer::TOK_IGNORE_EMPTY | Poco::StringTokenizer::TOK_TRIM);
         Poco::StringTokenizer positionYtokens(tilePositionsY, ",", Poco::StringTokenizer::TOK_IGNORE_EMPTY | Poco::StringTokenizer::TOK_TRIM);
         Poco::StringTokenizer sizeTokens(imgSizes, ",", Poco::StringTokenizer::TOK_IGNORE_EMPTY | Poco::StringTokenizer::TOK_TRIM);
+        Poco::StringTokenizer oldHashTokens(oldHashes, ",", Poco::StringTokenizer::TOK_IGNORE_EMPTY | Poco::StringTokenizer::TOK_TRIM);
 
         const auto numberOfPositions = positionYtokens.count();
 
         // check that number of positions for X and Y is the same
-        if (numberOfPositions != positionXtokens.count() || (!imgSizes.empty() && numberOfPositions != sizeTokens.count()))
+        if (numberOfPositions != positionXtokens.count() ||
+            (!imgSizes.empty() && numberOfPositions != sizeTokens.count()) ||
+            (!oldHashes.empty() && numberOfPositions != oldHashTokens.count()))
         {
             throw BadArgumentException("Invalid tilecombine descriptor. Uneven number of tiles.");
         }
@@ -246,7 +517,40 @@ private:
                 throw BadArgumentException("Invalid tilecombine descriptor.");
             }
 
-            _tiles.emplace_back(_part, _width, _height, x, y, _tileWidth, _tileHeight, ver, size, id);
+            uint64_t oldHash = 0;
+            if (oldHashTokens.count())
+            {
+                // A client without the tile sends 0.
+                LOOLProtocol::stringToUInt64(oldHashTokens[i], oldHash);
+            }
+
+            _tiles.emplace_back(_part, _width, _height, x, y, _tileWidth, _tileHeight, ver, size, id, preFetch);
+            _tiles.back().setOldHash(oldHash);
+        }
+    }
+
+    /// Create directly from parsed tiles, without a text round-trip.
+    /// The tiles must share part, sizes and geometry.
+    explicit TileCombined(const std::vector<TileDesc>& tiles) :
+        _tiles(tiles),
+        _part(tiles[0].getPart()),
+        _width(tiles[0].getWidth()),
+        _height(tiles[0].getHeight()),
+        _tileWidth(tiles[0].getTileWidth()),
+        _tileHeight(tiles[0].getTileHeight()),
+        _ver(-1),
+        _id(-1),
+        _preFetch(tiles[0].isPreFetch() ? 1 : 0)
+    {
+        for (const auto& tile : _tiles)
+        {
+            _ver = std::max(tile.getVersion(), _ver);
+        }
+
+        // The combined request renders as one; all tiles share its version.
+        for (auto& tile : _tiles)
+        {
+            tile.setVersion(_ver);
         }
     }
 
@@ -263,52 +567,72 @@ public:
     const std::vector<TileDesc>& getTiles() const { return _tiles; }
     std::vector<TileDesc>& getTiles() { return _tiles; }
 
-    /// Serialize this instance into a string.
+    /// Serialize this instance into a string, with fixed integer
+    /// formatting; this runs for every combined tile response.
     /// Optionally prepend a prefix.
     std::string serialize(const std::string& prefix = "") const
     {
-        std::ostringstream oss;
-        oss << prefix
-            << " part=" << _part
-            << " width=" << _width
-            << " height=" << _height
-            << " tileposx=";
+        std::string buffer;
+        buffer.reserve(prefix.size() + 128 + 24 * _tiles.size());
+        buffer.append(prefix);
+        buffer.append(" part=");
+        LOOLProtocol::appendInteger(buffer, _part);
+        buffer.append(" width=");
+        LOOLProtocol::appendInteger(buffer, _width);
+        buffer.append(" height=");
+        LOOLProtocol::appendInteger(buffer, _height);
+
+        buffer.append(" tileposx=");
         for (const auto& tile : _tiles)
         {
-            oss << tile.getTilePosX() << ',';
+            LOOLProtocol::appendInteger(buffer, tile.getTilePosX());
+            buffer += ',';
         }
 
-        oss.seekp(-1, std::ios_base::cur); // Remove last comma.
+        buffer.resize(buffer.size() - 1); // Remove last comma.
 
-        oss << " tileposy=";
+        buffer.append(" tileposy=");
         for (const auto& tile : _tiles)
         {
-            oss << tile.getTilePosY() << ',';
+            LOOLProtocol::appendInteger(buffer, tile.getTilePosY());
+            buffer += ',';
         }
 
-        oss.seekp(-1, std::ios_base::cur); // Remove last comma.
+        buffer.resize(buffer.size() - 1); // Remove last comma.
 
-        oss << " imgsize=";
+        buffer.append(" imgsize=");
         for (const auto& tile : _tiles)
         {
-            oss << tile.getImgSize() << ',';
+            LOOLProtocol::appendInteger(buffer, tile.getImgSize());
+            buffer += ',';
         }
 
-        oss.seekp(-1, std::ios_base::cur); // Remove last comma.
+        buffer.resize(buffer.size() - 1); // Remove last comma.
+
+        buffer.append(" tilewidth=");
+        LOOLProtocol::appendInteger(buffer, _tileWidth);
+        buffer.append(" tileheight=");
+        LOOLProtocol::appendInteger(buffer, _tileHeight);
 
-        oss << " tilewidth=" << _tileWidth
-            << " tileheight=" << _tileHeight;
         if (_ver >= 0)
         {
-            oss << " ver=" << _ver;
+            buffer.append(" ver=");
+            LOOLProtocol::appendInteger(buffer, _ver);
         }
 
         if (_id >= 0)
         {
-            oss << " id=" << _id;
+            buffer.append(" id=");
+            LOOLProtocol::appendInteger(buffer, _id);
         }
 
-        return oss.str();
+        if (_preFetch != 0)
+        {
+            buffer.append(" prefetch=");
+            LOOLProtocol::appendInteger(buffer, _preFetch);
+        }
+
+        return buffer;
     }
 
     /// Deserialize a TileDesc from a tokenized string.
@@ -322,10 +646,12 @@ public:
         // Optional.
         pairs["ver"] = -1;
         pairs["id"] = -1;
+        pairs["prefetch"] = 0;
 
         std::string tilePositionsX;
         std::string tilePositionsY;
         std::string imgSizes;
+        std::string oldHashes;
         for (size_t i = 0; i < tokens.count(); ++i)
         {
             std::string name;
@@ -344,6 +670,10 @@ public:
                 {
                     imgSizes = value;
                 }
+                else if (name == "oldhash")
+                {
+                    oldHashes = value;
+                }
                 else
                 {
                     int v = 0;
@@ -359,7 +689,7 @@ public:
                             tilePositionsX, tilePositionsY,
                             pairs["tilewidth"], pairs["tileheight"],
                             pairs["ver"],
-                            imgSizes, pairs["id"]);
+                            imgSizes, pairs["id"], oldHashes, pairs["prefetch"]);
     }
 
     /// Deserialize a TileDesc from a string format.
@@ -372,24 +702,72 @@ public:
         return parse(tokens);
     }
 
+    /// Serialize into the compact binary frame used on the
+    /// wsd <-> kit socket.
+    std::vector<char> serializeBinary() const
+    {
+        std::vector<char> buffer;
+        buffer.reserve(2 + (8 + 2 * _tiles.size()) * sizeof(int));
+        buffer.push_back(TileBinary::Magic);
+        buffer.push_back(TileBinary::TypeCombine);
+        TileBinary::appendInt(buffer, static_cast<int>(_tiles.size()));
+        TileBinary::appendInt(buffer, _part);
+        TileBinary::appendInt(buffer, _width);
+        TileBinary::appendInt(buffer, _height);
+        TileBinary::appendInt(buffer, _tileWidth);
+        TileBinary::appendInt(buffer, _tileHeight);
+        TileBinary::appendInt(buffer, _ver);
+        TileBinary::appendInt(buffer, _preFetch);
+        for (const auto& tile : _tiles)
+        {
+            TileBinary::appendInt(buffer, tile.getTilePosX());
+            TileBinary::appendInt(buffer, tile.getTilePosY());
+        }
+
+        return buffer;
+    }
+
+    /// Deserialize a TileCombined from its binary frame.
     static
-    TileCombined create(const std::vector<TileDesc>& tiles)
+    TileCombined parseBinary(const char* data, const size_t size)
     {
-        assert(!tiles.empty());
+        if (!TileBinary::isCombineFrame(data, size) || size < 2 + 8 * sizeof(int))
+        {
+            throw BadArgumentException("Invalid binary tilecombine frame.");
+        }
 
-        std::ostringstream xs;
-        std::ostringstream ys;
-        int ver = -1;
+        const char* pos = data + 2;
+        const auto count = TileBinary::readInt(pos);
+        const auto part = TileBinary::readInt(pos);
+        const auto width = TileBinary::readInt(pos);
+        const auto height = TileBinary::readInt(pos);
+        const auto tileWidth = TileBinary::readInt(pos);
+        const auto tileHeight = TileBinary::readInt(pos);
+        const auto ver = TileBinary::readInt(pos);
+        const auto preFetch = TileBinary::readInt(pos);
+        if (count <= 0 || size < 2 + (8 + 2 * static_cast<size_t>(count)) * sizeof(int))
+        {
+            throw BadArgumentException("Invalid binary tilecombine frame.");
+        }
 
-        for (auto& tile : tiles)
+        std::vector<TileDesc> tiles;
+        tiles.reserve(count);
+        for (int i = 0; i < count; ++i)
         {
-            xs << tile.getTilePosX() << ',';
-            ys << tile.getTilePosY() << ',';
-            ver = std::max(tile.getVersion(), ver);
+            const auto x = TileBinary::readInt(pos);
+            const auto y = TileBinary::readInt(pos);
+            tiles.emplace_back(part, width, height, x, y, tileWidth, tileHeight, ver, 0, -1, preFetch);
         }
 
-        return TileCombined(tiles[0].getPart(), tiles[0].getWidth(), tiles[0].getHeight(),
-                            xs.str(), ys.str(), tiles[0].getTileWidth(), tiles[0].getTileHeight(), ver, "", -1);
+        return TileCombined(tiles);
+    }
+
+    static
+    TileCombined create(const std::vector<TileDesc>& tiles)
+    {
+        assert(!tiles.empty());
+
+        return TileCombined(tiles);
     }
 
 private:
@@ -401,6 +779,7 @@ private:
     int _tileHeight;
     int _ver;       //< Versioning support.
     int _id;
+    int _preFetch;  //< Nonzero for cache-warming requests.
 };
 
 #endif
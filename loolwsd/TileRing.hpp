@@ -0,0 +1,239 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef INCLUDED_TILERING_HPP
+#define INCLUDED_TILERING_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Poco/Types.h>
+
+#include "Log.hpp"
+
+/// Path of the ring file, relative to the kit's jail root. The jail
+/// tree is visible to WSD under childRoot/jailId, so both processes
+/// map the same file.
+#define TILERING_PATH_IN_JAIL "/tmp/tilering"
+
+/// Single-producer single-consumer ring of length-prefixed records in
+/// a file-backed shared mapping. The kit writes rendered-tile payloads
+/// here and WSD reads them, replacing the websocket framing and the
+/// two copies through the kernel socket buffers on the tile path. A
+/// small note on the control socket still announces each record, which
+/// keeps ordering with the other messages and wakes the consumer.
+class TileRing
+{
+public:
+    /// One piece of a record; the pieces are written contiguously.
+    struct Segment
+    {
+        const char* data;
+        size_t size;
+    };
+
+    static const size_t RingSize = 8 * 1024 * 1024;
+
+    /// Create and initialize the ring file. The producer side;
+    /// the kit, inside its jail.
+    static std::unique_ptr<TileRing> create(const std::string& path)
+    {
+        const int fd = ::open(path.c_str(), O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+        if (fd < 0 || ftruncate(fd, RingSize) != 0)
+        {
+            Log::syserror("Cannot create tile ring [" + path + "].");
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+
+            return nullptr;
+        }
+
+        void* map = mmap(nullptr, RingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+        {
+            Log::syserror("Cannot map tile ring [" + path + "].");
+            return nullptr;
+        }
+
+        auto ring = std::unique_ptr<TileRing>(new TileRing(map));
+        ring->header()->Head.store(0);
+        ring->header()->Tail.store(0);
+
+        // Write the magic last; the consumer takes it as 'initialized'.
+        ring->header()->Magic.store(RingMagic, std::memory_order_release);
+        return ring;
+    }
+
+    /// Attach to an existing ring file. The consumer side; WSD.
+    static std::unique_ptr<TileRing> open(const std::string& path)
+    {
+        const int fd = ::open(path.c_str(), O_RDWR);
+        if (fd < 0)
+        {
+            Log::syserror("Cannot open tile ring [" + path + "].");
+            return nullptr;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size != static_cast<off_t>(RingSize))
+        {
+            Log::error("Tile ring [" + path + "] has unexpected size.");
+            close(fd);
+            return nullptr;
+        }
+
+        void* map = mmap(nullptr, RingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+        {
+            Log::syserror("Cannot map tile ring [" + path + "].");
+            return nullptr;
+        }
+
+        auto ring = std::unique_ptr<TileRing>(new TileRing(map));
+        if (ring->header()->Magic.load(std::memory_order_acquire) != RingMagic)
+        {
+            Log::error("Tile ring [" + path + "] is not initialized.");
+            return nullptr;
+        }
+
+        return ring;
+    }
+
+    ~TileRing()
+    {
+        munmap(_map, RingSize);
+    }
+
+    /// Append one record made of the given segments. Returns false
+    /// without writing anything when the ring lacks the space, in
+    /// which case the caller falls back to the socket.
+    bool write(std::initializer_list<Segment> segments)
+    {
+        return writeSegments(segments.begin(), segments.end());
+    }
+
+    bool write(const std::vector<Segment>& segments)
+    {
+        return writeSegments(segments.begin(), segments.end());
+    }
+
+    /// Pop the oldest record into the payload. Returns false when
+    /// the ring is empty.
+    bool read(std::vector<char>& payload)
+    {
+        auto* hdr = header();
+        const Poco::UInt64 tail = hdr->Tail.load(std::memory_order_relaxed);
+        const Poco::UInt64 head = hdr->Head.load(std::memory_order_acquire);
+        if (head == tail)
+        {
+            return false;
+        }
+
+        Poco::UInt32 size = 0;
+        copyOut(tail, &size, sizeof(size));
+        if (size > Capacity || head - tail < sizeof(size) + size)
+        {
+            Log::error("Corrupt tile ring record of " + std::to_string(size) + " bytes.");
+            return false;
+        }
+
+        payload.resize(size);
+        copyOut(tail + sizeof(size), payload.data(), size);
+
+        hdr->Tail.store(tail + sizeof(size) + size, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct RingHeader
+    {
+        std::atomic<Poco::UInt64> Magic;
+        std::atomic<Poco::UInt64> Head;
+        std::atomic<Poco::UInt64> Tail;
+    };
+
+    static const Poco::UInt64 RingMagic = 0x4c4f4f4c52494e47; // "LOOLRING"
+    static const size_t Capacity = RingSize - sizeof(RingHeader);
+
+    TileRing(void* map) :
+        _map(map)
+    {
+    }
+
+    template <typename Iterator>
+    bool writeSegments(const Iterator begin, const Iterator end)
+    {
+        Poco::UInt32 size = 0;
+        for (Iterator it = begin; it != end; ++it)
+        {
+            size += it->size;
+        }
+
+        auto* hdr = header();
+        const Poco::UInt64 head = hdr->Head.load(std::memory_order_relaxed);
+        const Poco::UInt64 tail = hdr->Tail.load(std::memory_order_acquire);
+        if (Capacity - (head - tail) < sizeof(size) + size)
+        {
+            return false;
+        }
+
+        Poco::UInt64 offset = head;
+        copyIn(offset, &size, sizeof(size));
+        offset += sizeof(size);
+        for (Iterator it = begin; it != end; ++it)
+        {
+            copyIn(offset, it->data, it->size);
+            offset += it->size;
+        }
+
+        hdr->Head.store(offset, std::memory_order_release);
+        return true;
+    }
+
+    RingHeader* header() { return static_cast<RingHeader*>(_map); }
+    char* data() { return static_cast<char*>(_map) + sizeof(RingHeader); }
+
+    /// memcpy into the ring, wrapping at the end of the buffer.
+    void copyIn(const Poco::UInt64 offset, const void* src, const size_t size)
+    {
+        const size_t pos = offset % Capacity;
+        const size_t first = (size < Capacity - pos ? size : Capacity - pos);
+        std::memcpy(data() + pos, src, first);
+        std::memcpy(data(), static_cast<const char*>(src) + first, size - first);
+    }
+
+    /// memcpy out of the ring, wrapping at the end of the buffer.
+    void copyOut(const Poco::UInt64 offset, void* dst, const size_t size)
+    {
+        const size_t pos = offset % Capacity;
+        const size_t first = (size < Capacity - pos ? size : Capacity - pos);
+        std::memcpy(dst, data() + pos, first);
+        std::memcpy(static_cast<char*>(dst) + first, data(), size - first);
+    }
+
+private:
+    void* _map;
+};
+
+#endif
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,288 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "TileStore.hpp"
+#include "config.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <Poco/SHA1Engine.h>
+
+#include "Log.hpp"
+
+namespace
+{
+/// Grow the backing file in chunks to limit remapping.
+constexpr size_t StoreGrowChunkBytes = 4 * 1024 * 1024;
+}
+
+TileStore::TileStore(const std::string& storePath) :
+    _storePath(storePath),
+    _fd(-1),
+    _map(nullptr),
+    _mapSize(0),
+    _end(0),
+    _liveSize(0)
+{
+    _fd = ::open(_storePath.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (_fd < 0)
+    {
+        Log::error("Failed to open tile store [" + _storePath + "]: " + std::strerror(errno));
+        return;
+    }
+
+    // Preserve a surviving store so restoreEntry can revive its entries.
+    struct stat st;
+    const size_t existingSize = (::fstat(_fd, &st) == 0 ? st.st_size : 0);
+
+    if (!growTo(std::max(existingSize, StoreGrowChunkBytes)))
+    {
+        ::close(_fd);
+        _fd = -1;
+        return;
+    }
+
+    Log::info("Opened tile store: " + _storePath);
+}
+
+TileStore::~TileStore()
+{
+    if (_map != nullptr)
+    {
+        ::munmap(_map, _mapSize);
+    }
+
+    if (_fd >= 0)
+    {
+        ::close(_fd);
+    }
+}
+
+bool TileStore::growTo(const size_t minCapacity)
+{
+    size_t newSize = (_mapSize > 0 ? _mapSize : StoreGrowChunkBytes);
+    while (newSize < minCapacity)
+    {
+        newSize += StoreGrowChunkBytes;
+    }
+
+    if (::ftruncate(_fd, newSize) != 0)
+    {
+        Log::error("Failed to grow tile store [" + _storePath + "]: " + std::strerror(errno));
+        return false;
+    }
+
+    if (_map != nullptr)
+    {
+        ::munmap(_map, _mapSize);
+        _map = nullptr;
+    }
+
+    void* map = ::mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (map == MAP_FAILED)
+    {
+        Log::error("Failed to map tile store [" + _storePath + "]: " + std::strerror(errno));
+        return false;
+    }
+
+    _map = static_cast<char*>(map);
+    _mapSize = newSize;
+    return true;
+}
+
+std::string TileStore::digest(const char* data, const size_t size)
+{
+    Poco::SHA1Engine engine;
+    engine.update(data, size);
+    return Poco::DigestEngine::digestToHex(engine.digest());
+}
+
+void TileStore::refRecord(const Entry& entry)
+{
+    if (++_recordRefs[entry.offset] == 1)
+    {
+        _liveSize += entry.size;
+    }
+}
+
+void TileStore::unrefRecord(const Entry& entry)
+{
+    const auto it = _recordRefs.find(entry.offset);
+    if (it != _recordRefs.end() && --it->second == 0)
+    {
+        // The record becomes dead space, but stays in _dedup:
+        // its bytes remain valid and can be revived by an
+        // identical payload arriving later.
+        _liveSize -= entry.size;
+        _recordRefs.erase(it);
+    }
+}
+
+bool TileStore::append(const std::string& name, const char* data, const size_t size)
+{
+    if (!isOpen())
+    {
+        return false;
+    }
+
+    const auto hash = digest(data, size);
+
+    Entry entry;
+    const auto dedupIt = _dedup.find(hash);
+    if (dedupIt != _dedup.end() && dedupIt->second.size == size &&
+        std::memcmp(_map + dedupIt->second.offset, data, size) == 0)
+    {
+        // Identical payload already in the store; share the record.
+        entry = dedupIt->second;
+    }
+    else
+    {
+        if (_end + size > _mapSize && !growTo(_end + size))
+        {
+            return false;
+        }
+
+        std::memcpy(_map + _end, data, size);
+        entry = Entry{_end, size};
+        _end += size;
+        _dedup[hash] = entry;
+    }
+
+    const auto it = _index.find(name);
+    if (it != _index.end())
+    {
+        if (it->second.offset == entry.offset)
+        {
+            // Re-stored unchanged tile.
+            return true;
+        }
+
+        // Supersede the old record.
+        unrefRecord(it->second);
+        it->second = entry;
+    }
+    else
+    {
+        _index.emplace(name, entry);
+    }
+
+    refRecord(entry);
+    return true;
+}
+
+const char* TileStore::lookup(const std::string& name, size_t& size) const
+{
+    const auto it = _index.find(name);
+    if (it == _index.end() || !isOpen())
+    {
+        return nullptr;
+    }
+
+    size = it->second.size;
+    return _map + it->second.offset;
+}
+
+void TileStore::remove(const std::string& name)
+{
+    const auto it = _index.find(name);
+    if (it != _index.end())
+    {
+        unrefRecord(it->second);
+        _index.erase(it);
+    }
+}
+
+bool TileStore::restoreEntry(const std::string& name, const size_t offset, const size_t size)
+{
+    if (!isOpen() || size == 0 || offset + size > _mapSize ||
+        _index.find(name) != _index.end())
+    {
+        return false;
+    }
+
+    const Entry entry{offset, size};
+    _index.emplace(name, entry);
+    refRecord(entry);
+    if (offset + size > _end)
+    {
+        _end = offset + size;
+    }
+
+    // Re-learn the content hash so deduplication survives the restart.
+    const auto hash = digest(_map + offset, size);
+    if (_dedup.find(hash) == _dedup.end())
+    {
+        _dedup.emplace(hash, entry);
+    }
+
+    return true;
+}
+
+bool TileStore::getEntry(const std::string& name, size_t& offset, size_t& size) const
+{
+    const auto it = _index.find(name);
+    if (it == _index.end())
+    {
+        return false;
+    }
+
+    offset = it->second.offset;
+    size = it->second.size;
+    return true;
+}
+
+void TileStore::clear()
+{
+    _index.clear();
+    _dedup.clear();
+    _recordRefs.clear();
+    _end = 0;
+    _liveSize = 0;
+
+    if (_fd >= 0 && ::ftruncate(_fd, 0) == 0)
+    {
+        if (_map != nullptr)
+        {
+            ::munmap(_map, _mapSize);
+            _map = nullptr;
+        }
+
+        _mapSize = 0;
+        growTo(StoreGrowChunkBytes);
+    }
+}
+
+void TileStore::preload() const
+{
+    if (isOpen() && _end > 0)
+    {
+        ::madvise(_map, _end, MADV_WILLNEED);
+    }
+}
+
+std::vector<std::string> TileStore::getNames() const
+{
+    std::vector<std::string> names;
+    names.reserve(_index.size());
+    for (const auto& pair : _index)
+    {
+        names.push_back(pair.first);
+    }
+
+    return names;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
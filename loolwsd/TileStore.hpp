@@ -0,0 +1,120 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef INCLUDED_TILESTORE_HPP
+#define INCLUDED_TILESTORE_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+/// A packed, memory-mapped, append-log store of tile payloads
+/// for one document. Replaces the file-per-tile cache: payloads
+/// are appended to a single backing file and read via pointer
+/// arithmetic into the mapping, with an in-memory index keyed
+/// by the tile's cache name. Invalidation only drops index
+/// entries and never touches the directory tree.
+///
+/// Not thread-safe; the caller (TileCache) provides locking.
+class TileStore
+{
+public:
+    /// Opens (or creates) the backing file and maps it. An existing
+    /// file is preserved so its entries can be restored via
+    /// restoreEntry; call clear() when no valid index survived.
+    TileStore(const std::string& storePath);
+    ~TileStore();
+
+    TileStore(const TileStore&) = delete;
+    TileStore& operator=(const TileStore&) = delete;
+
+    /// True when the backing file is open and mapped.
+    bool isOpen() const { return _map != nullptr; }
+
+    /// Append a payload to the store and index it under name.
+    /// An existing entry of the same name is superseded, and a
+    /// payload identical to an already stored one (by content hash)
+    /// shares that record instead of being stored again.
+    /// Returns false when the store is unusable (e.g. disk full).
+    bool append(const std::string& name, const char* data, size_t size);
+
+    /// Returns a pointer into the mapping and sets size,
+    /// or nullptr when name is not in the store.
+    /// The pointer is invalidated by the next append.
+    const char* lookup(const std::string& name, size_t& size) const;
+
+    /// Drop the index entry for name, if any.
+    /// The payload bytes are reclaimed on the next compaction.
+    void remove(const std::string& name);
+
+    /// Re-register an entry persisted by a previous instance,
+    /// validating it against the surviving backing file.
+    bool restoreEntry(const std::string& name, size_t offset, size_t size);
+
+    /// Get the offset and size of an entry, for persisting the index.
+    bool getEntry(const std::string& name, size_t& offset, size_t& size) const;
+
+    /// Discard all entries and truncate the backing file.
+    void clear();
+
+    /// Advise the kernel to fault in the live region of the store,
+    /// so restored tiles are served without demand-paging stalls.
+    void preload() const;
+
+    /// Names of all live entries, for iteration during invalidation.
+    std::vector<std::string> getNames() const;
+
+    /// Number of live entries.
+    size_t getEntryCount() const { return _index.size(); }
+
+    /// Bytes of unique live payload (dead records and entries
+    /// deduplicated onto a shared record count once).
+    size_t getLiveSize() const { return _liveSize; }
+
+    /// Bytes appended to the backing file in total.
+    size_t getUsedSize() const { return _end; }
+
+private:
+    /// Offset and size of one payload in the backing file.
+    struct Entry
+    {
+        size_t offset;
+        size_t size;
+    };
+
+    /// Grow the file and the mapping to hold at least minCapacity bytes.
+    bool growTo(size_t minCapacity);
+
+    /// Content hash of a payload, as hex digits.
+    static std::string digest(const char* data, size_t size);
+
+    /// Account for one more name referencing a record.
+    void refRecord(const Entry& entry);
+
+    /// Account for one less name referencing a record.
+    void unrefRecord(const Entry& entry);
+
+    const std::string _storePath;
+    int _fd;
+    char* _map;
+    size_t _mapSize;
+    size_t _end;
+    size_t _liveSize;
+    std::map<std::string, Entry> _index;
+
+    /// Records by content hash, for deduplicating identical payloads.
+    std::map<std::string, Entry> _dedup;
+
+    /// Number of names referencing each record, keyed by offset.
+    std::map<size_t, size_t> _recordRefs;
+};
+
+#endif
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -7,17 +7,31 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.
  */
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <Poco/DeflatingStream.h>
 #include <Poco/InflatingStream.h>
+#include <Poco/StreamCopier.h>
 
 #include "Util.hpp"
 
+/// Identifies a binary trace file (or gzip stream). Traces are written
+/// and replayed on the same host class, so records use host byte order.
+static const char TraceFileMagic[8] = { 'L', 'O', 'O', 'L', 'T', 'R', 'C', '1' };
+
 /// Dumps commands and notification trace.
 class TraceFileRecord
 {
@@ -45,7 +59,10 @@ public:
 };
 
 /// Trace-file generator class.
-/// Writes records into a trace file.
+/// Serializes records into fixed-layout binary batches and hands them
+/// to a writer thread, which compresses and writes them off the
+/// request path. A record costs the callers a few appends under the
+/// mutex instead of formatting, deflating and flushing a line.
 class TraceFileWriter
 {
 public:
@@ -55,19 +72,32 @@ public:
         _recordOutgoing(recordOugoing),
         _compress(compress),
         _filter(true),
-        _stream(path, compress ? std::ios::binary : std::ios::out),
+        _stream(path, std::ios::binary),
         _deflater(_stream, Poco::DeflatingStreamBuf::STREAM_GZIP),
-        _mutex()
+        _mutex(),
+        _stop(false)
     {
         for (const auto& f : filters)
         {
             _filter.deny(f);
         }
+
+        _buffer.reserve(BatchSizeBytes * 2);
+        _buffer.append(TraceFileMagic, sizeof(TraceFileMagic));
+
+        _thread = std::thread([this]() { run(); });
     }
 
     ~TraceFileWriter()
     {
-        std::unique_lock<std::mutex> lock(_mutex);
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            handOffLocked();
+            _stop = true;
+        }
+
+        _cond.notify_one();
+        _thread.join();
 
         _deflater.close();
         _stream.close();
@@ -78,7 +108,10 @@ public:
         std::unique_lock<std::mutex> lock(_mutex);
 
         writeLocked(pId, sessionId, data, static_cast<char>(TraceFileRecord::Direction::Event));
-        flushLocked();
+
+        // Events are rare and mark replay boundaries; push them out promptly.
+        handOffLocked();
+        _cond.notify_one();
     }
 
     void writeIncoming(const std::string& pId, const std::string& sessionId, const std::string& data)
@@ -102,42 +135,81 @@ public:
     }
 
 private:
-    void flushLocked()
+    static const size_t BatchSizeBytes = 64 * 1024;
+
+    void writeLocked(const std::string& pId, const std::string& sessionId, const std::string& data, const char dir)
     {
         Util::assertIsLocked(_mutex);
 
-        _deflater.flush();
-        _stream.flush();
+        const Poco::Int64 usec = Poco::Timestamp().epochMicroseconds() - _epochStart;
+        const Poco::UInt32 pid = std::atoi(pId.c_str());
+        const Poco::UInt32 sessionSize = sessionId.size();
+        const Poco::UInt32 payloadSize = data.size();
+
+        _buffer.append(&dir, 1);
+        _buffer.append(reinterpret_cast<const char*>(&usec), sizeof(usec));
+        _buffer.append(reinterpret_cast<const char*>(&pid), sizeof(pid));
+        _buffer.append(reinterpret_cast<const char*>(&sessionSize), sizeof(sessionSize));
+        _buffer.append(reinterpret_cast<const char*>(&payloadSize), sizeof(payloadSize));
+        _buffer.append(sessionId);
+        _buffer.append(data);
+
+        if (_buffer.size() >= BatchSizeBytes)
+        {
+            handOffLocked();
+            _cond.notify_one();
+        }
     }
 
-    void writeLocked(const std::string& pId, const std::string& sessionId, const std::string& data, const char delim)
+    /// Move the filled buffer onto the writer thread's queue.
+    void handOffLocked()
     {
         Util::assertIsLocked(_mutex);
 
-        const Poco::Int64 usec = Poco::Timestamp().epochMicroseconds() - _epochStart;
-        if (_compress)
+        if (!_buffer.empty())
         {
-            _deflater.write(&delim, 1);
-            _deflater << usec;
-            _deflater.write(&delim, 1);
-            _deflater << pId;
-            _deflater.write(&delim, 1);
-            _deflater << sessionId;
-            _deflater.write(&delim, 1);
-            _deflater.write(data.c_str(), data.size());
-            _deflater.write("\n", 1);
+            _batches.push_back(std::move(_buffer));
+            _buffer.clear();
         }
-        else
+    }
+
+    /// The writer thread: compresses and writes batches as they come.
+    void run()
+    {
+        Util::setThreadName("trace_writer");
+
+        for (;;)
         {
-            _stream.write(&delim, 1);
-            _stream << usec;
-            _stream.write(&delim, 1);
-            _stream << pId;
-            _stream.write(&delim, 1);
-            _stream << sessionId;
-            _stream.write(&delim, 1);
-            _stream.write(data.c_str(), data.size());
-            _stream.write("\n", 1);
+            std::vector<std::string> batches;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cond.wait(lock, [this]() { return _stop || !_batches.empty(); });
+                batches.swap(_batches);
+
+                if (batches.empty() && _stop)
+                {
+                    break;
+                }
+            }
+
+            for (const auto& batch : batches)
+            {
+                if (_compress)
+                {
+                    _deflater.write(batch.data(), batch.size());
+                }
+                else
+                {
+                    _stream.write(batch.data(), batch.size());
+                }
+            }
+
+            if (_compress)
+            {
+                _deflater.flush();
+            }
+
+            _stream.flush();
         }
     }
 
@@ -149,28 +221,28 @@ private:
     std::ofstream _stream;
     Poco::DeflatingOutputStream _deflater;
     std::mutex _mutex;
+    std::condition_variable _cond;
+    std::string _buffer;
+    std::vector<std::string> _batches;
+    std::thread _thread;
+    bool _stop;
 };
 
 /// Trace-file parser class.
-/// Reads records from a trace file.
+/// Reads records from a trace file: binary files are parsed straight
+/// out of an mmap of the file (or of the inflated gzip stream), and
+/// the old delimited text format is still understood.
 class TraceFileReader
 {
 public:
     TraceFileReader(const std::string& path) :
         _compressed(path.size() > 2 && path.substr(path.size() - 2) == "gz"),
         _epochStart(0),
-        _stream(path, _compressed ? std::ios::binary : std::ios::in),
-        _inflater(_stream, Poco::InflatingStreamBuf::STREAM_GZIP),
         _index(0),
         _indexIn(-1),
         _indexOut(-1)
     {
-        readFile();
-    }
-
-    ~TraceFileReader()
-    {
-        _stream.close();
+        readFile(path);
     }
 
     Poco::Int64 getEpoch() const { return _epochStart; }
@@ -212,22 +284,125 @@ public:
     }
 
 private:
-    void readFile()
+    void readFile(const std::string& path)
     {
         _records.clear();
 
-        std::string line;
-        for (;;)
+        if (_compressed)
+        {
+            // Inflate the whole stream, then parse from memory.
+            std::ifstream stream(path, std::ios::binary);
+            Poco::InflatingInputStream inflater(stream, Poco::InflatingStreamBuf::STREAM_GZIP);
+            std::string data;
+            Poco::StreamCopier::copyToString(inflater, data);
+            parse(data.data(), data.size());
+        }
+        else
         {
-            if (_compressed)
+            const int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
             {
-                std::getline(_inflater, line);
+                throw std::runtime_error("Failed to open trace file: " + path);
             }
-            else
+
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size == 0)
             {
-                std::getline(_stream, line);
+                close(fd);
+                throw std::runtime_error("Failed to stat trace file: " + path);
             }
 
+            void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (map == MAP_FAILED)
+            {
+                throw std::runtime_error("Failed to map trace file: " + path);
+            }
+
+            parse(static_cast<const char*>(map), st.st_size);
+            munmap(map, st.st_size);
+        }
+
+        if (_records.empty() ||
+            _records[0].Dir != TraceFileRecord::Direction::Event ||
+            _records[0].Payload.find("NewSession") != 0)
+        {
+            fprintf(stderr, "Invalid trace file with %ld records. First record: %s\n", _records.size(),
+                    _records.empty() ? "<empty>" : _records[0].Payload.c_str());
+            throw std::runtime_error("Invalid trace file.");
+        }
+
+        _indexIn = advance(-1, TraceFileRecord::Direction::Incoming);
+        _indexOut = advance(-1, TraceFileRecord::Direction::Outgoing);
+
+        _epochStart = _records[0].TimestampNs;
+    }
+
+    void parse(const char* data, const size_t size)
+    {
+        if (size >= sizeof(TraceFileMagic) &&
+            std::memcmp(data, TraceFileMagic, sizeof(TraceFileMagic)) == 0)
+        {
+            parseBinary(data + sizeof(TraceFileMagic), size - sizeof(TraceFileMagic));
+        }
+        else
+        {
+            parseText(data, size);
+        }
+    }
+
+    void parseBinary(const char* data, const size_t size)
+    {
+        // dir + usec + pid + session size + payload size.
+        const size_t headerSize = 1 + sizeof(Poco::Int64) + 3 * sizeof(Poco::UInt32);
+
+        size_t offset = 0;
+        while (offset + headerSize <= size)
+        {
+            TraceFileRecord rec;
+            rec.Dir = static_cast<TraceFileRecord::Direction>(data[offset]);
+            offset += 1;
+
+            Poco::Int64 usec;
+            std::memcpy(&usec, data + offset, sizeof(usec));
+            offset += sizeof(usec);
+            rec.TimestampNs = usec;
+
+            Poco::UInt32 pid;
+            std::memcpy(&pid, data + offset, sizeof(pid));
+            offset += sizeof(pid);
+            rec.Pid = pid;
+
+            Poco::UInt32 sessionSize;
+            std::memcpy(&sessionSize, data + offset, sizeof(sessionSize));
+            offset += sizeof(sessionSize);
+
+            Poco::UInt32 payloadSize;
+            std::memcpy(&payloadSize, data + offset, sizeof(payloadSize));
+            offset += sizeof(payloadSize);
+
+            if (offset + sessionSize + payloadSize > size)
+            {
+                fprintf(stderr, "Truncated trace file record at offset %ld.\n", offset);
+                break;
+            }
+
+            rec.SessionId.assign(data + offset, sessionSize);
+            offset += sessionSize;
+            rec.Payload.assign(data + offset, payloadSize);
+            offset += payloadSize;
+
+            _records.push_back(rec);
+        }
+    }
+
+    void parseText(const char* data, const size_t size)
+    {
+        std::istringstream stream(std::string(data, size));
+        std::string line;
+        for (;;)
+        {
+            std::getline(stream, line);
             if (line.empty())
             {
                 break;
@@ -250,20 +425,6 @@ private:
                 fprintf(stderr, "Invalid trace file record, expected 4 tokens. [%s]\n", line.c_str());
             }
         }
-
-        if (_records.empty() ||
-            _records[0].Dir != TraceFileRecord::Direction::Event ||
-            _records[0].Payload.find("NewSession") != 0)
-        {
-            fprintf(stderr, "Invalid trace file with %ld records. First record: %s\n", _records.size(),
-                    _records.empty() ? "<empty>" : _records[0].Payload.c_str());
-            throw std::runtime_error("Invalid trace file.");
-        }
-
-        _indexIn = advance(-1, TraceFileRecord::Direction::Incoming);
-        _indexOut = advance(-1, TraceFileRecord::Direction::Outgoing);
-
-        _epochStart = _records[0].TimestampNs;
     }
 
     std::vector<std::string> split(const std::string& s, const char delim) const
@@ -298,8 +459,6 @@ private:
 private:
     const bool _compressed;
     Poco::Int64 _epochStart;
-    std::ifstream _stream;
-    Poco::InflatingInputStream _inflater;
     std::vector<TraceFileRecord> _records;
     unsigned _index;
     unsigned _indexIn;
@@ -133,9 +133,10 @@ UnitWSD::~UnitWSD()
 }
 
 void UnitWSD::lookupTile(int part, int width, int height, int tilePosX, int tilePosY,
-                         int tileWidth, int tileHeight, std::unique_ptr<std::fstream>& cacheFile)
+                         int tileWidth, int tileHeight,
+                         std::shared_ptr<const std::vector<char>>& tileData)
 {
-    if (cacheFile && cacheFile->is_open())
+    if (tileData)
     {
         onTileCacheHit(part, width, height, tilePosX, tilePosY, tileWidth, tileHeight);
     }
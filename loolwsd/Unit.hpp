@@ -13,6 +13,7 @@
 #include <memory>
 #include <atomic>
 #include <cassert>
+#include <vector>
 
 #include <Poco/Net/WebSocket.h>
 
@@ -139,9 +140,10 @@ public:
         { return false; }
 
     // ---------------- TileCache hooks ----------------
-    /// Called before the lookupTile call returns. Should always be called to fire events.
+    /// Called before the lookupTileData call returns. Should always be called to fire events.
     virtual void lookupTile(int part, int width, int height, int tilePosX, int tilePosY,
-                            int tileWidth, int tileHeight, std::unique_ptr<std::fstream>& cacheFile);
+                            int tileWidth, int tileHeight,
+                            std::shared_ptr<const std::vector<char>>& tileData);
 
     // ---------------- WSD events ----------------
     virtual void onChildConnected(const int /* pid */, const std::string& /* sessionId */) {}
@@ -12,6 +12,7 @@
 
 #include <execinfo.h>
 #include <csignal>
+#include <fcntl.h>
 #include <sys/poll.h>
 #include <sys/prctl.h>
 #include <sys/stat.h>
@@ -488,32 +489,63 @@ namespace Util
     int getMemoryUsage(const Poco::Process::PID nPid)
     {
         //TODO: Instead of RSS, return PSS
-        const auto cmd = "ps o rss= -p " + std::to_string(nPid);
-        FILE* fp = popen(cmd.c_str(), "r");
-        if (fp == nullptr)
+        // Reading /proc/<pid>/statm costs a couple of syscalls,
+        // unlike the fork+exec of the popen("ps") it replaces.
+        char path[32];
+        snprintf(path, sizeof(path), "/proc/%d/statm", nPid);
+        const int fd = open(path, O_RDONLY);
+        if (fd < 0)
         {
-            return 0;
+            Log::warn() << "Trying to find memory of invalid/dead PID" << Log::end;
+            return -1;
         }
 
-        std::string sResponse;
-        char cmdBuffer[1024];
-        while (fgets(cmdBuffer, sizeof(cmdBuffer) - 1, fp) != nullptr)
+        char buffer[128];
+        const auto count = read(fd, buffer, sizeof(buffer) - 1);
+        close(fd);
+        if (count <= 0)
         {
-            sResponse += cmdBuffer;
+            Log::warn() << "Trying to find memory of invalid/dead PID" << Log::end;
+            return -1;
         }
-        pclose(fp);
 
-        int nMem = -1;
-        try
+        buffer[count] = '\0';
+        unsigned long size = 0;
+        unsigned long resident = 0;
+        if (sscanf(buffer, "%lu %lu", &size, &resident) != 2)
         {
-            nMem = std::stoi(sResponse);
+            return -1;
         }
-        catch(const std::exception&)
+
+        static const long pageSizeKB = sysconf(_SC_PAGESIZE) / 1024;
+        return resident * pageSizeKB;
+    }
+
+    unsigned getTotalMemoryUsage(const std::vector<Poco::Process::PID>& pids)
+    {
+        unsigned totalMem = 0;
+        for (const auto pid : pids)
         {
-            Log::warn() << "Trying to find memory of invalid/dead PID" << Log::end;
+            const auto mem = getMemoryUsage(pid);
+            if (mem > 0)
+            {
+                totalMem += mem;
+            }
+        }
+
+        return totalMem;
+    }
+
+    unsigned long getTotalSystemMemoryKb()
+    {
+        static const long pages = sysconf(_SC_PHYS_PAGES);
+        static const long pageSizeKB = sysconf(_SC_PAGESIZE) / 1024;
+        if (pages <= 0 || pageSizeKB <= 0)
+        {
+            return 0;
         }
 
-        return nMem;
+        return static_cast<unsigned long>(pages) * pageSizeKB;
     }
 
     std::string replace(const std::string& s, const std::string& a, const std::string& b)
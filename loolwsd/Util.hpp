@@ -18,6 +18,7 @@
 #include <set>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <Poco/File.h>
 #include <Poco/Net/WebSocket.h>
@@ -151,8 +152,17 @@ namespace Util
 
     void requestTermination(const Poco::Process::PID& pid);
 
+    /// Memory resident for the process, in KB, read from procfs.
+    /// Returns -1 when the process is gone.
     int getMemoryUsage(const Poco::Process::PID nPid);
 
+    /// Sum the memory of a set of processes in one pass. PIDs that
+    /// have exited meanwhile are skipped, not treated as errors.
+    unsigned getTotalMemoryUsage(const std::vector<Poco::Process::PID>& pids);
+
+    /// Physical memory of the host, in KB, or 0 when unknown.
+    unsigned long getTotalSystemMemoryKb();
+
     std::string replace(const std::string& s, const std::string& a, const std::string& b);
 
     std::string formatLinesForLog(const std::string& s);
@@ -0,0 +1,186 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef INCLUDED_WEBSOCKETDEFLATE_HPP
+#define INCLUDED_WEBSOCKETDEFLATE_HPP
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include <Poco/Net/HTTPServerRequest.h>
+#include <Poco/Net/HTTPServerResponse.h>
+#include <Poco/StringTokenizer.h>
+
+/// Compresses outgoing websocket messages per RFC 7692
+/// (permessage-deflate). One instance per socket and direction: the
+/// deflate window carries over from one message to the next, which is
+/// what makes the repetitive protocol text compress so well.
+class WebSocketDeflater
+{
+public:
+    WebSocketDeflater(const int level = Z_BEST_SPEED)
+    {
+        std::memset(&_strm, 0, sizeof(_strm));
+        if (deflateInit2(&_strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            throw std::runtime_error("deflateInit2 failed.");
+        }
+    }
+
+    ~WebSocketDeflater()
+    {
+        deflateEnd(&_strm);
+    }
+
+    WebSocketDeflater(const WebSocketDeflater&) = delete;
+    WebSocketDeflater& operator=(const WebSocketDeflater&) = delete;
+
+    /// Compress one message, stripping the trailing empty-block
+    /// marker as the RFC requires.
+    std::vector<char> compress(const char* data, const size_t size)
+    {
+        std::vector<char> out;
+        out.resize(deflateBound(&_strm, size) + 16);
+
+        _strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        _strm.avail_in = size;
+        _strm.next_out = reinterpret_cast<Bytef*>(out.data());
+        _strm.avail_out = out.size();
+
+        if (deflate(&_strm, Z_SYNC_FLUSH) != Z_OK || _strm.avail_in != 0)
+        {
+            throw std::runtime_error("deflate failed.");
+        }
+
+        out.resize(out.size() - _strm.avail_out);
+
+        // A sync flush always ends with the 00 00 ff ff marker.
+        assert(out.size() >= 4);
+        out.resize(out.size() - 4);
+        return out;
+    }
+
+private:
+    z_stream _strm;
+};
+
+/// Decompresses incoming permessage-deflate websocket messages,
+/// likewise with the window carried across messages.
+class WebSocketInflater
+{
+public:
+    WebSocketInflater()
+    {
+        std::memset(&_strm, 0, sizeof(_strm));
+        if (inflateInit2(&_strm, -15) != Z_OK)
+        {
+            throw std::runtime_error("inflateInit2 failed.");
+        }
+    }
+
+    ~WebSocketInflater()
+    {
+        inflateEnd(&_strm);
+    }
+
+    WebSocketInflater(const WebSocketInflater&) = delete;
+    WebSocketInflater& operator=(const WebSocketInflater&) = delete;
+
+    /// Decompress one message in place, re-appending the empty-block
+    /// marker the sender stripped.
+    void inflate(std::vector<char>& payload)
+    {
+        static const unsigned char marker[4] = { 0x00, 0x00, 0xff, 0xff };
+
+        std::vector<char> out;
+        out.reserve(payload.size() * 4);
+
+        feed(out, reinterpret_cast<const unsigned char*>(payload.data()), payload.size());
+        feed(out, marker, sizeof(marker));
+
+        payload.swap(out);
+    }
+
+private:
+    void feed(std::vector<char>& out, const unsigned char* data, const size_t size)
+    {
+        _strm.next_in = const_cast<Bytef*>(data);
+        _strm.avail_in = size;
+
+        do
+        {
+            char buffer[16384];
+            _strm.next_out = reinterpret_cast<Bytef*>(buffer);
+            _strm.avail_out = sizeof(buffer);
+
+            const int rc = ::inflate(&_strm, Z_SYNC_FLUSH);
+            if (rc != Z_OK && rc != Z_BUF_ERROR)
+            {
+                throw std::runtime_error("inflate failed.");
+            }
+
+            out.insert(out.end(), buffer, buffer + sizeof(buffer) - _strm.avail_out);
+        }
+        while (_strm.avail_in > 0 || _strm.avail_out == 0);
+    }
+
+private:
+    z_stream _strm;
+};
+
+/// Accept a client's permessage-deflate offer, if any, by setting the
+/// extension header on the handshake response. Must run before the
+/// WebSocket is constructed, which sends the response. Returns whether
+/// compression was negotiated.
+inline bool negotiateWebSocketCompression(const Poco::Net::HTTPServerRequest& request,
+                                          Poco::Net::HTTPServerResponse& response)
+{
+    const std::string offers = request.get("Sec-WebSocket-Extensions", "");
+    Poco::StringTokenizer extensions(offers, ",",
+                                     Poco::StringTokenizer::TOK_IGNORE_EMPTY | Poco::StringTokenizer::TOK_TRIM);
+    for (size_t i = 0; i < extensions.count(); ++i)
+    {
+        Poco::StringTokenizer params(extensions[i], ";",
+                                     Poco::StringTokenizer::TOK_IGNORE_EMPTY | Poco::StringTokenizer::TOK_TRIM);
+        if (params.count() == 0 || params[0] != "permessage-deflate")
+        {
+            continue;
+        }
+
+        // We accept only default server parameters; skip offers that
+        // would constrain our side. Declining an offer is always safe.
+        bool acceptable = true;
+        for (size_t j = 1; j < params.count(); ++j)
+        {
+            if (params[j] != "client_no_context_takeover" &&
+                params[j].compare(0, 22, "client_max_window_bits") != 0)
+            {
+                acceptable = false;
+                break;
+            }
+        }
+
+        if (acceptable)
+        {
+            response.set("Sec-WebSocket-Extensions", "permessage-deflate");
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#endif
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
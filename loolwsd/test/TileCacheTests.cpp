@@ -151,10 +151,6 @@ void TileCacheTests::testSimple()
         throw std::runtime_error("Failed to load wsd unit test library.");
     }
 
-    // Create TileCache and pretend the file was modified as recently as
-    // now, so it discards the cached data.
-    TileCache tc("doc.ods", Poco::Timestamp(), "/tmp/tile_cache_tests");
-
     int part = 0;
     int width = 256;
     int height = 256;
@@ -164,27 +160,43 @@ void TileCacheTests::testSimple()
     int tileHeight = 3840;
     TileDesc tile(part, width, height, tilePosX, tilePosY, tileWidth, tileHeight);
 
-    // No Cache
-    auto file = tc.lookupTile(tile);
-    CPPUNIT_ASSERT_MESSAGE("found tile when none was expected", !file);
-
-    // Cache Tile
     const auto size = 1024;
     const auto data = genRandomData(size);
-    tc.saveTileAndNotify(tile, data.data(), size);
 
-    // Find Tile
-    file = tc.lookupTile(tile);
-    CPPUNIT_ASSERT_MESSAGE("tile not found when expected", file && file->is_open());
-    const auto tileData = readDataFromFile(file);
-    CPPUNIT_ASSERT_MESSAGE("cached tile corrupted", data == tileData);
+    // Pretend the file was modified as recently as now,
+    // so the first TileCache discards any stale cached data.
+    const Poco::Timestamp modifiedTime;
+
+    {
+        TileCache tc("doc.ods", modifiedTime, "/tmp/tile_cache_tests");
+
+        // No Cache
+        CPPUNIT_ASSERT_MESSAGE("found tile when none was expected", !tc.lookupTileData(tile));
+
+        // Cache Tile
+        tc.saveTileAndNotify(tile, data.data(), size);
+
+        // Find Tile
+        const auto cachedTile = tc.lookupTileData(tile);
+        CPPUNIT_ASSERT_MESSAGE("tile not found when expected", cachedTile != nullptr);
+        CPPUNIT_ASSERT_MESSAGE("cached tile corrupted", data == *cachedTile);
+
+        // Invalidate Tiles
+        tc.invalidateTiles("invalidatetiles: EMPTY");
+
+        // No Cache
+        CPPUNIT_ASSERT_MESSAGE("found tile when none was expected", !tc.lookupTileData(tile));
+
+        // Leave a tile behind for the warm restart below.
+        tc.saveTileAndNotify(tile, data.data(), size);
+    }
 
-    // Invalidate Tiles
-    tc.invalidateTiles("invalidatetiles: EMPTY");
+    // Restore the persisted cache, as a restarted server would.
+    TileCache tc("doc.ods", modifiedTime, "/tmp/tile_cache_tests");
 
-    // No Cache
-    file = tc.lookupTile(tile);
-    CPPUNIT_ASSERT_MESSAGE("found tile when none was expected", !file);
+    const auto restoredTile = tc.lookupTileData(tile);
+    CPPUNIT_ASSERT_MESSAGE("restored tile not found when expected", restoredTile != nullptr);
+    CPPUNIT_ASSERT_MESSAGE("restored tile corrupted", data == *restoredTile);
 }
 
 void TileCacheTests::testSimpleCombine()
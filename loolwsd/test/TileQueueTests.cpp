@@ -42,26 +42,51 @@ class TileQueueTests : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testTileQueuePriority);
     CPPUNIT_TEST(testTileCombinedRendering);
     CPPUNIT_TEST(testTileRecombining);
+    CPPUNIT_TEST(testCancelTilesMarking);
     CPPUNIT_TEST(testViewOrder);
     CPPUNIT_TEST(testPreviewsDeprioritization);
+    CPPUNIT_TEST(testCallbacksBypassTiles);
+    CPPUNIT_TEST(testInvalidateCoalescing);
 
     CPPUNIT_TEST_SUITE_END();
 
     void testTileQueuePriority();
     void testTileCombinedRendering();
     void testTileRecombining();
+    void testCancelTilesMarking();
     void testViewOrder();
     void testPreviewsDeprioritization();
+    void testCallbacksBypassTiles();
+    void testInvalidateCoalescing();
 };
 
+namespace {
+
+/// The queue hands tiles out as binary frames; decode them back to
+/// their text serialization for comparison.
+std::string payloadAsString(const MessageQueue::Payload& payload)
+{
+    if (TileBinary::isTileFrame(payload.data(), payload.size()))
+    {
+        return TileDesc::parseBinary(payload.data(), payload.size()).serialize("tile");
+    }
+
+    if (TileBinary::isCombineFrame(payload.data(), payload.size()))
+    {
+        return TileCombined::parseBinary(payload.data(), payload.size()).serialize("tilecombine");
+    }
+
+    return std::string(payload.data(), payload.size());
+}
+
+}
+
 void TileQueueTests::testTileQueuePriority()
 {
     const std::string reqHigh = "tile part=0 width=256 height=256 tileposx=0 tileposy=0 tilewidth=3840 tileheight=3840";
     const std::string resHigh = "tile part=0 width=256 height=256 tileposx=0 tileposy=0 tilewidth=3840 tileheight=3840 ver=-1";
-    const TileQueue::Payload payloadHigh(resHigh.data(), resHigh.data() + resHigh.size());
     const std::string reqLow = "tile part=0 width=256 height=256 tileposx=0 tileposy=253440 tilewidth=3840 tileheight=3840";
     const std::string resLow = "tile part=0 width=256 height=256 tileposx=0 tileposy=253440 tilewidth=3840 tileheight=3840 ver=-1";
-    const TileQueue::Payload payloadLow(resLow.data(), resLow.data() + resLow.size());
 
     TileQueue queue;
 
@@ -70,8 +95,8 @@ void TileQueueTests::testTileQueuePriority()
     queue.put(reqHigh);
 
     // Original order.
-    CPPUNIT_ASSERT_EQUAL(payloadLow, queue.get());
-    CPPUNIT_ASSERT_EQUAL(payloadHigh, queue.get());
+    CPPUNIT_ASSERT_EQUAL(resLow, payloadAsString(queue.get()));
+    CPPUNIT_ASSERT_EQUAL(resHigh, payloadAsString(queue.get()));
 
     // Request the tiles.
     queue.put(reqLow);
@@ -83,21 +108,21 @@ void TileQueueTests::testTileQueuePriority()
     queue.updateCursorPosition(0, 0, 0, 0, 10, 100);
 
     // Prioritized order.
-    CPPUNIT_ASSERT_EQUAL(payloadHigh, queue.get());
-    CPPUNIT_ASSERT_EQUAL(payloadLow, queue.get());
+    CPPUNIT_ASSERT_EQUAL(resHigh, payloadAsString(queue.get()));
+    CPPUNIT_ASSERT_EQUAL(resLow, payloadAsString(queue.get()));
 
     // Repeat with cursor position set.
     queue.put(reqLow);
     queue.put(reqHigh);
-    CPPUNIT_ASSERT_EQUAL(payloadHigh, queue.get());
-    CPPUNIT_ASSERT_EQUAL(payloadLow, queue.get());
+    CPPUNIT_ASSERT_EQUAL(resHigh, payloadAsString(queue.get()));
+    CPPUNIT_ASSERT_EQUAL(resLow, payloadAsString(queue.get()));
 
     // Repeat by changing cursor position.
     queue.put(reqLow);
     queue.put(reqHigh);
     queue.updateCursorPosition(0, 0, 0, 253450, 10, 100);
-    CPPUNIT_ASSERT_EQUAL(payloadLow, queue.get());
-    CPPUNIT_ASSERT_EQUAL(payloadHigh, queue.get());
+    CPPUNIT_ASSERT_EQUAL(resLow, payloadAsString(queue.get()));
+    CPPUNIT_ASSERT_EQUAL(resHigh, payloadAsString(queue.get()));
 }
 
 void TileQueueTests::testTileCombinedRendering()
@@ -108,38 +133,26 @@ void TileQueueTests::testTileCombinedRendering()
     const std::string req4 = "tile part=0 width=256 height=256 tileposx=3840 tileposy=3840 tilewidth=3840 tileheight=3840";
 
     const std::string resHor = "tilecombine part=0 width=256 height=256 tileposx=0,3840 tileposy=0,0 imgsize=0,0 tilewidth=3840 tileheight=3840";
-    const TileQueue::Payload payloadHor(resHor.data(), resHor.data() + resHor.size());
     const std::string resVer = "tilecombine part=0 width=256 height=256 tileposx=0,0 tileposy=0,3840 imgsize=0,0 tilewidth=3840 tileheight=3840";
-    const TileQueue::Payload payloadVer(resVer.data(), resVer.data() + resVer.size());
     const std::string resFull = "tilecombine part=0 width=256 height=256 tileposx=0,3840,0 tileposy=0,0,3840 imgsize=0,0,0 tilewidth=3840 tileheight=3840";
-    const TileQueue::Payload payloadFull(resFull.data(), resFull.data() + resFull.size());
 
     TileQueue queue;
 
     // Horizontal.
     queue.put(req1);
     queue.put(req2);
-    CPPUNIT_ASSERT_EQUAL(payloadHor, queue.get());
+    CPPUNIT_ASSERT_EQUAL(resHor, payloadAsString(queue.get()));
 
     // Vertical.
     queue.put(req1);
     queue.put(req3);
-    CPPUNIT_ASSERT_EQUAL(payloadVer, queue.get());
+    CPPUNIT_ASSERT_EQUAL(resVer, payloadAsString(queue.get()));
 
     // Vertical.
     queue.put(req1);
     queue.put(req2);
     queue.put(req3);
-    CPPUNIT_ASSERT_EQUAL(payloadFull, queue.get());
-}
-
-namespace {
-
-std::string payloadAsString(const MessageQueue::Payload& payload)
-{
-    return std::string(payload.data(), payload.size());
-}
-
+    CPPUNIT_ASSERT_EQUAL(resFull, payloadAsString(queue.get()));
 }
 
 void TileQueueTests::testTileRecombining()
@@ -161,6 +174,31 @@ void TileQueueTests::testTileRecombining()
     CPPUNIT_ASSERT_EQUAL(0, static_cast<int>(queue._queue.size()));
 }
 
+void TileQueueTests::testCancelTilesMarking()
+{
+    const std::string req1 = "tile part=0 width=256 height=256 tileposx=0 tileposy=0 tilewidth=3840 tileheight=3840 ver=7";
+    const std::string req2 = "tile part=0 width=256 height=256 tileposx=3840 tileposy=0 tilewidth=3840 tileheight=3840 ver=8";
+
+    TileQueue queue;
+
+    queue.put(req1);
+    queue.put(req2);
+    CPPUNIT_ASSERT_EQUAL(2, static_cast<int>(queue._queue.size()));
+
+    // cancelling sweeps the matching tile from the queue
+    queue.put("canceltiles 7,");
+    CPPUNIT_ASSERT_EQUAL(1, static_cast<int>(queue._queue.size()));
+
+    // and marks its version for the render thread, which may have
+    // popped a matching tile before the cancellation arrived
+    CPPUNIT_ASSERT(queue.isCancelled(7));
+    CPPUNIT_ASSERT(!queue.isCancelled(8));
+
+    // the other tile is unaffected
+    CPPUNIT_ASSERT_EQUAL(std::string("tile part=0 width=256 height=256 tileposx=3840 tileposy=0 tilewidth=3840 tileheight=3840 ver=8"),
+                         payloadAsString(queue.get()));
+}
+
 void TileQueueTests::testViewOrder()
 {
     TileQueue queue;
@@ -218,9 +256,8 @@ void TileQueueTests::testPreviewsDeprioritization()
     // stays empty after all is done
     CPPUNIT_ASSERT_EQUAL(0, static_cast<int>(queue._queue.size()));
 
-    // re-ordering case - put previews and normal tiles to the queue and get
-    // everything back again but this time the tiles have to interleave with
-    // the previews
+    // re-ordering case - put previews and normal tiles to the queue; the
+    // plain tiles always overtake the queued previews
     const std::vector<std::string> tiles =
     {
         "tile part=0 width=256 height=256 tileposx=0 tileposy=0 tilewidth=3840 tileheight=3840 ver=-1",
@@ -232,14 +269,14 @@ void TileQueueTests::testPreviewsDeprioritization()
 
     queue.put(tiles[0]);
 
-    CPPUNIT_ASSERT_EQUAL(previews[0], payloadAsString(queue.get()));
     CPPUNIT_ASSERT_EQUAL(tiles[0], payloadAsString(queue.get()));
-    CPPUNIT_ASSERT_EQUAL(previews[1], payloadAsString(queue.get()));
+    CPPUNIT_ASSERT_EQUAL(previews[0], payloadAsString(queue.get()));
 
     queue.put(tiles[1]);
 
-    CPPUNIT_ASSERT_EQUAL(previews[2], payloadAsString(queue.get()));
     CPPUNIT_ASSERT_EQUAL(tiles[1], payloadAsString(queue.get()));
+    CPPUNIT_ASSERT_EQUAL(previews[1], payloadAsString(queue.get()));
+    CPPUNIT_ASSERT_EQUAL(previews[2], payloadAsString(queue.get()));
     CPPUNIT_ASSERT_EQUAL(previews[3], payloadAsString(queue.get()));
 
     // stays empty after all is done
@@ -259,6 +296,57 @@ void TileQueueTests::testPreviewsDeprioritization()
     CPPUNIT_ASSERT_EQUAL(0, static_cast<int>(queue._queue.size()));
 }
 
+void TileQueueTests::testCallbacksBypassTiles()
+{
+    const std::string tile = "tile part=0 width=256 height=256 tileposx=0 tileposy=0 tilewidth=3840 tileheight=3840 ver=-1";
+    const std::string callback = "callback all 0 15 3840 3840";
+
+    TileQueue queue;
+
+    // the callback was queued after the tile, but overtakes it
+    queue.put(tile);
+    queue.put(callback);
+
+    CPPUNIT_ASSERT_EQUAL(callback, payloadAsString(queue.get()));
+    CPPUNIT_ASSERT_EQUAL(tile, payloadAsString(queue.get()));
+
+    // stays empty after all is done
+    CPPUNIT_ASSERT_EQUAL(0, static_cast<int>(queue._queue.size()));
+}
+
+void TileQueueTests::testInvalidateCoalescing()
+{
+    const std::string tile = "tile part=0 width=256 height=256 tileposx=0 tileposy=0 tilewidth=3840 tileheight=3840 ver=-1";
+    // 0 is LOK_CALLBACK_INVALIDATE_TILES.
+    const std::string invalidate1 = "callback all 0 0, 0, 3840, 3840, 0";
+    const std::string invalidate2 = "callback all 0 3840, 0, 3840, 3840, 0";
+    const std::string merged = "callback all 0 0, 0, 7680, 3840, 0";
+    const std::string disjoint = "callback all 0 100000, 100000, 3840, 3840, 0";
+    const std::string otherPart = "callback all 0 0, 0, 3840, 3840, 1";
+    const std::string full = "callback all 0 EMPTY, 0";
+
+    TileQueue queue;
+
+    queue.put(tile);
+    queue.put(invalidate1);
+    queue.put(invalidate2);
+    queue.put(disjoint);
+    queue.put(otherPart);
+    queue.put(full);
+
+    // The touching rectangles merged into their cover in place; a
+    // disjoint rectangle, another part and a full invalidate passed
+    // through untouched.
+    CPPUNIT_ASSERT_EQUAL(merged, payloadAsString(queue.get()));
+    CPPUNIT_ASSERT_EQUAL(disjoint, payloadAsString(queue.get()));
+    CPPUNIT_ASSERT_EQUAL(otherPart, payloadAsString(queue.get()));
+    CPPUNIT_ASSERT_EQUAL(full, payloadAsString(queue.get()));
+    CPPUNIT_ASSERT_EQUAL(tile, payloadAsString(queue.get()));
+
+    // stays empty after all is done
+    CPPUNIT_ASSERT_EQUAL(0, static_cast<int>(queue._queue.size()));
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(TileQueueTests);
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
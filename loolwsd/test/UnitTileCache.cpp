@@ -24,13 +24,14 @@ public:
     }
 
     virtual void lookupTile(int part, int width, int height, int tilePosX, int tilePosY,
-                            int tileWidth, int tileHeight, std::unique_ptr<std::fstream>& cacheFile)
+                            int tileWidth, int tileHeight,
+                            std::shared_ptr<const std::vector<char>>& tileData)
     {
         // Call base to fire events.
-        UnitWSD::lookupTile(part, width, height, tilePosX, tilePosY, tileWidth, tileHeight, cacheFile);
+        UnitWSD::lookupTile(part, width, height, tilePosX, tilePosY, tileWidth, tileHeight, tileData);
 
         // Fail the lookup to force subscription and rendering.
-        cacheFile.reset();
+        tileData.reset();
     }
 
     virtual void invokeTest()
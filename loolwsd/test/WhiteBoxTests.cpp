@@ -73,6 +73,25 @@ void WhiteBoxTests::testLOOLProtocolFunctions()
     CPPUNIT_ASSERT(LOOLProtocol::getTokenKeywordFromMessage(message, "mumble", map, mumble));
     CPPUNIT_ASSERT_EQUAL(2, mumble);
 
+    // The in-place tokenizer.
+    const std::string tokenized("  tile  part=0  mumble ");
+    LOOLProtocol::Tokenizer tokenizer(tokenized);
+    LOOLProtocol::TokenView token;
+    CPPUNIT_ASSERT(tokenizer.next(token));
+    CPPUNIT_ASSERT(token.equals("tile"));
+    CPPUNIT_ASSERT(tokenizer.next(token));
+    LOOLProtocol::TokenView name;
+    int number = -1;
+    CPPUNIT_ASSERT(LOOLProtocol::parseNameIntegerPair(token, name, number));
+    CPPUNIT_ASSERT(name.equals("part"));
+    CPPUNIT_ASSERT_EQUAL(0, number);
+    CPPUNIT_ASSERT(tokenizer.next(token));
+    CPPUNIT_ASSERT(token.equals("mumble"));
+    CPPUNIT_ASSERT(!tokenizer.next(token));
+
+    const std::string negative("-42");
+    CPPUNIT_ASSERT(LOOLProtocol::stringToInteger(LOOLProtocol::getFirstTokenView(negative), number));
+    CPPUNIT_ASSERT_EQUAL(-42, number);
 }
 
 void WhiteBoxTests::testRegexListMatcher()
@@ -197,6 +216,19 @@ public:
     {
         return true;
     }
+
+    std::string getCachedResponse(const std::string& /*name*/) override
+    {
+        return std::string();
+    }
+
+    void cacheResponse(const std::string& /*name*/, const std::string& /*response*/) override
+    {
+    }
+
+    void invalidateResponseCache() override
+    {
+    }
 };
 
 void WhiteBoxTests::testEmptyCellCursor()
@@ -0,0 +1,165 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Performance regression suite. Needs a running loolwsd, like 'make
+// check', and is invoked via 'make bench'. Each scenario prints a
+// 'bench_result name=value' line (microseconds unless noted); setting
+// LOOL_BENCH_MAX_<NAME> (upper-cased; LOOL_BENCH_MIN_<NAME> for
+// throughput figures) makes a scenario fail when its value crosses the
+// limit, so CI can turn a regression into a red build.
+
+#include "config.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <Poco/URI.h>
+
+#include <Log.hpp>
+
+#include "helpers.hpp"
+
+namespace
+{
+
+constexpr auto FIRST_PAGE_TILES = "tilecombine part=0 width=256 height=256 tileposx=0,3840,7680,11520,0,3840,7680,11520,0,3840,7680,11520,0,3840,7680,11520 tileposy=0,0,0,0,3840,3840,3840,3840,7680,7680,7680,7680,11520,11520,11520,11520 tilewidth=3840 tileheight=3840";
+constexpr auto FIRST_PAGE_TILE_COUNT = 16;
+
+constexpr size_t Iterations = 10;
+
+/// One scenario measurement.
+struct BenchResult
+{
+    std::string name;
+    long value;
+};
+
+long median(std::vector<long>& v)
+{
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+/// Request the first page of tiles and return microseconds per tile.
+long timeTiles(const std::shared_ptr<Poco::Net::WebSocket>& socket)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    helpers::sendTextFrame(socket, FIRST_PAGE_TILES, "bench ");
+    for (int i = 0; i < FIRST_PAGE_TILE_COUNT; ++i)
+    {
+        helpers::getTileMessage(*socket, "bench ");
+    }
+
+    const auto delta = std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now() - start).count();
+    return delta / FIRST_PAGE_TILE_COUNT;
+}
+
+/// Type a character and wait for the invalidation, leaving the
+/// first page dirty so the next tile request renders afresh.
+void invalidate(const std::shared_ptr<Poco::Net::WebSocket>& socket)
+{
+    helpers::sendChar(*socket, 'a', helpers::skNone, "bench ");
+    helpers::getResponseMessage(socket, "invalidatetiles:", "bench ");
+}
+
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+    Log::initialize("bnc");
+
+    std::vector<BenchResult> results;
+
+    try
+    {
+        Poco::URI uri(helpers::getTestServerURI());
+
+        // Document load: a fresh copy each iteration, so the server
+        // cannot hand back an already-loaded document.
+        std::vector<long> loadStats;
+        for (size_t i = 0; i < Iterations; ++i)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            auto socket = helpers::loadDocAndGetSocket("hello.odt", uri, "bench ");
+            loadStats.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                                    std::chrono::steady_clock::now() - start).count());
+        }
+        results.push_back({ "doc_load_us", median(loadStats) });
+
+        auto socket = helpers::loadDocAndGetSocket("hello.odt", uri, "bench ");
+
+        // Cold tiles: invalidate by typing, then render the first page.
+        std::vector<long> coldStats;
+        for (size_t i = 0; i < Iterations; ++i)
+        {
+            invalidate(socket);
+            coldStats.push_back(timeTiles(socket));
+        }
+        results.push_back({ "tile_cold_us", median(coldStats) });
+
+        // Warm tiles: the same page again, straight from the cache.
+        std::vector<long> warmStats;
+        long warmTotal = 0;
+        for (size_t i = 0; i < Iterations; ++i)
+        {
+            const auto perTile = timeTiles(socket);
+            warmStats.push_back(perTile);
+            warmTotal += perTile * FIRST_PAGE_TILE_COUNT;
+        }
+        results.push_back({ "tile_warm_us", median(warmStats) });
+        results.push_back({ "tile_throughput_per_sec",
+                            static_cast<long>(1e6 * Iterations * FIRST_PAGE_TILE_COUNT / warmTotal) });
+    }
+    catch (const Poco::Exception& exc)
+    {
+        std::cerr << "bench_error " << exc.displayText() << std::endl;
+        return 1;
+    }
+    catch (const std::exception& exc)
+    {
+        std::cerr << "bench_error " << exc.what() << std::endl;
+        return 1;
+    }
+
+    bool failed = false;
+    for (const auto& result : results)
+    {
+        std::cout << "bench_result " << result.name << '=' << result.value << std::endl;
+
+        std::string upperName = result.name;
+        std::transform(upperName.begin(), upperName.end(), upperName.begin(), ::toupper);
+
+        const char* ceiling = std::getenv(("LOOL_BENCH_MAX_" + upperName).c_str());
+        if (ceiling != nullptr && result.value > std::atol(ceiling))
+        {
+            std::cout << "bench_fail " << result.name << '=' << result.value
+                      << " max=" << ceiling << std::endl;
+            failed = true;
+        }
+
+        const char* floor = std::getenv(("LOOL_BENCH_MIN_" + upperName).c_str());
+        if (floor != nullptr && result.value < std::atol(floor))
+        {
+            std::cout << "bench_fail " << result.name << '=' << result.value
+                      << " min=" << floor << std::endl;
+            failed = true;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
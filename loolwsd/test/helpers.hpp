@@ -182,10 +182,24 @@ std::vector<char> getResponseMessage(Poco::Net::WebSocket& ws, const std::string
                     timedout = false;
                 }
 
-                response.resize(READ_BUFFER_SIZE);
+                response.resize(READ_BUFFER_SIZE * 10);
                 int bytes = ws.receiveFrame(response.data(), response.size(), flags);
                 response.resize(bytes >= 0 ? bytes : 0);
-                std::cerr << name << "Got " << LOOLProtocol::getAbbreviatedFrameDump(response.data(), bytes, flags) << std::endl;
+
+                // One message can arrive in multiple frames.
+                while (bytes > 0 &&
+                       (flags & Poco::Net::WebSocket::FRAME_OP_BITMASK) != Poco::Net::WebSocket::FRAME_OP_CLOSE &&
+                       (flags & Poco::Net::WebSocket::FRAME_FLAG_FIN) != Poco::Net::WebSocket::FRAME_FLAG_FIN)
+                {
+                    std::vector<char> continuation(READ_BUFFER_SIZE * 10);
+                    bytes = ws.receiveFrame(continuation.data(), continuation.size(), flags);
+                    if (bytes > 0)
+                    {
+                        response.insert(response.end(), continuation.data(), continuation.data() + bytes);
+                    }
+                }
+
+                std::cerr << name << "Got " << LOOLProtocol::getAbbreviatedFrameDump(response.data(), response.size(), flags) << std::endl;
                 auto message = LOOLProtocol::getAbbreviatedMessage(response);
                 if (bytes > 0 && (flags & Poco::Net::WebSocket::FRAME_OP_BITMASK) != Poco::Net::WebSocket::FRAME_OP_CLOSE)
                 {
@@ -219,9 +233,23 @@ std::vector<char> getResponseMessage(Poco::Net::WebSocket& ws, const std::string
                             response.resize(size);
                             bytes = ws.receiveFrame(response.data(), response.size(), flags);
                             response.resize(bytes >= 0 ? bytes : 0);
-                            std::cerr << name << "Got " << LOOLProtocol::getAbbreviatedFrameDump(response.data(), bytes, flags) << std::endl;
+
+                            // The large message can itself arrive in fragments.
+                            while (bytes > 0 &&
+                                   (flags & Poco::Net::WebSocket::FRAME_OP_BITMASK) != Poco::Net::WebSocket::FRAME_OP_CLOSE &&
+                                   (flags & Poco::Net::WebSocket::FRAME_FLAG_FIN) != Poco::Net::WebSocket::FRAME_FLAG_FIN)
+                            {
+                                std::vector<char> continuation(READ_BUFFER_SIZE * 10);
+                                bytes = ws.receiveFrame(continuation.data(), continuation.size(), flags);
+                                if (bytes > 0)
+                                {
+                                    response.insert(response.end(), continuation.data(), continuation.data() + bytes);
+                                }
+                            }
+
+                            std::cerr << name << "Got " << LOOLProtocol::getAbbreviatedFrameDump(response.data(), response.size(), flags) << std::endl;
                             message = LOOLProtocol::getAbbreviatedMessage(response);
-                            if (bytes > 0 && message.find(prefix) == 0)
+                            if (!response.empty() && message.find(prefix) == 0)
                             {
                                 return response;
                             }
@@ -393,7 +421,8 @@ void SocketProcessor(const std::string& name,
     const Poco::Timespan waitTime(timeoutMs * 1000);
     int flags = 0;
     int n = 0;
-    char buffer[READ_BUFFER_SIZE];
+    char buffer[READ_BUFFER_SIZE * 10];
+    std::vector<char> message;
     do
     {
         if (!socket->poll(waitTime, Poco::Net::Socket::SELECT_READ))
@@ -406,9 +435,16 @@ void SocketProcessor(const std::string& name,
         std::cerr << name << "Got " << LOOLProtocol::getAbbreviatedFrameDump(buffer, n, flags) << std::endl;
         if (n > 0 && (flags & Poco::Net::WebSocket::FRAME_OP_BITMASK) != Poco::Net::WebSocket::FRAME_OP_CLOSE)
         {
-            if (!handler(std::string(buffer, n)))
+            // One message can arrive in multiple frames.
+            message.insert(message.end(), buffer, buffer + n);
+            if ((flags & Poco::Net::WebSocket::FRAME_FLAG_FIN) == Poco::Net::WebSocket::FRAME_FLAG_FIN)
             {
-                break;
+                const bool cont = handler(std::string(message.data(), message.size()));
+                message.clear();
+                if (!cont)
+                {
+                    break;
+                }
             }
         }
     }